@@ -0,0 +1,246 @@
+#ifndef SUXEC_AUDIT_H
+#define SUXEC_AUDIT_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "audit_record.h"
+#include "finally.h"
+
+/* -------------------------------------------------------------------------- */
+/* Audit log writer
+ *
+ * Auditing is enabled by the privileged user creating either a regular
+ * file or a datagram socket at SUXEC_AUDIT_PATH. Each launch is recorded
+ * with a single non-blocking write of at most PIPE_BUF bytes, which is
+ * appended atomically to a spool file, or sent as a single datagram.
+ * The launch never waits for the audit log, and a record that cannot
+ * be written is reported to the caller so that it can be counted as
+ * a drop.
+ */
+
+static int sAuditFd = -1;
+
+/* -------------------------------------------------------------------------- */
+static int
+open_audit_socket_(const char *aPath)
+{
+    int rc = -1;
+
+    int fd = -1;
+
+    struct sockaddr_un sockAddr = { .sun_family = AF_UNIX };
+
+    if (strlen(aPath) >= sizeof(sockAddr.sun_path)) {
+        errno = ENAMETOOLONG;
+        goto Finally;
+    }
+    strcpy(sockAddr.sun_path, aPath);
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (-1 == fd)
+        goto Finally;
+
+    if (connect(fd, (struct sockaddr *) &sockAddr, sizeof(sockAddr)))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (rc && -1 != fd) {
+            close(fd);
+            fd = -1;
+        }
+    });
+
+    return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+open_audit_(void)
+{
+    int rc = -1;
+
+    int fd = -1;
+
+    /* Only trust an audit log prepared by the privileged user, and
+     * that cannot be modified by other users.
+     */
+
+    struct stat auditStat;
+    if (lstat(SUXEC_AUDIT_PATH, &auditStat))
+        goto Finally;
+
+    if (auditStat.st_uid != geteuid() ||
+            (auditStat.st_mode & (S_IWGRP | S_IWOTH))) {
+        errno = EPERM;
+        goto Finally;
+    }
+
+    if (S_ISSOCK(auditStat.st_mode)) {
+        fd = open_audit_socket_(SUXEC_AUDIT_PATH);
+        if (-1 == fd)
+            goto Finally;
+    } else if (S_ISREG(auditStat.st_mode)) {
+        fd = open(SUXEC_AUDIT_PATH,
+            O_WRONLY | O_APPEND | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+        if (-1 == fd)
+            goto Finally;
+
+        struct stat fdStat;
+        if (fstat(fd, &fdStat))
+            goto Finally;
+
+        if (fdStat.st_dev != auditStat.st_dev ||
+                fdStat.st_ino != auditStat.st_ino) {
+            errno = EPERM;
+            goto Finally;
+        }
+    } else {
+        errno = EPERM;
+        goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (rc && -1 != fd) {
+            close(fd);
+            fd = -1;
+        }
+    });
+
+    return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+open_audit(void)
+{
+    int savedErrno = errno;
+    sAuditFd = open_audit_();
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+follow_audit(void)
+{
+    /* Sessions and pipelines hold the audit log across many launches,
+     * so follow a spool that the collector has replaced rather than
+     * appending records to the previous spool after it is collected.
+     */
+
+    if (-1 == sAuditFd)
+        return;
+
+    int savedErrno = errno;
+
+    struct stat fdStat;
+    struct stat auditStat;
+
+    if (!fstat(sAuditFd, &fdStat) && S_ISREG(fdStat.st_mode) &&
+            (lstat(SUXEC_AUDIT_PATH, &auditStat) ||
+                fdStat.st_dev != auditStat.st_dev ||
+                fdStat.st_ino != auditStat.st_ino)) {
+        close(sAuditFd);
+        sAuditFd = open_audit_();
+    }
+
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+record_audit(
+    const struct stat *aRegistration, const struct stat *aTarget,
+    uid_t aRequestorUid, gid_t aRequestorGid,
+    uid_t aLicensorUid, gid_t aLicensorGid,
+    unsigned aHops, const char *aSymLink, const char *aPath)
+{
+    if (-1 == sAuditFd)
+        return 0;
+
+    int savedErrno = errno;
+
+    union audit_buffer audit;
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        ts.tv_sec = ts.tv_nsec = 0;
+
+    audit.mRecord = (struct audit_record) {
+        .mMagic = AUDIT_MAGIC,
+        .mVersion = AUDIT_VERSION,
+        .mTime = ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+        .mRegistrationDev = aRegistration->st_dev,
+        .mRegistrationIno = aRegistration->st_ino,
+        .mTargetDev = aTarget->st_dev,
+        .mTargetIno = aTarget->st_ino,
+        .mPid = getpid(),
+        .mRequestorUid = aRequestorUid,
+        .mRequestorGid = aRequestorGid,
+        .mLicensorUid = aLicensorUid,
+        .mLicensorGid = aLicensorGid,
+        .mHops = aHops,
+    };
+
+    size_t length = fill_audit_paths(&audit.mRecord, aSymLink, aPath);
+
+    /* A short write to a spool leaves a fragment that the reader will
+     * skip, and is reported as a drop together with any failure to
+     * write to a congested socket.
+     */
+
+    ssize_t written = write(sAuditFd, audit.mBuf, length);
+
+    errno = savedErrno;
+
+    return (ssize_t) length == written ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_AUDIT_H */
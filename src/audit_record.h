@@ -0,0 +1,168 @@
+#ifndef SUXEC_AUDIT_RECORD_H
+#define SUXEC_AUDIT_RECORD_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Audit records
+ *
+ * Each launch is described by a fixed layout header followed by the
+ * registration symlink and resolved path as consecutive NUL terminated
+ * strings. The paths are truncated so that the entire record can be
+ * written atomically. The record is padded to a multiple of eight
+ * bytes, but a short write to a spool can leave a fragment of any
+ * length.
+ */
+
+#ifndef SUXEC_AUDIT_PATH
+#define SUXEC_AUDIT_PATH "/run/suxec/audit"
+#endif
+
+#define AUDIT_MAGIC 0x73757861u
+#define AUDIT_VERSION 1u
+#define AUDIT_ALIGN 8
+#define AUDIT_RECORD_MAX PIPE_BUF
+
+struct audit_record {
+    uint32_t mMagic;
+    uint16_t mVersion;
+    uint16_t mLength;
+    uint64_t mTime;
+    uint64_t mRegistrationDev;
+    uint64_t mRegistrationIno;
+    uint64_t mTargetDev;
+    uint64_t mTargetIno;
+    uint32_t mPid;
+    uint32_t mRequestorUid;
+    uint32_t mRequestorGid;
+    uint32_t mLicensorUid;
+    uint32_t mLicensorGid;
+    uint32_t mHops;
+    char mPaths[];
+};
+
+/* -------------------------------------------------------------------------- */
+static inline size_t
+fill_audit_paths(
+    struct audit_record *aRecord, const char *aSymLink, const char *aPath)
+{
+    /* Share the space between the two paths, and truncate the
+     * symlink first since the registration is also identified
+     * by its inode.
+     */
+
+    size_t space = AUDIT_RECORD_MAX - sizeof(*aRecord) - 2;
+
+    size_t pathLen = strlen(aPath);
+    if (pathLen > space / 2)
+        pathLen = space / 2;
+
+    size_t symLinkLen = strlen(aSymLink);
+    if (symLinkLen > space - pathLen)
+        symLinkLen = space - pathLen;
+
+    char *paths = aRecord->mPaths;
+
+    memcpy(paths, aSymLink, symLinkLen);
+    paths[symLinkLen] = 0;
+    memcpy(paths + symLinkLen + 1, aPath, pathLen);
+    paths[symLinkLen + 1 + pathLen] = 0;
+
+    size_t length = sizeof(*aRecord) + symLinkLen + 1 + pathLen + 1;
+    while (length % AUDIT_ALIGN)
+        paths[length++ - sizeof(*aRecord)] = 0;
+
+    aRecord->mLength = length;
+
+    return length;
+}
+
+/* -------------------------------------------------------------------------- */
+union audit_buffer {
+    struct audit_record mRecord;
+    char mBuf[AUDIT_RECORD_MAX];
+};
+
+/* -------------------------------------------------------------------------- */
+static inline const struct audit_record *
+scan_audit_record(
+    const char *aBuf, size_t aSize, size_t *aOffset,
+    union audit_buffer *aAudit)
+{
+    /* Find the next complete record, skipping over any fragment
+     * left by a short write. Fragments can have any length, so
+     * records are copied to an aligned buffer before use.
+     */
+
+    for (; *aOffset + sizeof(struct audit_record) <= aSize; ++*aOffset) {
+
+        struct audit_record *record = &aAudit->mRecord;
+
+        memcpy(record, aBuf + *aOffset, sizeof(*record));
+
+        if (AUDIT_MAGIC != record->mMagic ||
+                AUDIT_VERSION != record->mVersion ||
+                sizeof(*record) + 2 > record->mLength ||
+                AUDIT_RECORD_MAX < record->mLength ||
+                record->mLength % AUDIT_ALIGN ||
+                *aOffset + record->mLength > aSize)
+            continue;
+
+        size_t pathsLen = record->mLength - sizeof(*record);
+        const char *paths = aBuf + *aOffset + sizeof(*record);
+
+        const char *symLinkEnd = memchr(paths, 0, pathsLen);
+        if (!symLinkEnd || !memchr(
+                symLinkEnd + 1, 0, pathsLen - (symLinkEnd + 1 - paths)))
+            continue;
+
+        memcpy(record->mPaths, paths, pathsLen);
+
+        *aOffset += record->mLength;
+        return record;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline const char *
+audit_record_path(const struct audit_record *aRecord)
+{
+    return aRecord->mPaths + strlen(aRecord->mPaths) + 1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_AUDIT_RECORD_H */
@@ -0,0 +1,82 @@
+#ifndef SUXEC_BENCH_H
+#define SUXEC_BENCH_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* -------------------------------------------------------------------------- */
+/* Benchmark helpers
+ *
+ * Benchmarks print results one line per measurement as space
+ * separated NAME=VALUE fields so that results can be compared
+ * between commits.
+ */
+
+static inline unsigned long long
+monotonic_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        err(1, "Unable to read clock");
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int
+rank_ns_(const void *aLhs, const void *aRhs)
+{
+    unsigned long long lhs = * (const unsigned long long *) aLhs;
+    unsigned long long rhs = * (const unsigned long long *) aRhs;
+
+    return lhs == rhs ? 0 : lhs < rhs ? -1 : +1;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+sort_samples(unsigned long long *aSamples, unsigned aNumSamples)
+{
+    qsort(aSamples, aNumSamples, sizeof(*aSamples), rank_ns_);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline unsigned long long
+percentile(const unsigned long long *aSamples, unsigned aNumSamples,
+           unsigned aPerMille)
+{
+    return aSamples[(unsigned long long) aNumSamples * aPerMille / 1000];
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_BENCH_H */
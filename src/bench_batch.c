@@ -0,0 +1,367 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "libsuxec.h"
+
+/* -------------------------------------------------------------------------- */
+/* Batch verification benchmark
+ *
+ * Compare verifying every registration in a synthetic tree using
+ * suxec_verify_batch(), against calling suxec_verify() for each
+ * registration in turn:
+ *
+ *  -f fanout      Number of licensee directories.
+ *  -r count       Number of registrations in each directory.
+ *  -d depth       Number of symlinks in each chain, including the
+ *                 registration itself.
+ *  -n samples     Number of times to verify the whole tree.
+ *
+ * The tree is created under TMPDIR by the invoking user, who is both
+ * licensor and licensee, and is laid out as:
+ *
+ *  ROOT/l<i>/r<j>           -> ROOT/c<i>/h1
+ *  ROOT/c<i>/h<k>           -> h<k+1>
+ *  ROOT/c<i>/h<depth-1>     -> ROOT/target
+ *
+ * Each sample is the time to verify the whole tree, divided by the
+ * number of registrations. Run under make bench-slow to see the
+ * effect of slow name service and file system backends.
+ */
+
+struct tree
+{
+    char mRoot[PATH_MAX / 2];
+    unsigned mFanout;
+    unsigned mRegistrations;
+    unsigned mDepth;
+
+    char **mSymlinks;
+    uid_t *mUids;
+    enum failure *mVerdicts;
+    size_t mLen;
+};
+
+/* -------------------------------------------------------------------------- */
+static char *
+tree_path(const struct tree *aTree, const char *aFmt, ...)
+    __attribute__((__format__(__printf__, 2, 3)));
+
+static char *
+tree_path(const struct tree *aTree, const char *aFmt, ...)
+{
+    char name[PATH_MAX / 2];
+
+    va_list argp;
+    va_start(argp, aFmt);
+    int len = vsnprintf(name, sizeof(name), aFmt, argp);
+    va_end(argp);
+
+    if (0 > len || sizeof(name) <= (size_t) len)
+        errx(1, "Path too long");
+
+    char *path;
+    if (-1 == asprintf(&path, "%s/%s", aTree->mRoot, name))
+        err(1, "Unable to allocate path");
+
+    return path;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_tree(struct tree *aTree)
+{
+    const char *tmpDir = getenv("TMPDIR");
+    if (!tmpDir || !*tmpDir)
+        tmpDir = "/tmp";
+
+    int len = snprintf(aTree->mRoot, sizeof(aTree->mRoot),
+        "%s/bench_batch.XXXXXX", tmpDir);
+    if (0 > len || sizeof(aTree->mRoot) <= (size_t) len)
+        errx(1, "Temporary directory %s too long", tmpDir);
+
+    if (!mkdtemp(aTree->mRoot))
+        err(1, "Unable to create registration tree");
+
+    if (chmod(aTree->mRoot, 0711))
+        err(1, "Unable to change mode of %s", aTree->mRoot);
+
+    char *target = tree_path(aTree, "target");
+
+    int fd = open(target, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+    if (-1 == fd || fchmod(fd, 0755) || close(fd))
+        err(1, "Unable to create %s", target);
+
+    aTree->mLen = (size_t) aTree->mFanout * aTree->mRegistrations;
+
+    aTree->mSymlinks = calloc(aTree->mLen, sizeof(*aTree->mSymlinks));
+    aTree->mUids = calloc(aTree->mLen, sizeof(*aTree->mUids));
+    aTree->mVerdicts = calloc(aTree->mLen, sizeof(*aTree->mVerdicts));
+    if (!aTree->mSymlinks || !aTree->mUids || !aTree->mVerdicts)
+        err(1, "Unable to allocate registrations");
+
+    for (unsigned fx = 0; fx < aTree->mFanout; ++fx) {
+
+        char *path = tree_path(aTree, "l%u", fx);
+        if (mkdir(path, 0755) || chmod(path, 0755))
+            err(1, "Unable to create %s", path);
+        free(path);
+
+        path = tree_path(aTree, "c%u", fx);
+        if (mkdir(path, 0755) || chmod(path, 0755))
+            err(1, "Unable to create %s", path);
+        free(path);
+
+        /* The last symlink in the chain resolves to the target, and
+         * the others are relative to their neighbours.
+         */
+
+        for (unsigned hx = 1; hx < aTree->mDepth; ++hx) {
+            char next[3 * sizeof(unsigned) + 2];
+            snprintf(next, sizeof(next), "h%u", hx + 1);
+
+            path = tree_path(aTree, "c%u/h%u", fx, hx);
+            if (symlink(hx + 1 < aTree->mDepth ? next : target, path))
+                err(1, "Unable to create %s", path);
+            free(path);
+        }
+
+        char *first = 1 < aTree->mDepth
+            ? tree_path(aTree, "c%u/h1", fx) : strdup(target);
+        if (!first)
+            err(1, "Unable to allocate path");
+
+        for (unsigned rx = 0; rx < aTree->mRegistrations; ++rx) {
+            size_t ix = (size_t) fx * aTree->mRegistrations + rx;
+
+            path = tree_path(aTree, "l%u/r%u", fx, rx);
+            if (symlink(first, path))
+                err(1, "Unable to create %s", path);
+
+            aTree->mSymlinks[ix] = path;
+            aTree->mUids[ix] = getuid();
+        }
+
+        free(first);
+    }
+
+    free(target);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+remove_entry_(const char *aPath, const struct stat *aStat,
+              int aFlag, struct FTW *aFtw)
+{
+    (void) aStat;
+    (void) aFlag;
+    (void) aFtw;
+
+    if (remove(aPath))
+        warn("Unable to remove %s", aPath);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+close_tree(struct tree *aTree)
+{
+    if (nftw(aTree->mRoot, remove_entry_, 16, FTW_DEPTH | FTW_PHYS))
+        warn("Unable to remove %s", aTree->mRoot);
+
+    for (size_t ix = 0; ix < aTree->mLen; ++ix)
+        free(aTree->mSymlinks[ix]);
+
+    free(aTree->mSymlinks);
+    free(aTree->mUids);
+    free(aTree->mVerdicts);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+report(const struct tree *aTree, const char *aMethod,
+       unsigned long long *aSamples, unsigned aNumSamples)
+{
+    sort_samples(aSamples, aNumSamples);
+
+    printf("method=%s fanout=%u registrations=%u depth=%u n=%u"
+           " min_ns=%llu p50_ns=%llu p90_ns=%llu p99_ns=%llu\n",
+        aMethod,
+        aTree->mFanout, aTree->mRegistrations, aTree->mDepth,
+        aNumSamples,
+        aSamples[0],
+        percentile(aSamples, aNumSamples, 500),
+        percentile(aSamples, aNumSamples, 900),
+        percentile(aSamples, aNumSamples, 990));
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+verify_single(struct tree *aTree)
+{
+    for (size_t ix = 0; ix < aTree->mLen; ++ix) {
+        struct suxec_license license;
+
+        suxec_create_license(&license, 0);
+        suxec_verify(&license, aTree->mUids[ix], getgid(),
+            aTree->mSymlinks[ix]);
+
+        aTree->mVerdicts[ix] = license.mFailure;
+
+        suxec_close_license(&license);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+verify_batch(struct tree *aTree)
+{
+    if (suxec_verify_batch(
+            0, aTree->mLen, aTree->mUids,
+            (const char * const *) aTree->mSymlinks, aTree->mVerdicts))
+        err(1, "Unable to verify batch");
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+bench_batch(struct tree *aTree, unsigned aNumSamples)
+{
+    static const struct {
+        const char *mName;
+        void (*mVerify)(struct tree *);
+    } methods[] = {
+        { "single", verify_single },
+        { "batch",  verify_batch },
+    };
+
+    unsigned long long *samples = calloc(aNumSamples, sizeof(*samples));
+    if (!samples)
+        err(1, "Unable to allocate samples");
+
+    for (unsigned mx = 0; mx < sizeof(methods) / sizeof(*methods); ++mx) {
+        for (unsigned sx = 0; sx < aNumSamples; ++sx) {
+            memset(aTree->mVerdicts, 0xff,
+                aTree->mLen * sizeof(*aTree->mVerdicts));
+
+            unsigned long long begin = monotonic_ns();
+            methods[mx].mVerify(aTree);
+            samples[sx] = (monotonic_ns() - begin) / aTree->mLen;
+
+            /* Both methods must reach the same verdicts. */
+
+            for (size_t ix = 0; ix < aTree->mLen; ++ix) {
+                if (FAILURE_NONE != aTree->mVerdicts[ix])
+                    errx(1, "Unexpected verdict %s for %s",
+                        sFailureName[aTree->mVerdicts[ix]],
+                        aTree->mSymlinks[ix]);
+            }
+        }
+
+        report(aTree, methods[mx].mName, samples, aNumSamples);
+    }
+
+    free(samples);
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+parse_count(const char *aArg, const char *aName, unsigned aMin)
+{
+    char *end;
+
+    errno = 0;
+    unsigned long count = strtoul(aArg, &end, 10);
+    if (errno || end == aArg || *end || count < aMin || count > UINT_MAX)
+        errx(1, "Invalid %s %s", aName, aArg);
+
+    return count;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    struct tree tree = {
+        .mFanout = 16,
+        .mRegistrations = 64,
+        .mDepth = 4,
+    };
+
+    unsigned numSamples = 20;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+d:f:n:r:"))) {
+        switch (opt) {
+        default:
+            errx(1, "usage: %s [-f fanout] [-r registrations] [-d depth]"
+                " [-n samples]", argv[0]);
+
+        case 'd':
+            tree.mDepth = parse_count(optarg, "depth", 1);
+            break;
+
+        case 'f':
+            tree.mFanout = parse_count(optarg, "fanout", 1);
+            break;
+
+        case 'n':
+            numSamples = parse_count(optarg, "number of samples", 1);
+            break;
+
+        case 'r':
+            tree.mRegistrations = parse_count(optarg, "registrations", 1);
+            break;
+        }
+    }
+
+    if (optind != argc)
+        errx(1, "Unexpected argument %s", argv[optind]);
+
+    create_tree(&tree);
+
+    bench_batch(&tree, numSamples);
+
+    close_tree(&tree);
+
+    return 0;
+}
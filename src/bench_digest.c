@@ -0,0 +1,308 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include "bench.h"
+#include "libsuxec.h"
+#include "sha256.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Digest pin benchmark
+ *
+ * Compare verifying a registration without a digest pin, against
+ * verifying a registration whose target is pinned, both when the
+ * digest must be computed and when it is provided by a cache:
+ *
+ *  -s size        Size of the target in KiB.
+ *  -n samples     Number of verifications of each kind.
+ *
+ * The registration is created under TMPDIR by the invoking user,
+ * who is both licensor and licensee, and is laid out as:
+ *
+ *  ROOT/l/r    -> ROOT/target
+ *
+ * The file system holding TMPDIR must support user extended
+ * attributes.
+ */
+
+struct registration
+{
+    char mRoot[PATH_MAX / 2];
+    char mLicensee[PATH_MAX];
+    char mSymlink[PATH_MAX];
+    char mTarget[PATH_MAX];
+    unsigned mSize;
+    char mPin[sizeof("sha256:") + 2 * SUXEC_DIGEST_SIZE];
+};
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    int mValid;
+    unsigned char mDigest[SUXEC_DIGEST_SIZE];
+} sCache;
+
+static int
+fetch_digest(void *aArg, const struct stat *aStat, unsigned char *aDigest)
+{
+    if (!sCache.mValid)
+        return -1;
+
+    memcpy(aDigest, sCache.mDigest, SUXEC_DIGEST_SIZE);
+    return 0;
+}
+
+static void
+store_digest(void *aArg, const struct stat *aStat, const unsigned char *aDigest)
+{
+    sCache.mValid = 1;
+    memcpy(sCache.mDigest, aDigest, SUXEC_DIGEST_SIZE);
+}
+
+static const struct suxec_context sCachedContext = {
+    .mFetchDigest = fetch_digest,
+    .mStoreDigest = store_digest,
+};
+
+/* -------------------------------------------------------------------------- */
+static void
+create_registration(struct registration *aReg)
+{
+    const char *tmpDir = getenv("TMPDIR");
+    if (!tmpDir || !*tmpDir)
+        tmpDir = "/tmp";
+
+    int len = snprintf(aReg->mRoot, sizeof(aReg->mRoot),
+        "%s/bench_digest.XXXXXX", tmpDir);
+    if (0 > len || sizeof(aReg->mRoot) <= (size_t) len)
+        errx(1, "Temporary directory %s too long", tmpDir);
+
+    if (!mkdtemp(aReg->mRoot))
+        err(1, "Unable to create registration directory");
+
+    if (chmod(aReg->mRoot, 0711))
+        err(1, "Unable to change mode of %s", aReg->mRoot);
+
+    snprintf(aReg->mLicensee, sizeof(aReg->mLicensee), "%s/l", aReg->mRoot);
+    snprintf(aReg->mSymlink, sizeof(aReg->mSymlink), "%s/l/r", aReg->mRoot);
+    snprintf(aReg->mTarget, sizeof(aReg->mTarget), "%s/target", aReg->mRoot);
+
+    if (mkdir(aReg->mLicensee, 0755) || chmod(aReg->mLicensee, 0755))
+        err(1, "Unable to create %s", aReg->mLicensee);
+
+    if (symlink(aReg->mTarget, aReg->mSymlink))
+        err(1, "Unable to create %s", aReg->mSymlink);
+
+    /* Fill the target with content that cannot be stored sparsely,
+     * and compute the digest to pin as it is written.
+     */
+
+    int fd = open(aReg->mTarget,
+        O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+    if (-1 == fd || fchmod(fd, 0755))
+        err(1, "Unable to create %s", aReg->mTarget);
+
+    struct sha256 sha256;
+    create_sha256(&sha256);
+
+    unsigned char block[1024];
+    for (unsigned kx = 0; kx < aReg->mSize; ++kx) {
+        for (unsigned bx = 0; bx < sizeof(block); ++bx)
+            block[bx] = kx * 131 + bx * 7;
+        if (sizeof(block) != write(fd, block, sizeof(block)))
+            err(1, "Unable to write %s", aReg->mTarget);
+        update_sha256(&sha256, block, sizeof(block));
+    }
+
+    if (close(fd))
+        err(1, "Unable to close %s", aReg->mTarget);
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    finish_sha256(&sha256, digest);
+
+    char *pin = aReg->mPin + sprintf(aReg->mPin, "sha256:");
+    for (unsigned dx = 0; dx < sizeof(digest); ++dx)
+        pin += sprintf(pin, "%02x", digest[dx]);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+pin_registration(const struct registration *aReg, int aPinned)
+{
+    static const char name[] = "user.suxec.digest.r";
+
+    if (aPinned) {
+        if (setxattr(aReg->mLicensee,
+                name, aReg->mPin, strlen(aReg->mPin), 0))
+            err(1, "Unable to pin %s", aReg->mSymlink);
+    } else {
+        if (removexattr(aReg->mLicensee, name) && ENODATA != errno)
+            err(1, "Unable to unpin %s", aReg->mSymlink);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+close_registration(struct registration *aReg)
+{
+    if (unlink(aReg->mSymlink) || unlink(aReg->mTarget) ||
+            rmdir(aReg->mLicensee) || rmdir(aReg->mRoot))
+        warn("Unable to remove %s", aReg->mRoot);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+report(const struct registration *aReg, const char *aMethod,
+       unsigned long long *aSamples, unsigned aNumSamples)
+{
+    sort_samples(aSamples, aNumSamples);
+
+    printf("method=%s size_kib=%u n=%u"
+           " min_ns=%llu p50_ns=%llu p90_ns=%llu p99_ns=%llu\n",
+        aMethod,
+        aReg->mSize,
+        aNumSamples,
+        aSamples[0],
+        percentile(aSamples, aNumSamples, 500),
+        percentile(aSamples, aNumSamples, 900),
+        percentile(aSamples, aNumSamples, 990));
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+bench_digest(struct registration *aReg, unsigned aNumSamples)
+{
+    static const struct {
+        const char *mName;
+        int mPinned;
+        const struct suxec_context *mContext;
+    } methods[] = {
+        { "unpinned", 0, 0 },
+        { "cold",     1, 0 },
+        { "warm",     1, &sCachedContext },
+    };
+
+    unsigned long long *samples = calloc(aNumSamples, sizeof(*samples));
+    if (!samples)
+        err(1, "Unable to allocate samples");
+
+    for (unsigned mx = 0; mx < sizeof(methods) / sizeof(*methods); ++mx) {
+        pin_registration(aReg, methods[mx].mPinned);
+
+        /* The first verification is discarded, and primes the
+         * cache used by the warm samples.
+         */
+
+        sCache.mValid = 0;
+
+        for (unsigned sx = 0; sx <= aNumSamples; ++sx) {
+            struct suxec_license license;
+
+            unsigned long long begin = monotonic_ns();
+            suxec_create_license(&license, methods[mx].mContext);
+            suxec_verify(&license, getuid(), getgid(), aReg->mSymlink);
+            unsigned long long end = monotonic_ns();
+
+            if (FAILURE_NONE != license.mFailure)
+                errx(1, "Unexpected verdict %s for %s",
+                    sFailureName[license.mFailure], aReg->mSymlink);
+
+            suxec_close_license(&license);
+
+            if (sx)
+                samples[sx - 1] = end - begin;
+        }
+
+        report(aReg, methods[mx].mName, samples, aNumSamples);
+    }
+
+    free(samples);
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+parse_count(const char *aArg, const char *aName, unsigned aMin)
+{
+    char *end;
+
+    errno = 0;
+    unsigned long count = strtoul(aArg, &end, 10);
+    if (errno || end == aArg || *end || count < aMin || count > UINT_MAX)
+        errx(1, "Invalid %s %s", aName, aArg);
+
+    return count;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    struct registration reg = {
+        .mSize = 1024,
+    };
+
+    unsigned numSamples = 100;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+n:s:"))) {
+        switch (opt) {
+        default:
+            errx(1, "usage: %s [-s size] [-n samples]", argv[0]);
+
+        case 'n':
+            numSamples = parse_count(optarg, "number of samples", 1);
+            break;
+
+        case 's':
+            reg.mSize = parse_count(optarg, "size", 0);
+            break;
+        }
+    }
+
+    if (optind != argc)
+        errx(1, "Unexpected argument %s", argv[optind]);
+
+    create_registration(&reg);
+
+    bench_digest(&reg, numSamples);
+
+    close_registration(&reg);
+
+    return 0;
+}
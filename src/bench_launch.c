@@ -0,0 +1,731 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <ftw.h>
+#include <grp.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+/* -------------------------------------------------------------------------- */
+/* Launch latency benchmark
+ *
+ * Measure the end-to-end cost of launching through suxec against a
+ * synthetic registration tree shaped like a large installation:
+ *
+ *  -f fanout      Number of licensor directories.
+ *  -r count       Number of registrations for each licensee.
+ *  -d depth       Number of symlinks in each chain, including the
+ *                 registration itself.
+ *  -l length      Approximate length of the directory path holding
+ *                 each chain.
+ *  -L licensor    User owning the tree and the target program.
+ *  -R licensee    User owning the registrations and launching suxec.
+ *
+ * The tree is created under TMPDIR, and is laid out as:
+ *
+ *  ROOT/l<i>/bench/r<j>           -> ROOT/c<i>/<padding>/h1
+ *  ROOT/c<i>/<padding>/h<k>       -> h<k+1>
+ *  ROOT/c<i>/<padding>/h<depth-1> -> ROOT/target
+ *  ROOT/target                    Copy of the benchmark executable
+ *
+ * By default the invoking user is both licensor and licensee so that
+ * the benchmark can run unprivileged. Naming different users requires
+ * privileges to create the tree, and is used by userns.sh to measure
+ * launches that switch identity.
+ *
+ * Registrations are chosen pseudo-randomly so that successive
+ * launches do not repeatedly resolve the same directory entries.
+ * Each launch is broken down into:
+ *
+ *  exec-to-target Time from exec of suxec to the start of the
+ *                 target program.
+ *  target-to-exit Time from the start of the target program until
+ *                 suxec is reaped.
+ *  exec-to-exit   Time for the entire launch.
+ *
+ * The record written by suxec to --timing-fd further breaks down
+ * exec-to-target into the phases within suxec:
+ *
+ *  phase-main     Time from exec of suxec to the start of main().
+ *  phase-NAME     Time spent in each phase recorded by suxec, with
+ *                 all symlink hops combined into phase-follow.
+ *  phase-execv    Time from the end of suxec to the start of the
+ *                 target program.
+ */
+
+#define TARGET_ENV "BENCH_LAUNCH_FD"
+
+#define PADDING_NAME_MAX 64
+
+enum phase {
+    PHASE_MAIN,
+    PHASE_PARSE,
+    PHASE_GROUPLIST,
+    PHASE_REQUESTOR,
+    PHASE_SYMLINK,
+    PHASE_LICENSOR,
+    PHASE_PARENT,
+    PHASE_FOLLOW,
+    PHASE_RESOLVE,
+    PHASE_ENVIRONMENT,
+    PHASE_IMPERSONATE,
+    PHASE_EXEC,
+    PHASE_EXECV,
+    PHASES
+};
+
+static const char *sPhaseName[PHASES] = {
+    [PHASE_MAIN]        = "main",
+    [PHASE_PARSE]       = "parse",
+    [PHASE_GROUPLIST]   = "grouplist",
+    [PHASE_REQUESTOR]   = "requestor",
+    [PHASE_SYMLINK]     = "symlink",
+    [PHASE_LICENSOR]    = "licensor",
+    [PHASE_PARENT]      = "parent",
+    [PHASE_FOLLOW]      = "follow",
+    [PHASE_RESOLVE]     = "resolve",
+    [PHASE_ENVIRONMENT] = "environment",
+    [PHASE_IMPERSONATE] = "impersonate",
+    [PHASE_EXEC]        = "exec",
+    [PHASE_EXECV]       = "execv",
+};
+
+struct identity
+{
+    char mName[LOGIN_NAME_MAX];
+    uid_t mUid;
+    gid_t mGid;
+};
+
+struct tree
+{
+    char mRoot[PATH_MAX / 2];
+    char mTarget[PATH_MAX];
+    struct identity mLicensor;
+    struct identity mLicensee;
+    unsigned mFanout;
+    unsigned mRegistrations;
+    unsigned mDepth;
+    unsigned mLength;
+};
+
+/* -------------------------------------------------------------------------- */
+static void
+find_identity(struct identity *aIdentity, const char *aName)
+{
+    errno = 0;
+    struct passwd *pw = aName ? getpwnam(aName) : getpwuid(getuid());
+    if (!pw)
+        err(1, "Unable to find passwd entry for %s", aName ?: "self");
+
+    if (sizeof(aIdentity->mName) <= strlen(pw->pw_name))
+        errx(1, "User name %s too long", pw->pw_name);
+
+    strcpy(aIdentity->mName, pw->pw_name);
+    aIdentity->mUid = pw->pw_uid;
+    aIdentity->mGid = pw->pw_gid;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+assume_identity(const struct identity *aIdentity)
+{
+    if (aIdentity->mUid == geteuid() && aIdentity->mGid == getegid())
+        return;
+
+    if (initgroups(aIdentity->mName, aIdentity->mGid))
+        err(1, "Unable to set supplementary groups for %s", aIdentity->mName);
+
+    if (setgid(aIdentity->mGid))
+        err(1, "Unable to set gid %d", (int) aIdentity->mGid);
+
+    if (setuid(aIdentity->mUid))
+        err(1, "Unable to set uid %d", (int) aIdentity->mUid);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+own_path(const char *aPath, const struct identity *aOwner)
+{
+    if (lchown(aPath, aOwner->mUid, aOwner->mGid))
+        err(1, "Unable to change owner of %s", aPath);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_symlink(const struct identity *aOwner,
+               const char *aTarget, const char *aFmt, ...)
+    __attribute__((__format__(__printf__, 3, 4)));
+
+static void
+create_symlink(const struct identity *aOwner,
+               const char *aTarget, const char *aFmt, ...)
+{
+    char path[PATH_MAX];
+
+    va_list argp;
+    va_start(argp, aFmt);
+    int len = vsnprintf(path, sizeof(path), aFmt, argp);
+    va_end(argp);
+
+    if (0 > len || sizeof(path) <= (size_t) len)
+        errx(1, "Symlink path too long");
+
+    if (symlink(aTarget, path))
+        err(1, "Unable to create %s", path);
+
+    own_path(path, aOwner);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_dir(const char *aPath, mode_t aMode, const struct identity *aOwner)
+{
+    if (mkdir(aPath, aMode))
+        err(1, "Unable to create %s", aPath);
+
+    own_path(aPath, aOwner);
+
+    /* Apply the mode explicitly because the umask might otherwise
+     * remove permissions that suxec expects to find.
+     */
+
+    if (chmod(aPath, aMode))
+        err(1, "Unable to change mode of %s", aPath);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_chain(const struct tree *aTree, unsigned aLicensor,
+             char *aFirst, size_t aFirstSize)
+{
+    char chainDir[PATH_MAX];
+
+    int len = snprintf(chainDir, sizeof(chainDir),
+        "%s/c%u", aTree->mRoot, aLicensor);
+    if (0 > len || sizeof(chainDir) <= (size_t) len)
+        errx(1, "Chain path too long");
+
+    create_dir(chainDir, 0755, &aTree->mLicensor);
+
+    /* Pad the chain directory with nested directories until
+     * the path reaches the requested length.
+     */
+
+    size_t chainLen = len;
+
+    while (chainLen < aTree->mLength) {
+        size_t padLen = aTree->mLength - chainLen;
+        if (padLen < 2)
+            padLen = 2;
+        if (padLen > PADDING_NAME_MAX)
+            padLen = PADDING_NAME_MAX;
+
+        if (chainLen + padLen + sizeof("/h") + 3 * sizeof(unsigned) >=
+                sizeof(chainDir))
+            errx(1, "Chain path length %u too long", aTree->mLength);
+
+        chainDir[chainLen] = '/';
+        memset(chainDir + chainLen + 1, 'p', padLen - 1);
+        chainLen += padLen;
+        chainDir[chainLen] = 0;
+
+        create_dir(chainDir, 0755, &aTree->mLicensor);
+    }
+
+    /* The last symlink in the chain resolves to the target, and
+     * the others are relative to their neighbours.
+     */
+
+    for (unsigned hx = 1; hx < aTree->mDepth; ++hx) {
+        if (hx + 1 < aTree->mDepth) {
+            char next[3 * sizeof(unsigned) + 2];
+            snprintf(next, sizeof(next), "h%u", hx + 1);
+            create_symlink(&aTree->mLicensor, next, "%s/h%u", chainDir, hx);
+        } else {
+            create_symlink(
+                &aTree->mLicensor, aTree->mTarget, "%s/h%u", chainDir, hx);
+        }
+    }
+
+    /* Return the first hop for registrations to reference. */
+
+    len = 1 < aTree->mDepth
+        ? snprintf(aFirst, aFirstSize, "%s/h1", chainDir)
+        : snprintf(aFirst, aFirstSize, "%s", aTree->mTarget);
+    if (0 > len || aFirstSize <= (size_t) len)
+        errx(1, "Chain path too long");
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_target(struct tree *aTree)
+{
+    /* The target must be owned by the licensor, so run a copy of
+     * the benchmark rather than the benchmark itself.
+     */
+
+    snprintf(aTree->mTarget, sizeof(aTree->mTarget),
+        "%s/target", aTree->mRoot);
+
+    int srcFd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+    if (-1 == srcFd)
+        err(1, "Unable to open benchmark executable");
+
+    int dstFd = open(aTree->mTarget,
+        O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+    if (-1 == dstFd)
+        err(1, "Unable to create %s", aTree->mTarget);
+
+    while (1) {
+        char buf[BUFSIZ];
+
+        ssize_t len = read(srcFd, buf, sizeof(buf));
+        if (!len)
+            break;
+        if (-1 == len)
+            err(1, "Unable to read benchmark executable");
+
+        if (len != write(dstFd, buf, len))
+            err(1, "Unable to write %s", aTree->mTarget);
+    }
+
+    if (close(dstFd))
+        err(1, "Unable to close %s", aTree->mTarget);
+    close(srcFd);
+
+    own_path(aTree->mTarget, &aTree->mLicensor);
+
+    if (chmod(aTree->mTarget, 0755))
+        err(1, "Unable to change mode of %s", aTree->mTarget);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_tree(struct tree *aTree)
+{
+    const char *tmpDir = getenv("TMPDIR");
+    if (!tmpDir || !*tmpDir)
+        tmpDir = "/tmp";
+
+    int len = snprintf(aTree->mRoot, sizeof(aTree->mRoot),
+        "%s/bench_launch.XXXXXX", tmpDir);
+    if (0 > len || sizeof(aTree->mRoot) <= (size_t) len)
+        errx(1, "Temporary directory %s too long", tmpDir);
+
+    if (!mkdtemp(aTree->mRoot))
+        err(1, "Unable to create registration tree");
+
+    own_path(aTree->mRoot, &aTree->mLicensor);
+
+    if (chmod(aTree->mRoot, 0711))
+        err(1, "Unable to change mode of %s", aTree->mRoot);
+
+    create_target(aTree);
+
+    for (unsigned lx = 0; lx < aTree->mFanout; ++lx) {
+
+        /* The licensor directory must not allow others to list
+         * the licensee directories it contains.
+         */
+
+        char licenseeDir[PATH_MAX];
+        snprintf(licenseeDir, sizeof(licenseeDir),
+            "%s/l%u", aTree->mRoot, lx);
+        create_dir(licenseeDir, 0711, &aTree->mLicensor);
+
+        strcat(licenseeDir, "/bench");
+        create_dir(licenseeDir, 0755, &aTree->mLicensor);
+
+        char first[PATH_MAX];
+        create_chain(aTree, lx, first, sizeof(first));
+
+        for (unsigned rx = 0; rx < aTree->mRegistrations; ++rx)
+            create_symlink(
+                &aTree->mLicensee, first, "%s/r%u", licenseeDir, rx);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+remove_entry_(const char *aPath, const struct stat *aStat,
+              int aFlag, struct FTW *aFtw)
+{
+    (void) aStat;
+    (void) aFlag;
+    (void) aFtw;
+
+    if (remove(aPath))
+        warn("Unable to remove %s", aPath);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+close_tree(struct tree *aTree)
+{
+    if (nftw(aTree->mRoot, remove_entry_, 16, FTW_DEPTH | FTW_PHYS))
+        warn("Unable to remove %s", aTree->mRoot);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+report(const char *aSuxec, const struct tree *aTree, const char *aMetric,
+       unsigned long long *aSamples, unsigned aNumSamples)
+{
+    sort_samples(aSamples, aNumSamples);
+
+    printf("suxec=%s licensor=%s licensee=%s"
+           " fanout=%u registrations=%u depth=%u length=%u"
+           " metric=%s n=%u"
+           " min_ns=%llu p50_ns=%llu p99_ns=%llu p999_ns=%llu max_ns=%llu\n",
+        aSuxec,
+        aTree->mLicensor.mName, aTree->mLicensee.mName,
+        aTree->mFanout, aTree->mRegistrations,
+        aTree->mDepth, aTree->mLength,
+        aMetric, aNumSamples,
+        aSamples[0],
+        percentile(aSamples, aNumSamples, 500),
+        percentile(aSamples, aNumSamples, 990),
+        percentile(aSamples, aNumSamples, 999),
+        aSamples[aNumSamples-1]);
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned long long
+parse_record_field(const char *aRecord, const char *aName)
+{
+    char key[32];
+    snprintf(key, sizeof(key), "\"%s_ns\":", aName);
+
+    const char *field = strstr(aRecord, key);
+    if (!field)
+        errx(1, "Unable to find %s in timing record %s", aName, aRecord);
+
+    return strtoull(field + strlen(key), 0, 10);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+parse_record(const char *aRecord, unsigned long long aStartNs,
+             unsigned long long aTargetNs, unsigned long long *aPhase)
+{
+    /* Convert the offsets recorded by suxec into the time spent
+     * in each phase. All the hops are combined, and begin after
+     * the parent directory checks.
+     */
+
+    unsigned long long mainNs = parse_record_field(aRecord, "start");
+    unsigned long long lastNs = 0;
+
+    aPhase[PHASE_MAIN] = mainNs - aStartNs;
+
+    for (unsigned px = PHASE_PARSE; px < PHASE_EXECV; ++px) {
+
+        unsigned long long phaseNs;
+
+        if (PHASE_FOLLOW != px) {
+            phaseNs = parse_record_field(aRecord, sPhaseName[px]);
+        } else {
+            phaseNs = lastNs;
+
+            const char *hop = strstr(aRecord, "\"hop_ns\":[");
+            if (!hop)
+                errx(1, "Unable to find hops in timing record %s", aRecord);
+            hop += strlen("\"hop_ns\":[");
+
+            while (']' != *hop) {
+                char *end;
+                phaseNs = strtoull(hop, &end, 10);
+                if (end == hop)
+                    errx(1, "Unable to parse hops in %s", aRecord);
+                hop = end + (',' == *end);
+            }
+        }
+
+        aPhase[px] = phaseNs - lastNs;
+        lastNs = phaseNs;
+    }
+
+    aPhase[PHASE_EXECV] = aTargetNs - (mainNs + lastNs);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+bench_launch(const char *aSuxec, const struct tree *aTree,
+             unsigned aNumSamples)
+{
+    unsigned long long *samples = malloc(
+        (3 + PHASES) * aNumSamples * sizeof(*samples));
+    if (!samples)
+        err(1, "Unable to allocate %u samples", aNumSamples);
+
+    unsigned long long *targetSamples = samples;
+    unsigned long long *exitSamples = samples + aNumSamples;
+    unsigned long long *totalSamples = samples + 2 * aNumSamples;
+    unsigned long long *phaseSamples = samples + 3 * aNumSamples;
+
+    int pipeFds[2];
+    if (pipe(pipeFds))
+        err(1, "Unable to create pipe");
+
+    int timingFds[2];
+    if (pipe(timingFds))
+        err(1, "Unable to create timing pipe");
+
+    char targetEnv[sizeof(TARGET_ENV) + 3 * sizeof(int) + 1];
+    snprintf(targetEnv, sizeof(targetEnv), TARGET_ENV "=%d", pipeFds[1]);
+
+    char timingFd[3 * sizeof(int) + 1];
+    snprintf(timingFd, sizeof(timingFd), "%d", timingFds[1]);
+
+    /* Use a fixed seed so that runs against different builds
+     * launch the same sequence of registrations.
+     */
+
+    unsigned long long seed = 1;
+
+    for (unsigned ix = 0; ix < aNumSamples; ++ix) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+
+        unsigned licensor = (seed >> 33) % aTree->mFanout;
+        unsigned registration = (seed >> 17) % aTree->mRegistrations;
+
+        char symlinkPath[PATH_MAX];
+        snprintf(symlinkPath, sizeof(symlinkPath),
+            "%s/l%u/bench/r%u", aTree->mRoot, licensor, registration);
+
+        char *argv[] = {
+            (char *) aSuxec, "--timing-fd", timingFd,
+            "--", targetEnv, symlinkPath, 0 };
+
+        unsigned long long startNs = monotonic_ns();
+
+        pid_t pid = fork();
+        if (-1 == pid)
+            err(1, "Unable to fork");
+
+        if (!pid) {
+            /* Vary the seed used by the slow backend interposer for
+             * each launch, but repeat the sequence between runs.
+             */
+
+            char slowSeed[3 * sizeof(ix) + 1];
+            snprintf(slowSeed, sizeof(slowSeed), "%u", ix + 1);
+            if (setenv("SLOW_SEED", slowSeed, 1))
+                _exit(126);
+
+            execv(argv[0], argv);
+            _exit(126);
+        }
+
+        int status;
+        if (-1 == waitpid(pid, &status, 0))
+            err(1, "Unable to wait for pid %d", (int) pid);
+
+        unsigned long long stopNs = monotonic_ns();
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            errx(1, "Unable to launch %s %s", aSuxec, symlinkPath);
+
+        unsigned long long targetNs;
+        if (sizeof(targetNs) != read(pipeFds[0], &targetNs, sizeof(targetNs)))
+            err(1, "Unable to read target time");
+
+        char record[PIPE_BUF + 1];
+        ssize_t recordLen = read(timingFds[0], record, sizeof(record) - 1);
+        if (0 >= recordLen)
+            err(1, "Unable to read timing record");
+        record[recordLen] = 0;
+
+        unsigned long long phase[PHASES];
+        parse_record(record, startNs, targetNs, phase);
+
+        for (unsigned px = 0; px < PHASES; ++px)
+            phaseSamples[px * aNumSamples + ix] = phase[px];
+
+        targetSamples[ix] = targetNs - startNs;
+        exitSamples[ix] = stopNs - targetNs;
+        totalSamples[ix] = stopNs - startNs;
+    }
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    close(timingFds[0]);
+    close(timingFds[1]);
+
+    report(aSuxec, aTree, "exec-to-target", targetSamples, aNumSamples);
+    report(aSuxec, aTree, "target-to-exit", exitSamples, aNumSamples);
+    report(aSuxec, aTree, "exec-to-exit", totalSamples, aNumSamples);
+
+    for (unsigned px = 0; px < PHASES; ++px) {
+        char metric[32];
+        snprintf(metric, sizeof(metric), "phase-%s", sPhaseName[px]);
+
+        report(aSuxec, aTree, metric,
+            phaseSamples + px * aNumSamples, aNumSamples);
+    }
+
+    free(samples);
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+parse_count(const char *aArg, const char *aName, unsigned aMin)
+{
+    char *end;
+
+    errno = 0;
+    unsigned long count = strtoul(aArg, &end, 10);
+    if (errno || end == aArg || *end || count < aMin || count > UINT_MAX)
+        errx(1, "Invalid %s %s", aName, aArg);
+
+    return count;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    /* When run as the target of suxec, report the time immediately
+     * and exit.
+     */
+
+    const char *targetFd = getenv(TARGET_ENV);
+    if (targetFd) {
+        unsigned long long targetNs = monotonic_ns();
+        if (sizeof(targetNs) !=
+                write(atoi(targetFd), &targetNs, sizeof(targetNs)))
+            return 1;
+        return 0;
+    }
+
+    struct tree tree = {
+        .mFanout = 16,
+        .mRegistrations = 64,
+        .mDepth = 4,
+        .mLength = 128,
+    };
+
+    unsigned numSamples = 1000;
+
+    const char *licensor = 0;
+    const char *licensee = 0;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+d:f:l:n:r:L:R:"))) {
+        switch (opt) {
+        default:
+            errx(1, "usage: %s [-f fanout] [-r registrations] [-d depth]"
+                " [-l length] [-n samples] [-L licensor] [-R licensee]"
+                " suxec ...", argv[0]);
+
+        case 'L':
+            licensor = optarg;
+            break;
+
+        case 'R':
+            licensee = optarg;
+            break;
+
+        case 'd':
+            tree.mDepth = parse_count(optarg, "depth", 1);
+            break;
+
+        case 'f':
+            tree.mFanout = parse_count(optarg, "fanout", 1);
+            break;
+
+        case 'l':
+            tree.mLength = parse_count(optarg, "length", 0);
+            break;
+
+        case 'n':
+            numSamples = parse_count(optarg, "number of samples", 1);
+            break;
+
+        case 'r':
+            tree.mRegistrations = parse_count(optarg, "registrations", 1);
+            break;
+        }
+    }
+
+    find_identity(&tree.mLicensor, licensor);
+    find_identity(&tree.mLicensee, licensee);
+
+    create_tree(&tree);
+
+    /* Launch from a child running as the licensee so that the tree
+     * can be removed with the original privileges.
+     */
+
+    for (int ax = optind; ax < argc; ++ax) {
+        fflush(stdout);
+
+        pid_t pid = fork();
+        if (-1 == pid)
+            err(1, "Unable to fork");
+
+        if (!pid) {
+            assume_identity(&tree.mLicensee);
+            bench_launch(argv[ax], &tree, numSamples);
+            fflush(stdout);
+            _exit(0);
+        }
+
+        int status;
+        if (-1 == waitpid(pid, &status, 0))
+            err(1, "Unable to wait for pid %d", (int) pid);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            close_tree(&tree);
+            errx(1, "Unable to benchmark %s", argv[ax]);
+        }
+    }
+
+    close_tree(&tree);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,392 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+#define DEBUG(...) do { } while (0)
+
+#include "bench.h"
+#include "split_path.c.h"
+#include "splice_path.c.h"
+#include "splice_path_scalar.c.h"
+#include "stpcpyv.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Microbenchmarks for the path primitives
+ *
+ * Each primitive is run over several corpora, and the results are
+ * printed one line per measurement as space separated NAME=VALUE
+ * fields so that results can be compared between commits:
+ *
+ *  table    The test_splice_path table (generate_splice_cases.sh 5)
+ *  deep     generate_splice_cases.sh -c 8
+ *  long     Paths of about 4KiB comprising realistic names
+ *  dotdot   Long names followed by long runs of ../
+ *
+ * Allocations are counted by interposing malloc(3) and friends, so
+ * that allocations made within the C library are also counted.
+ */
+
+struct corpus {
+    const char *mName;
+    unsigned mSize;
+    const char **mLhs;
+    const char **mRhs;
+};
+
+static struct {
+    const char *mPath;
+    const char *mLhs;
+    const char *mRhs;
+} sTablePlan[] = {
+
+    /* generate_splice_cases.sh 5 */
+    #include "test_splice_path.h"
+
+}, sDeepPlan[] = {
+
+    /* generate_splice_cases.sh -c 8 */
+    #include "bench_splice_cases.h"
+
+};
+
+/* -------------------------------------------------------------------------- */
+extern void *__libc_malloc(size_t aSize);
+extern void *__libc_calloc(size_t aNum, size_t aSize);
+extern void *__libc_realloc(void *aPtr, size_t aSize);
+extern void __libc_free(void *aPtr);
+
+static unsigned long long sAllocs;
+
+void *malloc(size_t aSize);
+void *calloc(size_t aNum, size_t aSize);
+void *realloc(void *aPtr, size_t aSize);
+void free(void *aPtr);
+
+void *
+malloc(size_t aSize)
+{
+    ++sAllocs;
+    return __libc_malloc(aSize);
+}
+
+void *
+calloc(size_t aNum, size_t aSize)
+{
+    ++sAllocs;
+    return __libc_calloc(aNum, aSize);
+}
+
+void *
+realloc(void *aPtr, size_t aSize)
+{
+    ++sAllocs;
+    return __libc_realloc(aPtr, aSize);
+}
+
+void
+free(void *aPtr)
+{
+    __libc_free(aPtr);
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned long long
+cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* Primitives under test
+ *
+ * Each primitive is wrapped to take a pair of names so that all
+ * of them can be run over the same corpora. Primitives that use
+ * a path buffer reuse the same buffer for every call, as they
+ * would when resolving a chain of symlinks.
+ */
+
+typedef int primitivefn(const char *aLhs, const char *aRhs);
+
+static struct pathbuf sPath;
+static char sJoinBuf[2 * 8192];
+
+static int
+bench_split_path_(const char *aLhs, const char *aRhs)
+{
+    struct pathview dirName, baseName;
+
+    /* Split the base name of each pair, but avoid the error that
+     * results from splitting an empty path.
+     */
+
+    const char *path = *aRhs ? aRhs : aLhs;
+
+    return *path ? split_path(pathview_cstr(path), &dirName, &baseName) : 0;
+}
+
+static int
+bench_splice_path_(const char *aLhs, const char *aRhs)
+{
+    return splice_path(&sPath, pathview_cstr(aLhs), pathview_cstr(aRhs));
+}
+
+static int
+bench_splice_path_scalar_(const char *aLhs, const char *aRhs)
+{
+    char *path;
+
+    if (splice_path_scalar(&path, aLhs, aRhs))
+        return -1;
+
+    free(path);
+
+    return 0;
+}
+
+static int
+bench_stpcpyv_(const char *aLhs, const char *aRhs)
+{
+    return stpcpyv(sJoinBuf, sizeof(sJoinBuf), aLhs, "/", aRhs, "/", 0)
+        ? 0 : -1;
+}
+
+static struct {
+    const char *mName;
+    primitivefn *mFn;
+} sPrimitives[] = {
+    { "split_path",         bench_split_path_ },
+    { "splice_path",        bench_splice_path_ },
+    { "splice_path_scalar", bench_splice_path_scalar_ },
+    { "stpcpyv",            bench_stpcpyv_ },
+};
+
+/* -------------------------------------------------------------------------- */
+static void
+bench(const char *aName, primitivefn *aFn, const struct corpus *aCorpus)
+{
+    /* Run through the corpus repeatedly until enough time has elapsed
+     * to obtain a stable measurement.
+     */
+
+    unsigned long long numOps = 0;
+    unsigned long long numAllocs = 0;
+    unsigned long long elapsedNs = 0;
+    unsigned long long elapsedCycles = 0;
+
+    for (unsigned rounds = 1; elapsedNs < 200000000ULL; rounds *= 2) {
+
+        unsigned long long allocs = sAllocs;
+        unsigned long long startCycles = cycles();
+        unsigned long long startNs = monotonic_ns();
+
+        for (unsigned rx = 0; rx < rounds; ++rx) {
+            for (unsigned ix = 0; ix < aCorpus->mSize; ++ix) {
+                if (aFn(aCorpus->mLhs[ix], aCorpus->mRhs[ix]))
+                    err(1, "Unable to run %s on %s %s",
+                        aName, aCorpus->mLhs[ix], aCorpus->mRhs[ix]);
+            }
+        }
+
+        elapsedNs += monotonic_ns() - startNs;
+        elapsedCycles += cycles() - startCycles;
+        numAllocs += sAllocs - allocs;
+        numOps += (unsigned long long) rounds * aCorpus->mSize;
+    }
+
+    printf("primitive=%s corpus=%s ops=%llu"
+           " ns_per_op=%.1f cycles_per_op=%.1f allocs_per_op=%.3f\n",
+        aName, aCorpus->mName, numOps,
+        (double) elapsedNs / numOps,
+        (double) elapsedCycles / numOps,
+        (double) numAllocs / numOps);
+
+    fflush(stdout);
+}
+
+/* -------------------------------------------------------------------------- */
+static char *
+make_name(unsigned aLen, unsigned aSeed)
+{
+    static const char sAlphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_-.";
+
+    char *name = malloc(aLen + 1);
+    if (!name)
+        err(1, "Unable to allocate name");
+
+    for (unsigned ix = 0; ix < aLen; ++ix) {
+        aSeed = aSeed * 1103515245 + 12345;
+        name[ix] = sAlphabet[(aSeed >> 16) % (sizeof(sAlphabet) - 1)];
+    }
+    name[aLen] = 0;
+
+    /* Avoid creating dot and dot-dot names by accident.
+     */
+
+    name[0] = 'n';
+
+    return name;
+}
+
+/* -------------------------------------------------------------------------- */
+static char *
+make_path(unsigned aLen, unsigned aSeed, const char *aPrefix)
+{
+    char *path = malloc(aLen + 1);
+    if (!path)
+        err(1, "Unable to allocate path");
+
+    char *endp = stpcpy(path, aPrefix);
+
+    while (endp - path < aLen) {
+        aSeed = aSeed * 1103515245 + 12345;
+
+        unsigned nameLen = 1 + (aSeed >> 16) % 24;
+        if (endp - path + nameLen + 1 > aLen)
+            nameLen = aLen - (endp - path) - 1;
+        if (!nameLen)
+            break;
+
+        char *name = make_name(nameLen, aSeed);
+        endp = stpcpy(stpcpy(endp, name), "/");
+        free(name);
+    }
+
+    *endp = 0;
+
+    return path;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+make_corpus(struct corpus *self, const char *aName, unsigned aSize)
+{
+    self->mName = aName;
+    self->mSize = aSize;
+    self->mLhs = malloc(sizeof(*self->mLhs) * aSize);
+    self->mRhs = malloc(sizeof(*self->mRhs) * aSize);
+
+    if (!self->mLhs || !self->mRhs)
+        err(1, "Unable to allocate corpus %s", aName);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    struct corpus corpora[4];
+
+    make_corpus(
+        &corpora[0], "table", sizeof(sTablePlan)/sizeof(sTablePlan[0]));
+    for (unsigned ix = 0; ix < corpora[0].mSize; ++ix) {
+        corpora[0].mLhs[ix] = sTablePlan[ix].mLhs;
+        corpora[0].mRhs[ix] = sTablePlan[ix].mRhs;
+    }
+
+    make_corpus(
+        &corpora[1], "deep", sizeof(sDeepPlan)/sizeof(sDeepPlan[0]));
+    for (unsigned ix = 0; ix < corpora[1].mSize; ++ix) {
+        corpora[1].mLhs[ix] = sDeepPlan[ix].mLhs;
+        corpora[1].mRhs[ix] = sDeepPlan[ix].mRhs;
+    }
+
+    /* Paths of about 4KiB split evenly between the two names, with
+     * a mixture of absolute and relative directory names.
+     */
+
+    make_corpus(&corpora[2], "long", 64);
+    for (unsigned ix = 0; ix < corpora[2].mSize; ++ix) {
+        corpora[2].mLhs[ix] = make_path(2048, 2 * ix, ix % 2 ? "/" : "");
+        corpora[2].mRhs[ix] = make_path(2048, 2 * ix + 1, "");
+    }
+
+    /* Long runs of ../ that retract the names in the directory
+     * name and then, for relative paths, accumulate beyond it.
+     */
+
+    make_corpus(&corpora[3], "dotdot", 64);
+    for (unsigned ix = 0; ix < corpora[3].mSize; ++ix) {
+        unsigned dotdots = 64 + 16 * ix;
+
+        char *rhs = malloc(3 * dotdots + 1);
+        if (!rhs)
+            err(1, "Unable to allocate path");
+
+        char *endp = rhs;
+        for (unsigned dx = 0; dx < dotdots; ++dx)
+            endp = stpcpy(endp, "../");
+
+        corpora[3].mLhs[ix] = make_path(1024, ix, ix % 2 ? "/" : "");
+        corpora[3].mRhs[ix] = rhs;
+    }
+
+    /* Check that the primitives agree with the reference before
+     * measuring their performance.
+     */
+
+    for (unsigned cx = 0; cx < sizeof(corpora)/sizeof(corpora[0]); ++cx) {
+        for (unsigned ix = 0; ix < corpora[cx].mSize; ++ix) {
+            char *path;
+
+            if (bench_splice_path_(
+                        corpora[cx].mLhs[ix], corpora[cx].mRhs[ix]) ||
+                    splice_path_scalar(
+                        &path, corpora[cx].mLhs[ix], corpora[cx].mRhs[ix]))
+                err(1, "Unable to splice %s %s",
+                    corpora[cx].mLhs[ix], corpora[cx].mRhs[ix]);
+
+            if (strcmp(sPath.mBuf, path))
+                errx(1, "Mismatched %s and %s", sPath.mBuf, path);
+
+            free(path);
+        }
+    }
+
+    for (unsigned px = 0;
+            px < sizeof(sPrimitives)/sizeof(sPrimitives[0]); ++px)
+        for (unsigned cx = 0; cx < sizeof(corpora)/sizeof(corpora[0]); ++cx)
+            bench(sPrimitives[px].mName, sPrimitives[px].mFn, &corpora[cx]);
+
+    close_pathbuf(&sPath);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,226 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+/* -------------------------------------------------------------------------- */
+/* Startup latency benchmark
+ *
+ * Compare the cost of launching different builds of suxec. Two
+ * measurements are made for each build:
+ *
+ *  exec-to-main   Time to exec suxec and reach main(). This is
+ *                 approximated by running suxec without arguments
+ *                 so that it exits immediately after parsing.
+ *
+ *  exec-to-target Time from exec of suxec to the start of the
+ *                 target program. The benchmark registers itself
+ *                 as the target, and reports the time at which it
+ *                 starts through a pipe named in the environment.
+ */
+
+#define TARGET_ENV "BENCH_STARTUP_FD"
+
+/* -------------------------------------------------------------------------- */
+static void
+report(const char *aSuxec, const char *aMetric,
+       unsigned long long *aSamples, unsigned aNumSamples)
+{
+    sort_samples(aSamples, aNumSamples);
+
+    printf("suxec=%s metric=%s n=%u"
+           " min_ns=%llu p50_ns=%llu p90_ns=%llu p99_ns=%llu\n",
+        aSuxec, aMetric, aNumSamples,
+        aSamples[0],
+        percentile(aSamples, aNumSamples, 500),
+        percentile(aSamples, aNumSamples, 900),
+        percentile(aSamples, aNumSamples, 990));
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+launch(char **aArgv, int aQuiet)
+{
+    pid_t pid = fork();
+    if (-1 == pid)
+        err(1, "Unable to fork");
+
+    if (!pid) {
+        if (aQuiet && !freopen("/dev/null", "w", stderr))
+            _exit(126);
+        execv(aArgv[0], aArgv);
+        _exit(126);
+    }
+
+    int status;
+    if (-1 == waitpid(pid, &status, 0))
+        err(1, "Unable to wait for pid %d", (int) pid);
+
+    return status;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+bench_main(const char *aSuxec, unsigned aNumSamples)
+{
+    unsigned long long samples[aNumSamples];
+
+    for (unsigned ix = 0; ix < aNumSamples; ++ix) {
+        char *argv[] = { (char *) aSuxec, 0 };
+
+        unsigned long long startNs = monotonic_ns();
+        launch(argv, 1);
+        samples[ix] = monotonic_ns() - startNs;
+    }
+
+    report(aSuxec, "exec-to-main", samples, aNumSamples);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+bench_target(const char *aSuxec, const char *aSymlink, unsigned aNumSamples)
+{
+    unsigned long long samples[aNumSamples];
+
+    int pipeFds[2];
+    if (pipe(pipeFds))
+        err(1, "Unable to create pipe");
+
+    char targetEnv[sizeof(TARGET_ENV) + 3 * sizeof(int) + 1];
+    snprintf(targetEnv, sizeof(targetEnv), TARGET_ENV "=%d", pipeFds[1]);
+
+    for (unsigned ix = 0; ix < aNumSamples; ++ix) {
+        char *argv[] = {
+            (char *) aSuxec, "--", targetEnv, (char *) aSymlink, 0 };
+
+        unsigned long long startNs = monotonic_ns();
+        int status = launch(argv, 0);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            errx(1, "Unable to launch %s %s", aSuxec, aSymlink);
+
+        unsigned long long targetNs;
+        if (sizeof(targetNs) != read(pipeFds[0], &targetNs, sizeof(targetNs)))
+            err(1, "Unable to read target time");
+
+        samples[ix] = targetNs - startNs;
+    }
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+
+    report(aSuxec, "exec-to-target", samples, aNumSamples);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    /* When run as the target of suxec, report the time immediately
+     * and exit.
+     */
+
+    const char *targetFd = getenv(TARGET_ENV);
+    if (targetFd) {
+        unsigned long long targetNs = monotonic_ns();
+        if (sizeof(targetNs) !=
+                write(atoi(targetFd), &targetNs, sizeof(targetNs)))
+            return 1;
+        return 0;
+    }
+
+    unsigned numSamples = 1000;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+n:"))) {
+        switch (opt) {
+        default:
+            errx(1, "usage: %s [-n samples] suxec ...", argv[0]);
+
+        case 'n':
+            numSamples = atoi(optarg);
+            if (!numSamples)
+                errx(1, "Invalid number of samples %s", optarg);
+            break;
+        }
+    }
+
+    /* Create a registration that allows the benchmark to run itself
+     * as the target program. The parent directory must not allow
+     * others to list it, and the symlink must resolve to a file
+     * owned by the same user.
+     */
+
+    char self[PATH_MAX];
+    if (!realpath("/proc/self/exe", self))
+        err(1, "Unable to find benchmark executable");
+
+    char regDir[] = "/tmp/bench_startup.XXXXXX";
+    if (!mkdtemp(regDir))
+        err(1, "Unable to create registration directory");
+
+    if (chmod(regDir, 0711))
+        err(1, "Unable to change mode of %s", regDir);
+
+    char licenseeDir[sizeof(regDir) + sizeof("/bench")];
+    snprintf(licenseeDir, sizeof(licenseeDir), "%s/bench", regDir);
+
+    if (mkdir(licenseeDir, 0755))
+        err(1, "Unable to create %s", licenseeDir);
+
+    char symlinkPath[sizeof(licenseeDir) + sizeof("/run")];
+    snprintf(symlinkPath, sizeof(symlinkPath), "%s/run", licenseeDir);
+
+    if (symlink(self, symlinkPath))
+        err(1, "Unable to create %s", symlinkPath);
+
+    for (int ax = optind; ax < argc; ++ax) {
+        bench_main(argv[ax], numSamples);
+        bench_target(argv[ax], symlinkPath, numSamples);
+    }
+
+    unlink(symlinkPath);
+    rmdir(licenseeDir);
+    rmdir(regDir);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
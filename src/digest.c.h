@@ -0,0 +1,190 @@
+#ifndef SUXEC_DIGEST_H
+#define SUXEC_DIGEST_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libsuxec.h"
+#include "mapped.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Digest cache
+ *
+ * Cache the SHA-256 digest of each pinned target in a file shared by
+ * all invocations, so that only the first launch after the target
+ * changes reads its content. The file is opened while privileged,
+ * so that only the privileged user can record a digest, and mapped
+ * so that a lookup makes no system calls.
+ *
+ * Each digest is keyed by the device, inode, size, and modification
+ * and change times, of the target. The change time cannot be set by
+ * an unprivileged user, so any change to the target is a different
+ * key. Digests are held in a shared mapped table, so an entry for
+ * a target replaces any previous entry for the same target.
+ *
+ * The cache is silently disabled if the directory holding the file
+ * does not exist, or if the file is not owned by the privileged user.
+ */
+
+#ifndef SUXEC_DIGEST_PATH
+#define SUXEC_DIGEST_PATH "/run/suxec/digests"
+#endif
+
+#define DIGEST_MAGIC 0x73786467u
+#define DIGEST_VERSION 1u
+#define DIGEST_CACHELINE 64
+#define DIGEST_ENTRIES 4096
+#define DIGEST_PROBES 8
+
+#define DIGEST_WORDS (SUXEC_DIGEST_SIZE / sizeof(uint64_t))
+
+struct digest_key {
+    uint64_t mDev;
+    uint64_t mIno;
+    uint64_t mSize;
+    uint64_t mMtime;
+    uint64_t mCtime;
+};
+
+struct digest_entry {
+    uint64_t mSeq;
+    struct digest_key mKey;
+    uint64_t mDigest[DIGEST_WORDS];
+} __attribute__((__aligned__(DIGEST_CACHELINE)));
+
+struct digests {
+    struct mapped_header mHeader
+        __attribute__((__aligned__(DIGEST_CACHELINE)));
+
+    struct digest_entry mEntries[DIGEST_ENTRIES];
+};
+
+static struct digests *sDigests;
+
+/* -------------------------------------------------------------------------- */
+static struct digests *
+map_digests_(void)
+{
+    /* Each digest vouches for a target, so the file must belong to
+     * the privileged user.
+     */
+
+    return map_file(SUXEC_DIGEST_PATH, sizeof(struct digests),
+        MAPPED_WRITE | MAPPED_CREATE, 0600,
+        DIGEST_MAGIC, DIGEST_VERSION);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+open_digests(void)
+{
+    /* The cache is optional, so do not disturb the errno used
+     * by the diagnostics of subsequent failures.
+     */
+
+    int savedErrno = errno;
+    sDigests = map_digests_();
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct mapped_table
+digest_table_(void)
+{
+    return (struct mapped_table) {
+        .mEntries = sDigests->mEntries,
+        .mEntrySize = sizeof(*sDigests->mEntries),
+        .mEntriesLen = DIGEST_ENTRIES,
+        .mProbes = DIGEST_PROBES,
+        .mKeyWords = sizeof(struct digest_key) / sizeof(uint64_t),
+        .mValueWords = DIGEST_WORDS,
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+static struct digest_key
+key_digest_(const struct stat *aStat)
+{
+    return (struct digest_key) {
+        .mDev = aStat->st_dev,
+        .mIno = aStat->st_ino,
+        .mSize = aStat->st_size,
+        .mMtime =
+            aStat->st_mtim.tv_sec * 1000000000ULL + aStat->st_mtim.tv_nsec,
+        .mCtime =
+            aStat->st_ctim.tv_sec * 1000000000ULL + aStat->st_ctim.tv_nsec,
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fetch_digest(void *aArg, const struct stat *aStat, unsigned char *aDigest)
+{
+    if (!sDigests)
+        return -1;
+
+    struct mapped_table table = digest_table_();
+    struct digest_key key = key_digest_(aStat);
+
+    uint64_t digest[DIGEST_WORDS];
+
+    if (fetch_mapped_entry(&table, (const uint64_t *) &key, digest))
+        return -1;
+
+    memcpy(aDigest, digest, SUXEC_DIGEST_SIZE);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+store_digest(void *aArg, const struct stat *aStat, const unsigned char *aDigest)
+{
+    if (!sDigests)
+        return;
+
+    struct mapped_table table = digest_table_();
+    struct digest_key key = key_digest_(aStat);
+
+    uint64_t digest[DIGEST_WORDS];
+    memcpy(digest, aDigest, SUXEC_DIGEST_SIZE);
+
+    store_mapped_entry(&table, (const uint64_t *) &key, digest);
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_DIGEST_H */
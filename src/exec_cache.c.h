@@ -0,0 +1,450 @@
+#ifndef SUXEC_EXEC_CACHE_H
+#define SUXEC_EXEC_CACHE_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/fsuid.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+
+#include "finally.h"
+#include "sha256.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Executable cache
+ *
+ * Hold a node-local copy of each licensed executable, so that a
+ * target held on a network file system is only paged in from the
+ * file server once on each node. The directory is opened while
+ * privileged, and only the privileged user can add copies to it.
+ *
+ * Each copy is stored under the SHA-256 digest of its content, so
+ * that identical executables share a copy, and is linked to a name
+ * formed from the device, inode, size, and modification and change
+ * times, of the original. The change time cannot be set by an
+ * unprivileged user, so any change to the original is a different
+ * name. A copy is only made of a file that is unchanged throughout,
+ * and a name is only added for a complete copy.
+ *
+ * The original is opened with the file system credentials of the
+ * licensor, and is not copied from a noexec file system, so that a
+ * copy is only made of a program that the licensor could execute.
+ *
+ * Only ELF executables are copied, since an interpreter would be
+ * given the name of the copy rather than the original. Copies are
+ * never removed, and the directory is expected to be pruned by the
+ * administrator, for example using tmpfiles.d(5).
+ *
+ * The cache is silently disabled if the directory does not exist, or
+ * if it is not owned by the privileged user, or if it can be searched
+ * or modified by other users.
+ */
+
+#ifndef SUXEC_EXEC_CACHE_PATH
+#define SUXEC_EXEC_CACHE_PATH "/var/cache/suxec"
+#endif
+
+#define EXEC_CACHE_SIZE_MAX (256 * 1024 * 1024)
+#define EXEC_CACHE_COPY_SIZE (64 * 1024)
+#define EXEC_CACHE_MODE 0711
+
+static int sExecCacheFd = -1;
+
+/* -------------------------------------------------------------------------- */
+static void
+open_exec_cache(void)
+{
+    /* The cache is optional, so do not disturb the errno used
+     * by the diagnostics of subsequent failures.
+     */
+
+    int savedErrno = errno;
+
+    int fd = open(SUXEC_EXEC_CACHE_PATH,
+        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+    struct stat cacheStat;
+
+    if (-1 != fd && (fstat(fd, &cacheStat) ||
+            cacheStat.st_uid != geteuid() ||
+            (cacheStat.st_mode & (S_IRWXG | S_IRWXO)))) {
+        close(fd);
+        fd = -1;
+    }
+
+    sExecCacheFd = fd;
+
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_exec_cache_(const struct stat *aStat, const struct stat *aOther)
+{
+    return
+        aStat->st_dev == aOther->st_dev &&
+        aStat->st_ino == aOther->st_ino &&
+        aStat->st_size == aOther->st_size &&
+        aStat->st_mtim.tv_sec == aOther->st_mtim.tv_sec &&
+        aStat->st_mtim.tv_nsec == aOther->st_mtim.tv_nsec &&
+        aStat->st_ctim.tv_sec == aOther->st_ctim.tv_sec &&
+        aStat->st_ctim.tv_nsec == aOther->st_ctim.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+open_exec_cache_(const char *aName, off_t aSize)
+{
+    int rc = -1;
+
+    int fd = openat(
+        sExecCacheFd, aName, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == fd)
+        goto Finally;
+
+    /* Only use a complete copy made by the privileged user. */
+
+    struct stat copyStat;
+    if (fstat(fd, &copyStat))
+        goto Finally;
+
+    if (!S_ISREG(copyStat.st_mode) ||
+            copyStat.st_uid != geteuid() ||
+            (copyStat.st_mode & 07777) != EXEC_CACHE_MODE ||
+            copyStat.st_size != aSize) {
+        errno = EINVAL;
+        goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (rc && -1 != fd) {
+            close(fd);
+            fd = -1;
+        }
+    });
+
+    return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+copy_exec_cache_(int aDstFd, int aSrcFd, off_t aSize)
+{
+    int rc = -1;
+
+    char *buf = 0;
+
+    /* Let the kernel copy the content where it can, and otherwise
+     * copy the content through a buffer.
+     */
+
+    off_t offset = 0;
+
+    while (offset < aSize) {
+        ssize_t copied = copy_file_range(
+            aSrcFd, 0, aDstFd, 0, aSize - offset, 0);
+        if (-1 == copied) {
+            if (EINTR == errno)
+                continue;
+            if (EXDEV != errno && ENOSYS != errno && EINVAL != errno &&
+                    EOPNOTSUPP != errno)
+                goto Finally;
+            break;
+        }
+        if (!copied)
+            break;
+        offset += copied;
+    }
+
+    if (offset < aSize) {
+        buf = malloc(EXEC_CACHE_COPY_SIZE);
+        if (!buf)
+            goto Finally;
+    }
+
+    while (offset < aSize) {
+        ssize_t bufLen = pread(aSrcFd, buf, EXEC_CACHE_COPY_SIZE, offset);
+        if (-1 == bufLen) {
+            if (EINTR == errno)
+                continue;
+            goto Finally;
+        }
+
+        if (!bufLen) {
+            errno = EIO;
+            goto Finally;
+        }
+
+        for (ssize_t wx = 0; wx < bufLen; ) {
+            ssize_t wrLen = pwrite(
+                aDstFd, buf + wx, bufLen - wx, offset + wx);
+            if (-1 == wrLen) {
+                if (EINTR == errno)
+                    continue;
+                goto Finally;
+            }
+            wx += wrLen;
+        }
+
+        offset += bufLen;
+    }
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        free(buf);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+digest_exec_cache_(int aFd, off_t aSize, char *aName, size_t aNameSize)
+{
+    int rc = -1;
+
+    char *buf = malloc(EXEC_CACHE_COPY_SIZE);
+    if (!buf)
+        goto Finally;
+
+    struct sha256 sha256;
+    create_sha256(&sha256);
+
+    for (off_t offset = 0; offset < aSize; ) {
+        ssize_t bufLen = pread(aFd, buf, EXEC_CACHE_COPY_SIZE, offset);
+        if (-1 == bufLen) {
+            if (EINTR == errno)
+                continue;
+            goto Finally;
+        }
+
+        if (!bufLen) {
+            errno = EIO;
+            goto Finally;
+        }
+
+        update_sha256(&sha256, buf, bufLen);
+        offset += bufLen;
+    }
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    finish_sha256(&sha256, digest);
+
+    if (aNameSize < sizeof("sha256-") + 2 * sizeof(digest)) {
+        errno = ENAMETOOLONG;
+        goto Finally;
+    }
+
+    char *name = aName + sprintf(aName, "sha256-");
+    for (unsigned dx = 0; dx < sizeof(digest); ++dx)
+        name += sprintf(name, "%02x", digest[dx]);
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        free(buf);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+open_exec_source_(const char *aPath, uid_t aUid, gid_t aGid)
+{
+    /* Open the original as the licensor, rather than the privileged
+     * user, so that each directory must be searchable by the licensor.
+     */
+
+    setfsgid(aGid);
+    setfsuid(aUid);
+
+    int fd = open(aPath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+
+    int err = errno;
+    setfsuid(geteuid());
+    setfsgid(getegid());
+    errno = err;
+
+    return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fill_exec_cache_(
+    const char *aName, const char *aPath, const struct stat *aStat,
+    uid_t aUid, gid_t aGid)
+{
+    int rc = -1;
+
+    int srcFd = -1;
+    int copyFd = -1;
+
+    srcFd = open_exec_source_(aPath, aUid, aGid);
+    if (-1 == srcFd)
+        goto Finally;
+
+    struct statfs srcFs;
+    if (fstatfs(srcFd, &srcFs))
+        goto Finally;
+
+    errno = EACCES;
+    if (srcFs.f_flags & ST_NOEXEC)
+        goto Finally;
+
+    /* Only copy the file that was verified, and only if it is an
+     * ELF executable.
+     */
+
+    struct stat srcStat;
+    if (fstat(srcFd, &srcStat))
+        goto Finally;
+
+    errno = ESTALE;
+    if (!S_ISREG(srcStat.st_mode) || !match_exec_cache_(aStat, &srcStat))
+        goto Finally;
+
+    char magic[4];
+    if (sizeof(magic) != pread(srcFd, magic, sizeof(magic), 0))
+        goto Finally;
+
+    errno = ENOEXEC;
+    if (memcmp(magic, "\177ELF", sizeof(magic)))
+        goto Finally;
+
+    copyFd = openat(
+        sExecCacheFd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, EXEC_CACHE_MODE);
+    if (-1 == copyFd)
+        goto Finally;
+
+    if (fchmod(copyFd, EXEC_CACHE_MODE))
+        goto Finally;
+
+    if (copy_exec_cache_(copyFd, srcFd, srcStat.st_size))
+        goto Finally;
+
+    /* Discard the copy if the original changed while it was being
+     * copied.
+     */
+
+    if (fstat(srcFd, &srcStat))
+        goto Finally;
+
+    errno = ESTALE;
+    if (!match_exec_cache_(aStat, &srcStat))
+        goto Finally;
+
+    char object[sizeof("sha256-") + 2 * SHA256_DIGEST_SIZE];
+    if (digest_exec_cache_(copyFd, srcStat.st_size, object, sizeof(object)))
+        goto Finally;
+
+    /* Share an existing copy of the same content, and tolerate
+     * a concurrent launch that adds the same names.
+     */
+
+    char copyPath[sizeof("/proc/self/fd/") + sizeof(int) * 3];
+    snprintf(copyPath, sizeof(copyPath), "/proc/self/fd/%d", copyFd);
+
+    if (linkat(AT_FDCWD, copyPath, sExecCacheFd, object, AT_SYMLINK_FOLLOW) &&
+            EEXIST != errno)
+        goto Finally;
+
+    if (linkat(sExecCacheFd, object, sExecCacheFd, aName, 0) &&
+            EEXIST != errno)
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (-1 != srcFd)
+            close(srcFd);
+        if (-1 != copyFd)
+            close(copyFd);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fetch_exec_cache(
+    const char *aPath, const struct stat *aStat, uid_t aUid, gid_t aGid)
+{
+    int fd = -1;
+
+    if (-1 == sExecCacheFd || EXEC_CACHE_SIZE_MAX < aStat->st_size)
+        return -1;
+
+    /* The cache is optional, so do not disturb the errno used
+     * by the diagnostics of subsequent failures.
+     */
+
+    int savedErrno = errno;
+
+    char name[5 * 16 + 1];
+    snprintf(name, sizeof(name), "%016llx%016llx%016llx%016llx%016llx",
+        (unsigned long long) aStat->st_dev,
+        (unsigned long long) aStat->st_ino,
+        (unsigned long long) aStat->st_size,
+        aStat->st_mtim.tv_sec * 1000000000ULL + aStat->st_mtim.tv_nsec,
+        aStat->st_ctim.tv_sec * 1000000000ULL + aStat->st_ctim.tv_nsec);
+
+    fd = open_exec_cache_(name, aStat->st_size);
+    if (-1 == fd && !fill_exec_cache_(name, aPath, aStat, aUid, aGid))
+        fd = open_exec_cache_(name, aStat->st_size);
+
+    errno = savedErrno;
+
+    return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_EXEC_CACHE_H */
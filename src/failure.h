@@ -0,0 +1,101 @@
+#ifndef SUXEC_FAILURE_H
+#define SUXEC_FAILURE_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* Failure reasons
+ *
+ * Each verification failure is attributed to one of these reasons
+ * so that failures can be counted and traced without parsing the
+ * diagnostic text. Rules that pass report FAILURE_NONE.
+ */
+
+enum failure {
+    FAILURE_NONE,
+    FAILURE_OTHER,
+    FAILURE_USAGE,
+    FAILURE_GROUPLIST,
+    FAILURE_REQUESTOR,
+    FAILURE_SYMLINK,
+    FAILURE_DIRECTORY,
+    FAILURE_LICENSOR,
+    FAILURE_LICENSOR_GROUPLIST,
+    FAILURE_LICENSEE_DIRECTORY,
+    FAILURE_HIDDEN_DIRECTORY,
+    FAILURE_RESTRICTED_DIRECTORY,
+    FAILURE_PARENT,
+    FAILURE_PARENT_GROUP_MODE,
+    FAILURE_PARENT_OTHER_MODE,
+    FAILURE_PARENT_OWNER,
+    FAILURE_SYMLINK_STAT,
+    FAILURE_SYMLINK_OWNER,
+    FAILURE_FOLLOW,
+    FAILURE_PATH,
+    FAILURE_TARGET,
+    FAILURE_TARGET_OWNER,
+    FAILURE_TARGET_MODE,
+    FAILURE_ENVIRONMENT,
+    FAILURE_CHANGED,
+    FAILURE_DIGEST,
+    FAILURES
+};
+
+static const char * const sFailureName[FAILURES] = {
+    [FAILURE_NONE]                 = "none",
+    [FAILURE_OTHER]                = "other",
+    [FAILURE_USAGE]                = "usage",
+    [FAILURE_GROUPLIST]            = "grouplist",
+    [FAILURE_REQUESTOR]            = "requestor",
+    [FAILURE_SYMLINK]              = "symlink",
+    [FAILURE_DIRECTORY]            = "directory",
+    [FAILURE_LICENSOR]             = "licensor",
+    [FAILURE_LICENSOR_GROUPLIST]   = "licensor_grouplist",
+    [FAILURE_LICENSEE_DIRECTORY]   = "licensee_directory",
+    [FAILURE_HIDDEN_DIRECTORY]     = "hidden_directory",
+    [FAILURE_RESTRICTED_DIRECTORY] = "restricted_directory",
+    [FAILURE_PARENT]               = "parent",
+    [FAILURE_PARENT_GROUP_MODE]    = "parent_group_mode",
+    [FAILURE_PARENT_OTHER_MODE]    = "parent_other_mode",
+    [FAILURE_PARENT_OWNER]         = "parent_owner",
+    [FAILURE_SYMLINK_STAT]         = "symlink_stat",
+    [FAILURE_SYMLINK_OWNER]        = "symlink_owner",
+    [FAILURE_FOLLOW]               = "follow",
+    [FAILURE_PATH]                 = "path",
+    [FAILURE_TARGET]               = "target",
+    [FAILURE_TARGET_OWNER]         = "target_owner",
+    [FAILURE_TARGET_MODE]          = "target_mode",
+    [FAILURE_ENVIRONMENT]          = "environment",
+    [FAILURE_CHANGED]              = "changed",
+    [FAILURE_DIGEST]               = "digest",
+};
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_FAILURE_H */
@@ -14,18 +14,18 @@ generate()
 
         WORD=${WORD#@/}
 
-        local REALPATH
-        REALPATH=$(
+        local REALPATH=0
+        [ -n "${OPT_CORPUS++}" ] || REALPATH=\"$(
             set --
             [ "${WORD#/}" != "$WORD" ] || set -- --relative-to .
             realpath -m "$@" "$WORD"
-        )
+        )\"
 
         local SECOND=${WORD#?*/}
         local FIRST=${WORD%%$SECOND}
         local FIRST=${FIRST%/}
 
-        set -- \"$REALPATH\", \"$FIRST\", \"$SECOND\"
+        set -- "$REALPATH", \"$FIRST\", \"$SECOND\"
         printf '    { %-16s %-12s %s },\n' "$@"
 
     else
@@ -40,6 +40,11 @@ generate()
 
 main()
 {
+    # Use -c to generate a corpus for benchmarking. This omits the
+    # expected result, which is slow to compute for deeper levels.
+
+    [ x"${1:-}" != x"-c" ] || { OPT_CORPUS= ; shift ; }
+
     local LEVELS=$1 ; shift
 
     local LEVEL
@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+
+# Generate a table of system call names indexed by number from the
+# definitions visible to the compiler.
+#
+# usage: generate_syscall_names.sh cc [cppflags ...]
+
+set -eu
+
+main()
+{
+    printf '%s\n' '#include <sys/syscall.h>' |
+    "$@" -E -dM - |
+    sed -n -e 's/^#define __NR_\([a-z0-9_]*\) \([0-9][0-9]*\)$/\2 \1/p' |
+    sort -n |
+    awk '
+        BEGIN {
+            print "static const char * const sSyscallName[] = {"
+        }
+        {
+            printf "    [%s] = \"%s\",\n", $1, $2
+        }
+        END {
+            print "};"
+        }'
+}
+
+main "$@"
@@ -0,0 +1,58 @@
+#ifndef SUXEC_IDENTITY_H
+#define SUXEC_IDENTITY_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* -------------------------------------------------------------------------- */
+/* User and group ids
+ *
+ * Wrap the ids in distinct types so that a uid cannot be mistaken
+ * for a gid.
+ */
+
+#include <sys/types.h>
+
+struct uid { uid_t _; };
+struct gid { gid_t _; };
+
+static inline int uid_eq(struct uid aLhs, struct uid aRhs)
+{ return aLhs._ == aRhs._; }
+
+static inline int gid_eq(struct gid aLhs, struct gid aRhs)
+{ return aLhs._ == aRhs._; }
+
+static inline int uid_ne(struct uid aLhs, struct uid aRhs)
+{ return ! uid_eq(aLhs, aRhs); }
+
+static inline int gid_ne(struct gid aLhs, struct gid aRhs)
+{ return ! gid_eq(aLhs, aRhs); }
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_IDENTITY_H */
@@ -0,0 +1,137 @@
+#ifndef SUXEC_INDEX_H
+#define SUXEC_INDEX_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "libsuxec.h"
+#include "mapped.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Registration index
+ *
+ * Hold the verified chain of each registration in a file shared by
+ * all invocations, so that a launch can confirm the chain instead of
+ * following it. The index is maintained by suxec-index, which watches
+ * the registration directories and verifies each registration as it
+ * changes, and is only read by suxec. The file is opened while
+ * privileged, and is only trusted if it is owned by the privileged
+ * user, since each chain vouches for a registration.
+ *
+ * Each chain is keyed by the device, inode, and change time, of the
+ * registration symlink. The change time cannot be set by an unprivileged
+ * user, so any change to the symlink is a different key. Chains are
+ * held in a shared mapped table, so an entry for a registration
+ * replaces any previous entry for the same registration.
+ *
+ * Reading and writing the index are in index_fetch.c.h and
+ * index_store.c.h, so that each program includes only the half
+ * that it uses.
+ */
+
+#ifndef SUXEC_INDEX_PATH
+#define SUXEC_INDEX_PATH "/run/suxec/index"
+#endif
+
+#define INDEX_MAGIC 0x73786978u
+#define INDEX_VERSION 1u
+#define INDEX_CACHELINE 64
+#define INDEX_ENTRIES 1024
+#define INDEX_PROBES 8
+
+#define INDEX_CHAIN_WORDS (SUXEC_CHAIN_SIZE / sizeof(uint64_t))
+
+struct index_key {
+    uint64_t mDev;
+    uint64_t mIno;
+    uint64_t mCtime;
+};
+
+struct index_entry {
+    uint64_t mSeq;
+    struct index_key mKey;
+    uint64_t mChain[INDEX_CHAIN_WORDS];
+} __attribute__((__aligned__(INDEX_CACHELINE)));
+
+struct index {
+    struct mapped_header mHeader
+        __attribute__((__aligned__(INDEX_CACHELINE)));
+
+    struct index_entry mEntries[INDEX_ENTRIES];
+};
+
+static struct index *sIndex;
+
+/* -------------------------------------------------------------------------- */
+static struct index *
+map_index_(unsigned aFlags)
+{
+    /* Each chain vouches for a registration, so the file must belong
+     * to the privileged user, even when only reading it.
+     */
+
+    return map_file(SUXEC_INDEX_PATH, sizeof(struct index),
+        aFlags | MAPPED_TRUSTED, 0600,
+        INDEX_MAGIC, INDEX_VERSION);
+}
+
+/* -------------------------------------------------------------------------- */
+static struct mapped_table
+index_table_(void)
+{
+    return (struct mapped_table) {
+        .mEntries = sIndex->mEntries,
+        .mEntrySize = sizeof(*sIndex->mEntries),
+        .mEntriesLen = INDEX_ENTRIES,
+        .mProbes = INDEX_PROBES,
+        .mKeyWords = sizeof(struct index_key) / sizeof(uint64_t),
+        .mValueWords = INDEX_CHAIN_WORDS,
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+static struct index_key
+key_index_(const struct stat *aRegistration)
+{
+    return (struct index_key) {
+        .mDev = aRegistration->st_dev,
+        .mIno = aRegistration->st_ino,
+        .mCtime =
+            aRegistration->st_ctim.tv_sec * 1000000000ULL +
+            aRegistration->st_ctim.tv_nsec,
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_INDEX_H */
@@ -0,0 +1,82 @@
+#ifndef SUXEC_INDEX_FETCH_H
+#define SUXEC_INDEX_FETCH_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include "index.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Registration index reader
+ *
+ * Used by suxec to find the chain of a registration. The index is
+ * silently disabled if the file does not exist, or if it is not owned
+ * by the privileged user.
+ */
+
+static void
+open_index(void)
+{
+    /* The index is optional, so do not disturb the errno used
+     * by the diagnostics of subsequent failures.
+     */
+
+    int savedErrno = errno;
+    sIndex = map_index_(0);
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fetch_chain(void *aArg, const struct stat *aRegistration, void *aChain)
+{
+    if (!sIndex)
+        return -1;
+
+    struct mapped_table table = index_table_();
+    struct index_key key = key_index_(aRegistration);
+
+    uint64_t chain[INDEX_CHAIN_WORDS];
+
+    if (fetch_mapped_entry(&table, (const uint64_t *) &key, chain))
+        return -1;
+
+    memcpy(aChain, chain, SUXEC_CHAIN_SIZE);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_INDEX_FETCH_H */
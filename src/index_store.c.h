@@ -0,0 +1,80 @@
+#ifndef SUXEC_INDEX_STORE_H
+#define SUXEC_INDEX_STORE_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include "index.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Registration index writer
+ *
+ * Used by suxec-index to publish the chain of each authorised
+ * registration, and to remove the chain of each refused registration.
+ */
+
+static void
+store_chain(void *aArg, const struct stat *aRegistration, const void *aChain)
+{
+    if (!sIndex)
+        return;
+
+    struct mapped_table table = index_table_();
+    struct index_key key = key_index_(aRegistration);
+
+    uint64_t chain[INDEX_CHAIN_WORDS];
+    memcpy(chain, aChain, SUXEC_CHAIN_SIZE);
+
+    store_mapped_entry(&table, (const uint64_t *) &key, chain);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+erase_chain(const struct stat *aRegistration)
+{
+    /* Remove the chain of a registration that is no longer valid,
+     * whatever the change time of the registration.
+     */
+
+    if (!sIndex)
+        return;
+
+    struct mapped_table table = index_table_();
+    struct index_key key = key_index_(aRegistration);
+
+    erase_mapped_entry(&table, (const uint64_t *) &key);
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_INDEX_STORE_H */
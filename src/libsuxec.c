@@ -0,0 +1,3766 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/fsuid.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+
+#include <linux/fsverity.h>
+
+#include "config.h"
+
+#include "finally.h"
+#include "identity.h"
+#include "libsuxec.h"
+#include "pathbuf.h"
+#include "probe.h"
+
+/* -------------------------------------------------------------------------- */
+struct dirfd {
+    int mFd;
+    struct pathbuf mPath;
+};
+
+/* -------------------------------------------------------------------------- */
+/* Follow no more symlinks than the kernel would when resolving a path,
+ * so that a cycle of symlinks cannot be followed indefinitely.
+ */
+
+#define SYMLINK_HOPS_MAX 40
+
+struct symlinkfd {
+    int mFd;
+    unsigned mHops;
+    struct stat mStat;
+    struct pathview mName;
+    struct pathbuf mLink;
+    struct dirfd mDir;
+};
+
+/* -------------------------------------------------------------------------- */
+struct grouplist {
+    gid_t *mList;
+    size_t mSize;
+};
+
+/* -------------------------------------------------------------------------- */
+struct user {
+    struct uid mUid;
+    struct gid mGid;
+
+    char *mName;
+    char *mHome;
+
+    struct grouplist mGroups_, *mGroups;
+};
+
+/* -------------------------------------------------------------------------- */
+/* Identity of each object interrogated during verification, so that
+ * a verified license can later be revalidated without repeating the
+ * rules. The paths are held back to back in a single buffer. Only
+ * the path to the target is allowed to trigger an automount.
+ */
+
+struct pin {
+    size_t mPath;
+    int mFlags;
+    int mConfirm;
+    struct stat mStat;
+};
+
+/* -------------------------------------------------------------------------- */
+struct suxec_license_state {
+    struct grouplist mGroups_, *mGroups;
+
+    struct user mRequestor_, *mRequestor;
+    struct user mLicensor_, *mLicensor;
+
+    struct symlinkfd mSymLink_, *mSymLink;
+
+    struct pathbuf mPath;
+    int mVerified;
+
+    struct pin *mPins;
+    size_t mPinsLen;
+    char *mPinPaths;
+    size_t mPinPathsLen;
+
+    char **mEnv;
+};
+
+/* -------------------------------------------------------------------------- */
+/* Caller context
+ *
+ * The context of the caller is held by each thread for the duration
+ * of a call into the library, so that debugging output and events
+ * reach the caller without the need for any process wide state.
+ */
+
+static __thread const struct suxec_context *sContext;
+
+static const struct suxec_context *
+enter_context_(const struct suxec_context *aContext)
+{
+    const struct suxec_context *context = sContext;
+
+    sContext = aContext;
+
+    return context;
+}
+
+static void
+leave_context_(const struct suxec_context *aContext)
+{
+    sContext = aContext;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+debug_(const char *aFmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void
+debug_(const char *aFmt, ...)
+{
+    va_list argp;
+
+    va_start(argp, aFmt);
+    sContext->mDebug(sContext->mArg, aFmt, argp);
+    va_end(argp);
+}
+
+#define IFDEBUG(...) \
+    if (!sContext || !sContext->mDebug) ; else do __VA_ARGS__ while (0)
+
+#define DEBUG(...) \
+    IFDEBUG({ debug_(__VA_ARGS__); })
+
+/* -------------------------------------------------------------------------- */
+static void
+notify_(enum suxec_event aEvent, const struct stat *aStat)
+{
+    if (sContext && sContext->mEvent)
+        sContext->mEvent(sContext->mArg, aEvent, aStat);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+refuse_(
+    struct suxec_license *self, enum failure aFailure, const char *aFmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void
+refuse_(
+    struct suxec_license *self, enum failure aFailure, const char *aFmt, ...)
+{
+    int err = errno;
+
+    va_list argp;
+
+    va_start(argp, aFmt);
+    vsnprintf(self->mMessage, sizeof(self->mMessage), aFmt, argp);
+    va_end(argp);
+
+    self->mFailure = aFailure;
+    self->mErrno = err;
+
+    errno = err;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Attribute fetching
+ *
+ * Attributes are fetched using statx(2), requesting only the fields
+ * used by the rules, so that a network file system need not refresh
+ * the others. Each fetch that could require a round trip to the file
+ * server is counted for the thread performing the verification.
+ */
+
+#define FETCH_PIN_MASK \
+    (STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | \
+     STATX_INO | STATX_CTIME)
+
+#define FETCH_TARGET_MASK (FETCH_PIN_MASK | STATX_SIZE | STATX_MTIME)
+
+static __thread unsigned sRoundTrips;
+
+static int
+lazy_sync_(void)
+{
+    return sContext && (sContext->mFlags & SUXEC_DONT_SYNC)
+        ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT;
+}
+
+static int
+fetch_stat_(
+    int aDirFd, const char *aName, int aFlags, unsigned aMask,
+    struct stat *aStat)
+{
+    if (AT_STATX_DONT_SYNC != (aFlags & AT_STATX_SYNC_TYPE))
+        ++sRoundTrips;
+
+    struct statx stx;
+    if (statx(aDirFd, aName, aFlags, aMask, &stx))
+        return -1;
+
+    *aStat = (struct stat) {
+        .st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor),
+        .st_ino = stx.stx_ino,
+        .st_mode = stx.stx_mode,
+        .st_nlink = stx.stx_nlink,
+        .st_uid = stx.stx_uid,
+        .st_gid = stx.stx_gid,
+        .st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor),
+        .st_size = stx.stx_size,
+        .st_blksize = stx.stx_blksize,
+        .st_blocks = stx.stx_blocks,
+        .st_atim = { stx.stx_atime.tv_sec, stx.stx_atime.tv_nsec },
+        .st_mtim = { stx.stx_mtime.tv_sec, stx.stx_mtime.tv_nsec },
+        .st_ctim = { stx.stx_ctime.tv_sec, stx.stx_ctime.tv_nsec },
+    };
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_stat_(const struct stat *aExpected, const struct stat *aStat)
+{
+    if (aExpected->st_dev != aStat->st_dev ||
+            aExpected->st_ino != aStat->st_ino ||
+            aExpected->st_mode != aStat->st_mode ||
+            aExpected->st_uid != aStat->st_uid ||
+            aExpected->st_gid != aStat->st_gid)
+        return 0;
+
+    if (!S_ISDIR(aExpected->st_mode) && (
+            aExpected->st_ctim.tv_sec != aStat->st_ctim.tv_sec ||
+            aExpected->st_ctim.tv_nsec != aStat->st_ctim.tv_nsec))
+        return 0;
+
+    return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* String operations
+ *
+ * The implementations are separated to allow for a comprehensive unit tests
+ * to cover the different cases of dot and dot-dot directories, and
+ * their interaction with absolute and relative paths.
+ */
+
+#include "split_path.c.h"
+#include "splice_path.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* User and group database
+ *
+ * A statically linked program cannot load NSS modules at runtime,
+ * so that build uses a files-only database. This also avoids the
+ * cost of loading the modules on the first query. Each lookup
+ * returns its result in storage provided by the caller.
+ */
+
+#ifdef USE_NSS_FILES
+#include "nss_files.c.h"
+#endif
+
+static struct passwd *
+lookup_pwuid(struct uid aUid, struct passwd *aPasswd, char **aBuf)
+{
+#ifdef USE_NSS_FILES
+    return nss_files_getpwuid_r(aUid._, aPasswd, aBuf);
+#else
+    struct passwd *pw = 0;
+
+    /* Grow the buffer until the entry fits. As with getpwuid(3),
+     * errno is cleared if there is no entry for the uid.
+     */
+
+    for (size_t bufLen = 1024; ; bufLen *= 2) {
+        char *buf = realloc(*aBuf, bufLen);
+        if (!buf)
+            break;
+        *aBuf = buf;
+
+        int err = getpwuid_r(aUid._, aPasswd, buf, bufLen, &pw);
+        if (ERANGE != err) {
+            errno = err;
+            break;
+        }
+    }
+
+    return pw;
+#endif
+}
+
+static int
+lookup_grouplist(const char *aName, struct gid aGid, gid_t *aList, int *aLen)
+{
+#ifdef USE_NSS_FILES
+    return nss_files_getgrouplist(aName, aGid._, aList, aLen);
+#else
+    return getgrouplist(aName, aGid._, aList, aLen);
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fdclose(int aFd)
+{
+    if (-1 != aFd)
+        close(aFd);
+
+    return -1;
+}
+
+/* ************************************************************************** */
+static int
+create_grouplist_rank_gid_(const void *aLhs, const void *aRhs)
+{
+    struct gid lhs = (struct gid) { * (const gid_t *) aLhs };
+    struct gid rhs = (struct gid) { * (const gid_t *) aRhs };
+
+    return lhs._ == rhs._ ? 0 : lhs._ < rhs._ ? -1 : +1;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct grouplist *
+close_grouplist(struct grouplist *self) __attribute__((unused));
+
+static struct grouplist *
+create_grouplist(struct grouplist *self)
+{
+    int rc = -1;
+
+    gid_t *groupList = 0;
+    size_t groupListLen = 0;
+
+    /* Find the supplementary groups that the process already belongs
+     * to in order to compare with the target set of supplementary
+     * groups.
+     *
+     * This is useful when running as an unprivileged process, especially
+     * during unit test, where the process is already has the correct
+     * supplementary groups.
+     */
+
+    for (int groupBufLen = 1; !groupList; ) {
+
+        gid_t groupBuf[groupBufLen];
+
+        groupListLen = getgroups(groupBufLen, groupBuf);
+        if (-1 == groupListLen) {
+            if (EINVAL != errno)
+                goto Finally;
+
+            groupBufLen *= 2;
+
+            if (0 >= groupBufLen) {
+                errno = ENOMEM;
+                goto Finally;
+            }
+
+            continue;
+        }
+
+        groupBufLen = groupListLen;
+
+        /* Unfortunately the primary gid might not be present in the
+         * return list. Search for it, and insert it if it is absent.
+         */
+
+        struct gid primaryGid_ = { getgid() }, *primaryGid = &primaryGid_;
+
+        for (size_t gx = 0; gx < groupBufLen; ++gx) {
+            if (gid_eq((struct gid) { groupBuf[gx] }, *primaryGid)) {
+                primaryGid = 0;
+                break;
+            }
+        }
+
+        if (primaryGid)
+            ++groupListLen;
+
+        groupList = malloc(sizeof(*groupList) * groupListLen);
+        if (!groupList)
+            goto Finally;
+
+        memcpy(groupList, groupBuf, sizeof(*groupBuf) * groupBufLen);
+
+        if (primaryGid)
+            groupList[groupBufLen] = primaryGid->_;
+    }
+
+    qsort(
+        groupList, groupListLen, sizeof(*groupList),
+        create_grouplist_rank_gid_);
+
+    self->mSize = groupListLen;
+
+    self->mList = groupList;
+    groupList = 0;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        free(groupList);
+    });
+
+    return rc ? 0 : self;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct grouplist *
+create_grouplist_user(
+    struct grouplist *self, const char *aName, struct gid aGid)
+{
+    int rc = -1;
+
+    gid_t *groupList = 0;
+    size_t groupListLen = 0;
+
+    /* Find the supplementary groups required for the target user.
+     * Comapre this list with the supplementary groups bound
+     * to the process, and only attempt to configure the groups
+     * if required.
+     */
+
+    for (int groupBufLen = 1; !groupList; ) {
+
+        gid_t groupBuf[groupBufLen];
+
+        groupListLen = groupBufLen;
+
+        if (-1 == lookup_grouplist(aName, aGid, groupBuf, &groupBufLen)) {
+
+            if (groupListLen == groupBufLen)
+                goto Finally;
+
+            continue;
+        }
+
+        groupListLen = groupBufLen;
+        groupList = malloc(sizeof(*groupList) * groupListLen);
+        if (!groupList)
+            goto Finally;
+
+        memcpy(groupList, groupBuf, sizeof(*groupBuf) * groupListLen);
+    }
+
+    qsort(
+        groupList, groupListLen, sizeof(*groupList),
+        create_grouplist_rank_gid_);
+
+    PROBE(grouplist, aName, aGid._, groupListLen);
+
+    self->mSize = groupListLen;
+
+    self->mList = groupList;
+    groupList = 0;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        free(groupList);
+    });
+
+    return rc ? 0 : self;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct grouplist *
+close_grouplist(struct grouplist *self)
+{
+    if (self) {
+        free(self->mList);
+    }
+
+    return 0;
+}
+
+/* ************************************************************************** */
+static struct user *
+close_user(struct user *self) __attribute__((unused));
+
+static struct user *
+create_user(struct user *self, struct uid aUid, struct gid aGid)
+{
+    int rc = -1;
+
+    char *name = 0;
+    char *home = 0;
+
+    char *passwdBuf = 0;
+
+    self->mUid = (struct uid) { -1 };
+    self->mGid = (struct gid) { -1 };
+    self->mName = 0;
+    self->mHome = 0;
+
+    self->mGroups = 0;
+
+    struct passwd passwd;
+    struct passwd *pw = lookup_pwuid(aUid, &passwd, &passwdBuf);
+    if (!pw)
+        goto Finally;
+
+    /* If the caller passes -1 as the gid, then use struct passwd
+     * as the source for both uid and gid, otherwise prefer the
+     * uid and gid passed in from the caller.
+     */
+
+    if (-1 == aGid._) {
+        self->mUid = (struct uid) { pw->pw_uid };
+        self->mGid = (struct gid) { pw->pw_gid };
+    } else {
+        self->mUid = aUid;
+        self->mGid = aGid;
+    }
+
+    name = strdup(pw->pw_name);
+    if (!name)
+        goto Finally;
+
+    home = strdup(pw->pw_dir);
+    if (!home)
+        goto Finally;
+
+    self->mName = name;
+    name = 0;
+
+    self->mHome = home;
+    home = 0;
+
+    PROBE(user, self->mUid._, self->mGid._, self->mName);
+
+    rc = 0;
+
+Finally:
+
+    if (rc)
+        PROBE(user__error, aUid._, errno);
+
+    FINALLY({
+        free(home);
+        free(name);
+        free(passwdBuf);
+    });
+
+    return rc ? 0 : self;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fetch_user_groups(struct user *self)
+{
+    int rc = -1;
+
+    if (!self->mGroups) {
+        self->mGroups = create_grouplist_user(
+            &self->mGroups_, self->mName, self->mGid);
+        if (!self->mGroups)
+            goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct user *
+close_user(struct user *self)
+{
+    if (self) {
+        free(self->mName);
+        free(self->mHome);
+
+        close_grouplist(self->mGroups);
+    }
+
+    return 0;
+}
+
+/* ************************************************************************** */
+static struct dirfd *
+close_dirfd(struct dirfd *self);
+
+static struct dirfd *
+create_dirfd(struct dirfd *self)
+{
+    self->mFd = -1;
+    create_pathbuf(&self->mPath);
+
+    return self;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+change_dirfd(struct dirfd *self, struct pathview aPath)
+{
+    int rc = -1;
+
+    int dirFd = -1;
+
+    if (!aPath.mLen) {
+        errno = EINVAL;
+        goto Finally;
+    }
+
+    /* Open a file descriptor to the directory relative to the
+     * current directory, and then update the name of the directory
+     * in place. An absolute path replaces the name, otherwise
+     * splice the name together. The path must be nul terminated.
+     */
+
+    dirFd = openat(
+        -1 == self->mFd ? AT_FDCWD : self->mFd,
+        aPath.mPtr,
+        O_RDONLY | O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (-1 == dirFd)
+        goto Finally;
+
+    if (reserve_pathbuf(
+            &self->mPath, self->mPath.mLen + sizeof("/") + aPath.mLen))
+        goto Finally;
+
+    if ('/' == *aPath.mPtr)
+        self->mPath.mLen = 0;
+
+    if (append_path(&self->mPath, aPath))
+        goto Finally;
+
+    DEBUG("Directory %s", self->mPath.mBuf);
+
+    fdclose(self->mFd);
+
+    self->mFd = dirFd;
+    dirFd = -1;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        dirFd = fdclose(dirFd);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct dirfd *
+close_dirfd(struct dirfd *self)
+{
+    if (self) {
+        fdclose(self->mFd);
+        close_pathbuf(&self->mPath);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Automount detection
+ *
+ * Following a symlink must mount any automounted directory that
+ * the chain passes through, but other checks avoid triggering
+ * mounts. When debugging, the mounts visible to the process are
+ * counted before and after each directory is opened, so that the
+ * hop that caused a mount can be reported.
+ */
+
+static int
+count_mounts_(void)
+{
+    int rc = -1;
+
+    int fd = -1;
+    int mounts = 0;
+
+    fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+        goto Finally;
+
+    while (1) {
+        char buf[4096];
+
+        ssize_t bufLen = read(fd, buf, sizeof(buf));
+        if (-1 == bufLen) {
+            if (EINTR == errno)
+                continue;
+            goto Finally;
+        }
+
+        if (!bufLen)
+            break;
+
+        for (ssize_t bx = 0; bx < bufLen; ++bx)
+            mounts += '\n' == buf[bx];
+    }
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        fd = fdclose(fd);
+    });
+
+    return rc ? -1 : mounts;
+}
+
+/* ************************************************************************** */
+static struct symlinkfd *
+close_symlinkfd(struct symlinkfd *self);
+
+static int
+open_symlinkfd_(struct symlinkfd *self)
+{
+    int rc = -1;
+
+    int symlinkFd = -1;
+
+    struct pathview dirName;
+    struct pathview baseName;
+
+    /* Split the path held in the link buffer, and terminate both
+     * names in place to avoid copying them. The directory name
+     * is either a literal, or is followed by a slash that can be
+     * overwritten.
+     */
+
+    if (split_path(pathview_buf(&self->mLink), &dirName, &baseName))
+        goto Finally;
+
+    if (self->mLink.mBuf <= dirName.mPtr &&
+            dirName.mPtr < self->mLink.mBuf + self->mLink.mLen)
+        self->mLink.mBuf[dirName.mPtr - self->mLink.mBuf + dirName.mLen] = 0;
+
+    self->mLink.mBuf[baseName.mPtr - self->mLink.mBuf + baseName.mLen] = 0;
+
+    /* The directory holding the next symlink must be searched, so
+     * opening it mounts any automounted directory along the way.
+     * The symlink itself is opened without O_DIRECTORY, so that
+     * an automount point in its place is not mounted.
+     */
+
+    int mounts = -1;
+    IFDEBUG({ mounts = count_mounts_(); });
+
+    if (change_dirfd(&self->mDir, dirName))
+        goto Finally;
+
+    IFDEBUG({
+        if (-1 != mounts && mounts < count_mounts_())
+            DEBUG("Hop %u mounted %s", self->mHops, self->mDir.mPath.mBuf);
+    });
+
+    symlinkFd = openat(
+        self->mDir.mFd,
+        baseName.mPtr, O_RDONLY | O_PATH | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == symlinkFd)
+        goto Finally;
+
+    fdclose(self->mFd);
+
+    self->mFd = symlinkFd;
+    symlinkFd = -1;
+
+    self->mName = baseName;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        symlinkFd = fdclose(symlinkFd);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct symlinkfd *
+create_symlinkfd(struct symlinkfd *self, const char *aPath)
+{
+    int rc = -1;
+
+    self->mFd = -1;
+    self->mHops = 0;
+    self->mName = (struct pathview) { "", 0 };
+
+    create_pathbuf(&self->mLink);
+    create_dirfd(&self->mDir);
+
+    if (assign_pathbuf(&self->mLink, pathview_cstr(aPath)))
+        goto Finally;
+
+    if (open_symlinkfd_(self))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (rc)
+            close_symlinkfd(self);
+    });
+
+    return rc ? 0 : self;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct symlinkfd *
+create_symlinkfd_at(
+    struct symlinkfd *self, const struct dirfd *aDir, struct pathview aName)
+{
+    int rc = -1;
+
+    self->mFd = -1;
+    self->mHops = 0;
+    self->mName = (struct pathview) { "", 0 };
+
+    create_pathbuf(&self->mLink);
+    create_dirfd(&self->mDir);
+
+    /* Open the name in a directory already opened by the caller, so
+     * that the symlink is found in the same directory that the caller
+     * interrogated. The name must not contain a slash.
+     */
+
+    self->mDir.mFd = fcntl(aDir->mFd, F_DUPFD_CLOEXEC, 0);
+    if (-1 == self->mDir.mFd)
+        goto Finally;
+
+    if (assign_pathbuf(&self->mDir.mPath, pathview_buf(&aDir->mPath)))
+        goto Finally;
+
+    if (assign_pathbuf(&self->mLink, aName))
+        goto Finally;
+
+    self->mFd = openat(
+        self->mDir.mFd,
+        self->mLink.mBuf, O_RDONLY | O_PATH | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == self->mFd)
+        goto Finally;
+
+    self->mName = pathview_buf(&self->mLink);
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (rc)
+            close_symlinkfd(self);
+    });
+
+    return rc ? 0 : self;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+read_symlinkfd(struct symlinkfd *self)
+{
+    int rc = -1;
+
+    /* Read the content of the symlink into the link buffer, growing
+     * the buffer until the content fits.
+     */
+
+    if (reserve_pathbuf(&self->mLink, 0))
+        goto Finally;
+
+    while (1) {
+        ssize_t symlinkLen = readlinkat(
+            self->mFd, "", self->mLink.mBuf, self->mLink.mSize);
+        if (-1 == symlinkLen)
+            goto Finally;
+
+        if (symlinkLen < self->mLink.mSize) {
+            self->mLink.mBuf[symlinkLen] = 0;
+            self->mLink.mLen = symlinkLen;
+            break;
+        }
+
+        if (reserve_pathbuf(&self->mLink, self->mLink.mSize))
+            goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+follow_symlinkfd(struct symlinkfd *self)
+{
+    int rc = -1;
+
+    /* Only the target of the chain is trusted, so the attributes
+     * of each hop can be those cached by the file system.
+     */
+
+    if (fetch_stat_(
+            self->mFd, "",
+            AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW | lazy_sync_(),
+            FETCH_PIN_MASK, &self->mStat))
+        goto Finally;
+
+    if (!S_ISLNK(self->mStat.st_mode)) {
+
+        errno = 0;
+        goto Finally;
+
+    }
+
+    DEBUG("Follow %s/%s", self->mDir.mPath.mBuf, self->mName.mPtr);
+
+    if (SYMLINK_HOPS_MAX <= self->mHops) {
+
+        errno = ELOOP;
+        goto Finally;
+
+    }
+
+    ++self->mHops;
+    PROBE(follow, self->mHops, self->mDir.mPath.mBuf, self->mName.mPtr);
+
+    /* Resolve the symlink in place, reusing the link buffer to hold
+     * the content of the symlink, and the directory to hold the
+     * location of the resolved name.
+     */
+
+    self->mName = (struct pathview) { "", 0 };
+
+    if (read_symlinkfd(self))
+        goto Finally;
+
+    self->mName = pathview_buf(&self->mLink);
+
+    if (open_symlinkfd_(self))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    if (rc && errno)
+        PROBE(follow__error, self->mHops, errno);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct symlinkfd *
+close_symlinkfd(struct symlinkfd *self)
+{
+    if (self) {
+        fdclose(self->mFd);
+        close_pathbuf(&self->mLink);
+
+        close_dirfd(&self->mDir);
+    }
+
+    return 0;
+}
+
+/* ************************************************************************** */
+/* Registration rules
+ *
+ * Each rule returns the reason that a registration is refused, or
+ * FAILURE_NONE if the registration satisfies the rule. The rules are
+ * shared by the launch path and by the audit of a registration
+ * directory.
+ */
+
+static enum failure
+check_licensee_dir(const char *aName)
+{
+    if ('.' == *aName)
+        return FAILURE_HIDDEN_DIRECTORY;
+
+    if ('@' == *aName)
+        return FAILURE_RESTRICTED_DIRECTORY;
+
+    return FAILURE_NONE;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+check_parent_dir(mode_t aMode, struct uid aOwner, struct uid aLicensor)
+{
+    if (aMode & (S_IRGRP|S_IWGRP))
+        return FAILURE_PARENT_GROUP_MODE;
+
+    if (aMode & (S_IROTH|S_IWOTH))
+        return FAILURE_PARENT_OTHER_MODE;
+
+    if (uid_ne(aOwner, aLicensor))
+        return FAILURE_PARENT_OWNER;
+
+    return FAILURE_NONE;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+check_target(mode_t aMode, struct uid aOwner, struct uid aLicensor)
+{
+    if (uid_ne(aOwner, aLicensor))
+        return FAILURE_TARGET_OWNER;
+
+    if (!S_ISREG(aMode) || !(aMode & S_IXUSR))
+        return FAILURE_TARGET_MODE;
+
+    return FAILURE_NONE;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+readahead_target_(const char *aPath)
+{
+    /* Start reading the target into the page cache, so that the
+     * reads overlap the remaining checks and the switch of identity.
+     * The target is only opened once the rules have confirmed that
+     * it is a regular file, and is opened without blocking in case
+     * it has since been replaced. A target that cannot be read by
+     * the requestor is simply not read ahead.
+     */
+
+    int fd = open(aPath,
+        O_RDONLY | O_NONBLOCK | O_NOCTTY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == fd)
+        return;
+
+    int err = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+
+    DEBUG("Read ahead %s %s", aPath, err ? strerror(err) : "started");
+
+    close(fd);
+}
+
+/* ************************************************************************** */
+/* Digest pins
+ *
+ * A licensor can pin the content of the target of a registration by
+ * recording its digest in an extended attribute of the licensee
+ * directory, named for the registration. Only the licensor can write
+ * the attribute, and the attribute is read through the directory
+ * already opened so that it cannot be substituted.
+ *
+ * A pin is either the SHA-256 digest of the content of the target, or
+ * the fs-verity measurement of the target. The fs-verity measurement
+ * is maintained by the kernel, so is cheap to obtain. The SHA-256
+ * digest must be computed by reading the target, so the result is
+ * offered to the caller to cache, keyed by the identity, size, and
+ * modification and change times, of the target.
+ */
+
+#include "sha256.c.h"
+
+#define DIGEST_PIN_XATTR "user.suxec.digest."
+#define DIGEST_SHA256_PREFIX "sha256:"
+#define DIGEST_FSVERITY_PREFIX "fsverity:"
+
+#define DIGEST_READ_SIZE (64 * 1024)
+
+enum digest_pin_kind {
+    DIGEST_PIN_NONE,
+    DIGEST_PIN_SHA256,
+    DIGEST_PIN_FSVERITY,
+};
+
+struct digest_pin {
+    enum digest_pin_kind mKind;
+    unsigned char mDigest[SUXEC_DIGEST_SIZE];
+};
+
+/* -------------------------------------------------------------------------- */
+static int
+parse_digest_pin_(
+    struct digest_pin *self, const char *aValue, size_t aLen)
+{
+    /* The value is a prefix naming the kind of digest, followed by
+     * the digest in hexadecimal.
+     */
+
+    if (aLen < 2 * SUXEC_DIGEST_SIZE)
+        return -1;
+
+    size_t prefixLen = aLen - 2 * SUXEC_DIGEST_SIZE;
+
+    if (prefixLen == sizeof(DIGEST_SHA256_PREFIX) - 1 &&
+            !memcmp(aValue, DIGEST_SHA256_PREFIX, prefixLen))
+        self->mKind = DIGEST_PIN_SHA256;
+    else if (prefixLen == sizeof(DIGEST_FSVERITY_PREFIX) - 1 &&
+            !memcmp(aValue, DIGEST_FSVERITY_PREFIX, prefixLen))
+        self->mKind = DIGEST_PIN_FSVERITY;
+    else
+        return -1;
+
+    for (size_t dx = 0; dx < 2 * SUXEC_DIGEST_SIZE; ++dx) {
+        char hex = aValue[prefixLen + dx];
+
+        unsigned nibble;
+        if ('0' <= hex && hex <= '9')
+            nibble = hex - '0';
+        else if ('a' <= hex && hex <= 'f')
+            nibble = hex - 'a' + 10;
+        else if ('A' <= hex && hex <= 'F')
+            nibble = hex - 'A' + 10;
+        else
+            return -1;
+
+        if (dx % 2)
+            self->mDigest[dx / 2] |= nibble;
+        else
+            self->mDigest[dx / 2] = nibble << 4;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+read_digest_pin_(
+    struct digest_pin *self, const char *aDirPath, const char *aName)
+{
+    self->mKind = DIGEST_PIN_NONE;
+
+    /* A registration whose name is too long to form the name of an
+     * attribute cannot be pinned.
+     */
+
+    char name[XATTR_NAME_MAX + 1];
+    if (sizeof(name) <= (size_t) snprintf(
+            name, sizeof(name), "%s%s", DIGEST_PIN_XATTR, aName))
+        return FAILURE_NONE;
+
+    char value[sizeof(DIGEST_FSVERITY_PREFIX) + 2 * SUXEC_DIGEST_SIZE];
+
+    ssize_t valueLen = getxattr(aDirPath, name, value, sizeof(value));
+    if (-1 == valueLen) {
+        if (ENODATA == errno || ENOTSUP == errno)
+            return FAILURE_NONE;
+        return FAILURE_DIGEST;
+    }
+
+    if (parse_digest_pin_(self, value, valueLen)) {
+        errno = EINVAL;
+        return FAILURE_DIGEST;
+    }
+
+    DEBUG("Digest pin %.*s", (int) valueLen, value);
+
+    return FAILURE_NONE;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+read_digest_pin(struct digest_pin *self, const struct symlinkfd *aSymLink)
+{
+    /* The symlink must not yet have been followed, so that it names
+     * the registration in the licensee directory. The descriptor of the
+     * directory is opened with O_PATH, which precludes fgetxattr(2),
+     * so read the attribute through the descriptor in procfs instead.
+     */
+
+    char dirPath[sizeof("/proc/self/fd/") + sizeof(int) * 3];
+    snprintf(dirPath, sizeof(dirPath), "/proc/self/fd/%d", aSymLink->mDir.mFd);
+
+    return read_digest_pin_(self, dirPath, aSymLink->mName.mPtr);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_digest_stat_(const struct stat *aLhs, const struct stat *aRhs)
+{
+    return
+        aLhs->st_dev == aRhs->st_dev &&
+        aLhs->st_ino == aRhs->st_ino &&
+        aLhs->st_size == aRhs->st_size &&
+        aLhs->st_mtim.tv_sec == aRhs->st_mtim.tv_sec &&
+        aLhs->st_mtim.tv_nsec == aRhs->st_mtim.tv_nsec &&
+        aLhs->st_ctim.tv_sec == aRhs->st_ctim.tv_sec &&
+        aLhs->st_ctim.tv_nsec == aRhs->st_ctim.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+measure_fsverity_(int aFd, unsigned char *aDigest)
+{
+    int rc = -1;
+
+    struct {
+        struct fsverity_digest mHeader;
+        unsigned char mDigest[SUXEC_DIGEST_SIZE];
+    } measurement = {
+        .mHeader.digest_size = SUXEC_DIGEST_SIZE,
+    };
+
+    if (ioctl(aFd, FS_IOC_MEASURE_VERITY, &measurement))
+        goto Finally;
+
+    if (FS_VERITY_HASH_ALG_SHA256 != measurement.mHeader.digest_algorithm ||
+            SUXEC_DIGEST_SIZE != measurement.mHeader.digest_size) {
+        errno = EINVAL;
+        goto Finally;
+    }
+
+    memcpy(aDigest, measurement.mDigest, SUXEC_DIGEST_SIZE);
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+compute_sha256_(int aFd, unsigned char *aDigest)
+{
+    int rc = -1;
+
+    char *buf = malloc(DIGEST_READ_SIZE);
+    if (!buf)
+        goto Finally;
+
+    struct sha256 sha256;
+    create_sha256(&sha256);
+
+    while (1) {
+        ssize_t bufLen = read(aFd, buf, DIGEST_READ_SIZE);
+        if (-1 == bufLen) {
+            if (EINTR == errno)
+                continue;
+            goto Finally;
+        }
+
+        if (!bufLen)
+            break;
+
+        update_sha256(&sha256, buf, bufLen);
+    }
+
+    finish_sha256(&sha256, aDigest);
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        free(buf);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+check_digest_pin(
+    const struct digest_pin *self, const char *aPath, const struct stat *aStat)
+{
+    enum failure failure = FAILURE_NONE;
+
+    int fd = -1;
+
+    if (DIGEST_PIN_NONE == self->mKind)
+        goto Finally;
+
+    unsigned char digest[SUXEC_DIGEST_SIZE];
+
+    /* A cached digest of the content saves opening the target, so
+     * the cost is only the stat(2) already made of the target.
+     */
+
+    if (DIGEST_PIN_SHA256 == self->mKind &&
+            sContext && sContext->mFetchDigest &&
+            !sContext->mFetchDigest(sContext->mArg, aStat, digest)) {
+        DEBUG("Cached digest for %s", aPath);
+        goto Match;
+    }
+
+    failure = FAILURE_DIGEST;
+
+    fd = open(aPath, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == fd)
+        goto Finally;
+
+    /* Only compute the digest of the target that was verified, and
+     * not of a replacement.
+     */
+
+    struct stat fdStat;
+    if (fstat(fd, &fdStat))
+        goto Finally;
+
+    if (!match_digest_stat_(&fdStat, aStat)) {
+        errno = 0;
+        goto Finally;
+    }
+
+    if (DIGEST_PIN_FSVERITY == self->mKind) {
+        if (measure_fsverity_(fd, digest))
+            goto Finally;
+    } else {
+        DEBUG("Computing digest for %s", aPath);
+
+        if (compute_sha256_(fd, digest))
+            goto Finally;
+
+        if (fstat(fd, &fdStat))
+            goto Finally;
+
+        if (!match_digest_stat_(&fdStat, aStat)) {
+            errno = 0;
+            goto Finally;
+        }
+
+        if (sContext && sContext->mStoreDigest)
+            sContext->mStoreDigest(sContext->mArg, aStat, digest);
+    }
+
+Match:
+
+    failure = FAILURE_DIGEST;
+    if (memcmp(digest, self->mDigest, SUXEC_DIGEST_SIZE)) {
+        errno = 0;
+        goto Finally;
+    }
+
+    failure = FAILURE_NONE;
+
+Finally:
+
+    FINALLY({
+        if (-1 != fd) {
+            int err = errno;
+            close(fd);
+            errno = err;
+        }
+    });
+
+    return failure;
+}
+
+/* ************************************************************************** */
+/* Worker pool
+ *
+ * Start one worker for each processor, but no more than are useful,
+ * and let the calling thread serve as one of the workers. Fewer
+ * workers are used if threads cannot be created. Each worker takes
+ * items until none remain.
+ */
+
+#define POOL_WORKERS_MAX 16
+
+static void
+run_pool_(
+    const char *aWork, size_t aItems, void *(*aWorker)(void *), void *aArg)
+{
+    pthread_t workers[POOL_WORKERS_MAX];
+    size_t workersLen = 0;
+
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    size_t workersMax = processors > 1 ? processors : 1;
+    if (workersMax > POOL_WORKERS_MAX)
+        workersMax = POOL_WORKERS_MAX;
+    if (workersMax > aItems)
+        workersMax = aItems;
+
+    while (workersLen + 1 < workersMax) {
+        if (pthread_create(&workers[workersLen], 0, aWorker, aArg))
+            break;
+        ++workersLen;
+    }
+
+    DEBUG("%s %zu registrations with %zu workers",
+        aWork, aItems, workersLen + 1);
+
+    aWorker(aArg);
+
+    while (workersLen)
+        pthread_join(workers[--workersLen], 0);
+}
+
+/* ************************************************************************** */
+/* Registration audit
+ *
+ * Walk a registration directory, and apply the registration rules to
+ * every entry in each licensee subdirectory without executing anything.
+ * The directories are listed, and the licensors resolved, by the calling
+ * thread so that each licensor is only looked up once. The symlink
+ * chains are then followed concurrently by a pool of threads.
+ *
+ * The audit uses the credentials of the caller, so each chain is
+ * followed with the permissions of the caller rather than those of
+ * the licensee.
+ * Because the owner of each symlink is the licensee that could use it,
+ * the ownership of the symlink is not checked.
+ */
+
+struct review_licensee {
+    char *mName;
+    struct pathbuf mPath;
+    struct uid mLicensor;
+    enum failure mLicensorFailure;
+    enum failure mFailure;
+};
+
+struct review_registration {
+    size_t mLicensee;
+    char *mName;
+    enum failure mVerdict;
+};
+
+struct review {
+    const struct suxec_context *mContext;
+
+    struct statx mDirStat;
+
+    struct review_licensee *mLicensees;
+    size_t mLicenseesLen;
+
+    struct review_registration *mRegistrations;
+    size_t mRegistrationsLen;
+    size_t mRegistrationsSize;
+
+    size_t mNext;
+};
+
+/* -------------------------------------------------------------------------- */
+static int
+read_review_dir_(
+    struct review *self, int aDirFd,
+    int (*aVisit)(struct review *, int, const struct dirent64 *))
+{
+    int rc = -1;
+
+    union {
+        struct dirent64 mEntry;
+        char mBuf[32768];
+    } entries;
+
+    /* Read the directory in large batches to amortise the cost of
+     * each system call across many entries.
+     */
+
+    while (1) {
+        ssize_t entriesLen = getdents64(
+            aDirFd, entries.mBuf, sizeof(entries.mBuf));
+        if (-1 == entriesLen)
+            goto Finally;
+
+        if (!entriesLen)
+            break;
+
+        for (ssize_t ex = 0; ex < entriesLen; ) {
+            const struct dirent64 *entry = (const void *) &entries.mBuf[ex];
+
+            ex += entry->d_reclen;
+
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            if (aVisit(self, aDirFd, entry))
+                goto Finally;
+        }
+    }
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+visit_review_registration_(
+    struct review *self, int aDirFd, const struct dirent64 *aEntry)
+{
+    int rc = -1;
+
+    if (self->mRegistrationsLen == self->mRegistrationsSize) {
+        size_t size = self->mRegistrationsSize
+            ? 2 * self->mRegistrationsSize : 64;
+
+        struct review_registration *registrations = realloc(
+            self->mRegistrations, size * sizeof(*registrations));
+        if (!registrations)
+            goto Finally;
+
+        self->mRegistrations = registrations;
+        self->mRegistrationsSize = size;
+    }
+
+    char *name = strdup(aEntry->d_name);
+    if (!name)
+        goto Finally;
+
+    self->mRegistrations[self->mRegistrationsLen++] =
+        (struct review_registration) {
+            .mLicensee = self->mLicenseesLen - 1,
+            .mName = name,
+            .mVerdict = FAILURE_OTHER,
+        };
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+review_licensor_(struct review *self, struct uid aLicensor)
+{
+    enum failure failure = FAILURE_NONE;
+
+    struct user licensor_, *licensor = 0;
+
+    /* Most licensee directories share the same licensor, so reuse
+     * the outcome of a previous lookup where possible.
+     */
+
+    for (size_t lx = 0; lx < self->mLicenseesLen; ++lx) {
+        if (uid_eq(self->mLicensees[lx].mLicensor, aLicensor)) {
+            failure = self->mLicensees[lx].mLicensorFailure;
+            goto Finally;
+        }
+    }
+
+    failure = FAILURE_LICENSOR;
+    licensor = create_user(&licensor_, aLicensor, (struct gid) { -1 });
+    if (!licensor)
+        goto Finally;
+
+    failure = FAILURE_LICENSOR_GROUPLIST;
+    if (fetch_user_groups(licensor))
+        goto Finally;
+
+    failure = FAILURE_NONE;
+
+Finally:
+
+    FINALLY({
+        licensor = close_user(licensor);
+    });
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+visit_review_licensee_(
+    struct review *self, int aDirFd, const struct dirent64 *aEntry)
+{
+    int rc = -1;
+
+    int licenseeFd = -1;
+
+    struct review_licensee *licensee = 0;
+
+    /* Only directories hold registrations, so other entries can be
+     * skipped without further interrogation if the directory reports
+     * the type of each entry.
+     */
+
+    if (DT_DIR != aEntry->d_type && DT_UNKNOWN != aEntry->d_type) {
+        rc = 0;
+        goto Finally;
+    }
+
+    struct statx licenseeStat;
+    if (statx(aDirFd, aEntry->d_name,
+            AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_UID, &licenseeStat))
+        goto Finally;
+
+    if (!S_ISDIR(licenseeStat.stx_mode)) {
+        rc = 0;
+        goto Finally;
+    }
+
+    struct review_licensee *licensees = realloc(
+        self->mLicensees, (self->mLicenseesLen + 1) * sizeof(*licensees));
+    if (!licensees)
+        goto Finally;
+    self->mLicensees = licensees;
+
+    /* The licensor is the owner of the licensee directory, and the
+     * rules are applied in the same order as the launch path.
+     */
+
+    struct uid licensor = { licenseeStat.stx_uid };
+
+    enum failure licensorFailure = review_licensor_(self, licensor);
+
+    enum failure failure = licensorFailure;
+    if (FAILURE_NONE == failure)
+        failure = check_licensee_dir(aEntry->d_name);
+    if (FAILURE_NONE == failure)
+        failure = check_parent_dir(
+            self->mDirStat.stx_mode,
+            (struct uid) { self->mDirStat.stx_uid }, licensor);
+
+    licensee = &licensees[self->mLicenseesLen++];
+
+    *licensee = (struct review_licensee) {
+        .mName = strdup(aEntry->d_name),
+        .mLicensor = licensor,
+        .mLicensorFailure = licensorFailure,
+        .mFailure = failure,
+    };
+    create_pathbuf(&licensee->mPath);
+
+    if (!licensee->mName)
+        goto Finally;
+
+    licenseeFd = openat(
+        aDirFd, aEntry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (-1 == licenseeFd)
+        goto Finally;
+
+    if (read_review_dir_(self, licenseeFd, visit_review_registration_))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        licenseeFd = fdclose(licenseeFd);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+resolve_registration_(
+    struct symlinkfd *aSymLink, struct pathbuf *aPath, struct uid aLicensor)
+{
+    enum failure failure;
+
+    /* Follow the chain from an open registration, and apply the rules
+     * for the target that it resolves to.
+     */
+
+    struct digest_pin pin;
+
+    failure = read_digest_pin(&pin, aSymLink);
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = FAILURE_FOLLOW;
+
+    while (!follow_symlinkfd(aSymLink))
+        ;
+    if (errno)
+        goto Finally;
+
+    failure = FAILURE_PATH;
+    if (splice_path(aPath,
+            pathview_buf(&aSymLink->mDir.mPath), aSymLink->mName))
+        goto Finally;
+
+    failure = FAILURE_TARGET;
+
+    struct stat targetStat;
+    if (fetch_stat_(AT_FDCWD, aPath->mBuf,
+            AT_STATX_SYNC_AS_STAT, FETCH_TARGET_MASK, &targetStat))
+        goto Finally;
+
+    failure = check_target(
+        targetStat.st_mode, (struct uid) { targetStat.st_uid }, aLicensor);
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = check_digest_pin(&pin, aPath->mBuf, &targetStat);
+
+Finally:
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+review_registration_(
+    const struct review *self,
+    const struct review_registration *aRegistration, struct pathbuf *aPath)
+{
+    enum failure failure = FAILURE_OTHER;
+
+    struct symlinkfd symlinkFd_, *symlinkFd = 0;
+
+    const struct review_licensee *licensee =
+        &self->mLicensees[aRegistration->mLicensee];
+
+    if (assign_pathbuf(aPath, pathview_buf(&licensee->mPath)))
+        goto Finally;
+
+    if (append_path(aPath, pathview_cstr(aRegistration->mName)))
+        goto Finally;
+
+    failure = FAILURE_SYMLINK;
+    symlinkFd = create_symlinkfd(&symlinkFd_, aPath->mBuf);
+    if (!symlinkFd)
+        goto Finally;
+
+    failure = licensee->mFailure;
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = resolve_registration_(symlinkFd, aPath, licensee->mLicensor);
+
+Finally:
+
+    FINALLY({
+        symlinkFd = close_symlinkfd(symlinkFd);
+    });
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static void *
+review_worker_(void *aReview)
+{
+    struct review *self = aReview;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    struct pathbuf path;
+    create_pathbuf(&path);
+
+    while (1) {
+        size_t rx = __atomic_fetch_add(&self->mNext, 1, __ATOMIC_RELAXED);
+        if (rx >= self->mRegistrationsLen)
+            break;
+
+        struct review_registration *registration = &self->mRegistrations[rx];
+
+        registration->mVerdict = review_registration_(
+            self, registration, &path);
+    }
+
+    close_pathbuf(&path);
+
+    leave_context_(context);
+
+    return 0;
+}
+
+/* ************************************************************************** */
+/* Batch verification
+ *
+ * Verify many registrations at once, for example on behalf of a
+ * scheduler checking its pending jobs. Registrations are grouped by
+ * the directory that holds them, so that the directory, its licensor,
+ * and its parent, are interrogated once for each group, and each
+ * requestor is looked up once. The groups are prepared by the calling
+ * thread, and the symlink chains are then followed concurrently by a
+ * pool of threads.
+ *
+ * The verdict for each registration is the first rule that it fails,
+ * in the same order as suxec_verify().
+ */
+
+struct batch_user {
+    struct uid mUid;
+    enum failure mFailure;
+};
+
+struct batch_group {
+    struct dirfd mDir;
+    struct stat mDirStat;
+    struct stat mParentDirStat;
+    struct uid mLicensor;
+    enum failure mFailure;
+};
+
+struct batch_entry {
+    size_t mIndex;
+    struct pathview mDirName;
+    struct pathview mBaseName;
+    size_t mGroup;
+    enum failure mRequestor;
+};
+
+struct batch {
+    const struct suxec_context *mContext;
+
+    const uid_t *mUids;
+    enum failure *mVerdicts;
+
+    struct batch_entry *mEntries;
+    size_t mEntriesLen;
+
+    struct batch_group *mGroups;
+    size_t mGroupsLen;
+
+    struct batch_user *mRequestors;
+    size_t mRequestorsLen;
+
+    struct batch_user *mLicensors;
+    size_t mLicensorsLen;
+
+    size_t mNext;
+    unsigned mRoundTrips;
+};
+
+/* -------------------------------------------------------------------------- */
+static int
+rank_batch_dir_(struct pathview aLhs, struct pathview aRhs)
+{
+    size_t len = aLhs.mLen < aRhs.mLen ? aLhs.mLen : aRhs.mLen;
+
+    int rank = memcmp(aLhs.mPtr, aRhs.mPtr, len);
+    if (rank)
+        return rank;
+
+    return aLhs.mLen == aRhs.mLen ? 0 : aLhs.mLen < aRhs.mLen ? -1 : +1;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+rank_batch_entry_(const void *aLhs, const void *aRhs)
+{
+    const struct batch_entry *lhs = aLhs;
+    const struct batch_entry *rhs = aRhs;
+
+    int rank = rank_batch_dir_(lhs->mDirName, rhs->mDirName);
+    if (rank)
+        return rank;
+
+    return lhs->mIndex < rhs->mIndex ? -1 : +1;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+lookup_batch_user_(
+    struct batch_user **aUsers, size_t *aUsersLen, struct uid aUid,
+    enum failure aUserFailure, enum failure aGroupsFailure)
+{
+    enum failure failure = FAILURE_OTHER;
+
+    struct user user_, *user = 0;
+
+    /* Reuse the outcome of a previous lookup of the same user. Groups
+     * are only fetched if the caller provides a reason for failure.
+     */
+
+    for (size_t ux = 0; ux < *aUsersLen; ++ux) {
+        if (uid_eq((*aUsers)[ux].mUid, aUid)) {
+            failure = (*aUsers)[ux].mFailure;
+            goto Finally;
+        }
+    }
+
+    struct batch_user *users = realloc(
+        *aUsers, (*aUsersLen + 1) * sizeof(*users));
+    if (!users)
+        goto Finally;
+    *aUsers = users;
+
+    failure = aUserFailure;
+    user = create_user(&user_, aUid, (struct gid) { -1 });
+    if (!user)
+        goto Cache;
+
+    failure = aGroupsFailure;
+    if (FAILURE_NONE != failure && fetch_user_groups(user))
+        goto Cache;
+
+    failure = FAILURE_NONE;
+
+Cache:
+
+    users[(*aUsersLen)++] = (struct batch_user) {
+        .mUid = aUid,
+        .mFailure = failure,
+    };
+
+Finally:
+
+    FINALLY({
+        user = close_user(user);
+    });
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+prepare_batch_group_(
+    struct batch *self, struct batch_group *aGroup, struct pathbuf *aDirName)
+{
+    enum failure failure = FAILURE_SYMLINK;
+
+    if (change_dirfd(&aGroup->mDir, pathview_buf(aDirName)))
+        goto Finally;
+
+    failure = FAILURE_DIRECTORY;
+
+    if (fetch_stat_(aGroup->mDir.mFd, "",
+            AT_EMPTY_PATH | lazy_sync_(), FETCH_PIN_MASK, &aGroup->mDirStat))
+        goto Finally;
+
+    /* The rules for the directory are applied in the same order
+     * as suxec_verify().
+     */
+
+    aGroup->mLicensor = (struct uid) { aGroup->mDirStat.st_uid };
+
+    failure = lookup_batch_user_(
+        &self->mLicensors, &self->mLicensorsLen, aGroup->mLicensor,
+        FAILURE_LICENSOR, FAILURE_LICENSOR_GROUPLIST);
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = FAILURE_LICENSEE_DIRECTORY;
+
+    const char *licenseeDir = strrchr(aGroup->mDir.mPath.mBuf, '/');
+    if (!licenseeDir || licenseeDir == aGroup->mDir.mPath.mBuf)
+        goto Finally;
+
+    failure = check_licensee_dir(licenseeDir + 1);
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = FAILURE_PARENT;
+
+    struct stat *parentDirStat = &aGroup->mParentDirStat;
+    if (fetch_stat_(aGroup->mDir.mFd, "..",
+            AT_NO_AUTOMOUNT | lazy_sync_(), FETCH_PIN_MASK, parentDirStat))
+        goto Finally;
+
+    failure = check_parent_dir(
+        parentDirStat->st_mode,
+        (struct uid) { parentDirStat->st_uid }, aGroup->mLicensor);
+
+Finally:
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+confirm_batch_entry_(
+    const struct batch_group *aGroup, const struct batch_entry *aEntry,
+    const struct stat *aSymLinkStat, struct pathbuf *aPath)
+{
+    enum failure failure = FAILURE_CHANGED;
+
+    /* As with suxec_verify(), confirm the attributes cached by the
+     * file system with the file server once the rules are satisfied.
+     * The target was already fetched from the file server. Following
+     * the chain moved the symlink descriptor to the last hop, so find
+     * the registration by name again.
+     */
+
+    struct stat dirStat;
+    if (fetch_stat_(aGroup->mDir.mFd, "",
+            AT_EMPTY_PATH | AT_STATX_FORCE_SYNC, FETCH_PIN_MASK, &dirStat) ||
+            !match_stat_(&aGroup->mDirStat, &dirStat))
+        goto Finally;
+
+    struct stat parentDirStat;
+    if (fetch_stat_(aGroup->mDir.mFd, "..",
+            AT_NO_AUTOMOUNT | AT_STATX_FORCE_SYNC, FETCH_PIN_MASK,
+            &parentDirStat) ||
+            !match_stat_(&aGroup->mParentDirStat, &parentDirStat))
+        goto Finally;
+
+    if (assign_pathbuf(aPath, aEntry->mBaseName))
+        goto Finally;
+
+    struct stat symLinkStat;
+    if (fetch_stat_(aGroup->mDir.mFd, aPath->mBuf,
+            AT_SYMLINK_NOFOLLOW | AT_STATX_FORCE_SYNC,
+            FETCH_PIN_MASK, &symLinkStat) ||
+            !match_stat_(aSymLinkStat, &symLinkStat))
+        goto Finally;
+
+    failure = FAILURE_NONE;
+
+Finally:
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+verify_batch_entry_(
+    const struct batch *self,
+    const struct batch_entry *aEntry, struct pathbuf *aPath)
+{
+    enum failure failure = aEntry->mRequestor;
+
+    struct symlinkfd symLink_, *symLink = 0;
+
+    const struct batch_group *group = &self->mGroups[aEntry->mGroup];
+
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = group->mFailure;
+    if (-1 == group->mDir.mFd)
+        goto Finally;
+
+    failure = FAILURE_SYMLINK;
+    symLink = create_symlinkfd_at(&symLink_, &group->mDir, aEntry->mBaseName);
+    if (!symLink)
+        goto Finally;
+
+    failure = group->mFailure;
+    if (FAILURE_NONE != failure)
+        goto Finally;
+
+    failure = FAILURE_SYMLINK_STAT;
+
+    struct stat symLinkStat;
+    if (fetch_stat_(symLink->mFd, "",
+            AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW | lazy_sync_(),
+            FETCH_PIN_MASK, &symLinkStat))
+        goto Finally;
+
+    failure = FAILURE_SYMLINK_OWNER;
+    if (uid_ne(
+            (struct uid) { symLinkStat.st_uid },
+            (struct uid) { self->mUids[aEntry->mIndex] }))
+        goto Finally;
+
+    failure = resolve_registration_(symLink, aPath, group->mLicensor);
+
+    if (FAILURE_NONE == failure && AT_STATX_DONT_SYNC == lazy_sync_())
+        failure = confirm_batch_entry_(group, aEntry, &symLinkStat, aPath);
+
+Finally:
+
+    FINALLY({
+        symLink = close_symlinkfd(symLink);
+    });
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static void *
+verify_batch_worker_(void *aBatch)
+{
+    struct batch *self = aBatch;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    struct pathbuf path;
+    create_pathbuf(&path);
+
+    unsigned roundTrips = sRoundTrips;
+
+    /* Entries are sorted by directory, so neighbouring entries taken
+     * by a worker tend to share the same directory.
+     */
+
+    while (1) {
+        size_t ex = __atomic_fetch_add(&self->mNext, 1, __ATOMIC_RELAXED);
+        if (ex >= self->mEntriesLen)
+            break;
+
+        const struct batch_entry *entry = &self->mEntries[ex];
+
+        self->mVerdicts[entry->mIndex] = verify_batch_entry_(
+            self, entry, &path);
+    }
+
+    __atomic_fetch_add(
+        &self->mRoundTrips, sRoundTrips - roundTrips, __ATOMIC_RELAXED);
+
+    close_pathbuf(&path);
+
+    leave_context_(context);
+
+    return 0;
+}
+
+/* ************************************************************************** */
+static int
+impersonate_user(
+    struct suxec_license *self,
+    const struct user *aUser, const struct grouplist *aGroups)
+{
+    int rc = -1;
+
+    /* Use conditional setgroups(2) because initgroups(3) sets
+     * the supplementary groups unconditionally and fails if the
+     * caller is unprivileged.
+     */
+
+    if (aUser->mGroups->mSize != aGroups->mSize ||
+            memcmp(
+                aUser->mGroups->mList,
+                aGroups->mList,
+                aUser->mGroups->mSize * sizeof(*aUser->mGroups->mList))) {
+
+        if (setgroups(aUser->mGroups->mSize, aUser->mGroups->mList)) {
+            refuse_(self, FAILURE_OTHER,
+                "Unable to set supplementary groups for user %s",
+                aUser->mName);
+            goto Finally;
+        }
+    }
+
+    struct uid ouid = { geteuid() };
+
+    if (setgid(aUser->mGid._)) {
+        refuse_(self, FAILURE_OTHER, "Unable to set gid %d", aUser->mGid._);
+        goto Finally;
+    }
+
+    if (setuid(aUser->mUid._)) {
+        refuse_(self, FAILURE_OTHER, "Unable to set uid %d", aUser->mUid._);
+        goto Finally;
+    }
+
+    struct gid egid = { getegid() };
+    if (gid_ne(aUser->mGid, egid)) {
+        refuse_(self, FAILURE_OTHER, "Mismatched effective gid %d", egid._);
+        goto Finally;
+    }
+
+    struct uid euid = { geteuid() };
+    if (uid_ne(aUser->mUid, euid)) {
+        refuse_(self, FAILURE_OTHER, "Mismatched effective uid %d", euid._);
+        goto Finally;
+    }
+
+    if (aUser->mUid._ && !setreuid(-1, 0)) {
+        errno = 0;
+        refuse_(self, FAILURE_OTHER, "Unexpected privilege escalation");
+        goto Finally;
+    }
+
+    if (uid_ne(ouid, euid) && !setreuid(-1, ouid._)) {
+        errno = 0;
+        refuse_(self, FAILURE_OTHER, "Unexpected privilege recovery");
+        goto Finally;
+    }
+
+    struct gid fsgid = { setfsgid(-1) };
+    if (gid_ne(fsgid, aUser->mGid)) {
+        errno = 0;
+        refuse_(self, FAILURE_OTHER, "Unexpected fsgid %d", fsgid._);
+        goto Finally;
+    }
+
+    struct uid fsuid = { setfsuid(-1) };
+    if (uid_ne(fsuid, aUser->mUid)) {
+        errno = 0;
+        refuse_(self, FAILURE_OTHER, "Unexpected fsuid %d", fsuid._);
+        goto Finally;
+    }
+
+    PROBE(impersonate, aUser->mUid._, aUser->mGid._, aUser->mGroups->mSize);
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* ************************************************************************** */
+/* Verified chain
+ *
+ * Each directory, symlink, and the target interrogated while verifying
+ * the license is pinned by identity. Directories are pinned by device,
+ * inode, owner and mode, because their change time moves whenever a
+ * sibling registration is added. Symlinks and the target are also
+ * pinned by change time, so that a change of owner or mode, or any
+ * replacement, is detected.
+ */
+
+static struct pin *
+pin_license_(
+    struct suxec_license_state *self,
+    struct pathview aDir, struct pathview aName, int aFlags)
+{
+    struct pin *pin = 0;
+
+    size_t pathLen = aDir.mLen + (aName.mLen ? 1 + aName.mLen : 0) + 1;
+
+    char *paths = realloc(self->mPinPaths, self->mPinPathsLen + pathLen);
+    if (!paths)
+        goto Finally;
+    self->mPinPaths = paths;
+
+    struct pin *pins = realloc(
+        self->mPins, (self->mPinsLen + 1) * sizeof(*pins));
+    if (!pins)
+        goto Finally;
+    self->mPins = pins;
+
+    char *path = paths + self->mPinPathsLen;
+
+    memcpy(path, aDir.mPtr, aDir.mLen);
+    if (aName.mLen) {
+        path[aDir.mLen] = '/';
+        memcpy(path + aDir.mLen + 1, aName.mPtr, aName.mLen);
+    }
+    path[pathLen - 1] = 0;
+
+    pin = &pins[self->mPinsLen++];
+
+    *pin = (struct pin) {
+        .mPath = self->mPinPathsLen,
+        .mFlags = aFlags,
+    };
+
+    self->mPinPathsLen += pathLen;
+
+Finally:
+
+    return pin;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+unpin_license_(struct suxec_license_state *self)
+{
+    struct pin *pin = &self->mPins[--self->mPinsLen];
+
+    self->mPinPathsLen = pin->mPath;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_pin_(const struct pin *aPin, const struct stat *aStat)
+{
+    return match_stat_(&aPin->mStat, aStat);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+confirm_license_(struct suxec_license *self)
+{
+    int rc = -1;
+
+    struct suxec_license_state *state = self->mState;
+
+    /* Fetch the attributes of each object that the rules depend
+     * upon from the file server, and confirm that the attributes
+     * used to apply the rules were current.
+     */
+
+    size_t confirmed = 0;
+
+    for (size_t px = 0; px < state->mPinsLen; ++px) {
+        const struct pin *pin = &state->mPins[px];
+        const char *path = state->mPinPaths + pin->mPath;
+
+        if (!pin->mConfirm)
+            continue;
+
+        struct stat pathStat;
+
+        if (fetch_stat_(AT_FDCWD, path,
+                pin->mFlags | AT_STATX_FORCE_SYNC, FETCH_PIN_MASK,
+                &pathStat)) {
+            refuse_(self, FAILURE_CHANGED, "Unable to stat %s", path);
+            goto Finally;
+        }
+
+        if (!match_pin_(pin, &pathStat)) {
+            errno = 0;
+            refuse_(self, FAILURE_CHANGED, "Changed %s", path);
+            goto Finally;
+        }
+
+        ++confirmed;
+    }
+
+    DEBUG("Confirmed %zu pins", confirmed);
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* ************************************************************************** */
+static struct suxec_user
+export_user_(const struct user *aUser)
+{
+    return (struct suxec_user) {
+        .mUid = aUser->mUid._,
+        .mGid = aUser->mGid._,
+        .mName = aUser->mName,
+        .mHome = aUser->mHome,
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+struct suxec_license *
+suxec_create_license(
+    struct suxec_license *self, const struct suxec_context *aContext)
+{
+    *self = (struct suxec_license) {
+        .mContext = aContext,
+        .mFailure = FAILURE_NONE,
+    };
+
+    return self;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct suxec_license_state *
+find_peer_(
+    const struct suxec_license *aPeers, size_t aPeersLen,
+    int (*aMatch)(const struct suxec_license_state *aPeer, const void *aArg),
+    const void *aArg)
+{
+    for (size_t px = 0; px < aPeersLen; ++px) {
+        struct suxec_license_state *peer = aPeers[px].mState;
+
+        if (peer && aMatch(peer, aArg))
+            return peer;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_peer_groups_(const struct suxec_license_state *aPeer, const void *aArg)
+{
+    return !!aPeer->mGroups;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_peer_requestor_(
+    const struct suxec_license_state *aPeer, const void *aArg)
+{
+    const struct user *requestor = aArg;
+
+    return aPeer->mRequestor &&
+        uid_eq(aPeer->mRequestor->mUid, requestor->mUid) &&
+        gid_eq(aPeer->mRequestor->mGid, requestor->mGid);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_peer_licensor_(
+    const struct suxec_license_state *aPeer, const void *aArg)
+{
+    const struct uid *licensor = aArg;
+
+    return aPeer->mLicensor && aPeer->mLicensor->mGroups &&
+        uid_eq(aPeer->mLicensor->mUid, *licensor);
+}
+
+/* -------------------------------------------------------------------------- */
+static struct user *
+find_licensor_(
+    struct suxec_license *self,
+    const struct suxec_license *aPeers, size_t aPeersLen, struct uid aUid)
+{
+    struct suxec_license_state *state = self->mState;
+
+    struct suxec_license_state *peer = find_peer_(
+        aPeers, aPeersLen, match_peer_licensor_, &aUid);
+    if (peer)
+        state->mLicensor = peer->mLicensor;
+    else
+        state->mLicensor = create_user(
+            &state->mLicensor_, aUid, (struct gid) { -1 });
+    if (!state->mLicensor) {
+        refuse_(self, FAILURE_LICENSOR,
+            "Unable to find passwd entry for uid %d", aUid._);
+        return 0;
+    }
+
+    struct user *licensor = state->mLicensor;
+
+    self->mLicensor = export_user_(licensor);
+
+    DEBUG("Licensor %s", licensor->mName);
+
+    if (fetch_user_groups(licensor)) {
+        refuse_(self, FAILURE_LICENSOR_GROUPLIST,
+            "Unable to query supplementary groups for user %s",
+            licensor->mName);
+        return 0;
+    }
+
+    IFDEBUG({
+        for (size_t gx = 0; gx < licensor->mGroups->mSize; ++gx)
+            DEBUG("Licensor gid %d", licensor->mGroups->mList[gx]);
+    });
+
+    notify_(SUXEC_EVENT_LICENSOR, 0);
+
+    return licensor;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+resolve_license_(
+    struct suxec_license *self,
+    const struct digest_pin *aDigestPin, const char *aSymlink)
+{
+    int rc = -1;
+
+    struct suxec_license_state *state = self->mState;
+
+    if (sContext && (sContext->mFlags & SUXEC_READAHEAD))
+        readahead_target_(state->mPath.mBuf);
+
+    /* The rules were applied using the attributes cached by the
+     * file system, so confirm them before the target is read.
+     */
+
+    if (AT_STATX_DONT_SYNC == lazy_sync_() && confirm_license_(self))
+        goto Finally;
+
+    if (check_digest_pin(aDigestPin, state->mPath.mBuf, &self->mPathStat)) {
+        refuse_(self, FAILURE_DIGEST,
+            "Mismatched digest for file referenced by %s", aSymlink);
+        goto Finally;
+    }
+
+    notify_(SUXEC_EVENT_RESOLVE, 0);
+
+    PROBE(license__resolved,
+        state->mRequestor->mUid._, state->mLicensor->mUid._,
+        self->mHops, aSymlink, state->mPath.mBuf);
+
+    state->mVerified = 1;
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* ************************************************************************** */
+/* Indexed chains
+ *
+ * A verified chain is exported as the pins of the license followed
+ * by their paths, so that a later verification of the registration
+ * can fetch the attributes of each pinned object rather than follow
+ * the chain. The pins are held in the order of verification: the
+ * licensee directory, its parent, each symlink in the chain starting
+ * with the registration, and the target. A chain is only exported if
+ * every path is absolute, so that it does not depend on the current
+ * directory of the verifier.
+ *
+ * The registration is identified by its attributes, and must be owned
+ * by the requestor. The rules only depend on the attributes of the
+ * pinned objects, and the names of the pinned paths, so a chain whose
+ * objects are unchanged satisfies the rules as before. A chain that
+ * is not found, or that has changed, is followed as usual.
+ */
+
+#define CHAIN_MAGIC 0x73786368u
+#define CHAIN_PINS_MIN 4
+
+struct chain {
+    uint32_t mMagic;
+    uint32_t mPinsLen;
+    uint32_t mPinPathsLen;
+};
+
+/* -------------------------------------------------------------------------- */
+static void
+store_chain_(struct suxec_license *self)
+{
+    const struct suxec_context *context = sContext;
+
+    if (!context || !context->mStoreChain)
+        return;
+
+    struct suxec_license_state *state = self->mState;
+
+    struct chain chain = {
+        .mMagic = CHAIN_MAGIC,
+        .mPinsLen = state->mPinsLen,
+        .mPinPathsLen = state->mPinPathsLen,
+    };
+
+    size_t pinsSize = state->mPinsLen * sizeof(*state->mPins);
+
+    if (SUXEC_CHAIN_SIZE < sizeof(chain) + pinsSize + state->mPinPathsLen)
+        return;
+
+    for (size_t px = 0; px < state->mPinsLen; ++px) {
+        if ('/' != state->mPinPaths[state->mPins[px].mPath])
+            return;
+    }
+
+    unsigned char buf[SUXEC_CHAIN_SIZE] = { 0 };
+
+    memcpy(buf, &chain, sizeof(chain));
+    memcpy(buf + sizeof(chain), state->mPins, pinsSize);
+    memcpy(buf + sizeof(chain) + pinsSize,
+        state->mPinPaths, state->mPinPathsLen);
+
+    context->mStoreChain(context->mArg, &self->mRegistrationStat, buf);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fetch_chain_(struct suxec_license *self, const char *aSymlink)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = sContext;
+    struct suxec_license_state *state = self->mState;
+
+    unsigned char *buf = 0;
+    struct pin *pins = 0;
+    char *pinPaths = 0;
+
+    if (!context || !context->mFetchChain)
+        goto Finally;
+
+    struct stat registrationStat;
+    if (fetch_stat_(AT_FDCWD, aSymlink,
+            AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | lazy_sync_(),
+            FETCH_TARGET_MASK, &registrationStat))
+        goto Finally;
+
+    if (!S_ISLNK(registrationStat.st_mode) || uid_ne(
+            (struct uid) { registrationStat.st_uid },
+            state->mRequestor->mUid))
+        goto Finally;
+
+    buf = malloc(SUXEC_CHAIN_SIZE);
+    if (!buf)
+        goto Finally;
+
+    if (context->mFetchChain(context->mArg, &registrationStat, buf))
+        goto Finally;
+
+    /* Only use a chain that is well formed, and has the expected
+     * pins at the start.
+     */
+
+    struct chain chain;
+    memcpy(&chain, buf, sizeof(chain));
+
+    if (CHAIN_MAGIC != chain.mMagic ||
+            CHAIN_PINS_MIN > chain.mPinsLen ||
+            CHAIN_PINS_MIN - 1 + SYMLINK_HOPS_MAX < chain.mPinsLen ||
+            !chain.mPinPathsLen)
+        goto Finally;
+
+    size_t pinsSize = chain.mPinsLen * sizeof(*pins);
+
+    if (SUXEC_CHAIN_SIZE < sizeof(chain) + pinsSize + chain.mPinPathsLen)
+        goto Finally;
+
+    pins = malloc(pinsSize);
+    pinPaths = malloc(chain.mPinPathsLen);
+    if (!pins || !pinPaths)
+        goto Finally;
+
+    memcpy(pins, buf + sizeof(chain), pinsSize);
+    memcpy(pinPaths, buf + sizeof(chain) + pinsSize, chain.mPinPathsLen);
+
+    if (pinPaths[chain.mPinPathsLen - 1])
+        goto Finally;
+
+    for (size_t px = 0; px < chain.mPinsLen; ++px) {
+        if (chain.mPinPathsLen <= pins[px].mPath ||
+                '/' != pinPaths[pins[px].mPath])
+            goto Finally;
+    }
+
+    const struct pin *registration = &pins[2];
+    const struct pin *target = &pins[chain.mPinsLen - 1];
+
+    if (!match_pin_(registration, &registrationStat))
+        goto Finally;
+
+    /* The registration is unchanged, so confirm each of the other
+     * objects in the chain.
+     */
+
+    for (size_t px = 0; px < chain.mPinsLen; ++px) {
+        const struct pin *pin = &pins[px];
+        const char *path = pinPaths + pin->mPath;
+
+        if (pin == registration)
+            continue;
+
+        struct stat pathStat;
+
+        if (fetch_stat_(AT_FDCWD, path,
+                pin->mFlags | lazy_sync_(),
+                pin == target ? FETCH_TARGET_MASK : FETCH_PIN_MASK,
+                &pathStat) || !match_pin_(pin, &pathStat)) {
+            DEBUG("Changed %s in index", path);
+            goto Finally;
+        }
+
+        if (pin == target)
+            self->mPathStat = pathStat;
+    }
+
+    if (assign_pathbuf(&state->mPath, pathview_cstr(pinPaths + target->mPath)))
+        goto Finally;
+
+    state->mPins = pins;
+    state->mPinsLen = chain.mPinsLen;
+    state->mPinPaths = pinPaths;
+    state->mPinPathsLen = chain.mPinPathsLen;
+
+    pins = 0;
+    pinPaths = 0;
+
+    self->mPath = state->mPath.mBuf;
+    self->mRegistrationStat = registrationStat;
+    self->mHops = state->mPinsLen - (CHAIN_PINS_MIN - 1);
+
+    DEBUG("Indexed %s", aSymlink);
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        free(pinPaths);
+        free(pins);
+        free(buf);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+verify_chain_(
+    struct suxec_license *self,
+    const struct suxec_license *aPeers, size_t aPeersLen,
+    const char *aSymlink)
+{
+    int rc = -1;
+
+    struct suxec_license_state *state = self->mState;
+
+    const struct pin *pins = state->mPins;
+
+    notify_(SUXEC_EVENT_DIRECTORY, &pins[0].mStat);
+    notify_(SUXEC_EVENT_SYMLINK, 0);
+
+    if (!find_licensor_(
+            self, aPeers, aPeersLen, (struct uid) { pins[0].mStat.st_uid }))
+        goto Finally;
+
+    notify_(SUXEC_EVENT_PARENT_DIRECTORY, &pins[1].mStat);
+    notify_(SUXEC_EVENT_REGISTRATION, &self->mRegistrationStat);
+    notify_(SUXEC_EVENT_PARENT, 0);
+
+    /* The digest pin is held by the licensee directory, and is
+     * read again in case the licensor has changed it.
+     */
+
+    struct digest_pin digestPin;
+
+    const char *name = strrchr(state->mPinPaths + pins[2].mPath, '/') + 1;
+
+    if (read_digest_pin_(
+            &digestPin, state->mPinPaths + pins[0].mPath, name)) {
+        refuse_(self, FAILURE_DIGEST,
+            "Unable to read digest pin for %s", aSymlink);
+        goto Finally;
+    }
+
+    for (unsigned hx = 0; hx < self->mHops; ++hx)
+        notify_(SUXEC_EVENT_HOP, 0);
+
+    notify_(SUXEC_EVENT_TARGET, &self->mPathStat);
+
+    if (resolve_license_(self, &digestPin, aSymlink))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_verify(
+    struct suxec_license *self,
+    uid_t aUid, gid_t aGid, const char *aSymlink)
+{
+    return suxec_verify_with(self, 0, 0, aUid, aGid, aSymlink);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_verify_with(
+    struct suxec_license *self,
+    const struct suxec_license *aPeers, size_t aPeersLen,
+    uid_t aUid, gid_t aGid, const char *aSymlink)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    unsigned roundTrips = sRoundTrips;
+
+    PROBE(license, aUid, aGid);
+
+    if (self->mState) {
+        errno = EINVAL;
+        refuse_(self, FAILURE_OTHER, "License already verified");
+        goto Finally;
+    }
+
+    struct suxec_license_state *state = calloc(1, sizeof(*state));
+    if (!state) {
+        refuse_(self, FAILURE_OTHER, "Unable to allocate license");
+        goto Finally;
+    }
+    self->mState = state;
+
+    create_pathbuf(&state->mPath);
+
+    self->mSymlink = aSymlink;
+
+    /* Each user already found by a peer is shared with that peer
+     * rather than queried again. Only users that are not shared
+     * are owned by this license.
+     */
+
+    struct suxec_license_state *peer;
+
+    peer = find_peer_(aPeers, aPeersLen, match_peer_groups_, 0);
+    if (peer)
+        state->mGroups = peer->mGroups;
+    else
+        state->mGroups = create_grouplist(&state->mGroups_);
+    if (!state->mGroups) {
+        refuse_(self, FAILURE_GROUPLIST,
+            "Unable to query supplementary groups");
+        goto Finally;
+    }
+
+    IFDEBUG({
+        for (size_t gx = 0; gx < state->mGroups->mSize; ++gx)
+            DEBUG("Supplementary gid %d", state->mGroups->mList[gx]);
+    });
+
+    notify_(SUXEC_EVENT_GROUPLIST, 0);
+
+    /* The requestor is determined from user running the program
+     * and is required to also be the licensee.
+     */
+
+    struct user requestor = {
+        .mUid = (struct uid) { aUid },
+        .mGid = (struct gid) { aGid },
+    };
+
+    peer = find_peer_(aPeers, aPeersLen, match_peer_requestor_, &requestor);
+    if (peer)
+        state->mRequestor = peer->mRequestor;
+    else
+        state->mRequestor = create_user(
+            &state->mRequestor_, requestor.mUid, requestor.mGid);
+    if (!state->mRequestor) {
+        refuse_(self, FAILURE_REQUESTOR,
+            "Unable to find passwd entry for uid %d gid %d", aUid, aGid);
+        goto Finally;
+    }
+
+    self->mRequestor = export_user_(state->mRequestor);
+
+    DEBUG("Requestor %s", state->mRequestor->mName);
+
+    notify_(SUXEC_EVENT_REQUESTOR, 0);
+
+    /* A chain found in the index is confirmed by fetching the
+     * attributes of each object in the chain, rather than by
+     * following the chain again.
+     */
+
+    if (!fetch_chain_(self, aSymlink)) {
+        rc = verify_chain_(self, aPeers, aPeersLen, aSymlink);
+        goto Finally;
+    }
+
+    /* The licensee is determined from the owner of the symlink. For
+     * now, simply keep a reference to the symlink so that it can
+     * be interrogated later.
+     */
+
+    state->mSymLink = create_symlinkfd(&state->mSymLink_, aSymlink);
+    if (!state->mSymLink) {
+        refuse_(self, FAILURE_SYMLINK, "Unable to open %s", aSymlink);
+        goto Finally;
+    }
+
+    struct symlinkfd *symLink = state->mSymLink;
+
+    struct stat dirStat;
+
+    if (fetch_stat_(symLink->mDir.mFd, "",
+            AT_EMPTY_PATH | lazy_sync_(), FETCH_PIN_MASK, &dirStat)) {
+        refuse_(self, FAILURE_DIRECTORY,
+            "Unable to stat directory %s", symLink->mDir.mPath.mBuf);
+        goto Finally;
+    }
+
+    notify_(SUXEC_EVENT_DIRECTORY, &dirStat);
+    notify_(SUXEC_EVENT_SYMLINK, 0);
+
+    struct pin *pin = pin_license_(
+        state, pathview_buf(&symLink->mDir.mPath), pathview_cstr(""),
+        AT_NO_AUTOMOUNT);
+    if (!pin) {
+        refuse_(self, FAILURE_OTHER, "Unable to allocate license");
+        goto Finally;
+    }
+    pin->mConfirm = 1;
+    pin->mStat = dirStat;
+
+    /* The licensor is determined from the directory containing
+     * the symlink. That directory is presumed to house all the
+     * registrations for a particular licensee.
+     */
+
+    struct user *licensor = find_licensor_(
+        self, aPeers, aPeersLen, (struct uid) { dirStat.st_uid });
+    if (!licensor)
+        goto Finally;
+
+    /* The owner of the symlink determines the licensee, and should match
+     * the requestor.
+     */
+
+    DEBUG("Command %s", aSymlink);
+    DEBUG("Licensee %s", symLink->mDir.mPath.mBuf);
+
+    /* Determine the name of the directory holding the registrations
+     * for this licensee, and verify the format of the name.
+     */
+
+    const char *licenseeDir = strrchr(symLink->mDir.mPath.mBuf, '/');
+    if (!licenseeDir || licenseeDir == symLink->mDir.mPath.mBuf) {
+        errno = 0;
+        refuse_(self, FAILURE_LICENSEE_DIRECTORY,
+            "Unable to determine licensee directory from %s",
+            symLink->mDir.mPath.mBuf);
+        goto Finally;
+    }
+    ++licenseeDir;
+
+    switch (check_licensee_dir(licenseeDir)) {
+    default:
+        break;
+
+    case FAILURE_HIDDEN_DIRECTORY:
+        errno = 0;
+        refuse_(self, FAILURE_HIDDEN_DIRECTORY,
+            "Hidden directory at %s", symLink->mDir.mPath.mBuf);
+        goto Finally;
+
+    case FAILURE_RESTRICTED_DIRECTORY:
+        errno = 0;
+        refuse_(self, FAILURE_RESTRICTED_DIRECTORY,
+            "Restricted directory at %s", symLink->mDir.mPath.mBuf);
+        goto Finally;
+    }
+
+    /* Interrogate the parent of the licensee registration directory.
+     * This directory should be owned by the licensor, and should not
+     * allow other users to list its contents. Only the licensor
+     * should be allowed to know the names of all the registered
+     * licensees, and the names of the submission and staging directories.
+     * The parent is already mounted, so do not trigger an automount
+     * of any other directory.
+     */
+
+    struct stat parentDirStat;
+
+    if (fetch_stat_(symLink->mDir.mFd, "..",
+            AT_NO_AUTOMOUNT | lazy_sync_(), FETCH_PIN_MASK, &parentDirStat)) {
+        refuse_(self, FAILURE_PARENT,
+            "Unable to stat directory %s/../", symLink->mDir.mPath.mBuf);
+        goto Finally;
+    }
+
+    notify_(SUXEC_EVENT_PARENT_DIRECTORY, &parentDirStat);
+
+    pin = pin_license_(
+        state, pathview_buf(&symLink->mDir.mPath), pathview_cstr(".."),
+        AT_NO_AUTOMOUNT);
+    if (!pin) {
+        refuse_(self, FAILURE_OTHER, "Unable to allocate license");
+        goto Finally;
+    }
+    pin->mConfirm = 1;
+    pin->mStat = parentDirStat;
+
+    switch (check_parent_dir(
+                parentDirStat.st_mode,
+                (struct uid) { parentDirStat.st_uid },
+                licensor->mUid)) {
+    default:
+        break;
+
+    case FAILURE_PARENT_GROUP_MODE:
+        errno = 0;
+        refuse_(self, FAILURE_PARENT_GROUP_MODE,
+            "Directory %s/../ has group rw permissions",
+            symLink->mDir.mPath.mBuf);
+        goto Finally;
+
+    case FAILURE_PARENT_OTHER_MODE:
+        errno = 0;
+        refuse_(self, FAILURE_PARENT_OTHER_MODE,
+            "Directory %s/../ has other rw permissions",
+            symLink->mDir.mPath.mBuf);
+        goto Finally;
+
+    case FAILURE_PARENT_OWNER:
+        errno = 0;
+        refuse_(self, FAILURE_PARENT_OWNER,
+            "Expected owner user %s for directory %s/../",
+            licensor->mName, symLink->mDir.mPath.mBuf);
+        goto Finally;
+    }
+
+    /* Verify that the licensor also owns the file resolved by the
+     * symlink. Only the symlink itself is owned by the licensee.
+     */
+
+    if (fetch_stat_(symLink->mFd, "",
+            AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW | lazy_sync_(),
+            FETCH_TARGET_MASK, &self->mRegistrationStat)) {
+        refuse_(self, FAILURE_SYMLINK_STAT,
+            "Unable to stat symlink %s/%s",
+            symLink->mDir.mPath.mBuf, symLink->mName.mPtr);
+        goto Finally;
+    }
+
+    notify_(SUXEC_EVENT_REGISTRATION, &self->mRegistrationStat);
+
+    if (uid_ne(
+            (struct uid) { self->mRegistrationStat.st_uid },
+            state->mRequestor->mUid)) {
+        errno = 0;
+        refuse_(self, FAILURE_SYMLINK_OWNER,
+            "Symlink %s should be owned by user %s",
+            aSymlink, state->mRequestor->mName);
+        goto Finally;
+    }
+
+    notify_(SUXEC_EVENT_PARENT, 0);
+
+    /* Read any digest pin for the registration before the symlink
+     * is followed away from the licensee directory.
+     */
+
+    struct digest_pin digestPin;
+
+    if (read_digest_pin(&digestPin, symLink)) {
+        refuse_(self, FAILURE_DIGEST,
+            "Unable to read digest pin for %s", aSymlink);
+        goto Finally;
+    }
+
+    /* Follow the chain of symlinks to find the final symlink
+     * that resolves to a regular file. The number of hops is
+     * bounded so that a cycle of symlinks is refused.
+     */
+
+    while (1) {
+        pin = pin_license_(
+            state,
+            pathview_buf(&symLink->mDir.mPath),
+            symLink->mName, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT);
+        if (!pin) {
+            refuse_(self, FAILURE_OTHER, "Unable to allocate license");
+            goto Finally;
+        }
+
+        if (follow_symlinkfd(symLink)) {
+            if (errno) {
+                refuse_(self, FAILURE_FOLLOW,
+                    "Unable to follow %s/%s",
+                    symLink->mDir.mPath.mBuf, symLink->mName.mPtr);
+                goto Finally;
+            }
+            unpin_license_(state);
+            break;
+        }
+
+        pin->mConfirm = 1 == symLink->mHops;
+        pin->mStat = symLink->mStat;
+
+        self->mHops = symLink->mHops;
+
+        notify_(SUXEC_EVENT_HOP, 0);
+    }
+
+    /* Now that the symlink has resolved, combine the directory
+     * name and the base name to form the path to the resolved
+     * file.
+     */
+
+    if (splice_path(&state->mPath,
+            pathview_buf(&symLink->mDir.mPath), symLink->mName)) {
+        refuse_(self, FAILURE_PATH,
+            "Unable to create path %s/%s",
+            symLink->mDir.mPath.mBuf, symLink->mName.mPtr);
+        goto Finally;
+    }
+
+    /* Verify that the resolved symlink is owned by the licensor
+     * previously established by looking at the owner of the directory
+     * containing the symlink. Also verify that the owner has permission
+     * to execute the target file.
+     */
+
+    DEBUG("Path allocations %u", sPathBufAllocs);
+
+    if (fetch_stat_(AT_FDCWD, state->mPath.mBuf,
+            lazy_sync_(), FETCH_TARGET_MASK, &self->mPathStat)) {
+        refuse_(self, FAILURE_TARGET, "Unable to stat %s", state->mPath.mBuf);
+        goto Finally;
+    }
+
+    self->mPath = state->mPath.mBuf;
+
+    notify_(SUXEC_EVENT_TARGET, &self->mPathStat);
+
+    pin = pin_license_(
+        state,
+        pathview_buf(&state->mPath), pathview_cstr(""), AT_SYMLINK_NOFOLLOW);
+    if (!pin) {
+        refuse_(self, FAILURE_OTHER, "Unable to allocate license");
+        goto Finally;
+    }
+    pin->mConfirm = 1;
+    pin->mStat = self->mPathStat;
+
+    switch (check_target(
+                self->mPathStat.st_mode,
+                (struct uid) { self->mPathStat.st_uid },
+                licensor->mUid)) {
+    default:
+        break;
+
+    case FAILURE_TARGET_OWNER:
+        errno = 0;
+        refuse_(self, FAILURE_TARGET_OWNER,
+            "Expected owner user %s for file referenced by %s",
+            licensor->mName, aSymlink);
+        goto Finally;
+
+    case FAILURE_TARGET_MODE:
+        errno = 0;
+        refuse_(self, FAILURE_TARGET_MODE,
+            "Expected executable file at %s", aSymlink);
+        goto Finally;
+    }
+
+    if (resolve_license_(self, &digestPin, aSymlink))
+        goto Finally;
+
+    store_chain_(self);
+
+    rc = 0;
+
+Finally:
+
+    self->mRoundTrips += sRoundTrips - roundTrips;
+
+    DEBUG("Attribute round trips %u", self->mRoundTrips);
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_revalidate(struct suxec_license *self)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    struct suxec_license_state *state = self->mState;
+
+    if (!state || !state->mVerified) {
+        errno = EINVAL;
+        refuse_(self, FAILURE_OTHER, "License not verified");
+        goto Finally;
+    }
+
+    for (size_t px = 0; px < state->mPinsLen; ++px) {
+        const struct pin *pin = &state->mPins[px];
+        const char *path = state->mPinPaths + pin->mPath;
+
+        struct stat pathStat;
+
+        if (fstatat(AT_FDCWD, path, &pathStat, pin->mFlags)) {
+            state->mVerified = 0;
+            refuse_(self, FAILURE_CHANGED, "Unable to stat %s", path);
+            goto Finally;
+        }
+
+        if (!match_pin_(pin, &pathStat)) {
+            state->mVerified = 0;
+            errno = 0;
+            refuse_(self, FAILURE_CHANGED, "Changed %s", path);
+            goto Finally;
+        }
+    }
+
+    DEBUG("Revalidated %zu pins", state->mPinsLen);
+
+    rc = 0;
+
+Finally:
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_verify_batch(
+    const struct suxec_context *aContext, size_t aLen,
+    const uid_t *aUids, const char * const *aSymlinks,
+    enum failure *aVerdicts)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(aContext);
+
+    struct batch batch = {
+        .mContext = aContext,
+        .mUids = aUids,
+        .mVerdicts = aVerdicts,
+    };
+
+    struct pathbuf dirName;
+    create_pathbuf(&dirName);
+
+    unsigned roundTrips = sRoundTrips;
+
+    batch.mEntries = calloc(aLen ? aLen : 1, sizeof(*batch.mEntries));
+    if (!batch.mEntries)
+        goto Finally;
+
+    batch.mGroups = calloc(aLen ? aLen : 1, sizeof(*batch.mGroups));
+    if (!batch.mGroups)
+        goto Finally;
+
+    /* Look up each requestor, and split each registration into its
+     * directory and name so that the registrations can be grouped
+     * by directory.
+     */
+
+    for (size_t ix = 0; ix < aLen; ++ix) {
+        struct batch_entry *entry = &batch.mEntries[batch.mEntriesLen++];
+
+        *entry = (struct batch_entry) {
+            .mIndex = ix,
+            .mDirName = { "", 0 },
+            .mBaseName = { "", 0 },
+            .mRequestor = lookup_batch_user_(
+                &batch.mRequestors, &batch.mRequestorsLen,
+                (struct uid) { aUids[ix] },
+                FAILURE_REQUESTOR, FAILURE_NONE),
+        };
+
+        if (split_path(
+                pathview_cstr(aSymlinks[ix]),
+                &entry->mDirName, &entry->mBaseName))
+            entry->mBaseName = (struct pathview) { "", 0 };
+    }
+
+    qsort(
+        batch.mEntries, batch.mEntriesLen, sizeof(*batch.mEntries),
+        rank_batch_entry_);
+
+    /* Interrogate each directory once on behalf of all the entries
+     * that it holds.
+     */
+
+    for (size_t ex = 0; ex < batch.mEntriesLen; ++ex) {
+        struct batch_entry *entry = &batch.mEntries[ex];
+
+        if (!ex || rank_batch_dir_(entry[-1].mDirName, entry->mDirName)) {
+
+            struct batch_group *group = &batch.mGroups[batch.mGroupsLen++];
+
+            create_dirfd(&group->mDir);
+
+            group->mFailure = FAILURE_OTHER;
+            if (!assign_pathbuf(&dirName, entry->mDirName))
+                group->mFailure = prepare_batch_group_(
+                    &batch, group, &dirName);
+        }
+
+        entry->mGroup = batch.mGroupsLen - 1;
+    }
+
+    batch.mRoundTrips = sRoundTrips - roundTrips;
+
+    run_pool_("Verify", batch.mEntriesLen, verify_batch_worker_, &batch);
+
+    DEBUG("Attribute round trips %u", batch.mRoundTrips);
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        close_pathbuf(&dirName);
+
+        for (size_t gx = 0; gx < batch.mGroupsLen; ++gx)
+            close_dirfd(&batch.mGroups[gx].mDir);
+        free(batch.mGroups);
+
+        free(batch.mEntries);
+        free(batch.mRequestors);
+        free(batch.mLicensors);
+    });
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+match_env_(const char *aVar, size_t aNameLen, const char *aName)
+{
+    return !strncmp(aVar, aName, aNameLen) && !aName[aNameLen];
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+put_env_(char **aEnv, size_t *aEnvLen, char *aVar, size_t aNameLen)
+{
+    /* Replace an earlier setting of the same name in place, in the
+     * manner of setenv(3), otherwise append the new setting.
+     */
+
+    for (size_t ex = 0; ex < *aEnvLen; ++ex) {
+        if (!strncmp(aEnv[ex], aVar, aNameLen + 1)) {
+            free(aEnv[ex]);
+            aEnv[ex] = aVar;
+            return;
+        }
+    }
+
+    aEnv[(*aEnvLen)++] = aVar;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+add_env_(
+    struct suxec_license *self, size_t *aEnvLen,
+    const char *aName, const char *aValue)
+{
+    int rc = -1;
+
+    char *var;
+    if (-1 == asprintf(&var, "%s=%s", aName, aValue)) {
+        refuse_(self, FAILURE_ENVIRONMENT,
+            "Unable to set environment variable %s=%s", aName, aValue);
+        goto Finally;
+    }
+
+    put_env_(self->mState->mEnv, aEnvLen, var, strlen(aName));
+
+    DEBUG("Env %s", var);
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_environment(
+    struct suxec_license *self, char * const *aEnv, size_t aEnvLen)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    struct suxec_license_state *state = self->mState;
+
+    if (!state || !state->mVerified || state->mEnv) {
+        errno = EINVAL;
+        refuse_(self, FAILURE_ENVIRONMENT, "Unable to construct environment");
+        goto Finally;
+    }
+
+    /* Allow for each of the settings, the four defaults, and the
+     * terminating null pointer.
+     */
+
+    state->mEnv = calloc(aEnvLen + 4 + 1, sizeof(*state->mEnv));
+    if (!state->mEnv) {
+        refuse_(self, FAILURE_ENVIRONMENT, "Unable to construct environment");
+        goto Finally;
+    }
+
+    size_t envLen = 0;
+
+    /* Add all the specified variables to the environment. Named
+     * variables override the default LOGNAME, PATH, HOME, and SHELL,
+     * variables that would normally be added.
+     */
+
+    const char *logNameEnv = "LOGNAME";
+    const char *pathEnv = "PATH";
+    const char *homeEnv = "HOME";
+    const char *shellEnv = "SHELL";
+
+    const char *foundEnv = "";
+
+    for (size_t ex = 0; ex < aEnvLen; ++ex) {
+        DEBUG("Env %s", aEnv[ex]);
+
+        const char *envSep = strchr(aEnv[ex], '=');
+        if (!envSep || envSep == aEnv[ex]) {
+            errno = 0;
+            refuse_(self, FAILURE_ENVIRONMENT,
+                "Unable to parse environment variable %s", aEnv[ex]);
+            goto Finally;
+        }
+
+        size_t nameLen = envSep - aEnv[ex];
+
+        if (match_env_(aEnv[ex], nameLen, logNameEnv))
+            logNameEnv = foundEnv;
+        else if (match_env_(aEnv[ex], nameLen, pathEnv))
+            pathEnv = foundEnv;
+        else if (match_env_(aEnv[ex], nameLen, homeEnv))
+            homeEnv = foundEnv;
+        else if (match_env_(aEnv[ex], nameLen, shellEnv))
+            shellEnv = foundEnv;
+
+        char *var = strdup(aEnv[ex]);
+        if (!var) {
+            refuse_(self, FAILURE_ENVIRONMENT,
+                "Unable to set environment variable %s", aEnv[ex]);
+            goto Finally;
+        }
+
+        put_env_(state->mEnv, &envLen, var, nameLen);
+    }
+
+    if (logNameEnv != foundEnv) {
+        if (add_env_(self, &envLen, logNameEnv, state->mLicensor->mName))
+            goto Finally;
+    }
+
+    if (homeEnv != foundEnv) {
+        if (add_env_(self, &envLen, homeEnv, state->mLicensor->mHome))
+            goto Finally;
+    }
+
+    if (shellEnv != foundEnv) {
+        if (add_env_(self, &envLen, shellEnv, "/bin/sh"))
+            goto Finally;
+    }
+
+    if (pathEnv != foundEnv) {
+        if (add_env_(self, &envLen, pathEnv, "/usr/bin:/bin"))
+            goto Finally;
+    }
+
+    self->mEnv = state->mEnv;
+
+    notify_(SUXEC_EVENT_ENVIRONMENT, 0);
+
+    rc = 0;
+
+Finally:
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_impersonate(struct suxec_license *self)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    struct suxec_license_state *state = self->mState;
+
+    if (!state || !state->mVerified) {
+        errno = EINVAL;
+        refuse_(self, FAILURE_OTHER, "Unable to impersonate licensor");
+        goto Finally;
+    }
+
+    if (impersonate_user(self, state->mLicensor, state->mGroups))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+exec_license_(struct suxec_license *self, int aFd)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    struct suxec_license_state *state = self->mState;
+
+    if (!state || !state->mVerified) {
+        errno = EINVAL;
+        refuse_(self, FAILURE_OTHER, "Unable to execute program");
+        goto Finally;
+    }
+
+    if (-1 == aFd)
+        DEBUG("Executing %s", state->mPath.mBuf);
+    else
+        DEBUG("Executing copy of %s", state->mPath.mBuf);
+
+    PROBE(exec, state->mPath.mBuf);
+
+    char *args[2] = {
+        state->mPath.mBuf,
+        0
+    };
+
+    char *noEnv[1] = { 0 };
+
+    if (-1 == aFd)
+        execve(state->mPath.mBuf, args, self->mEnv ? self->mEnv : noEnv);
+    else
+        execveat(aFd, "", args, self->mEnv ? self->mEnv : noEnv, AT_EMPTY_PATH);
+
+    refuse_(self, FAILURE_OTHER, "Unable to execute %s", state->mPath.mBuf);
+
+Finally:
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_exec(struct suxec_license *self)
+{
+    return exec_license_(self, -1);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_exec_copy(struct suxec_license *self, int aFd)
+{
+    if (-1 == aFd) {
+        errno = EBADF;
+        refuse_(self, FAILURE_OTHER, "Unable to execute copy");
+        return -1;
+    }
+
+    /* The copy is executable wherever it is held, so only use it if
+     * the licensor could execute the original in place.
+     */
+
+    if (self->mState && self->mState->mVerified && faccessat(
+            AT_FDCWD, self->mState->mPath.mBuf, X_OK, AT_EACCESS)) {
+        refuse_(self, FAILURE_OTHER,
+            "Unable to execute %s", self->mState->mPath.mBuf);
+        return -1;
+    }
+
+    return exec_license_(self, aFd);
+}
+
+/* -------------------------------------------------------------------------- */
+struct suxec_spawn_report_ {
+    enum failure mFailure;
+    int mErrno;
+    char mMessage[sizeof(((struct suxec_license *) 0)->mMessage)];
+};
+
+pid_t
+suxec_spawn(struct suxec_license *self)
+{
+    pid_t rc = -1;
+
+    const struct suxec_context *context = enter_context_(self->mContext);
+
+    int reportFd[2] = { -1, -1 };
+
+    /* The child reports a failure to impersonate the licensor, or
+     * to execute the program, through a pipe that is otherwise
+     * closed when the program is executed.
+     */
+
+    if (pipe2(reportFd, O_CLOEXEC)) {
+        refuse_(self, FAILURE_OTHER, "Unable to create pipe");
+        goto Finally;
+    }
+
+    pid_t pid = fork();
+    if (-1 == pid) {
+        refuse_(self, FAILURE_OTHER, "Unable to fork");
+        goto Finally;
+    }
+
+    if (!pid) {
+        if (!suxec_impersonate(self))
+            suxec_exec(self);
+
+        struct suxec_spawn_report_ report = {
+            .mFailure = self->mFailure,
+            .mErrno = self->mErrno,
+        };
+        memcpy(report.mMessage, self->mMessage, sizeof(report.mMessage));
+
+        ssize_t reportLen = write(reportFd[1], &report, sizeof(report));
+        (void) reportLen;
+
+        _exit(127);
+    }
+
+    reportFd[1] = fdclose(reportFd[1]);
+
+    struct suxec_spawn_report_ report;
+
+    ssize_t reportLen;
+    do
+        reportLen = read(reportFd[0], &report, sizeof(report));
+    while (-1 == reportLen && EINTR == errno);
+
+    if (reportLen) {
+        if (sizeof(report) == reportLen) {
+            self->mFailure = report.mFailure;
+            self->mErrno = report.mErrno;
+            memcpy(self->mMessage, report.mMessage, sizeof(self->mMessage));
+        } else {
+            refuse_(self, FAILURE_OTHER,
+                "Unable to launch %s", self->mPath ? self->mPath : "program");
+        }
+
+        while (-1 == waitpid(pid, 0, 0) && EINTR == errno)
+            ;
+
+        errno = self->mErrno;
+        goto Finally;
+    }
+
+    rc = pid;
+
+Finally:
+
+    FINALLY({
+        reportFd[0] = fdclose(reportFd[0]);
+        reportFd[1] = fdclose(reportFd[1]);
+    });
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+struct suxec_license *
+suxec_close_license(struct suxec_license *self)
+{
+    if (self) {
+        struct suxec_license_state *state = self->mState;
+
+        if (state) {
+            if (state->mEnv) {
+                for (char **envp = state->mEnv; *envp; ++envp)
+                    free(*envp);
+                free(state->mEnv);
+            }
+
+            close_pathbuf(&state->mPath);
+
+            free(state->mPins);
+            free(state->mPinPaths);
+
+            close_symlinkfd(state->mSymLink);
+
+            if (&state->mLicensor_ == state->mLicensor)
+                close_user(state->mLicensor);
+            if (&state->mRequestor_ == state->mRequestor)
+                close_user(state->mRequestor);
+            if (&state->mGroups_ == state->mGroups)
+                close_grouplist(state->mGroups);
+
+            free(state);
+        }
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+suxec_review(
+    const struct suxec_context *aContext, const char *aDir,
+    int (*aVisit)(
+        void *aArg,
+        const char *aLicensee, const char *aName, enum failure aVerdict),
+    void *aArg)
+{
+    int rc = -1;
+
+    const struct suxec_context *context = enter_context_(aContext);
+
+    int dirFd = -1;
+
+    struct review review = { .mContext = aContext };
+
+    dirFd = open(aDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (-1 == dirFd)
+        goto Finally;
+
+    if (statx(dirFd, "",
+            AT_EMPTY_PATH, STATX_MODE | STATX_UID, &review.mDirStat))
+        goto Finally;
+
+    if (read_review_dir_(&review, dirFd, visit_review_licensee_))
+        goto Finally;
+
+    for (size_t lx = 0; lx < review.mLicenseesLen; ++lx) {
+        struct review_licensee *licensee = &review.mLicensees[lx];
+
+        if (assign_pathbuf(&licensee->mPath, pathview_cstr(aDir)))
+            goto Finally;
+
+        if (append_path(&licensee->mPath, pathview_cstr(licensee->mName)))
+            goto Finally;
+    }
+
+    run_pool_("Audit", review.mRegistrationsLen, review_worker_, &review);
+
+    for (size_t rx = 0; rx < review.mRegistrationsLen; ++rx) {
+        const struct review_registration *registration =
+            &review.mRegistrations[rx];
+
+        if (aVisit(
+                aArg,
+                review.mLicensees[registration->mLicensee].mName,
+                registration->mName,
+                registration->mVerdict))
+            goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        for (size_t rx = 0; rx < review.mRegistrationsLen; ++rx)
+            free(review.mRegistrations[rx].mName);
+        free(review.mRegistrations);
+
+        for (size_t lx = 0; lx < review.mLicenseesLen; ++lx) {
+            free(review.mLicensees[lx].mName);
+            close_pathbuf(&review.mLicensees[lx].mPath);
+        }
+        free(review.mLicensees);
+
+        dirFd = fdclose(dirFd);
+    });
+
+    leave_context_(context);
+
+    return rc;
+}
+
+/* ************************************************************************** */
@@ -0,0 +1,341 @@
+#ifndef SUXEC_LIBSUXEC_H
+#define SUXEC_LIBSUXEC_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "failure.h"
+
+/* -------------------------------------------------------------------------- */
+/* Verification library
+ *
+ * Verify that a symlink is an authorised registration, and launch
+ * the registered program as the licensor. All state is held in storage
+ * owned by the caller, and each refusal is returned to the caller
+ * rather than terminating the process, so that a long running daemon
+ * can verify registrations concurrently on many threads.
+ *
+ * Registrations are verified using the file system credentials of
+ * the calling thread. A privileged caller should first adopt the
+ * credentials of the requestor, for example using setfsuid(2) and
+ * setfsgid(2) which only affect the calling thread.
+ *
+ * Process credentials are shared by all threads, so a multithreaded
+ * caller must impersonate the licensor and execute the program in
+ * a child process, as suxec_spawn() does.
+ */
+
+/* -------------------------------------------------------------------------- */
+/* Progress of a verification
+ *
+ * Events that carry a stat(2) result describe the object that was
+ * interrogated, and are otherwise null.
+ */
+
+enum suxec_event {
+    SUXEC_EVENT_GROUPLIST,
+    SUXEC_EVENT_REQUESTOR,
+    SUXEC_EVENT_DIRECTORY,
+    SUXEC_EVENT_SYMLINK,
+    SUXEC_EVENT_LICENSOR,
+    SUXEC_EVENT_PARENT_DIRECTORY,
+    SUXEC_EVENT_REGISTRATION,
+    SUXEC_EVENT_PARENT,
+    SUXEC_EVENT_HOP,
+    SUXEC_EVENT_TARGET,
+    SUXEC_EVENT_RESOLVE,
+    SUXEC_EVENT_ENVIRONMENT,
+};
+
+/* -------------------------------------------------------------------------- */
+/* Caller supplied hooks
+ *
+ * Debugging messages are only formatted if mDebug is provided, and
+ * each event is reported to mEvent if provided.
+ *
+ * A licensor can pin the SHA-256 digest of a target. Computing the
+ * digest reads the whole target, so each digest computed is offered
+ * to mStoreDigest, and mFetchDigest is asked for a digest before
+ * computing it. Digests are identified by the device, inode, size,
+ * and modification and change times, in aStat. mFetchDigest returns
+ * 0 if it provides the digest, or -1 otherwise.
+ *
+ * A verified chain of symlinks can be held in an index, so that the
+ * chain need not be followed again. Each chain verified using absolute
+ * paths is offered to mStoreChain as SUXEC_CHAIN_SIZE opaque bytes,
+ * and mFetchChain is asked for the chain of a registration before it
+ * is followed. Chains are identified by the device, inode, and change
+ * time of the registration symlink, in aRegistration. A chain from
+ * mFetchChain is only used if each object in it is unchanged, and
+ * mFetchChain returns 0 if it provides the chain, or -1 otherwise.
+ *
+ * All hooks are called on the thread performing the work.
+ *
+ * Registrations held on a network file system can set SUXEC_DONT_SYNC
+ * in mFlags, so that suxec_verify() and suxec_verify_batch() use the
+ * attributes cached by the file system while following the
+ * registration, and then fetch the attributes of the licensee
+ * directory, its parent, the registration symlink, and the target,
+ * once more from the file server, refusing the registration with
+ * FAILURE_CHANGED if any of them differ.
+ *
+ * Setting SUXEC_READAHEAD in mFlags starts reading the target into
+ * the page cache as soon as it is found to satisfy the rules, so that
+ * the reads overlap the remainder of the launch.
+ */
+
+#define SUXEC_DIGEST_SIZE 32
+#define SUXEC_CHAIN_SIZE 2048
+
+#define SUXEC_DONT_SYNC 0x1u
+#define SUXEC_READAHEAD 0x2u
+
+struct suxec_context {
+    void (*mDebug)(void *aArg, const char *aFmt, va_list aArgp);
+    void (*mEvent)(
+        void *aArg, enum suxec_event aEvent, const struct stat *aStat);
+    int (*mFetchDigest)(
+        void *aArg, const struct stat *aStat, unsigned char *aDigest);
+    void (*mStoreDigest)(
+        void *aArg, const struct stat *aStat, const unsigned char *aDigest);
+    int (*mFetchChain)(
+        void *aArg, const struct stat *aRegistration, void *aChain);
+    void (*mStoreChain)(
+        void *aArg, const struct stat *aRegistration, const void *aChain);
+    unsigned mFlags;
+    void *mArg;
+};
+
+/* -------------------------------------------------------------------------- */
+struct suxec_user {
+    uid_t mUid;
+    gid_t mGid;
+    const char *mName;
+    const char *mHome;
+};
+
+/* -------------------------------------------------------------------------- */
+/* License to run a registered program
+ *
+ * The verdict is FAILURE_NONE until a rule refuses the registration,
+ * in which case the reason is described by mErrno and mMessage. The
+ * remaining fields are filled as verification proceeds, and those
+ * not yet determined are zero. The strings and the environment
+ * remain valid until the license is closed.
+ *
+ * mRoundTrips counts the attribute fetches made by suxec_verify()
+ * that could not be answered from attributes cached by the file
+ * system.
+ */
+
+struct suxec_license_state;
+
+struct suxec_license {
+    const struct suxec_context *mContext;
+
+    enum failure mFailure;
+    int mErrno;
+    char mMessage[256];
+
+    struct suxec_user mRequestor;
+    struct suxec_user mLicensor;
+
+    const char *mSymlink;
+    struct stat mRegistrationStat;
+    unsigned mHops;
+    unsigned mRoundTrips;
+
+    const char *mPath;
+    struct stat mPathStat;
+
+    char **mEnv;
+
+    struct suxec_license_state *mState;
+};
+
+/* -------------------------------------------------------------------------- */
+/* Create a license that reports to the specified context
+ *
+ * The context must outlive the license. Creating a license makes
+ * no system calls and cannot fail.
+ */
+
+struct suxec_license *
+suxec_create_license(
+    struct suxec_license *self, const struct suxec_context *aContext);
+
+/* -------------------------------------------------------------------------- */
+/* Verify a registration for a requestor
+ *
+ * Apply the registration rules to the symlink on behalf of the
+ * requestor. Return 0 if the registration is authorised, or -1
+ * if it is refused. A license can only be verified once.
+ */
+
+int
+suxec_verify(
+    struct suxec_license *self,
+    uid_t aUid, gid_t aGid, const char *aSymlink);
+
+/* -------------------------------------------------------------------------- */
+/* Verify a registration using the users found by other licenses
+ *
+ * As suxec_verify(), but reuse the supplementary groups of the caller,
+ * the requestor, and the licensor, where these were already found
+ * by one of the aPeersLen licenses at aPeers, instead of querying the
+ * user and group databases again. The peers must remain open until
+ * this license is closed.
+ */
+
+int
+suxec_verify_with(
+    struct suxec_license *self,
+    const struct suxec_license *aPeers, size_t aPeersLen,
+    uid_t aUid, gid_t aGid, const char *aSymlink);
+
+/* -------------------------------------------------------------------------- */
+/* Revalidate a verified registration
+ *
+ * Confirm that each directory, symlink, and the target interrogated
+ * by suxec_verify() is unchanged, without applying the rules again.
+ * Relative paths are resolved from the current directory, which must
+ * not have changed since the license was verified. Return 0 if the
+ * registration is unchanged, or -1 if the license is refused with
+ * FAILURE_CHANGED, after which it can no longer be used.
+ */
+
+int
+suxec_revalidate(struct suxec_license *self);
+
+/* -------------------------------------------------------------------------- */
+/* Verify many registrations at once
+ *
+ * Verify each aSymlinks[i] on behalf of the requestor aUids[i], and
+ * store FAILURE_NONE, or the reason for refusal, in aVerdicts[i].
+ * Registrations held in the same directory share the checks of that
+ * directory and its licensor, and the symlink chains are followed
+ * concurrently. As with suxec_verify(), the chains are followed with
+ * the file system credentials of the caller. Return 0 if a verdict
+ * was reached for every registration, or -1 on failure.
+ */
+
+int
+suxec_verify_batch(
+    const struct suxec_context *aContext, size_t aLen,
+    const uid_t *aUids, const char * const *aSymlinks,
+    enum failure *aVerdicts);
+
+/* -------------------------------------------------------------------------- */
+/* Construct the environment for the program
+ *
+ * Construct LOGNAME, PATH, HOME, and SHELL, in the manner of
+ * crontab(5), overridden by the NAME=VALUE settings provided.
+ * Return 0 on success, or -1 if the environment is refused.
+ */
+
+int
+suxec_environment(
+    struct suxec_license *self, char * const *aEnv, size_t aEnvLen);
+
+/* -------------------------------------------------------------------------- */
+/* Impersonate the licensor
+ *
+ * Change the credentials of the process to those of the licensor,
+ * and verify that the privileged credentials cannot be recovered.
+ * Return 0 on success, or -1 on failure.
+ */
+
+int
+suxec_impersonate(struct suxec_license *self);
+
+/* -------------------------------------------------------------------------- */
+/* Execute the program
+ *
+ * Replace the process image with the verified program, using
+ * the constructed environment. Only returns on failure.
+ */
+
+int
+suxec_exec(struct suxec_license *self);
+
+/* -------------------------------------------------------------------------- */
+/* Execute a copy of the program
+ *
+ * As suxec_exec(), but execute the program held by the open file aFd,
+ * which the caller has confirmed is an unchanged copy of the verified
+ * program. The program is still given its own path as argv[0]. The
+ * copy is refused unless the impersonated licensor could execute
+ * the original, for example from a noexec file system.
+ */
+
+int
+suxec_exec_copy(struct suxec_license *self, int aFd);
+
+/* -------------------------------------------------------------------------- */
+/* Launch the program in a child process
+ *
+ * Fork a child that impersonates the licensor and executes the
+ * program. Return the pid of the child, or -1 if the child could
+ * not be created, or could not execute the program, in which case
+ * the reason is recorded in the license.
+ */
+
+pid_t
+suxec_spawn(struct suxec_license *self);
+
+/* -------------------------------------------------------------------------- */
+struct suxec_license *
+suxec_close_license(struct suxec_license *self);
+
+/* -------------------------------------------------------------------------- */
+/* Verify every registration in a registration directory
+ *
+ * Apply the registration rules to each entry in each licensee
+ * subdirectory of aDir, without executing anything. The verdicts
+ * are reported to aVisit in the order that the entries were found,
+ * and a non-zero return from aVisit stops the audit. Return 0 if
+ * the audit completes, or -1 on failure.
+ */
+
+int
+suxec_review(
+    const struct suxec_context *aContext, const char *aDir,
+    int (*aVisit)(
+        void *aArg,
+        const char *aLicensee, const char *aName, enum failure aVerdict),
+    void *aArg);
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_LIBSUXEC_H */
@@ -0,0 +1,349 @@
+#ifndef SUXEC_MAPPED_H
+#define SUXEC_MAPPED_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "finally.h"
+
+/* -------------------------------------------------------------------------- */
+/* Shared mapped files
+ *
+ * Statistics, the event trace, the digest cache, and the registration
+ * index, are each held in a file shared by all invocations, and mapped
+ * so that they can be used without system calls. Each file starts with
+ * a header holding a magic number and a version. The file is created
+ * and extended by the first writer, and concurrent creators race to
+ * initialise the header, all agreeing on the outcome.
+ *
+ * A file is only trusted if it could not have been prepared by another
+ * user. A writer must own the file, as must a reader that relies on
+ * the content, and nobody else can be allowed to write it.
+ */
+
+#define MAPPED_WRITE   0x1u
+#define MAPPED_CREATE  0x2u
+#define MAPPED_TRUSTED 0x4u
+
+struct mapped_header {
+    uint32_t mMagic;
+    uint32_t mVersion;
+};
+
+/* -------------------------------------------------------------------------- */
+static void *
+map_file(
+    const char *aPath, size_t aSize, unsigned aFlags, mode_t aMode,
+    uint32_t aMagic, uint32_t aVersion)
+{
+    int rc = -1;
+
+    int fd = -1;
+    void *map = MAP_FAILED;
+
+    int writable = !!(aFlags & MAPPED_WRITE);
+
+    fd = open(aPath,
+        (writable ? O_RDWR : O_RDONLY) |
+        (aFlags & MAPPED_CREATE ? O_CREAT : 0) | O_NOFOLLOW | O_CLOEXEC,
+        aMode);
+    if (-1 == fd)
+        goto Finally;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat))
+        goto Finally;
+
+    if (!S_ISREG(fileStat.st_mode) ||
+            ((aFlags & (MAPPED_WRITE | MAPPED_TRUSTED)) &&
+                fileStat.st_uid != geteuid()) ||
+            (fileStat.st_mode & (S_IWGRP | S_IWOTH))) {
+        errno = EPERM;
+        goto Finally;
+    }
+
+    if (aSize > (size_t) fileStat.st_size) {
+        if (!writable || ftruncate(fd, aSize))
+            goto Finally;
+    }
+
+    map = mmap(0, aSize,
+        PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    if (MAP_FAILED == map)
+        goto Finally;
+
+    struct mapped_header *header = map;
+
+    if (writable) {
+        uint32_t magic = 0;
+        if (__atomic_compare_exchange_n(
+                &header->mMagic, &magic, aMagic,
+                0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            __atomic_store_n(&header->mVersion, aVersion, __ATOMIC_RELAXED);
+    }
+
+    /* The version is briefly zero while a concurrent creator
+     * initialises the header.
+     */
+
+    uint32_t version = __atomic_load_n(&header->mVersion, __ATOMIC_RELAXED);
+
+    if (aMagic != __atomic_load_n(&header->mMagic, __ATOMIC_RELAXED) ||
+            (aVersion != version && version)) {
+        errno = EINVAL;
+        goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (-1 != fd)
+            close(fd);
+
+        if (rc && MAP_FAILED != map)
+            munmap(map, aSize);
+    });
+
+    return rc ? 0 : map;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline uint64_t
+hash_inode(uint64_t aDev, uint64_t aIno)
+{
+    return (aDev * 0x9e3779b97f4a7c15ULL) ^ (aIno * 0xc2b2ae3d27d4eb4fULL);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Shared mapped tables
+ *
+ * The digest cache and the registration index each hold a fixed size
+ * open addressed table keyed by a file. Each entry is a sequence
+ * number, followed by the words of the key, starting with the device
+ * and inode of the file, and then the words of the value. A key is
+ * placed using a bounded number of probes, and replaces any previous
+ * entry for the same file.
+ *
+ * Each entry is guarded by its sequence number, which is odd while the
+ * entry is being written. A reader only accepts an entry whose sequence
+ * number is even and unchanged after the entry is copied, and a writer
+ * that finds the entry busy does not wait.
+ *
+ * A writer can be killed part way through an entry, so the sequence
+ * number only occupies the low half of the first word of the entry,
+ * and the high half holds the pid of the writer while the entry is
+ * busy. A writer that finds the entry busy takes it over if that pid
+ * no longer exists, which relies on all writers sharing a pid
+ * namespace.
+ *
+ * Each unit uses only some of these functions, so they are inline
+ * to avoid warnings about the others.
+ */
+
+struct mapped_table {
+    void *mEntries;
+    size_t mEntrySize;
+    unsigned mEntriesLen;
+    unsigned mProbes;
+    unsigned mKeyWords;
+    unsigned mValueWords;
+};
+
+/* -------------------------------------------------------------------------- */
+static inline uint64_t *
+probe_mapped_entry_(
+    const struct mapped_table *aTable, const uint64_t *aKey, unsigned aProbe)
+{
+    size_t ix = (hash_inode(aKey[0], aKey[1]) + aProbe) % aTable->mEntriesLen;
+
+    return (uint64_t *) ((char *) aTable->mEntries + ix * aTable->mEntrySize);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int
+read_mapped_entry_(
+    const struct mapped_table *aTable, const uint64_t *aEntry,
+    const uint64_t *aKey, unsigned aKeyWords, uint64_t *aValue)
+{
+    /* Only copy the value of an entry that holds the leading words
+     * of the key, and accept the copy only if the entry was not
+     * changed meanwhile.
+     */
+
+    uint64_t seq = __atomic_load_n(&aEntry[0], __ATOMIC_ACQUIRE);
+    if (!seq || (seq & 1))
+        return -1;
+
+    const uint64_t *key = aEntry + 1;
+    const uint64_t *value = key + aTable->mKeyWords;
+
+    for (unsigned kx = 0; kx < aKeyWords; ++kx) {
+        if (aKey[kx] != __atomic_load_n(&key[kx], __ATOMIC_RELAXED))
+            return -1;
+    }
+
+    if (aValue) {
+        for (unsigned vx = 0; vx < aTable->mValueWords; ++vx)
+            aValue[vx] = __atomic_load_n(&value[vx], __ATOMIC_RELAXED);
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return seq == __atomic_load_n(&aEntry[0], __ATOMIC_RELAXED) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+write_mapped_entry_(
+    const struct mapped_table *aTable, uint64_t *aEntry,
+    const uint64_t *aKey, const uint64_t *aValue)
+{
+    /* Write the key, or clear it if there is none, and the value if
+     * there is one, while the entry is marked busy.
+     */
+
+    uint64_t word = __atomic_load_n(&aEntry[0], __ATOMIC_RELAXED);
+    uint32_t seq = word;
+
+    if (seq & 1) {
+        pid_t writer = word >> 32;
+
+        int savedErrno = errno;
+        int dead = writer && kill(writer, 0) && ESRCH == errno;
+        errno = savedErrno;
+
+        if (!dead)
+            return;
+
+        ++seq;
+    }
+
+    uint64_t busy = (uint64_t) getpid() << 32 | (uint32_t) (seq + 1);
+
+    if (!__atomic_compare_exchange_n(
+            &aEntry[0], &word, busy,
+            0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint64_t *key = aEntry + 1;
+    uint64_t *value = key + aTable->mKeyWords;
+
+    for (unsigned kx = 0; kx < aTable->mKeyWords; ++kx)
+        __atomic_store_n(&key[kx], aKey ? aKey[kx] : 0, __ATOMIC_RELAXED);
+
+    if (aValue) {
+        for (unsigned vx = 0; vx < aTable->mValueWords; ++vx)
+            __atomic_store_n(&value[vx], aValue[vx], __ATOMIC_RELAXED);
+    }
+
+    /* Only publish the entry if it was not taken over meanwhile. */
+
+    __atomic_compare_exchange_n(
+        &aEntry[0], &busy, (uint32_t) (seq + 2),
+        0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int
+fetch_mapped_entry(
+    const struct mapped_table *aTable, const uint64_t *aKey, uint64_t *aValue)
+{
+    for (unsigned px = 0; px < aTable->mProbes; ++px) {
+        if (!read_mapped_entry_(
+                aTable, probe_mapped_entry_(aTable, aKey, px),
+                aKey, aTable->mKeyWords, aValue))
+            return 0;
+    }
+
+    return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+store_mapped_entry(
+    const struct mapped_table *aTable,
+    const uint64_t *aKey, const uint64_t *aValue)
+{
+    /* Prefer the entry already holding the same file, so that each
+     * file holds at most one entry, then an unused entry, and
+     * otherwise evict the first entry.
+     */
+
+    uint64_t *entry = 0;
+
+    for (unsigned px = 0; px < aTable->mProbes; ++px) {
+        uint64_t *probe = probe_mapped_entry_(aTable, aKey, px);
+
+        if (!__atomic_load_n(&probe[0], __ATOMIC_RELAXED)) {
+            if (!entry)
+                entry = probe;
+        } else if (!read_mapped_entry_(aTable, probe, aKey, 2, 0)) {
+            entry = probe;
+            break;
+        }
+    }
+
+    if (!entry)
+        entry = probe_mapped_entry_(aTable, aKey, 0);
+
+    write_mapped_entry_(aTable, entry, aKey, aValue);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+erase_mapped_entry(const struct mapped_table *aTable, const uint64_t *aKey)
+{
+    /* Clear the key of each entry holding the same file, whatever
+     * the remaining words of the key.
+     */
+
+    for (unsigned px = 0; px < aTable->mProbes; ++px) {
+        uint64_t *entry = probe_mapped_entry_(aTable, aKey, px);
+
+        if (!read_mapped_entry_(aTable, entry, aKey, 2, 0))
+            write_mapped_entry_(aTable, entry, 0, 0);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_MAPPED_H */
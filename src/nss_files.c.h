@@ -0,0 +1,339 @@
+#ifndef SUXEC_NSS_FILES_H
+#define SUXEC_NSS_FILES_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "finally.h"
+
+/* -------------------------------------------------------------------------- */
+/* Files-only passwd and group database
+ *
+ * A statically linked program cannot use the NSS modules that would
+ * otherwise be loaded by getpwuid(3) and getgrouplist(3). Provide
+ * replacements that read the flat files directly using read(2),
+ * avoiding both dlopen(3) and stdio.
+ */
+
+#ifndef NSS_FILES_PASSWD
+#define NSS_FILES_PASSWD "/etc/passwd"
+#endif
+
+#ifndef NSS_FILES_GROUP
+#define NSS_FILES_GROUP "/etc/group"
+#endif
+
+/* -------------------------------------------------------------------------- */
+static char *
+nss_files_read_(const char *aPath)
+{
+    int rc = -1;
+
+    int fd = -1;
+    char *buf = 0;
+
+    fd = open(aPath, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+        goto Finally;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat))
+        goto Finally;
+
+    /* The file might be replaced or grow while it is being read, so
+     * treat the size as a hint, and continue reading until the end
+     * of the file is found.
+     */
+
+    size_t bufLen = fileStat.st_size + 1;
+    size_t readLen = 0;
+
+    buf = malloc(bufLen);
+    if (!buf)
+        goto Finally;
+
+    while (1) {
+        if (readLen + 1 == bufLen) {
+            char *resized = realloc(buf, bufLen * 2);
+            if (!resized)
+                goto Finally;
+            buf = resized;
+            bufLen *= 2;
+        }
+
+        ssize_t len = read(fd, buf + readLen, bufLen - readLen - 1);
+        if (-1 == len) {
+            if (EINTR == errno)
+                continue;
+            goto Finally;
+        }
+
+        if (!len)
+            break;
+
+        readLen += len;
+    }
+
+    buf[readLen] = 0;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (-1 != fd)
+            close(fd);
+
+        if (rc) {
+            free(buf);
+            buf = 0;
+        }
+    });
+
+    return buf;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Split the next line into colon separated fields
+ *
+ * Advance *aBuf past the next line, and nul terminate each field
+ * in place. Return the number of fields found, or -1 at the
+ * end of the buffer.
+ */
+
+static int
+nss_files_fields_(char **aBuf, char **aFields, int aMaxFields)
+{
+    char *bufp = *aBuf;
+
+    if (!*bufp)
+        return -1;
+
+    int fields = 0;
+
+    aFields[fields++] = bufp;
+
+    for (; *bufp && '\n' != *bufp; ++bufp) {
+        if (':' == *bufp) {
+            *bufp = 0;
+            if (fields < aMaxFields)
+                aFields[fields++] = bufp + 1;
+        }
+    }
+
+    if (*bufp)
+        *bufp++ = 0;
+
+    *aBuf = bufp;
+
+    /* Ignore comments, and compat entries that would otherwise
+     * require the services of another database.
+     */
+
+    if ('#' == *aFields[0] || '+' == *aFields[0] || '-' == *aFields[0])
+        return 0;
+
+    return fields;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+nss_files_id_(const char *aField, unsigned long *aId)
+{
+    char *endp;
+
+    if (!*aField)
+        return -1;
+
+    errno = 0;
+    *aId = strtoul(aField, &endp, 10);
+    if (*endp || errno)
+        return -1;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Find the passwd entry for a uid
+ *
+ * In the manner of getpwuid_r(3), the entry is returned in storage
+ * provided by the caller. The strings refer to a buffer that is
+ * returned in *aBuf, replacing any previous buffer, and which
+ * the caller must free.
+ */
+
+static struct passwd *
+nss_files_getpwuid_r(uid_t aUid, struct passwd *aPasswd, char **aBuf)
+{
+    struct passwd *pw = 0;
+
+    free(*aBuf);
+
+    *aBuf = nss_files_read_(NSS_FILES_PASSWD);
+    if (!*aBuf)
+        goto Finally;
+
+    errno = 0;
+
+    for (char *bufp = *aBuf; ; ) {
+
+        char *fields[7];
+
+        int numFields = nss_files_fields_(&bufp, fields, 7);
+        if (-1 == numFields)
+            break;
+
+        if (7 != numFields)
+            continue;
+
+        unsigned long uid, gid;
+
+        if (nss_files_id_(fields[2], &uid) || uid != aUid)
+            continue;
+
+        if (nss_files_id_(fields[3], &gid))
+            continue;
+
+        *aPasswd = (struct passwd) {
+            .pw_name = fields[0],
+            .pw_passwd = fields[1],
+            .pw_uid = uid,
+            .pw_gid = gid,
+            .pw_gecos = fields[4],
+            .pw_dir = fields[5],
+            .pw_shell = fields[6],
+        };
+
+        pw = aPasswd;
+        break;
+    }
+
+Finally:
+
+    return pw;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+nss_files_getgrouplist(
+    const char *aUser, gid_t aGroup, gid_t *aGroups, int *aNumGroups)
+{
+    int rc = -1;
+
+    char *groupBuf = 0;
+
+    groupBuf = nss_files_read_(NSS_FILES_GROUP);
+    if (!groupBuf)
+        goto Finally;
+
+    /* Mirror getgrouplist(3) by always listing the specified group
+     * first, followed by the groups that name the user as a member.
+     * Count all the groups found so that the caller can learn the
+     * size of the list if the buffer is too small.
+     */
+
+    int numGroups = 0;
+
+    if (numGroups < *aNumGroups)
+        aGroups[numGroups] = aGroup;
+    ++numGroups;
+
+    for (char *bufp = groupBuf; ; ) {
+
+        char *fields[4];
+
+        int numFields = nss_files_fields_(&bufp, fields, 4);
+        if (-1 == numFields)
+            break;
+
+        if (4 != numFields)
+            continue;
+
+        unsigned long gid;
+        if (nss_files_id_(fields[2], &gid) || gid == aGroup)
+            continue;
+
+        for (char *memberp = fields[3]; *memberp; ) {
+
+            size_t memberLen = strcspn(memberp, ",");
+
+            if (strlen(aUser) == memberLen &&
+                    !memcmp(memberp, aUser, memberLen)) {
+
+                int gx;
+                for (gx = 1; gx < numGroups && gx < *aNumGroups; ++gx) {
+                    if (aGroups[gx] == gid)
+                        break;
+                }
+
+                if (gx == numGroups || gx == *aNumGroups) {
+                    if (numGroups < *aNumGroups)
+                        aGroups[numGroups] = gid;
+                    ++numGroups;
+                }
+                break;
+            }
+
+            memberp += memberLen;
+            if (*memberp)
+                ++memberp;
+        }
+    }
+
+    if (numGroups > *aNumGroups) {
+        *aNumGroups = numGroups;
+        goto Finally;
+    }
+
+    *aNumGroups = numGroups;
+
+    rc = numGroups;
+
+Finally:
+
+    FINALLY({
+        free(groupBuf);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_NSS_FILES_H */
@@ -0,0 +1,154 @@
+#ifndef SUXEC_PATHBUF_H
+#define SUXEC_PATHBUF_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* Path views and path buffers
+ *
+ * A path view refers to a run of characters owned by another party,
+ * which is not necessarily nul terminated. A path buffer owns a nul
+ * terminated path, and retains its capacity so that it can be reused
+ * as the path is modified in place.
+ */
+
+struct pathview {
+    const char *mPtr;
+    size_t mLen;
+};
+
+struct pathbuf {
+    char *mBuf;
+    size_t mLen;
+    size_t mSize;
+};
+
+/* Count the allocations made for all path buffers so that the cost
+ * of resolving a path can be measured. The count is updated atomically
+ * because registrations can be audited concurrently.
+ */
+
+static unsigned sPathBufAllocs;
+
+/* -------------------------------------------------------------------------- */
+static inline struct pathview
+pathview_cstr(const char *aStr)
+{
+    return (struct pathview) { aStr ? aStr : "", aStr ? strlen(aStr) : 0 };
+}
+
+/* -------------------------------------------------------------------------- */
+static inline struct pathview
+pathview_buf(const struct pathbuf *aBuf)
+{
+    return (struct pathview) { aBuf->mBuf, aBuf->mLen };
+}
+
+/* -------------------------------------------------------------------------- */
+static inline struct pathbuf *
+create_pathbuf(struct pathbuf *self)
+{
+    self->mBuf = 0;
+    self->mLen = 0;
+    self->mSize = 0;
+
+    return self;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline struct pathbuf *
+close_pathbuf(struct pathbuf *self)
+{
+    if (self) {
+        free(self->mBuf);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Reserve space for a path of the specified length
+ *
+ * Ensure that the buffer has room for the path and its terminating nul,
+ * preserving the current content. The buffer is sized to hold typical
+ * paths on first use, and doubles thereafter, so that the number of
+ * allocations remains small and independent of how often the buffer
+ * is reused.
+ */
+
+static inline int
+reserve_pathbuf(struct pathbuf *self, size_t aLen)
+{
+    if (aLen < self->mSize)
+        return 0;
+
+    size_t size = self->mSize ? self->mSize : PATH_MAX;
+
+    while (aLen >= size) {
+        size *= 2;
+        if (!size) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    char *buf = realloc(self->mBuf, size);
+    if (!buf)
+        return -1;
+
+    __atomic_fetch_add(&sPathBufAllocs, 1, __ATOMIC_RELAXED);
+
+    self->mBuf = buf;
+    self->mSize = size;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int
+assign_pathbuf(struct pathbuf *self, struct pathview aPath)
+{
+    if (reserve_pathbuf(self, aPath.mLen))
+        return -1;
+
+    memcpy(self->mBuf, aPath.mPtr, aPath.mLen);
+    self->mBuf[aPath.mLen] = 0;
+    self->mLen = aPath.mLen;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_PATHBUF_H */
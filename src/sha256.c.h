@@ -0,0 +1,221 @@
+#ifndef SUXEC_SHA256_H
+#define SUXEC_SHA256_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/* SHA-256 message digest
+ *
+ * A straightforward implementation of FIPS 180-4, so that the digest
+ * of a target can be computed without depending on a cryptographic
+ * library that a static build cannot easily link.
+ */
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+struct sha256 {
+    uint32_t mState[8];
+    uint64_t mLen;
+    size_t mBufLen;
+    unsigned char mBuf[SHA256_BLOCK_SIZE];
+};
+
+static const uint32_t sSha256Rounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/* -------------------------------------------------------------------------- */
+static inline uint32_t
+rotate_sha256_(uint32_t aWord, unsigned aBits)
+{
+    return (aWord >> aBits) | (aWord << (32 - aBits));
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+compress_sha256_(struct sha256 *self, const unsigned char *aBlock)
+{
+    uint32_t w[64];
+
+    for (unsigned wx = 0; wx < 16; ++wx)
+        w[wx] =
+            (uint32_t) aBlock[4*wx+0] << 24 |
+            (uint32_t) aBlock[4*wx+1] << 16 |
+            (uint32_t) aBlock[4*wx+2] <<  8 |
+            (uint32_t) aBlock[4*wx+3];
+
+    for (unsigned wx = 16; wx < 64; ++wx) {
+        uint32_t s0 =
+            rotate_sha256_(w[wx-15], 7) ^
+            rotate_sha256_(w[wx-15], 18) ^ (w[wx-15] >> 3);
+        uint32_t s1 =
+            rotate_sha256_(w[wx-2], 17) ^
+            rotate_sha256_(w[wx-2], 19) ^ (w[wx-2] >> 10);
+        w[wx] = w[wx-16] + s0 + w[wx-7] + s1;
+    }
+
+    uint32_t a = self->mState[0];
+    uint32_t b = self->mState[1];
+    uint32_t c = self->mState[2];
+    uint32_t d = self->mState[3];
+    uint32_t e = self->mState[4];
+    uint32_t f = self->mState[5];
+    uint32_t g = self->mState[6];
+    uint32_t h = self->mState[7];
+
+    for (unsigned rx = 0; rx < 64; ++rx) {
+        uint32_t s1 =
+            rotate_sha256_(e, 6) ^
+            rotate_sha256_(e, 11) ^ rotate_sha256_(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + sSha256Rounds[rx] + w[rx];
+        uint32_t s0 =
+            rotate_sha256_(a, 2) ^
+            rotate_sha256_(a, 13) ^ rotate_sha256_(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    self->mState[0] += a;
+    self->mState[1] += b;
+    self->mState[2] += c;
+    self->mState[3] += d;
+    self->mState[4] += e;
+    self->mState[5] += f;
+    self->mState[6] += g;
+    self->mState[7] += h;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_sha256(struct sha256 *self)
+{
+    static const uint32_t initialState[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(self->mState, initialState, sizeof(self->mState));
+    self->mLen = 0;
+    self->mBufLen = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+update_sha256(struct sha256 *self, const void *aData, size_t aLen)
+{
+    const unsigned char *data = aData;
+
+    self->mLen += aLen;
+
+    /* Complete any partial block, then compress whole blocks directly
+     * from the input, and retain the remainder.
+     */
+
+    if (self->mBufLen) {
+        size_t fill = SHA256_BLOCK_SIZE - self->mBufLen;
+        if (fill > aLen)
+            fill = aLen;
+
+        memcpy(self->mBuf + self->mBufLen, data, fill);
+        self->mBufLen += fill;
+        data += fill;
+        aLen -= fill;
+
+        if (SHA256_BLOCK_SIZE != self->mBufLen)
+            return;
+
+        compress_sha256_(self, self->mBuf);
+        self->mBufLen = 0;
+    }
+
+    for (; SHA256_BLOCK_SIZE <= aLen; aLen -= SHA256_BLOCK_SIZE) {
+        compress_sha256_(self, data);
+        data += SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(self->mBuf, data, aLen);
+    self->mBufLen = aLen;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+finish_sha256(struct sha256 *self, unsigned char *aDigest)
+{
+    uint64_t bits = self->mLen * 8;
+
+    unsigned char pad[SHA256_BLOCK_SIZE + 8] = { 0x80 };
+
+    size_t padLen = SHA256_BLOCK_SIZE - (self->mLen + 8) % SHA256_BLOCK_SIZE;
+
+    for (unsigned bx = 0; bx < 8; ++bx)
+        pad[padLen + bx] = bits >> (56 - 8 * bx);
+
+    update_sha256(self, pad, padLen + 8);
+
+    for (unsigned sx = 0; sx < 8; ++sx) {
+        aDigest[4*sx+0] = self->mState[sx] >> 24;
+        aDigest[4*sx+1] = self->mState[sx] >> 16;
+        aDigest[4*sx+2] = self->mState[sx] >>  8;
+        aDigest[4*sx+3] = self->mState[sx];
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_SHA256_H */
@@ -0,0 +1,254 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/* -------------------------------------------------------------------------- */
+/* Slow backend interposer
+ *
+ * Preload this module to add latency to the name service and
+ * filesystem calls made by suxec, reproducing the behaviour of
+ * slow LDAP and NFS backends without either:
+ *
+ *  SLOW_NSS=DELAY[:JITTER]   Delay getpwuid_r(3) and getgrouplist(3).
+ *  SLOW_FS=DELAY[:JITTER]    Delay openat(2), fstatat(2), statx(2)
+ *                            and readlinkat(2).
+ *  SLOW_SEED=N               Seed for the jitter sequence.
+ *  SLOW_TRACE=1              Print each delay to stderr.
+ *
+ * Delays are in microseconds. Each call sleeps for DELAY plus a
+ * pseudo-random amount up to JITTER. The sequence is determined
+ * only by the seed, so that repeated runs see the same delays.
+ *
+ * As with NFS, statx(2) using AT_STATX_DONT_SYNC is answered from
+ * cached attributes, and is not delayed.
+ *
+ * Only dynamically linked programs can be interposed, and the
+ * dynamic loader ignores LD_PRELOAD for setuid programs, so this
+ * is used with unprivileged runs of suxec in tests and benchmarks.
+ */
+
+struct slow_delay
+{
+    unsigned long mDelay;
+    unsigned long mJitter;
+};
+
+static struct slow_delay sSlowNss;
+static struct slow_delay sSlowFs;
+
+static unsigned long long sSlowSeed;
+static int sSlowTrace;
+
+/* -------------------------------------------------------------------------- */
+static void
+slow_parse_(struct slow_delay *aDelay, const char *aEnv)
+{
+    const char *delay = getenv(aEnv);
+    if (delay) {
+        char *end;
+        aDelay->mDelay = strtoul(delay, &end, 10);
+        if (':' == *end)
+            aDelay->mJitter = strtoul(end + 1, 0, 10);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void __attribute__((__constructor__))
+slow_init_(void)
+{
+    /* Read the configuration when the module is loaded because
+     * suxec clears its environment before it starts work.
+     */
+
+    slow_parse_(&sSlowNss, "SLOW_NSS");
+    slow_parse_(&sSlowFs, "SLOW_FS");
+
+    const char *seed = getenv("SLOW_SEED");
+    sSlowSeed = seed ? strtoull(seed, 0, 10) : 0;
+    if (!sSlowSeed)
+        sSlowSeed = 1;
+
+    const char *trace = getenv("SLOW_TRACE");
+    sSlowTrace = trace && '1' == *trace;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+slow_down_(const struct slow_delay *aDelay, const char *aName)
+{
+    int err = errno;
+
+    unsigned long long delay = aDelay->mDelay;
+
+    if (aDelay->mJitter) {
+        sSlowSeed ^= sSlowSeed << 13;
+        sSlowSeed ^= sSlowSeed >> 7;
+        sSlowSeed ^= sSlowSeed << 17;
+
+        delay += sSlowSeed % (aDelay->mJitter + 1);
+    }
+
+    if (sSlowTrace)
+        dprintf(STDERR_FILENO, "slow %s %lluus\n", aName, delay);
+
+    if (delay) {
+        struct timespec ts = {
+            .tv_sec = delay / 1000000,
+            .tv_nsec = delay % 1000000 * 1000,
+        };
+
+        while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts))
+            ;
+    }
+
+    errno = err;
+}
+
+/* -------------------------------------------------------------------------- */
+static void *
+slow_next_(const char *aSymbol)
+{
+    void *next = dlsym(RTLD_NEXT, aSymbol);
+    if (!next)
+        abort();
+
+    return next;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+getpwuid_r(
+    uid_t aUid, struct passwd *aPasswd,
+    char *aBuf, size_t aBufLen, struct passwd **aResult)
+{
+    static int (*next)(
+        uid_t, struct passwd *, char *, size_t, struct passwd **);
+
+    if (!next)
+        next = slow_next_("getpwuid_r");
+
+    slow_down_(&sSlowNss, "getpwuid_r");
+
+    return next(aUid, aPasswd, aBuf, aBufLen, aResult);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+getgrouplist(const char *aUser, gid_t aGroup, gid_t *aGroups, int *aNumGroups)
+{
+    static int (*next)(const char *, gid_t, gid_t *, int *);
+
+    if (!next)
+        next = slow_next_("getgrouplist");
+
+    slow_down_(&sSlowNss, "getgrouplist");
+
+    return next(aUser, aGroup, aGroups, aNumGroups);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+openat(int aDirFd, const char *aPath, int aFlags, ...)
+{
+    static int (*next)(int, const char *, int, ...);
+
+    if (!next)
+        next = slow_next_("openat");
+
+    mode_t mode = 0;
+
+    if (aFlags & (O_CREAT | O_TMPFILE)) {
+        va_list argp;
+        va_start(argp, aFlags);
+        mode = va_arg(argp, mode_t);
+        va_end(argp);
+    }
+
+    slow_down_(&sSlowFs, "openat");
+
+    return next(aDirFd, aPath, aFlags, mode);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+fstatat(int aDirFd, const char *aPath, struct stat *aStat, int aFlags)
+{
+    static int (*next)(int, const char *, struct stat *, int);
+
+    if (!next)
+        next = slow_next_("fstatat");
+
+    slow_down_(&sSlowFs, "fstatat");
+
+    return next(aDirFd, aPath, aStat, aFlags);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+statx(int aDirFd, const char *aPath, int aFlags,
+      unsigned aMask, struct statx *aStat)
+{
+    static int (*next)(int, const char *, int, unsigned, struct statx *);
+
+    if (!next)
+        next = slow_next_("statx");
+
+    if (AT_STATX_DONT_SYNC != (aFlags & AT_STATX_SYNC_TYPE))
+        slow_down_(&sSlowFs, "statx");
+
+    return next(aDirFd, aPath, aFlags, aMask, aStat);
+}
+
+/* -------------------------------------------------------------------------- */
+ssize_t
+readlinkat(int aDirFd, const char *aPath, char *aBuf, size_t aBufSize)
+{
+    static ssize_t (*next)(int, const char *, char *, size_t);
+
+    if (!next)
+        next = slow_next_("readlinkat");
+
+    slow_down_(&sSlowFs, "readlinkat");
+
+    return next(aDirFd, aPath, aBuf, aBufSize);
+}
+
+/* -------------------------------------------------------------------------- */
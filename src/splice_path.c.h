@@ -29,235 +29,211 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include <errno.h>
-#include <stdarg.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "debug.h"
-#include "finally.h"
+#include "pathbuf.h"
+
+/* -------------------------------------------------------------------------- */
+/* Scan for slashes
+ *
+ * Return a pointer to the first byte in the range that is a slash
+ * if aSlash is set, or the first byte that is not a slash otherwise.
+ * Return aEnd if there is no such byte. Whole blocks are compared at
+ * once where the instruction set allows, which is effective because
+ * most names and separators in paths are short.
+ */
+
+static const char *
+splice_path_scan_(const char *aPtr, const char *aEnd, int aSlash)
+{
+#ifdef __AVX2__
+    const __m256i slash32 = _mm256_set1_epi8('/');
+
+    for (; 32 <= aEnd - aPtr; aPtr += 32) {
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *) aPtr), slash32));
+        if (!aSlash)
+            mask = ~mask;
+        if (mask)
+            return aPtr + __builtin_ctz(mask);
+    }
+#endif
+
+#ifdef __SSE2__
+    const __m128i slash16 = _mm_set1_epi8('/');
+
+    for (; 16 <= aEnd - aPtr; aPtr += 16) {
+        unsigned mask = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *) aPtr), slash16));
+        if (!aSlash)
+            mask ^= 0xffff;
+        if (mask)
+            return aPtr + __builtin_ctz(mask);
+    }
+#endif
 
-#include "stpcpyv.c.h"
+    while (aPtr != aEnd && aSlash != ('/' == *aPtr))
+        ++aPtr;
+
+    return aPtr;
+}
 
 /* -------------------------------------------------------------------------- */
-/* Splice path from for base and directory names
+/* Append a name to a normalised path
+ *
+ * Append aName to the normalised path held in the buffer, normalising
+ * the name in place to remove dot names, dot-dot names, and repeated
+ * slashes. If the buffer is empty, the first character of the name
+ * determines whether the path is absolute. The name must not refer
+ * to the content of the buffer.
  *
+ * The name is scanned a whole name at a time, and written to the
+ * buffer in a single pass.
  */
 
 static int
-splice_path(char **aPath, const char *aDirName, const char *aBaseName)
+append_path(struct pathbuf *self, struct pathview aName)
 {
     int rc = -1;
 
-    /* Join the lhs and rhs together, separated by a slash, and
-     * always add an additional slash as a sentinel. The sentinel
-     * simplifies checking for the end of the path since the terminating
-     * nul will only occur after a slash, and there will always be
-     * a slash to mark the end of a name.
+    /* Reserve space before modifying the buffer so that the path
+     * is unchanged if the buffer cannot be grown.
      */
 
-    size_t lhsLen = aDirName ? strlen(aDirName) : 0;
-    size_t rhsLen = aBaseName ? strlen(aBaseName) : 0;
-
-    size_t pathBufLen = lhsLen + sizeof("/") + rhsLen + sizeof("/");
-
-    char *pathBuf = malloc(pathBufLen);
-    if (!pathBuf)
-        goto Finally;
-    if (!lhsLen)
-        strcpy(strcpy(pathBuf, aBaseName) + rhsLen, "/");
-    else if (!rhsLen)
-        strcpy(strcpy(pathBuf, aDirName) + lhsLen, "/");
-    else if (!stpcpyv(pathBuf, pathBufLen, aDirName, "/", aBaseName, "/", 0))
+    if (reserve_pathbuf(self, self->mLen + sizeof("/") + aName.mLen))
         goto Finally;
 
-    DEBUG("Spliced path %s", pathBuf);
+    /* Treat "." as the empty relative path, so that names can
+     * simply be appended.
+     */
 
-    char *rhsp = pathBuf;
+    if (!self->mLen) {
+        if (aName.mLen && '/' == *aName.mPtr)
+            self->mBuf[self->mLen++] = '/';
+    } else if (1 == self->mLen && '.' == *self->mBuf) {
+        self->mLen = 0;
+    }
 
-    /* If the path is relative, skip the first name to find the
-     * first slash. Note that this slash might be the sentinel
-     * that terminates the path.
+    /* The path comprises an optional leading slash, followed by a
+     * sequence of dot-dot names that cannot be retracted,
+     * followed by the names that remain. Because the path is
+     * normalised, dot-dot names only occur at the start.
      */
 
-    while ('/' != *rhsp)
-        ++rhsp;
+    int absolute = self->mLen && '/' == *self->mBuf;
 
-    char *lhsp = rhsp;
+    char *rootp = self->mBuf + !!absolute;
+    char *lhsp = self->mBuf + self->mLen;
 
-    while (1) {
+    const char *endp = aName.mPtr + aName.mLen;
 
-        /* Making use of of the fact that there is a final slash
-         * as a sentinel, each iteration of the loop starts at
-         * a slash.
-         *
-         * Advance the pointer until it points at the final
-         * slash in a sequence.
-         */
+    for (const char *rhsp = aName.mPtr; ; ) {
 
-        while ('/' == rhsp[1])
-            ++rhsp;
+        rhsp = splice_path_scan_(rhsp, endp, 0);
+        if (rhsp == endp)
+            break;
 
-        /* There are four interesting cases at scanned path:
-         *
-         *  1. "..../"
-         *  2. "...././"
-         *  3. "..../../"
-         *  4. "..../name/"
-         *
-         * Case 4 is the most common, so check for that first,
-         * combining that with a check for Case 1.
-         */
+        const char *namep = rhsp;
 
-        if ('.' != rhsp[1]) {
+        rhsp = splice_path_scan_(rhsp, endp, 1);
 
-            /* Check for Case 1 which detects the terminating sentinel
-             * at the end of the path. Take care of the special case
-             * where the path contains only slashes.
-             */
+        size_t nameLen = rhsp - namep;
 
-            if (!rhsp[1]) {
-                if (pathBuf == lhsp)
-                    *lhsp++ = '/';
-                break;
-            }
+        if ('.' == namep[0]) {
 
-            /* This is Case 4, but check of the special cases where
-             * the emitted path contains:
-             *
-             *  a. "/" - Overwrite with "/name"
-             *  b. "." - Overwrite with "name"
+            /* Dot names can simply be elided.
              */
 
-            if (pathBuf+1 == lhsp) {
-                if ('/' == lhsp[-1]) {
-                    --lhsp;
-                } else if ('.' == lhsp[-1]) {
-                    --lhsp;
-                    ++rhsp;
-                }
-            }
-
-        } else if ('/' == rhsp[2]) {
+            if (1 == nameLen)
+                continue;
 
-            /* This is Case 2 which is treated simply by moving
-             * the scanner past the dot name.
+            /* Dot-dot names retract the previous name, if there
+             * is one. A dot-dot name at the root of an absolute
+             * path can be elided, but a relative path must retain
+             * the dot-dot name.
              */
 
-            rhsp += 2;
-            continue;
+            if (2 == nameLen && '.' == namep[1]) {
 
-        } else if ('.' == rhsp[2] && '/' == rhsp[3]) {
+                char *slashp = memrchr(rootp, '/', lhsp - rootp);
+                char *lastp = slashp ? slashp + 1 : rootp;
 
-            /* This is Case 3 which requires the previous name
-             * in the emitted path to be retracted, if possible.
-             * There are four special cases for the emitted path:
-             *
-             *  a. ""     - Scanning absolute path starting with "/../"
-             *  b. "."    - Scanning relative path starting with "./"
-             *  c. ".."   - Scanning a sequence of "/.."
-             *  d. "name" - Backing up to a parent directory
-             */
+                if (rootp != lhsp &&
+                        !(2 == lhsp - lastp &&
+                            '.' == lastp[0] && '.' == lastp[1])) {
+                    lhsp = slashp ? slashp : rootp;
+                    continue;
+                }
 
-            if (pathBuf == lhsp) {
+                if (absolute)
+                    continue;
+            }
+        }
 
-                /* This is Case a which can be dealt with by dropping
-                 * the leading "/../".
-                 */
+        if (rootp != lhsp)
+            *lhsp++ = '/';
+        memcpy(lhsp, namep, nameLen);
+        lhsp += nameLen;
+    }
 
-                rhsp += 3;
-                continue;
+    /* An empty relative path refers to the current directory, but
+     * an empty absolute path already comprises the leading slash.
+     */
 
-            } else if (pathBuf+1 == lhsp && '.' == lhsp[-1]) {
+    if (self->mBuf == lhsp)
+        *lhsp++ = '.';
 
-                /* This is Case b which can be dealt with by
-                 * converting the emitted path from "." to "..".
-                 */
+    *lhsp = 0;
 
-                *lhsp++ = '.';
+    self->mLen = lhsp - self->mBuf;
 
-                rhsp += 3;
-                continue;
+    rc = 0;
 
-            } else if (
-                    !(pathBuf+2 == lhsp &&
-                        '.' == lhsp[-2] &&
-                        '.' == lhsp[-1]) &&
-                    !(pathBuf+3 <= lhsp &&
-                        '/' == lhsp[-3] &&
-                        '.' == lhsp[-2] &&
-                        '.' == lhsp[-1])) {
-
-                /* Check that this is not Case c, in which case it
-                 * must be Case d.
-                 *
-                 * Check that there is a parent in the emitted path
-                 * before reversing to find the previous sentinel.
-                 */
-
-                rhsp += 3;
-
-                if (pathBuf != lhsp &&
-                        !(pathBuf+1 == lhsp && '/' == lhsp[-1])) {
-
-                    do {
-                        --lhsp;
-
-                        /* Check for the previous slash which marks
-                         * the start of the name being reverted, and
-                         * retain the slash if it is the start of
-                         * an absolute path..
-                         */
-
-                        if ('/' == *lhsp) {
-                            if (pathBuf == lhsp)
-                                ++lhsp;
-                            break;
-                        }
-
-                        /* Check for the start of the path which
-                         * marks the beginning of a relative path,
-                         * and replace it with ".".
-                         */
-
-                        if (pathBuf == lhsp) {
-                            *lhsp++ = '.';
-                            break;
-                        }
-
-                    } while (pathBuf != lhsp);
-                }
+Finally:
 
-                continue;
+    return rc;
+}
 
-            }
-        }
+/* -------------------------------------------------------------------------- */
+/* Splice path from for base and directory names
+ *
+ * Join the directory name and base name, and normalise the result
+ * in the buffer. Only the first character of the joined path determines
+ * whether the path is absolute, so any leading slash in the base name
+ * is merely a separator unless the directory name is empty.
+ */
 
-        /* Append the name to the emitted path, and stop at the
-         * next slash which is the invariant for the main loop.
-         */
+static int
+splice_path(
+    struct pathbuf *self, struct pathview aDirName, struct pathview aBaseName)
+{
+    int rc = -1;
 
-        do
-            *lhsp++ = *rhsp++;
-        while ('/' != *rhsp);
-    }
+    self->mLen = 0;
 
-    *lhsp = 0;
+    if (aDirName.mLen && append_path(self, aDirName))
+        goto Finally;
 
-    DEBUG("Normalised path %s", pathBuf);
+    if (append_path(self, aBaseName))
+        goto Finally;
 
-    *aPath = pathBuf;
-    pathBuf = 0;
+    DEBUG("Normalised path %s", self->mBuf);
 
     rc = 0;
 
 Finally:
 
-    FINALLY({
-        free(pathBuf);
-    });
-
     return rc;
 }
 
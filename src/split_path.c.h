@@ -31,103 +31,81 @@
 
 #include <errno.h>
 #include <string.h>
-#include <stdlib.h>
-#include <unistd.h>
 
-#include "finally.h"
+#include "pathbuf.h"
 
 /* -------------------------------------------------------------------------- */
 /* Split path from for base and directory names
  *
  * Isolate the dirname from the basename in aPath. Return both the dirname
- * and the basename in *aDirName and *aBaseName, respectively, that the
- * caller must free.
+ * and the basename in *aDirName and *aBaseName, respectively, as views
+ * of aPath without copying.
+ *
+ * The dirname is either a literal "." or "/", or a prefix of aPath
+ * that is followed by a slash. The basename is followed either by a
+ * slash, or by the end of aPath. This allows a caller that owns aPath
+ * to nul terminate both names in place.
  */
 
 static int
-split_path(const char *aPath, char **aDirName, char **aBaseName)
+split_path(
+    struct pathview aPath,
+    struct pathview *aDirName, struct pathview *aBaseName)
 {
     int rc = -1;
 
-    char *dirName = 0;
-    char *baseName = 0;
-
-    if (!aPath || !*aPath) {
+    if (!aPath.mLen) {
         errno = ENOENT;
         goto Finally;
     }
 
-    do {
-
-        char pathBuf[strlen(aPath) + 1];
-        char *endp = stpcpy(pathBuf, aPath);
-
-        while (pathBuf+1 < endp && '/' == endp[-1])
-            --endp;
-        *endp = 0;
-
-        char *lastSlash = 0;
-
-        while (pathBuf != endp) {
-            if ('/' == *--endp) {
-                lastSlash = endp;
-                break;
-            }
-        }
+    /* Strip any trailing slashes, but retain the leading slash
+     * of an absolute path. Then find the last slash which separates
+     * the dirname from the basename.
+     */
 
-        const char *parentBuf;
+    const char *beginp = aPath.mPtr;
+    const char *endp = beginp + aPath.mLen;
 
-        if (!lastSlash) {
+    while (beginp+1 < endp && '/' == endp[-1])
+        --endp;
 
-            parentBuf = ".";
+    const char *lastSlash = memrchr(beginp, '/', endp - beginp);
 
-            baseName = strdup(pathBuf);
-            if (!baseName)
-                goto Finally;
+    struct pathview dirName;
+    struct pathview baseName;
 
-        } else {
+    if (!lastSlash) {
 
-            baseName = strdup(lastSlash+1);
-            if (!baseName)
-                goto Finally;
+        dirName = (struct pathview) { ".", 1 };
+        baseName = (struct pathview) { beginp, endp - beginp };
 
-            while (pathBuf != lastSlash) {
-                if ('/' != lastSlash[-1])
-                    break;
-                --lastSlash;
-            }
+    } else {
 
-            if (pathBuf == lastSlash)
-                lastSlash[1] = 0;
-            else
-                lastSlash[0] = 0;
+        baseName = (struct pathview) { lastSlash+1, endp - lastSlash - 1 };
 
-            parentBuf = pathBuf;
+        while (beginp != lastSlash) {
+            if ('/' != lastSlash[-1])
+                break;
+            --lastSlash;
         }
 
-        dirName = strdup(parentBuf);
-        if (!dirName)
-            goto Finally;
-
-    } while (0);
+        if (beginp == lastSlash)
+            dirName = (struct pathview) { "/", 1 };
+        else
+            dirName = (struct pathview) { beginp, lastSlash - beginp };
+    }
 
     if (aBaseName)
         *aBaseName = baseName;
-    baseName = 0;
 
     if (aDirName)
         *aDirName = dirName;
-    dirName = 0;
 
     rc = 0;
 
 Finally:
 
-    FINALLY({
-        free(baseName);
-        free(dirName);
-    });
-
     return rc;
 }
 
@@ -0,0 +1,349 @@
+#ifndef SUXEC_STATS_H
+#define SUXEC_STATS_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "failure.h"
+#include "finally.h"
+#include "mapped.c.h"
+
+/* -------------------------------------------------------------------------- */
+/* Usage statistics
+ *
+ * Count launches, failures by reason, launches per registration, and
+ * a histogram of verification latency in a file shared by all
+ * invocations. The file is opened while privileged, and mapped so
+ * that each update is a single relaxed atomic instruction without
+ * locks or system calls. Every counter occupies its own cache line
+ * so that concurrent launches do not contend.
+ *
+ * Each registration is identified by the device and inode of its
+ * symlink, and is claimed in a fixed size open addressed table using
+ * a bounded number of probes so that updates remain wait-free.
+ * Registrations that cannot be placed are counted as overflow.
+ *
+ * Statistics are silently disabled if the directory holding the file
+ * does not exist, or if the file is not owned by the privileged user.
+ */
+
+#ifndef SUXEC_STATS_PATH
+#define SUXEC_STATS_PATH "/run/suxec/stats"
+#endif
+
+#define STATS_MAGIC 0x73757865u
+#define STATS_VERSION 5u
+#define STATS_CACHELINE 64
+#define STATS_BUCKETS 64
+#define STATS_BUCKET_MIN 10
+#define STATS_BUCKET_MAX 34
+#define STATS_REGISTRATIONS 1024
+#define STATS_PROBES 8
+
+struct stats_counter {
+    uint64_t mValue;
+} __attribute__((__aligned__(STATS_CACHELINE)));
+
+struct stats_registration {
+    uint64_t mKey;
+    uint64_t mDev;
+    uint64_t mIno;
+    uint32_t mLicensor;
+    uint32_t mLicensee;
+    uint64_t mLaunches;
+} __attribute__((__aligned__(STATS_CACHELINE)));
+
+struct stats {
+    struct mapped_header mHeader
+        __attribute__((__aligned__(STATS_CACHELINE)));
+
+    struct stats_counter mLaunches;
+    struct stats_counter mLatencySum;
+    struct stats_counter mOverflow;
+    struct stats_counter mAuditDrops;
+    struct stats_counter mFailures[FAILURES];
+    struct stats_counter mLatency[STATS_BUCKETS];
+
+    struct stats_registration mRegistrations[STATS_REGISTRATIONS];
+};
+
+static struct stats *sStats;
+
+/* -------------------------------------------------------------------------- */
+static struct stats *
+map_stats_(int aWritable)
+{
+    /* Anyone can read the statistics, but only the privileged user
+     * can create and update them.
+     */
+
+    return map_file(SUXEC_STATS_PATH, sizeof(struct stats),
+        aWritable ? MAPPED_WRITE | MAPPED_CREATE : 0, 0644,
+        STATS_MAGIC, STATS_VERSION);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+open_stats(void)
+{
+    /* Statistics are optional, so do not disturb the errno used
+     * by the diagnostics of subsequent failures.
+     */
+
+    int savedErrno = errno;
+    sStats = map_stats_(1);
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+count_stats_(struct stats_counter *aCounter, uint64_t aValue)
+{
+    __atomic_fetch_add(&aCounter->mValue, aValue, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_stats_failure(enum failure aFailure)
+{
+    if (sStats)
+        count_stats_(&sStats->mFailures[aFailure], 1);
+}
+
+/* -------------------------------------------------------------------------- */
+static uint64_t
+key_stats_(const struct stat *aRegistration)
+{
+    /* Use a non-zero key derived from the identity of the symlink. */
+
+    return hash_inode(aRegistration->st_dev, aRegistration->st_ino) | 1;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_stats_launch(
+    const struct stat *aRegistration, uid_t aLicensor, uid_t aLicensee,
+    uint64_t aLatencyNs)
+{
+    if (!sStats)
+        return;
+
+    count_stats_(&sStats->mLaunches, 1);
+    count_stats_(&sStats->mLatencySum, aLatencyNs);
+
+    unsigned bucket = aLatencyNs ? 64 - __builtin_clzll(aLatencyNs) : 0;
+    if (STATS_BUCKETS <= bucket)
+        bucket = STATS_BUCKETS - 1;
+    count_stats_(&sStats->mLatency[bucket], 1);
+
+    /* Claim the first free slot within a bounded distance. */
+
+    uint64_t key = key_stats_(aRegistration);
+
+    for (unsigned px = 0; px < STATS_PROBES; ++px) {
+        struct stats_registration *slot = &sStats->mRegistrations[
+            (key + px) % STATS_REGISTRATIONS];
+
+        uint64_t slotKey = __atomic_load_n(&slot->mKey, __ATOMIC_RELAXED);
+        if (!slotKey) {
+            if (__atomic_compare_exchange_n(
+                    &slot->mKey, &slotKey, key,
+                    0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                __atomic_store_n(
+                    &slot->mDev, aRegistration->st_dev, __ATOMIC_RELAXED);
+                __atomic_store_n(
+                    &slot->mIno, aRegistration->st_ino, __ATOMIC_RELAXED);
+                __atomic_store_n(
+                    &slot->mLicensor, aLicensor, __ATOMIC_RELAXED);
+                __atomic_store_n(
+                    &slot->mLicensee, aLicensee, __ATOMIC_RELAXED);
+                slotKey = key;
+            }
+        }
+
+        if (key == slotKey) {
+            __atomic_fetch_add(&slot->mLaunches, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    count_stats_(&sStats->mOverflow, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+static uint64_t
+count_stats_launches(
+    const struct stats *aStats, const struct stat *aRegistration)
+{
+    /* Find the launches of a registration by probing the same
+     * slots that would have been claimed when it was launched.
+     */
+
+    uint64_t key = key_stats_(aRegistration);
+
+    for (unsigned px = 0; px < STATS_PROBES; ++px) {
+        const struct stats_registration *slot = &aStats->mRegistrations[
+            (key + px) % STATS_REGISTRATIONS];
+
+        uint64_t slotKey = __atomic_load_n(&slot->mKey, __ATOMIC_RELAXED);
+        if (!slotKey)
+            break;
+
+        if (key == slotKey)
+            return __atomic_load_n(&slot->mLaunches, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_stats_audit_drop(void)
+{
+    if (sStats)
+        count_stats_(&sStats->mAuditDrops, 1);
+}
+
+/* -------------------------------------------------------------------------- */
+static uint64_t
+read_stats_(const struct stats_counter *aCounter)
+{
+    return __atomic_load_n(&aCounter->mValue, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+print_stats(FILE *aFile)
+{
+    int rc = -1;
+
+    const struct stats *stats = sStats ? sStats : map_stats_(0);
+    if (!stats)
+        goto Finally;
+
+    fprintf(aFile,
+        "# HELP suxec_launches_total"
+        " Launches that executed the target program.\n"
+        "# TYPE suxec_launches_total counter\n"
+        "suxec_launches_total %" PRIu64 "\n",
+        read_stats_(&stats->mLaunches));
+
+    fprintf(aFile,
+        "# HELP suxec_failures_total Launches rejected by reason.\n"
+        "# TYPE suxec_failures_total counter\n");
+    for (unsigned fx = FAILURE_NONE + 1; fx < FAILURES; ++fx)
+        fprintf(aFile,
+            "suxec_failures_total{reason=\"%s\"} %" PRIu64 "\n",
+            sFailureName[fx], read_stats_(&stats->mFailures[fx]));
+
+    /* Each bucket counts latencies with the same bit length, so
+     * bucket N holds latencies below 2^N nanoseconds.
+     */
+
+    fprintf(aFile,
+        "# HELP suxec_verification_seconds"
+        " Time from start to execution of the target program.\n"
+        "# TYPE suxec_verification_seconds histogram\n");
+
+    uint64_t count = 0;
+    for (unsigned bx = 0; bx < STATS_BUCKETS; ++bx) {
+        count += read_stats_(&stats->mLatency[bx]);
+        if (STATS_BUCKET_MIN <= bx && STATS_BUCKET_MAX >= bx)
+            fprintf(aFile,
+                "suxec_verification_seconds_bucket{le=\"%.9g\"} %" PRIu64 "\n",
+                (double) (1ULL << bx) / 1e9, count);
+    }
+
+    fprintf(aFile,
+        "suxec_verification_seconds_bucket{le=\"+Inf\"} %" PRIu64 "\n"
+        "suxec_verification_seconds_sum %.9f\n"
+        "suxec_verification_seconds_count %" PRIu64 "\n",
+        count, read_stats_(&stats->mLatencySum) / 1e9, count);
+
+    fprintf(aFile,
+        "# HELP suxec_registration_launches_total"
+        " Launches by registration symlink.\n"
+        "# TYPE suxec_registration_launches_total counter\n");
+    for (unsigned rx = 0; rx < STATS_REGISTRATIONS; ++rx) {
+        const struct stats_registration *slot = &stats->mRegistrations[rx];
+
+        uint64_t launches =
+            __atomic_load_n(&slot->mLaunches, __ATOMIC_RELAXED);
+        if (launches)
+            fprintf(aFile,
+                "suxec_registration_launches_total{"
+                "licensor=\"%" PRIu32 "\",licensee=\"%" PRIu32 "\","
+                "dev=\"%" PRIu64 "\",ino=\"%" PRIu64 "\"} %" PRIu64 "\n",
+                slot->mLicensor, slot->mLicensee,
+                slot->mDev, slot->mIno, launches);
+    }
+
+    fprintf(aFile,
+        "# HELP suxec_registration_overflow_total"
+        " Launches of registrations that could not be tracked.\n"
+        "# TYPE suxec_registration_overflow_total counter\n"
+        "suxec_registration_overflow_total %" PRIu64 "\n",
+        read_stats_(&stats->mOverflow));
+
+    fprintf(aFile,
+        "# HELP suxec_audit_drops_total"
+        " Launches that could not be written to the audit log.\n"
+        "# TYPE suxec_audit_drops_total counter\n"
+        "suxec_audit_drops_total %" PRIu64 "\n",
+        read_stats_(&stats->mAuditDrops));
+
+    if (fflush(aFile))
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (stats && stats != sStats)
+            munmap((void *) stats, sizeof(*stats));
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_STATS_H */
@@ -31,17 +31,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
-#include <grp.h>
-#include <pwd.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#include <sys/fsuid.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include "config.h"
 
@@ -50,100 +51,233 @@
 #endif
 
 #include "finally.h"
+#include "identity.h"
+#include "libsuxec.h"
+#include "probe.h"
 
 /* -------------------------------------------------------------------------- */
-struct uid { uid_t _; };
-struct gid { gid_t _; };
+struct app {
 
-static inline int uid_eq(struct uid aLhs, struct uid aRhs)
-{ return aLhs._ == aRhs._; }
+    char **mEnv;
+    char **mCmd;
+    size_t mCmds;
 
-static inline int gid_eq(struct gid aLhs, struct gid aRhs)
-{ return aLhs._ == aRhs._; }
+    struct suxec_context mContext;
+    struct suxec_license mLicense;
 
-static inline int uid_ne(struct uid aLhs, struct uid aRhs)
-{ return ! uid_eq(aLhs, aRhs); }
+};
 
-static inline int gid_ne(struct gid aLhs, struct gid aRhs)
-{ return ! gid_eq(aLhs, aRhs); }
+/* -------------------------------------------------------------------------- */
+/* Usage statistics, event trace, and audit log
+ *
+ * Statistics, events, and audit records are written only when the
+ * shared files are available, and each failure is attributed to the
+ * reason given by fail().
+ */
+
+#include "audit.c.h"
+#include "stats.c.h"
+#include "trace.c.h"
 
 /* -------------------------------------------------------------------------- */
-struct dirfd {
-    int mFd;
-    char *mPath;
-};
+/* Digest cache
+ *
+ * Digests of pinned targets are cached only when the shared file is
+ * available, so that most launches need not read the target.
+ */
+
+#include "digest.c.h"
 
 /* -------------------------------------------------------------------------- */
-struct symlinkfd {
-    int mFd;
-    char *mName;
-    struct dirfd mDir;
-};
+/* Executable cache
+ *
+ * Copies of targets are only held when the cache directory is
+ * available, and otherwise the target is executed in place.
+ */
+
+#include "exec_cache.c.h"
 
 /* -------------------------------------------------------------------------- */
-struct grouplist {
-    gid_t *mList;
-    size_t mSize;
-};
+/* Registration index
+ *
+ * Chains published by suxec-index are only consulted when the shared
+ * file is available, and otherwise each chain is followed.
+ */
+
+#include "index_fetch.c.h"
 
 /* -------------------------------------------------------------------------- */
-struct user {
-    struct uid mUid;
-    struct gid mGid;
+/* Page cache warmer
+ *
+ * The programs of the most launched registrations are read ahead
+ * when requested using --warm.
+ */
 
-    char *mName;
-    char *mHome;
+#include "warm.c.h"
 
-    struct grouplist mGroups_, *mGroups;
-};
+/* -------------------------------------------------------------------------- */
+/* Verdict of a dry run
+ *
+ * A dry run reports the verdict, the failing rule, the licensor, and
+ * the resolved target and its identity, in a single nul terminated
+ * record. Fields that were not determined before the verdict was
+ * reached are shown as a dash.
+ */
+
+static const struct app *sCheck;
+
+static int
+print_check(const struct app *aApp, enum failure aFailure, FILE *aFile)
+{
+    const struct suxec_license *license = &aApp->mLicense;
+
+    fprintf(aFile, "%s %s %s",
+        FAILURE_NONE == aFailure ? "allow" : "deny",
+        sFailureName[aFailure],
+        license->mLicensor.mName ? license->mLicensor.mName : "-");
+
+    if (license->mPathStat.st_ino)
+        fprintf(aFile, " %u:%u %ju",
+            major(license->mPathStat.st_dev), minor(license->mPathStat.st_dev),
+            (uintmax_t) license->mPathStat.st_ino);
+    else
+        fputs(" - -", aFile);
+
+    fprintf(aFile, " %s%c", license->mPath ? license->mPath : "-", 0);
+
+    return fflush(aFile) || ferror(aFile) ? -1 : 0;
+}
 
 /* -------------------------------------------------------------------------- */
-struct app {
+/* Replies of a session
+ *
+ * A session replies to each command with nul terminated records
+ * naming the pid of the launched program, and its exit status, or
+ * the reason that the session was refused.
+ */
 
-    char **mEnv;
-    char **mCmd;
+static int sSession;
 
-    char *mPath;
+static int
+print_session(const char *aFmt, ...) __attribute__((format(printf, 1, 2)));
 
-    struct grouplist mGroups;
+static int
+print_session(const char *aFmt, ...)
+{
+    va_list argp;
 
-    struct user mRequestor;
-    struct user mLicensor;
+    va_start(argp, aFmt);
+    vfprintf(stdout, aFmt, argp);
+    va_end(argp);
 
-    struct {
+    fputc(0, stdout);
 
-        struct symlinkfd mSymLink;
+    return fflush(stdout) || ferror(stdout) ? -1 : 0;
+}
 
-    } mLicensee;
+/* -------------------------------------------------------------------------- */
+/* Pipeline
+ *
+ * The exit status of each stage of a pipeline is reported to
+ * mStatusFd, if provided, in the order of the stages.
+ */
 
-};
+static struct {
+    int mEnabled;
+    int mStatusFd;
+} sPipeline = { .mStatusFd = -1 };
 
 /* -------------------------------------------------------------------------- */
 static void
-die(const char *aFmt, ...) __attribute__((format(printf, 1, 2)));
+vdie_(enum failure aFailure, const char *aFmt, va_list aArgp)
+    __attribute__((noreturn));
 
 static void
-die(const char *aFmt, ...)
+vdie_(enum failure aFailure, const char *aFmt, va_list aArgp)
 {
-    if (aFmt) {
-        va_list argp;
+    PROBE(die, errno, aFmt);
+
+    /* A dry run is not a launch, so its failures are not counted,
+     * but are reported in the verdict instead.
+     */
+
+    if (!sCheck)
+        record_stats_failure(aFailure);
+    record_trace_failure(aFailure, errno);
 
-        va_start(argp, aFmt);
+    if (aFmt) {
         if (errno)
-            vwarn(aFmt, argp);
+            vwarn(aFmt, aArgp);
         else
-            vwarnx(aFmt, argp);
-        va_end(argp);
+            vwarnx(aFmt, aArgp);
     }
 
+    if (sCheck)
+        print_check(sCheck, aFailure, stdout);
+    else if (sSession)
+        print_session("deny %s", sFailureName[aFailure]);
+
     exit(127);
 }
 
+/* -------------------------------------------------------------------------- */
+static void
+die(const char *aFmt, ...)
+    __attribute__((format(printf, 1, 2), noreturn));
+
+static void
+die(const char *aFmt, ...)
+{
+    va_list argp;
+
+    va_start(argp, aFmt);
+    vdie_(FAILURE_OTHER, aFmt, argp);
+    va_end(argp);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+fail(enum failure aFailure, const char *aFmt, ...)
+    __attribute__((format(printf, 2, 3), noreturn));
+
+static void
+fail(enum failure aFailure, const char *aFmt, ...)
+{
+    va_list argp;
+
+    va_start(argp, aFmt);
+    vdie_(aFailure, aFmt, argp);
+    va_end(argp);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+refuse(const struct suxec_license *aLicense) __attribute__((noreturn));
+
+static void
+refuse(const struct suxec_license *aLicense)
+{
+    errno = aLicense->mErrno;
+    fail(aLicense->mFailure, "%s", aLicense->mMessage);
+}
+
 /* -------------------------------------------------------------------------- */
 static int sDebug;
 
 static struct option sOptions[] = {
+   { "audit", required_argument, 0, 'A' },
+   { "check", no_argument, 0, 'C' },
    { "debug", no_argument, 0, 'd' },
+   { "nfs", no_argument, 0, 'N' },
+   { "lock", no_argument, 0, 'L' },
+   { "pipeline", no_argument, 0, 'P' },
+   { "session", no_argument, 0, 'E' },
+   { "stats", no_argument, 0, 'S' },
+   { "status-fd", required_argument, 0, 'F' },
+   { "timing-fd", required_argument, 0, 'T' },
+   { "top", required_argument, 0, 'K' },
+   { "warm", required_argument, 0, 'W' },
+   { 0 },
 };
 
 /* -------------------------------------------------------------------------- */
@@ -161,12 +295,18 @@ debug_(unsigned aLineNo, const char *aFmt, ...)
     va_end(argp);
 }
 
-#define IFDEBUG(...) \
-    if (!sDebug) ; else do __VA_ARGS__ while (0)
-
 #define DEBUG(...) \
     if (!sDebug) ; else do debug_(__LINE__, __VA_ARGS__); while (0)
 
+/* -------------------------------------------------------------------------- */
+static void
+debug_license_(void *aApp, const char *aFmt, va_list aArgp)
+{
+    fprintf(stderr, "%s: ", program_invocation_short_name);
+    vfprintf(stderr, aFmt, aArgp);
+    fputc('\n', stderr);
+}
+
 /* -------------------------------------------------------------------------- */
 static void
 swap_reuid()
@@ -185,11 +325,24 @@ swap_reuid()
 }
 
 /* -------------------------------------------------------------------------- */
-static int
-chain_execv(char *aPath)
+static void
+drop_privileges(struct uid aUid, struct gid aGid)
 {
-    DEBUG("Executing %s", aPath);
+    /* Relinquish the saved privileged user and group so that they
+     * cannot be regained, for modes that never launch a program.
+     */
+
+   if (setresgid(aGid._, aGid._, aGid._))
+       die("Unable to drop privileges to gid %d", aGid._);
 
+   if (setresuid(aUid._, aUid._, aUid._))
+       die("Unable to drop privileges to uid %d", aUid._);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+chain_execv(struct suxec_license *aLicense, int aCopyFd)
+{
     VALGRIND_DO_LEAK_CHECK;
 
     unsigned long
@@ -205,62 +358,14 @@ chain_execv(char *aPath)
         die("Memory leaks found  - definite %lu dubious %lu",
             definiteLeaks, dubiousLeaks);
 
-    char *args[2] = {
-        aPath,
-       0
-    };
-
-    return execv(aPath, args);
-}
-
-/* -------------------------------------------------------------------------- */
-static void
-impersonate_user(const struct user *aUser, const struct grouplist *aGroups)
-{
-    /* Use conditional setgroups(2) because initgroups(3) sets
-     * the supplementary groups unconditionally and fails if the
-     * caller is unprivileged.
+    /* Execute the original if the copy cannot be executed, for
+     * example because the cache is on a noexec file system.
      */
 
-    if (aUser->mGroups->mSize != aGroups->mSize ||
-            memcmp(
-                aUser->mGroups->mList,
-                aGroups->mList,
-                aUser->mGroups->mSize * sizeof(*aUser->mGroups->mList))) {
-
-        if (setgroups(aUser->mGroups->mSize, aUser->mGroups->mList))
-            die("Unable to set supplementary groups for user %s", aUser->mName);
-    }
-
-    struct uid ouid = { geteuid() };
-
-    if (setgid(aUser->mGid._))
-        die("Unable to set gid %d", aUser->mGid._);
+    if (-1 != aCopyFd && suxec_exec_copy(aLicense, aCopyFd))
+        DEBUG("Unable to execute copy of %s", aLicense->mPath);
 
-    if (setuid(aUser->mUid._))
-        die("Unable to set uid %d", aUser->mUid._);
-
-    struct gid egid = { getegid() };
-    if (gid_ne(aUser->mGid, egid))
-        die("Mismatched effective gid %d", egid._);
-
-    struct uid euid = { geteuid() };
-    if (uid_ne(aUser->mUid, euid))
-        die("Mismatched effective uid %d", euid._);
-
-    if (aUser->mUid._ && !setreuid(-1, 0))
-        die("Unexpected privilege escalation");
-
-    if (uid_ne(ouid, euid) && !setreuid(-1, ouid._))
-        die("Unexpected privilege recovery");
-
-    struct gid fsgid = { setfsgid(-1) };
-    if (gid_ne(fsgid, aUser->mGid))
-        die("Unexpected fsgid %d", fsgid._);
-
-    struct uid fsuid = { setfsuid(-1) };
-    if (uid_ne(fsuid, aUser->mUid))
-        die("Unexpected fsuid %d", fsuid._);
+    return suxec_exec(aLicense);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -269,815 +374,835 @@ usage(void)
 {
     fprintf(
         stderr,
-        "usage: %s [--debug] [--] [NAME=VALUE ...] symlink\n",
+        "usage: %s [--check] [--debug] [--nfs] [--timing-fd N]"
+        " [--] [NAME=VALUE ...] symlink\n"
+        "       %s [--debug] [--nfs] --session"
+        " [--] [NAME=VALUE ...] symlink\n"
+        "       %s [--debug] [--nfs] [--status-fd N] --pipeline"
+        " [--] [NAME=VALUE ...] symlink ...\n"
+        "       %s [--debug] --audit DIR\n"
+        "       %s [--debug] [--top N] [--lock] --warm DIR\n"
+        "       %s --stats\n",
+        program_invocation_short_name,
+        program_invocation_short_name,
+        program_invocation_short_name,
+        program_invocation_short_name,
+        program_invocation_short_name,
         program_invocation_short_name);
-    die(0);
+    fail(FAILURE_USAGE, 0);
 }
 
-/* -------------------------------------------------------------------------- */
-/* String operations
- *
- * The implementations are separated to allow for a comprehensive unit tests
- * to cover the different cases of dot and dot-dot directories, and
- * their interaction with absolute and relative paths.
- */
-
-#include "split_path.c.h"
-#include "splice_path.c.h"
-#include "stpcpyv.c.h"
-
 /* -------------------------------------------------------------------------- */
 static int
-fdclose(int aFd)
+is_privileged_fd_(int aFd)
 {
-    if (-1 != aFd)
-        close(aFd);
+    /* The audit log and the executable cache are opened while
+     * privileged, and remain open, so compare the files rather than
+     * the descriptor numbers to catch duplicates as well.
+     */
 
-    return -1;
-}
+    const int privilegedFds[] = { sAuditFd, sExecCacheFd };
 
-/* ************************************************************************** */
-static int
-create_grouplist_rank_gid_(const void *aLhs, const void *aRhs)
-{
-    struct gid lhs = (struct gid) { * (const gid_t *) aLhs };
-    struct gid rhs = (struct gid) { * (const gid_t *) aRhs };
+    struct stat fdStat;
+    if (fstat(aFd, &fdStat))
+        return 1;
+
+    size_t numPrivilegedFds = sizeof(privilegedFds) / sizeof(*privilegedFds);
+
+    for (size_t px = 0; px < numPrivilegedFds; ++px) {
+        struct stat privilegedStat;
 
-    return lhs._ == rhs._ ? 0 : lhs._ < rhs._ ? -1 : +1;
+        if (-1 != privilegedFds[px] &&
+                !fstat(privilegedFds[px], &privilegedStat) &&
+                privilegedStat.st_dev == fdStat.st_dev &&
+                privilegedStat.st_ino == fdStat.st_ino)
+            return 1;
+    }
+
+    return 0;
 }
 
 /* -------------------------------------------------------------------------- */
-static struct grouplist *
-close_grouplist(struct grouplist *self) __attribute__((unused));
-
-static struct grouplist *
-create_grouplist(struct grouplist *self)
+static int
+parse_fd(const char *aName, const char *aArg)
 {
-    int rc = -1;
+    char *end;
 
-    gid_t *groupList = 0;
-    size_t groupListLen = 0;
+    errno = 0;
+    long fd = strtol(aArg, &end, 10);
+    if (errno || end == aArg || *end || 0 > fd || INT_MAX < fd)
+        die("Invalid %s fd %s", aName, aArg);
 
-    /* Find the supplementary groups that the process already belongs
-     * to in order to compare with the target set of supplementary
-     * groups.
-     *
-     * This is useful when running as an unprivileged process, especially
-     * during unit test, where the process is already has the correct
-     * supplementary groups.
+    /* Ensure that the descriptor is open, and prevent the target
+     * program from inheriting it.
      */
 
-    for (int groupBufLen = 1; !groupList; ) {
+    if (-1 == fcntl(fd, F_SETFD, FD_CLOEXEC))
+        die("Unable to use %s fd %ld", aName, fd);
 
-        gid_t groupBuf[groupBufLen];
+    /* Refuse the descriptors that suxec opened while privileged so
+     * that the requestor cannot write into them.
+     */
 
-        groupListLen = getgroups(groupBufLen, groupBuf);
-        if (-1 == groupListLen) {
-            if (EINVAL != errno)
-                goto Finally;
+    if (is_privileged_fd_(fd))
+        die("Unable to use privileged %s fd %ld", aName, fd);
 
-            groupBufLen *= 2;
+    return fd;
+}
 
-            if (0 >= groupBufLen) {
-                errno = ENOMEM;
-                goto Finally;
-            }
+/* -------------------------------------------------------------------------- */
+static size_t
+parse_top(const char *aArg)
+{
+    char *end;
 
-            continue;
-        }
+    errno = 0;
+    unsigned long top = strtoul(aArg, &end, 10);
+    if (errno || end == aArg || *end || !top || '-' == *aArg)
+        die("Invalid number of registrations %s", aArg);
 
-        groupBufLen = groupListLen;
+    return top;
+}
 
-        /* Unfortunately the primary gid might not be present in the
-         * return list. Search for it, and insert it if it is absent.
-         */
+/* -------------------------------------------------------------------------- */
+/* Phase timing
+ *
+ * Timestamps are only recorded when requested using --timing-fd.
+ */
 
-        struct gid primaryGid_ = { getgid() }, *primaryGid = &primaryGid_;
+#include "timing.c.h"
 
-        for (size_t gx = 0; gx < groupBufLen; ++gx) {
-            if (gid_eq((struct gid) { groupBuf[gx] }, *primaryGid)) {
-                primaryGid = 0;
-                break;
-            }
-        }
+/* -------------------------------------------------------------------------- */
+static void
+observe_license_(
+    void *aApp, enum suxec_event aEvent, const struct stat *aStat)
+{
+    /* Translate the progress of the verification into the phases
+     * of the launch, and the events recorded in the trace.
+     */
 
-        if (primaryGid)
-            ++groupListLen;
+    switch (aEvent) {
+    case SUXEC_EVENT_GROUPLIST:
+        mark_timing(TIMING_GROUPLIST);
+        break;
 
-        groupList = malloc(sizeof(*groupList) * groupListLen);
-        if (!groupList)
-            goto Finally;
+    case SUXEC_EVENT_REQUESTOR:
+        mark_timing(TIMING_REQUESTOR);
+        break;
 
-        memcpy(groupList, groupBuf, sizeof(*groupBuf) * groupBufLen);
+    case SUXEC_EVENT_DIRECTORY:
+        record_trace_stat(TRACE_DIRECTORY, aStat);
+        break;
 
-        if (primaryGid)
-            groupList[groupBufLen] = primaryGid->_;
-    }
+    case SUXEC_EVENT_SYMLINK:
+        mark_timing(TIMING_SYMLINK);
+        break;
+
+    case SUXEC_EVENT_LICENSOR:
+        mark_timing(TIMING_LICENSOR);
+        break;
 
-    qsort(
-        groupList, groupListLen, sizeof(*groupList),
-        create_grouplist_rank_gid_);
+    case SUXEC_EVENT_PARENT_DIRECTORY:
+        record_trace_stat(TRACE_PARENT, aStat);
+        break;
 
-    self->mSize = groupListLen;
+    case SUXEC_EVENT_REGISTRATION:
+        record_trace_stat(TRACE_REGISTRATION, aStat);
+        break;
 
-    self->mList = groupList;
-    groupList = 0;
+    case SUXEC_EVENT_PARENT:
+        mark_timing(TIMING_PARENT);
+        break;
 
-    rc = 0;
+    case SUXEC_EVENT_HOP:
+        mark_timing_hop();
+        break;
 
-Finally:
+    case SUXEC_EVENT_TARGET:
+        record_trace_stat(TRACE_TARGET, aStat);
+        break;
 
-    FINALLY({
-        free(groupList);
-    });
+    case SUXEC_EVENT_RESOLVE:
+        mark_timing(TIMING_RESOLVE);
+        break;
 
-    return rc ? 0 : self;
+    case SUXEC_EVENT_ENVIRONMENT:
+        mark_timing(TIMING_ENVIRONMENT);
+        break;
+    }
 }
 
 /* -------------------------------------------------------------------------- */
-static struct grouplist *
-create_grouplist_user(
-    struct grouplist *self, const char *aName, struct gid aGid)
+static int
+print_review_(
+    void *aFile,
+    const char *aLicensee, const char *aName, enum failure aVerdict)
 {
-    int rc = -1;
+    return 0 > fprintf(aFile, "%s %s %s/%s%c",
+        FAILURE_NONE == aVerdict ? "allow" : "deny",
+        sFailureName[aVerdict], aLicensee, aName, 0) ? -1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+struct warm_review {
+    struct warm mWarm;
+    const char *mDir;
+    const struct stats *mStats;
+};
 
-    gid_t *groupList = 0;
-    size_t groupListLen = 0;
+static int
+collect_warm_(
+    void *aReview,
+    const char *aLicensee, const char *aName, enum failure aVerdict)
+{
+    struct warm_review *review = aReview;
 
-    /* Find the supplementary groups required for the target user.
-     * Comapre this list with the supplementary groups bound
-     * to the process, and only attempt to configure the groups
-     * if required.
+    /* Only the programs of registrations that would be allowed
+     * are worth reading ahead.
      */
 
-    for (int groupBufLen = 1; !groupList; ) {
+    if (FAILURE_NONE != aVerdict)
+        return 0;
 
-        gid_t groupBuf[groupBufLen];
+    char path[PATH_MAX];
+    if (sizeof(path) <= (size_t) snprintf(path, sizeof(path),
+            "%s/%s/%s", review->mDir, aLicensee, aName))
+        return 0;
 
-        groupListLen = groupBufLen;
+    struct stat registrationStat;
+    if (lstat(path, &registrationStat))
+        return 0;
 
-        if (-1 == getgrouplist(aName, aGid._, groupBuf, &groupBufLen)) {
+    return add_warm_target(
+        &review->mWarm,
+        path, count_stats_launches(review->mStats, &registrationStat));
+}
 
-            if (groupListLen == groupBufLen)
-                goto Finally;
+/* -------------------------------------------------------------------------- */
+static void
+warm_registrations(
+    const struct suxec_context *aContext,
+    const char *aDir, size_t aTop, int aLock)
+{
+    const struct stats *stats = sStats ? sStats : map_stats_(0);
+    if (!stats)
+        die("Unable to read statistics from %s", SUXEC_STATS_PATH);
 
-            continue;
-        }
+    /* When locking, the warmer remains running to hold the locks,
+     * and ranks the registrations again periodically. The previous
+     * programs remain locked until their successors are locked.
+     */
 
-        groupListLen = groupBufLen;
-        groupList = malloc(sizeof(*groupList) * groupListLen);
-        if (!groupList)
-            goto Finally;
+    struct warm previous;
+    create_warm(&previous);
 
-        memcpy(groupList, groupBuf, sizeof(*groupBuf) * groupListLen);
-    }
+    while (1) {
+        struct warm_review review = { .mDir = aDir, .mStats = stats };
+        create_warm(&review.mWarm);
 
-    qsort(
-        groupList, groupListLen, sizeof(*groupList),
-        create_grouplist_rank_gid_);
+        if (suxec_review(aContext, aDir, collect_warm_, &review))
+            die("Unable to review registrations in %s", aDir);
 
-    self->mSize = groupListLen;
+        size_t warmed = load_warm(&review.mWarm, aTop, aLock);
 
-    self->mList = groupList;
-    groupList = 0;
+        DEBUG("Read ahead %zu of %zu registrations",
+            warmed, review.mWarm.mLen);
 
-    rc = 0;
+        for (size_t tx = 0; tx < review.mWarm.mLen && tx < aTop; ++tx) {
+            const struct warm_target *target = &review.mWarm.mTargets[tx];
 
-Finally:
+            printf("%" PRIu64 " %s %s%c",
+                target->mLaunches,
+                target->mMap ? "locked" : target->mWarm ? "warm" : "cold",
+                target->mPath, 0);
+        }
 
-    FINALLY({
-        free(groupList);
-    });
+        if (fflush(stdout) || ferror(stdout))
+            die("Unable to report registrations");
 
-    return rc ? 0 : self;
-}
+        close_warm(&previous);
+        previous = review.mWarm;
 
-/* -------------------------------------------------------------------------- */
-static struct grouplist *
-close_grouplist(struct grouplist *self)
-{
-    if (self) {
-        free(self->mList);
+        if (!aLock)
+            break;
+
+        sleep(WARM_INTERVAL);
     }
 
-    return 0;
+    close_warm(&previous);
 }
 
 /* ************************************************************************** */
-static struct user *
-close_user(struct user *self) __attribute__((unused));
-
-static struct user *
-create_user(struct user *self, struct uid aUid, struct gid aGid)
+static void
+license_program(
+    struct app *aApp, int argc, char **argv, struct uid aUid, struct gid aGid)
 {
-    int rc = -1;
+    const char *auditDir = 0;
+    const char *warmDir = 0;
+    size_t warmTop = 16;
+    int warmLock = 0;
 
-    char *name = 0;
-    char *home = 0;
-
-    self->mUid = (struct uid) { -1 };
-    self->mGid = (struct gid) { -1 };
-    self->mName = 0;
-    self->mHome = 0;
+    while (1) {
+        int opt = getopt_long(
+            argc, argv, "+A:CdEF:K:LNPST:W:", sOptions, 0);
+        if (-1 == opt)
+            break;
 
-    self->mGroups = 0;
+        switch (opt) {
+        case '?':
+            usage();
+            break;
 
-    struct passwd *pw = getpwuid(aUid._);
-    if (!pw)
-        goto Finally;
+        case 'A':
+            auditDir = optarg;
+            break;
 
-    /* If the caller passes -1 as the gid, then use struct passwd
-     * as the source for both uid and gid, otherwise prefer the
-     * uid and gid passed in from the caller.
-     */
+        case 'C':
+            sCheck = aApp;
+            aApp->mContext.mFlags &= ~SUXEC_READAHEAD;
+            break;
 
-    if (-1 == aGid._) {
-        self->mUid = (struct uid) { pw->pw_uid };
-        self->mGid = (struct gid) { pw->pw_gid };
-    } else {
-        self->mUid = aUid;
-        self->mGid = aGid;
-    }
+        case 'd':
+            sDebug =1;
+            break;
 
-    name = strdup(pw->pw_name);
-    if (!name)
-        goto Finally;
+        case 'E':
+            sSession = 1;
+            break;
 
-    home = strdup(pw->pw_dir);
-    if (!home)
-        goto Finally;
+        case 'K':
+            warmTop = parse_top(optarg);
+            break;
 
-    self->mName = name;
-    name = 0;
+        case 'L':
+            warmLock = 1;
+            break;
 
-    self->mHome = home;
-    home = 0;
+        case 'N':
+            aApp->mContext.mFlags |= SUXEC_DONT_SYNC;
+            break;
 
-    rc = 0;
+        case 'F':
+            sPipeline.mStatusFd = parse_fd("status", optarg);
+            break;
 
-Finally:
-    FINALLY({
-        free(home);
-        free(name);
-    });
+        case 'P':
+            sPipeline.mEnabled = 1;
+            break;
 
-    return rc ? 0 : self;
-}
+        case 'S':
+            if (print_stats(stdout))
+                die("Unable to read statistics from %s", SUXEC_STATS_PATH);
+            exit(0);
 
-/* -------------------------------------------------------------------------- */
-static int
-fetch_user_groups(struct user *self)
-{
-    int rc = -1;
+        case 'T':
+            sTiming.mFd = parse_fd("timing", optarg);
+            break;
 
-    if (!self->mGroups) {
-        self->mGroups = create_grouplist_user(
-            &self->mGroups_, self->mName, self->mGid);
-        if (!self->mGroups)
-            goto Finally;
+        case 'W':
+            warmDir = optarg;
+            break;
+        }
     }
 
-    rc = 0;
+    if (sDebug)
+        aApp->mContext.mDebug = debug_license_;
 
-Finally:
+    /* An audit only reports on the registrations, so there is no
+     * need to retain privileges to launch a program.
+     */
 
-    return rc;
-}
+    if (auditDir) {
+        if (optind != argc)
+            usage();
 
-/* -------------------------------------------------------------------------- */
-static struct user *
-close_user(struct user *self)
-{
-    if (self) {
-        free(self->mName);
-        free(self->mHome);
+        drop_privileges(aUid, aGid);
 
-        close_grouplist(self->mGroups);
-    }
+        if (suxec_review(&aApp->mContext, auditDir, print_review_, stdout) ||
+                fflush(stdout) || ferror(stdout))
+            die("Unable to audit registrations in %s", auditDir);
 
-    return 0;
-}
+        exit(0);
+    }
 
-/* ************************************************************************** */
-static struct dirfd *
-close_dirfd(struct dirfd *self);
+    /* The warmer only reads the programs, so there is no need
+     * to retain privileges beyond those of the invoker.
+     */
 
-static struct dirfd *
-create_dirfd(struct dirfd *self, const struct dirfd *aAt, const char *aPath)
-{
-    int rc = -1;
+    if (warmDir) {
+        if (optind != argc)
+            usage();
 
-    char *dirPath = 0;
-    int dirFd = -1;
+        drop_privileges(aUid, aGid);
 
-    self->mFd = -1;
-    self->mPath = 0;
+        warm_registrations(&aApp->mContext, warmDir, warmTop, warmLock);
 
-    if (!aPath || !aPath[0]) {
-        errno = EINVAL;
-        goto Finally;
+        exit(0);
     }
 
-    /* Open a file descriptor to the directory. If the caller uses
-     * dot to name the current working directory, use the current
-     * working directory as the name. If the caller specifies
-     * an absolute path, then use that as the name, otherwise
-     * splice the name together.
-     */
+    if (optind >= argc || (!!sCheck + sSession + sPipeline.mEnabled) > 1)
+        usage();
 
-    dirFd = openat(
-        aAt ? aAt->mFd : AT_FDCWD,
-        aPath,
-        O_RDONLY | O_PATH | O_DIRECTORY | O_CLOEXEC);
-    if (-1 == dirFd)
-        goto Finally;
+    /* Skip all NAME=VALUE arguments, but take care to detect
+     * degenerate cases where NAME is empty.
+     */
 
-    if ('.' == aPath[0] && !aPath) {
+    char **argp = &argv[optind];
 
-        if (aAt)
-            dirPath = strdup(aAt->mPath);
-        else
-            dirPath = get_current_dir_name();
+    aApp->mEnv = argp;
 
-    } else if ('/' == aPath[0]) {
+    while (*argp && strchr(*argp, '=')) {
+        if ('=' == **argp)
+            usage();
+        ++argp;
+    }
 
-        dirPath = strdup(aPath);
+    /* Ensure that there is one non-empty argument remaining
+     * that specifies the command to execute, or one for each
+     * stage of a pipeline.
+     */
 
-    } else {
+    aApp->mCmd = argp;
 
-        if (splice_path(&dirPath, aAt ? aAt->mPath : 0, aPath))
-            goto Finally;
+    while (*argp) {
+        if (!**argp)
+            usage();
+        ++argp;
     }
 
-    if (!dirPath)
-        goto Finally;
+    aApp->mCmds = argp - aApp->mCmd;
 
-    self->mFd = dirFd;
-    dirFd = -1;
+    if (!aApp->mCmds || (1 < aApp->mCmds && !sPipeline.mEnabled))
+        usage();
 
-    self->mPath = dirPath;
-    dirPath = 0;
+    mark_timing(TIMING_PARSE);
 
-    rc = 0;
+    record_trace_identity(TRACE_START, aUid._, aGid._, 0);
 
-Finally:
+    /* Each stage of a pipeline is verified when the pipeline
+     * is run.
+     */
 
-    FINALLY({
-        dirFd = fdclose(dirFd);
+    if (sPipeline.mEnabled)
+        return;
+
+    if (suxec_verify(&aApp->mLicense, aUid._, aGid._, *aApp->mCmd))
+        refuse(&aApp->mLicense);
+
+    /* A dry run stops once the target is verified, and neither
+     * constructs the environment nor executes the program.
+     */
 
-        free(dirPath);
-    });
+    if (sCheck)
+        exit(print_check(aApp, FAILURE_NONE, stdout) ? 127 : 0);
+
+    /* Add all the specified variables named on the command line to
+     * the environment. Named variables override the default
+     * LOGNAME, PATH, HOME, and SHELL, variables that would
+     * normally be added.
+     */
 
-    return rc ? 0 : self;
+    if (suxec_environment(
+            &aApp->mLicense, aApp->mEnv, aApp->mCmd - aApp->mEnv))
+        refuse(&aApp->mLicense);
 }
 
 /* -------------------------------------------------------------------------- */
-static struct dirfd *
-close_dirfd(struct dirfd *self)
+static void
+record_launch(const struct suxec_license *aLicense, const char *aCmd)
 {
-    if (self) {
-        fdclose(self->mFd);
-        free(self->mPath);
-    }
-
-    return 0;
+    record_stats_launch(
+        &aLicense->mRegistrationStat,
+        aLicense->mLicensor.mUid,
+        aLicense->mRequestor.mUid,
+        elapsed_timing());
+
+    count_timing_round_trips(aLicense->mRoundTrips);
+
+    record_trace_identity(
+        TRACE_EXEC,
+        aLicense->mLicensor.mUid,
+        aLicense->mLicensor.mGid,
+        aLicense->mHops);
+
+    if (record_audit(
+            &aLicense->mRegistrationStat,
+            &aLicense->mPathStat,
+            aLicense->mRequestor.mUid,
+            aLicense->mRequestor.mGid,
+            aLicense->mLicensor.mUid,
+            aLicense->mLicensor.mGid,
+            aLicense->mHops,
+            aCmd, aLicense->mPath))
+        record_stats_audit_drop();
 }
 
 /* ************************************************************************** */
-static struct symlinkfd *
-close_symlinkfd(struct symlinkfd *self);
+/* Launching programs in child processes
+ *
+ * Sessions and pipelines launch each program using vfork(2), since
+ * the child only redirects stdin and stdout, impersonates the licensor,
+ * and executes the program.
+ */
 
-static struct symlinkfd *
-create_symlinkfd(
-    struct symlinkfd *self, const struct dirfd *aAt, const char *aPath)
+static int
+redirect_fd_(int aFd, int aTarget)
 {
-    int rc = -1;
-
-    struct dirfd dirFd_, *dirFd = 0;
-    int symlinkFd = -1;
-
-    char *dirName = 0;
-    char *baseName = 0;
-
-    self->mDir.mFd = -1;
-    self->mDir.mPath = 0;
-    self->mFd = -1;
-    self->mName = 0;
-
-    if (split_path(aPath, &dirName, &baseName))
-        goto Finally;
-
-    dirFd = create_dirfd(&dirFd_, aAt, dirName);
-    if (!dirFd)
-        goto Finally;
-
-    symlinkFd = openat(
-        dirFd->mFd, baseName, O_RDONLY | O_PATH | O_NOFOLLOW | O_CLOEXEC);
-    if (-1 == symlinkFd)
-        goto Finally;
-
-    self->mFd = symlinkFd;
-    symlinkFd = -1;
-
-    self->mName = baseName;
-    baseName = 0;
-
-    self->mDir = *dirFd;
-    dirFd = 0;
-
-    rc = 0;
-
-Finally:
-
-    FINALLY({
-        free(baseName);
-        free(dirName);
-
-        symlinkFd = fdclose(symlinkFd);
+    /* A descriptor that is already in place is only made inheritable,
+     * since dup2(2) would leave it to be closed on exec.
+     */
 
-        dirFd = close_dirfd(dirFd);
-    });
+    if (aFd == aTarget)
+        return fcntl(aFd, F_SETFD, 0);
 
-    return rc ? 0 : self;
+    return -1 == dup2(aFd, aTarget) ? -1 : 0;
 }
 
 /* -------------------------------------------------------------------------- */
-static char *
-read_symlinkfd(const struct symlinkfd *self)
-{
-    int rc = -1;
-
-    char *symlink = 0;
-    size_t bufLen = 1;
-
-    while (1) {
-        char buf[bufLen];
-
-        ssize_t symlinkLen = readlinkat(self->mFd, "", buf, bufLen);
-        if (-1 == symlinkLen)
-            goto Finally;
+static void
+exec_program_(struct suxec_license *aLicense, int aStdin, int aStdout)
+    __attribute__((noreturn));
 
-        if (symlinkLen < bufLen) {
-            buf[symlinkLen] = 0;
-            symlink = strdup(buf);
-            break;
-        }
+static void
+exec_program_(struct suxec_license *aLicense, int aStdin, int aStdout)
+{
+    /* Runs in the child created by vfork(2), so only modify the
+     * license shared with the parent to report a failure.
+     */
 
-        bufLen *= 2;
+    if (redirect_fd_(aStdin, STDIN_FILENO) ||
+            redirect_fd_(aStdout, STDOUT_FILENO)) {
+        aLicense->mFailure = FAILURE_OTHER;
+        aLicense->mErrno = errno;
+        strcpy(aLicense->mMessage, "Unable to redirect stdin and stdout");
+    } else if (!suxec_impersonate(aLicense)) {
+        suxec_exec(aLicense);
     }
 
-    rc = 0;
-
-Finally:
-
-    return rc ? 0 : symlink;
+    _exit(127);
 }
 
-
 /* -------------------------------------------------------------------------- */
 static int
-follow_symlinkfd(struct symlinkfd *self)
+wait_program(pid_t aPid)
 {
-    int rc = -1;
-
-    struct symlinkfd followFd_, *followFd = 0;
+    int status;
 
-    char *symlink = 0;
-
-    struct stat symlinkStat;
-    if (fstatat(
-            self->mFd, "", &symlinkStat, AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW))
-        goto Finally;
+    while (-1 == waitpid(aPid, &status, 0)) {
+        if (EINTR != errno)
+            die("Unable to wait for pid %d", aPid);
+    }
 
-    if (!S_ISLNK(symlinkStat.st_mode)) {
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
 
-        errno = 0;
-        goto Finally;
+/* -------------------------------------------------------------------------- */
+static pid_t
+launch_program(
+    struct suxec_license *aLicense, const char *aCmd, int aStdin, int aStdout)
+{
+    /* PRIVILEGED */ swap_reuid();
+    /* PRIVILEGED */
+    /* PRIVILEGED */ follow_audit();
+    /* PRIVILEGED */ record_launch(aLicense, aCmd);
+    /* PRIVILEGED */
+    /* PRIVILEGED */ pid_t pid = vfork();
+    /* PRIVILEGED */
+    /* PRIVILEGED */ if (!pid)
+    /* PRIVILEGED */     exec_program_(aLicense, aStdin, aStdout);
+    /* PRIVILEGED */
+    /* PRIVILEGED */ int err = errno;
+    /* PRIVILEGED */ swap_reuid();
 
+    if (-1 == pid) {
+        errno = err;
+        die("Unable to launch %s", aLicense->mPath);
     }
 
-    symlink = read_symlinkfd(self);
-    if (!symlink)
-        goto Finally;
-
-    followFd = create_symlinkfd(&followFd_, &self->mDir, symlink);
-    if (!followFd)
-        goto Finally;
-
-    DEBUG("Follow %s/%s %s/%s",
-        self->mDir.mPath, self->mName,
-        followFd->mDir.mPath, followFd->mName);
+    /* The child shares the license until it executes the program,
+     * so a failure to launch the program is recorded there.
+     */
 
-    close_symlinkfd(self);
+    if (FAILURE_NONE != aLicense->mFailure) {
+        wait_program(pid);
+        refuse(aLicense);
+    }
 
-    *self = *followFd;
-    followFd = 0;
+    return pid;
+}
 
-    rc = 0;
+/* ************************************************************************** */
+/* Session
+ *
+ * A session verifies the registration once, then launches the program
+ * again for each command read from stdin. Each command is a sequence
+ * of nul terminated NAME=VALUE settings that override the environment
+ * given on the command line, and is terminated by an empty string.
+ * Before each launch, the chain that was verified is revalidated
+ * rather than verified again, and the session is refused if any part
+ * of it has changed.
+ *
+ * Each program reads from /dev/null and writes to stderr, because
+ * stdin and stdout carry the session. Commands are run one at a time,
+ * and the session ends when stdin is closed.
+ */
 
-Finally:
+static ssize_t
+read_session_(char **aBuf, size_t *aBufSize, FILE *aFile)
+{
+    ssize_t bufLen = getdelim(aBuf, aBufSize, 0, aFile);
+    if (-1 == bufLen) {
+        if (ferror(aFile))
+            die("Unable to read session command");
+        return -1;
+    }
 
-    FINALLY({
-        free(symlink);
+    /* A command truncated by the end of the stream lacks the
+     * terminating nul, and is refused rather than launched.
+     */
 
-        followFd = close_symlinkfd(followFd);
-    });
+    if ((*aBuf)[bufLen-1]) {
+        errno = 0;
+        fail(FAILURE_USAGE, "Truncated session command");
+    }
 
-    return rc;
+    return bufLen - 1;
 }
 
 /* -------------------------------------------------------------------------- */
-static struct symlinkfd *
-close_symlinkfd(struct symlinkfd *self)
-{
-    if (self) {
-        fdclose(self->mFd);
-        free(self->mName);
-
-        close_dirfd(&self->mDir);
-    }
-
-    return 0;
-}
+static void
+run_session(struct app *aApp) __attribute__((noreturn));
 
-/* ************************************************************************** */
 static void
-license_program(
-    struct app *aApp, int argc, char **argv, struct uid aUid, struct gid aGid)
+run_session(struct app *aApp)
 {
-    while (1) {
-        int opt = getopt_long(argc, argv, "+d", sOptions, 0);
-        if (-1 == opt)
-            break;
-
-        switch (opt) {
-        case '?':
-            usage();
-            break;
+    struct suxec_license *license = &aApp->mLicense;
 
-        case 'd':
-            sDebug =1;
-            break;
-        }
-    }
+    int nullFd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (-1 == nullFd)
+        die("Unable to open /dev/null");
 
-    if (optind >= argc)
-        usage();
+    char **baseEnv = license->mEnv;
 
-    /* Skip all NAME=VALUE arguments, but take care to detect
-     * degenerate cases where NAME is empty.
-     */
+    size_t baseEnvLen = 0;
+    while (baseEnv[baseEnvLen])
+        ++baseEnvLen;
 
-    char **argp = &argv[optind];
+    char *buf = 0;
+    size_t bufSize = 0;
 
-    aApp->mEnv = argp;
+    char **env = 0;
+    char **settings = 0;
+    size_t settingsLen = 0;
 
-    while (*argp && strchr(*argp, '=')) {
-        if ('=' == **argp)
-            usage();
-        ++argp;
-    }
+    while (1) {
 
-    /* Ensure that there is one non-empty argument remaining
-     * that specifies the command to execute.
-     */
+        /* Read the settings of the next command, and override the
+         * environment of the session with each of them.
+         */
 
-    if (!argp[0] || !argp[0][0] || argp[1])
-        usage();
+        ssize_t settingLen = read_session_(&buf, &bufSize, stdin);
+        if (-1 == settingLen)
+            break;
 
-    aApp->mCmd = argp;
+        start_timing();
 
-    if (!create_grouplist(&aApp->mGroups))
-        die("Unable to query supplementary groups");
+        while (settingLen) {
+            const char *settingSep = strchr(buf, '=');
+            if (!settingSep || settingSep == buf) {
+                errno = 0;
+                fail(FAILURE_ENVIRONMENT,
+                    "Unable to parse environment variable %s", buf);
+            }
 
-    IFDEBUG({
-        for (size_t gx = 0; gx < aApp->mGroups.mSize; ++gx)
-            DEBUG("Supplementary gid %d", aApp->mGroups.mList[gx]);
-    });
+            char **resized = realloc(
+                settings, (settingsLen + 1) * sizeof(*settings));
+            if (!resized)
+                die("Unable to allocate session command");
+            settings = resized;
+
+            settings[settingsLen] = strdup(buf);
+            if (!settings[settingsLen])
+                die("Unable to allocate session command");
+            ++settingsLen;
+
+            settingLen = read_session_(&buf, &bufSize, stdin);
+            if (-1 == settingLen) {
+                errno = 0;
+                fail(FAILURE_USAGE, "Truncated session command");
+            }
+        }
 
-    /* The requestor is determined from user running the program
-     * and is required to also be the licensee.
-     */
+        char **resized = realloc(
+            env, (baseEnvLen + settingsLen + 1) * sizeof(*env));
+        if (!resized)
+            die("Unable to allocate session environment");
+        env = resized;
 
-    if (!create_user(&aApp->mRequestor, aUid, aGid))
-        die("Unable to find passwd entry for uid %d gid %d", aUid._, aGid._);
+        size_t envLen = baseEnvLen;
+        memcpy(env, baseEnv, baseEnvLen * sizeof(*env));
 
-    DEBUG("Requestor %s", aApp->mRequestor.mName);
+        for (size_t sx = 0; sx < settingsLen; ++sx) {
+            size_t nameLen = strchr(settings[sx], '=') - settings[sx] + 1;
 
-    /* The licensee is determined from the owner of the symlink. For
-     * now, simply keep a reference to the symlink so that it can
-     * be interrogated later after dropping privileges.
-     */
+            size_t ex;
+            for (ex = 0; ex < envLen; ++ex) {
+                if (!strncmp(env[ex], settings[sx], nameLen))
+                    break;
+            }
 
-    if (!create_symlinkfd(&aApp->mLicensee.mSymLink, 0, *aApp->mCmd))
-        die("Unable to open %s", *aApp->mCmd);
+            DEBUG("Session env %s", settings[sx]);
 
-    struct stat dirStat;
+            env[ex] = settings[sx];
+            if (ex == envLen)
+                ++envLen;
+        }
 
-    if (fstat(aApp->mLicensee.mSymLink.mDir.mFd, &dirStat))
-        die("Unable to stat directory %s",
-            aApp->mLicensee.mSymLink.mDir.mPath);
+        env[envLen] = 0;
 
-    /* The licensor is determined from the directory containing
-     * the symlink. That directory is presumed to house all the
-     * registrations for a particular licensee.
-     */
+        /* Only launch the program if the registration is unchanged
+         * since it was verified.
+         */
 
-    if (!create_user(
-            &aApp->mLicensor,
-            (struct uid) { dirStat.st_uid },
-            (struct gid) { -1 }))
-        die("Unable to find passwd entry for uid %d", dirStat.st_uid);
+        if (suxec_revalidate(license))
+            refuse(license);
 
-    DEBUG("Licensor %s", aApp->mLicensor.mName);
+        license->mEnv = env;
 
-    if (fetch_user_groups(&aApp->mLicensor))
-        die("Unable to query supplementary groups for user %s",
-            aApp->mLicensor.mName);
+        pid_t pid = launch_program(
+            license, *aApp->mCmd, nullFd, STDERR_FILENO);
 
-    IFDEBUG({
-        for (size_t gx = 0; gx < aApp->mLicensor.mGroups->mSize; ++gx)
-            DEBUG("Licensor gid %d", aApp->mLicensor.mGroups->mList[gx]);
-    });
+        license->mEnv = baseEnv;
 
-    /* The owner of the symlink determines the licensee, and should match
-     * the requestor.
-     */
+        if (print_session("pid %d", pid))
+            die("Unable to reply to session");
 
-    DEBUG("Command %s", *aApp->mCmd);
-    DEBUG("Licensee %s", aApp->mLicensee.mSymLink.mDir.mPath);
+        if (print_session("exit %d %d", pid, wait_program(pid)))
+            die("Unable to reply to session");
 
-    /* Determine the name of the directory holding the registrations
-     * for this licensee, and verify the format of the name.
-     */
+        for (size_t sx = 0; sx < settingsLen; ++sx)
+            free(settings[sx]);
+        settingsLen = 0;
+    }
 
-    char *licenseeDir = strrchr(aApp->mLicensee.mSymLink.mDir.mPath, '/');
-    if (!licenseeDir || licenseeDir == aApp->mLicensee.mSymLink.mDir.mPath)
-        die("Unable to determine licensee directory from %s",
-            aApp->mLicensee.mSymLink.mDir.mPath);
-    ++licenseeDir;
+    free(settings);
+    free(env);
+    free(buf);
 
-    if ('.' == *licenseeDir)
-        die("Hidden directory at %s", aApp->mLicensee.mSymLink.mDir.mPath);
+    close(nullFd);
 
-    if ('@' == *licenseeDir)
-        die("Restricted directory at %s", aApp->mLicensee.mSymLink.mDir.mPath);
+    suxec_close_license(license);
 
-    /* Interrogate the parent of the licensee registration directory.
-     * This directory should be owned by the licensor, and should not
-     * allow other users to list its contents. Only the licensor
-     * should be allowed to know the names of all the registered
-     * licensees, and the names of the submission and staging directories.
-     */
+    exit(0);
+}
 
-    struct stat parentDirStat;
+/* ************************************************************************** */
+/* Pipeline
+ *
+ * A pipeline verifies each stage in turn, sharing the users already
+ * found for earlier stages, so that each user is only looked up once.
+ * The stages are connected by pipes, and each stage is launched as
+ * its own licensor. Each pipe is enlarged so that stages run by
+ * different licensors exchange data with fewer context switches.
+ *
+ * The exit status of the pipeline is that of the last stage that
+ * failed, or zero if all stages succeed, in the manner of the
+ * pipefail option of bash(1).
+ */
 
-    if (fstatat(aApp->mLicensee.mSymLink.mDir.mFd, "..", &parentDirStat, 0))
-        die("Unable to stat directory %s/../",
-            aApp->mLicensee.mSymLink.mDir.mPath);
+#define PIPELINE_PIPE_SIZE (1024 * 1024)
 
-    if (parentDirStat.st_mode & (S_IRGRP|S_IWGRP))
-        die("Directory %s/../ has group rw permissions",
-            aApp->mLicensee.mSymLink.mDir.mPath);
+static void
+run_pipeline(struct app *aApp, struct uid aUid, struct gid aGid)
+    __attribute__((noreturn));
 
-    if (parentDirStat.st_mode & (S_IROTH|S_IWOTH))
-        die("Directory %s/../ has other rw permissions",
-            aApp->mLicensee.mSymLink.mDir.mPath);
+static void
+run_pipeline(struct app *aApp, struct uid aUid, struct gid aGid)
+{
+    size_t stages = aApp->mCmds;
 
-    if (uid_ne(
-            (struct uid) { parentDirStat.st_uid },
-            aApp->mLicensor.mUid))
-        die("Expected owner user %s for directory %s/../",
-            aApp->mLicensor.mName, aApp->mLicensee.mSymLink.mDir.mPath);
+    struct suxec_license *licenses = calloc(stages, sizeof(*licenses));
+    pid_t *pids = calloc(stages, sizeof(*pids));
+    if (!licenses || !pids)
+        die("Unable to allocate pipeline of %zu stages", stages);
 
-    /* Verify that the licensor also owns the file resolved by the
-     * symlink. Only the symlink itself is owned by the licensee.
-     */
+    for (size_t sx = 0; sx < stages; ++sx) {
+        struct suxec_license *license = &licenses[sx];
 
-    struct stat symLinkStat;
+        suxec_create_license(license, &aApp->mContext);
 
-    if (fstat(aApp->mLicensee.mSymLink.mFd, &symLinkStat))
-        die("Unable to stat symlink %s/%s",
-            aApp->mLicensee.mSymLink.mDir.mPath,
-            aApp->mLicensee.mSymLink.mName);
+        if (suxec_verify_with(
+                license, licenses, sx, aUid._, aGid._, aApp->mCmd[sx]))
+            refuse(license);
 
-    if (uid_ne(
-            (struct uid) { symLinkStat.st_uid },
-            aApp->mRequestor.mUid))
-        die("Symlink %s should be owned by user %s",
-            *aApp->mCmd, aApp->mRequestor.mName);
+        if (suxec_environment(
+                license, aApp->mEnv, aApp->mCmd - aApp->mEnv))
+            refuse(license);
+    }
 
-    /* Follow the chain of symlinks to find the final symlink
-     * that resolves to a regular file. Note that the previous
-     * fstat(2) would have failed with ELOOP if the chain of
-     * symlinks could not resolve.
+    /* Create each pipe just before launching the stage that writes
+     * to it, and close the copies held by the pipeline as soon as
+     * both stages have been launched.
      */
 
-    while (1) {
-        if (follow_symlinkfd(&aApp->mLicensee.mSymLink)) {
-            if (errno)
-                die("Unable to follow %s/%s",
-                    aApp->mLicensee.mSymLink.mDir.mPath,
-                    aApp->mLicensee.mSymLink.mName);
-            break;
-        }
-    }
+    int stdinFd = STDIN_FILENO;
 
-    /* Now that the symlink has resolved, combine the directory
-     * name and the base name to form the path to the resolved
-     * file.
-     */
+    for (size_t sx = 0; sx < stages; ++sx) {
+        int pipeFds[2] = { -1, -1 };
 
-    if (splice_path(&aApp->mPath,
-            aApp->mLicensee.mSymLink.mDir.mPath,
-            aApp->mLicensee.mSymLink.mName))
-        die("Unable to create path %s/%s",
-            aApp->mLicensee.mSymLink.mDir.mPath,
-            aApp->mLicensee.mSymLink.mName);
-
-    /* Verify that the resolved symlink is owned by the licensor
-     * previously established by looking at the owner of the directory
-     * containing the symlink. Also verify that the owner has permission
-     * to execute the target file.
-     */
+        int stdoutFd = STDOUT_FILENO;
 
-    struct stat linkStat;
+        if (sx + 1 < stages) {
+            if (pipe2(pipeFds, O_CLOEXEC))
+                die("Unable to create pipe");
 
-    if (stat(aApp->mPath, &linkStat))
-        die("Unable to stat %s", aApp->mPath);
+            if (-1 == fcntl(pipeFds[1], F_SETPIPE_SZ, PIPELINE_PIPE_SIZE))
+                DEBUG("Unable to resize pipe to %d bytes",
+                    PIPELINE_PIPE_SIZE);
 
-    if (uid_ne(
-            (struct uid) { linkStat.st_uid },
-            aApp->mLicensor.mUid))
-        die("Expected owner user %s for file referenced by %s",
-            aApp->mLicensor.mName, *aApp->mCmd);
+            stdoutFd = pipeFds[1];
+        }
 
-    if (!S_ISREG(linkStat.st_mode) || !(linkStat.st_mode & S_IXUSR))
-        die("Expected executable file at %s", *aApp->mCmd);
+        DEBUG("Stage %zu %s", sx, aApp->mCmd[sx]);
 
-    /* Add all the specified variables named on the command line to
-     * the environment. Named variables override the default
-     * LOGNAME, PATH, HOME, and SHELL, variables that would
-     * normally be added.
-     */
+        pids[sx] = launch_program(
+            &licenses[sx], aApp->mCmd[sx], stdinFd, stdoutFd);
 
-    const char *logNameEnv = "LOGNAME";
-    const char *pathEnv = "PATH";
-    const char *homeEnv = "HOME";
-    const char *shellEnv = "SHELL";
+        if (STDIN_FILENO != stdinFd)
+            close(stdinFd);
+        if (-1 != pipeFds[1])
+            close(pipeFds[1]);
 
-    const char *foundEnv = "";
+        stdinFd = pipeFds[0];
+    }
 
-    for (char **envp = aApp->mEnv; envp != aApp->mCmd; ) {
-        DEBUG("Env %s", *envp);
+    mark_timing(TIMING_EXEC);
+    if (write_timing())
+        DEBUG("Unable to write timing to fd %d", sTiming.mFd);
 
-        char *envSep = strchr(*envp, '=');
-        if (!envSep)
-            die("Unable to parse environment variable %s", *envp);
+    int exitCode = 0;
 
-        *envSep++ = 0;
+    for (size_t sx = 0; sx < stages; ++sx) {
+        int stageCode = wait_program(pids[sx]);
 
-        if (!strcmp(*envp, logNameEnv))
-            logNameEnv = foundEnv;
-        else if (!strcmp(*envp, pathEnv))
-            pathEnv = foundEnv;
-        else if (!strcmp(*envp, homeEnv))
-            homeEnv = foundEnv;
-        else if (!strcmp(*envp, shellEnv))
-            shellEnv = foundEnv;
+        DEBUG("Stage %zu pid %d exit %d", sx, pids[sx], stageCode);
 
-        if (setenv(*envp, envSep, 1))
-            die("Unable to set environment variable %s=%s", *envp, envSep);
-    }
+        if (stageCode)
+            exitCode = stageCode;
 
-    if (logNameEnv != foundEnv) {
-        if (setenv(logNameEnv, aApp->mLicensor.mName, 1))
-            die("Unable to set environment variable %s=%s",
-                logNameEnv, aApp->mLicensor.mName);
-        DEBUG("Env %s=%s", logNameEnv, aApp->mLicensor.mName);
+        if (-1 != sPipeline.mStatusFd &&
+                0 > dprintf(sPipeline.mStatusFd,
+                    "exit %d %d%c", pids[sx], stageCode, 0))
+            die("Unable to write status to fd %d", sPipeline.mStatusFd);
     }
 
-    if (homeEnv != foundEnv) {
-        if (setenv(homeEnv, aApp->mLicensor.mHome, 1))
-            die("Unable to set environment variable %s=%s",
-                homeEnv, aApp->mLicensor.mHome);
-        DEBUG("Env %s=%s", homeEnv, aApp->mLicensor.mHome);
-    }
+    for (size_t sx = stages; sx--; )
+        suxec_close_license(&licenses[sx]);
 
-    if (shellEnv != foundEnv) {
-        const char *shellPath = "/bin/sh";
-        if (setenv(shellEnv, shellPath, 1))
-            die("Unable to set environment variable %s=%s",
-                shellEnv, shellPath);
-        DEBUG("Env %s=%s", shellEnv, shellPath);
-    }
+    free(pids);
+    free(licenses);
 
-    if (pathEnv != foundEnv) {
-        const char *path = "/usr/bin:/bin";
-        if (setenv(pathEnv, path, 1))
-            die("Unable to set environment variable %s=%s", pathEnv, path);
-        DEBUG("Env %s=%s", pathEnv, path);
-    }
+    exit(exitCode);
 }
 
 /* ************************************************************************** */
@@ -1093,6 +1218,14 @@ main(int argc, char **argv)
      * computes the name of the current working directory.
      */
 
+    start_timing();
+
+    /* PRIVILEGED */ open_stats();
+    /* PRIVILEGED */ open_trace();
+    /* PRIVILEGED */ open_audit();
+    /* PRIVILEGED */ open_digests();
+    /* PRIVILEGED */ open_exec_cache();
+    /* PRIVILEGED */ open_index();
     /* PRIVILEGED */ struct gid privilegedGid = { getegid() };
     /* PRIVILEGED */ struct uid privilegedUid = { geteuid() };
     /* PRIVILEGED */
@@ -1119,19 +1252,54 @@ main(int argc, char **argv)
      * to run the licensed program as the licensor.
      */
 
-    struct app app;
+    struct app app = { .mEnv = 0 };
+
+    /* Read the target ahead while the launch proceeds, unless the
+     * target is expected to be executed from the local cache.
+     */
+
+    app.mContext = (struct suxec_context) {
+        .mFlags = -1 == sExecCacheFd ? SUXEC_READAHEAD : 0,
+        .mEvent = observe_license_,
+        .mFetchDigest = fetch_digest,
+        .mStoreDigest = store_digest,
+        .mFetchChain = sIndex ? fetch_chain : 0,
+        .mArg = &app,
+    };
+
+    suxec_create_license(&app.mLicense, &app.mContext);
 
     license_program(&app, argc, argv, unprivilegedUid, unprivilegedGid);
 
+    if (sSession)
+        run_session(&app);
+
+    if (sPipeline.mEnabled)
+        run_pipeline(&app, unprivilegedUid, unprivilegedGid);
+
     /* Run the remainder as the privileged user so that the
      * target program can be launched as the licensor.
      */
 
     /* PRIVILEGED */ swap_reuid();
     /* PRIVILEGED */
-    /* PRIVILEGED */ impersonate_user(&app.mLicensor, &app.mGroups);
+    /* PRIVILEGED */ int copyFd = fetch_exec_cache(
+    /* PRIVILEGED */     app.mLicense.mPath, &app.mLicense.mPathStat,
+    /* PRIVILEGED */     app.mLicense.mLicensor.mUid,
+    /* PRIVILEGED */     app.mLicense.mLicensor.mGid);
+    /* PRIVILEGED */
+    /* PRIVILEGED */ if (suxec_impersonate(&app.mLicense))
+    /* PRIVILEGED */     refuse(&app.mLicense);
+    /* PRIVILEGED */
+    /* PRIVILEGED */ mark_timing(TIMING_IMPERSONATE);
+    /* PRIVILEGED */
+    /* PRIVILEGED */ record_launch(&app.mLicense, *app.mCmd);
+    /* PRIVILEGED */
+    /* PRIVILEGED */ mark_timing(TIMING_EXEC);
+    /* PRIVILEGED */ if (write_timing())
+    /* PRIVILEGED */     DEBUG("Unable to write timing to fd %d", sTiming.mFd);
     /* PRIVILEGED */
-    /* PRIVILEGED */ return chain_execv(app.mPath);
+    /* PRIVILEGED */ return chain_execv(&app.mLicense, copyFd);
 }
 
 /* ************************************************************************** */
@@ -0,0 +1,332 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/un.h>
+
+#include <zlib.h>
+
+#include "audit_record.h"
+
+/* -------------------------------------------------------------------------- */
+/* Collect the audit log
+ *
+ * Records are decoded into one line of text per launch, and appended
+ * to a gzip file in batches. A spool is collected by atomically
+ * replacing it with an empty file, waiting for launches still holding
+ * the previous spool to complete, and then compressing its content.
+ * A socket is collected by receiving batches of datagrams, and
+ * flushing the compressed output after each batch.
+ */
+
+#define AUDIT_BATCH 64
+
+static volatile sig_atomic_t sStopped;
+
+/* -------------------------------------------------------------------------- */
+static void
+stop(int aSigNum)
+{
+    sStopped = 1;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+write_path(gzFile aOutput, const char *aName, const char *aPath)
+{
+    /* Escape the path so that each record occupies exactly one
+     * line regardless of the characters in the path.
+     */
+
+    gzprintf(aOutput, " %s=", aName);
+
+    for (const unsigned char *cp = (const unsigned char *) aPath; *cp; ++cp) {
+        if (' ' < *cp && '\\' != *cp && '\177' != *cp)
+            gzputc(aOutput, *cp);
+        else
+            gzprintf(aOutput, "\\%03o", *cp);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+write_record(gzFile aOutput, const struct audit_record *aRecord)
+{
+    struct tm tm;
+    time_t secs = aRecord->mTime / 1000000000;
+    char stamp[sizeof("YYYY-MM-DDTHH:MM:SS")];
+
+    if (!gmtime_r(&secs, &tm) ||
+            !strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm))
+        strcpy(stamp, "?");
+
+    gzprintf(aOutput,
+        "time=%s.%09" PRIu64 "Z pid=%" PRIu32
+        " requestor=%" PRIu32 ":%" PRIu32
+        " licensor=%" PRIu32 ":%" PRIu32
+        " hops=%" PRIu32
+        " registration=%u:%u:%" PRIu64
+        " target=%u:%u:%" PRIu64,
+        stamp, aRecord->mTime % 1000000000, aRecord->mPid,
+        aRecord->mRequestorUid, aRecord->mRequestorGid,
+        aRecord->mLicensorUid, aRecord->mLicensorGid,
+        aRecord->mHops,
+        major(aRecord->mRegistrationDev), minor(aRecord->mRegistrationDev),
+        aRecord->mRegistrationIno,
+        major(aRecord->mTargetDev), minor(aRecord->mTargetDev),
+        aRecord->mTargetIno);
+
+    write_path(aOutput, "symlink", aRecord->mPaths);
+    write_path(aOutput, "path", audit_record_path(aRecord));
+
+    gzputc(aOutput, '\n');
+}
+
+/* -------------------------------------------------------------------------- */
+static size_t
+write_records(gzFile aOutput, const char *aBuf, size_t aSize)
+{
+    size_t numRecords = 0;
+    size_t offset = 0;
+
+    union audit_buffer audit;
+
+    const struct audit_record *record;
+    while ((record = scan_audit_record(aBuf, aSize, &offset, &audit))) {
+        write_record(aOutput, record);
+        ++numRecords;
+    }
+
+    return numRecords;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+collect_spool(gzFile aOutput, const char *aSpool, unsigned aGrace)
+{
+    /* Hold the current spool open, and replace it with an empty file
+     * of the same ownership so that launches are never without a
+     * spool.
+     */
+
+    int spoolFd = open(aSpool, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (-1 == spoolFd)
+        err(1, "Unable to open %s", aSpool);
+
+    struct stat spoolStat;
+    if (fstat(spoolFd, &spoolStat))
+        err(1, "Unable to stat %s", aSpool);
+
+    char nextSpool[PATH_MAX];
+    if (sizeof(nextSpool) <= (size_t) snprintf(
+            nextSpool, sizeof(nextSpool), "%s.next", aSpool))
+        errx(1, "Spool path too long %s", aSpool);
+
+    int nextFd = open(nextSpool,
+        O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+        spoolStat.st_mode & 07777);
+    if (-1 == nextFd)
+        err(1, "Unable to create %s", nextSpool);
+
+    if (fchown(nextFd, spoolStat.st_uid, spoolStat.st_gid) ||
+            fchmod(nextFd, spoolStat.st_mode & 07777) ||
+            close(nextFd) ||
+            rename(nextSpool, aSpool)) {
+        int savedErrno = errno;
+        unlink(nextSpool);
+        errno = savedErrno;
+        err(1, "Unable to replace %s", aSpool);
+    }
+
+    /* Each launch holds the spool only from the start of verification
+     * until the program is executed. Sessions and pipelines hold the
+     * spool for longer, but check that it has not been replaced
+     * immediately before recording each launch.
+     */
+
+    sleep(aGrace);
+
+    if (fstat(spoolFd, &spoolStat))
+        err(1, "Unable to stat %s", aSpool);
+
+    size_t numRecords = 0;
+
+    if (spoolStat.st_size) {
+        void *spool = mmap(
+            0, spoolStat.st_size, PROT_READ, MAP_PRIVATE, spoolFd, 0);
+        if (MAP_FAILED == spool)
+            err(1, "Unable to map %s", aSpool);
+
+        numRecords = write_records(aOutput, spool, spoolStat.st_size);
+
+        munmap(spool, spoolStat.st_size);
+    }
+
+    close(spoolFd);
+
+    fprintf(stderr, "%s: %zu records from %s\n",
+        program_invocation_short_name, numRecords, aSpool);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+collect_socket(gzFile aOutput, const char *aSocket)
+{
+    struct sockaddr_un sockAddr = { .sun_family = AF_UNIX };
+
+    if (strlen(aSocket) >= sizeof(sockAddr.sun_path))
+        errx(1, "Socket path too long %s", aSocket);
+    strcpy(sockAddr.sun_path, aSocket);
+
+    int sockFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (-1 == sockFd)
+        err(1, "Unable to create socket");
+
+    mode_t mask = umask(077);
+    unlink(aSocket);
+    if (bind(sockFd, (struct sockaddr *) &sockAddr, sizeof(sockAddr)))
+        err(1, "Unable to bind %s", aSocket);
+    umask(mask);
+
+    struct timeval timeout = { .tv_sec = 1 };
+    if (setsockopt(
+            sockFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+        err(1, "Unable to configure %s", aSocket);
+
+    struct sigaction stopAction = { .sa_handler = stop };
+    if (sigaction(SIGINT, &stopAction, 0) ||
+            sigaction(SIGTERM, &stopAction, 0))
+        err(1, "Unable to configure signal handlers");
+
+    static char buf[AUDIT_BATCH][AUDIT_RECORD_MAX];
+    struct iovec iov[AUDIT_BATCH];
+    struct mmsghdr msgs[AUDIT_BATCH];
+
+    size_t numRecords = 0;
+
+    while (!sStopped) {
+        for (unsigned mx = 0; mx < AUDIT_BATCH; ++mx) {
+            iov[mx] = (struct iovec) {
+                .iov_base = buf[mx], .iov_len = sizeof(buf[mx]) };
+            msgs[mx] = (struct mmsghdr) {
+                .msg_hdr = { .msg_iov = &iov[mx], .msg_iovlen = 1 } };
+        }
+
+        int numMsgs = recvmmsg(
+            sockFd, msgs, AUDIT_BATCH, MSG_WAITFORONE, 0);
+        if (-1 == numMsgs) {
+            if (EINTR == errno || EAGAIN == errno)
+                continue;
+            err(1, "Unable to receive from %s", aSocket);
+        }
+
+        for (int mx = 0; mx < numMsgs; ++mx)
+            numRecords += write_records(aOutput, buf[mx], msgs[mx].msg_len);
+
+        if (Z_OK != gzflush(aOutput, Z_SYNC_FLUSH))
+            errx(1, "Unable to flush output");
+    }
+
+    unlink(aSocket);
+    close(sockFd);
+
+    fprintf(stderr, "%s: %zu records from %s\n",
+        program_invocation_short_name, numRecords, aSocket);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [-g seconds] spool output\n"
+        "       %s -l socket output\n",
+        program_invocation_short_name,
+        program_invocation_short_name);
+    exit(1);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    unsigned grace = 1;
+    const char *socketPath = 0;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+g:l:"))) {
+        switch (opt) {
+        default:
+            usage();
+
+        case 'g':
+            grace = strtoul(optarg, 0, 10);
+            break;
+
+        case 'l':
+            socketPath = optarg;
+            break;
+        }
+    }
+
+    if (optind + (socketPath ? 1 : 2) != argc)
+        usage();
+
+    const char *outputPath = argv[argc-1];
+
+    gzFile output = gzopen(outputPath, "ab");
+    if (!output)
+        err(1, "Unable to open %s", outputPath);
+
+    if (socketPath)
+        collect_socket(output, socketPath);
+    else
+        collect_spool(output, argv[optind], grace);
+
+    if (Z_OK != gzclose(output))
+        errx(1, "Unable to write %s", outputPath);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,762 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <grp.h>
+#include <limits.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "index_store.c.h"
+#include "libsuxec.h"
+
+/* -------------------------------------------------------------------------- */
+/* Maintain the registration index
+ *
+ * Watch each registration directory, each licensee directory within
+ * it, and the directory holding each target, using inotify(7). Each
+ * registration is verified once when it is found, and then only when
+ * an event reports a change to its symlink or its target, publishing
+ * the chain of each authorised registration in the index, and removing
+ * the chain of each refused registration. A change to a registration
+ * directory, or a lost event, causes every registration to be found
+ * again, as does the periodic rescan that also catches changes to
+ * intermediate symlinks that are not watched.
+ *
+ * The index is only a hint, since suxec confirms each object in
+ * a chain before using it, so a late or lost event can only cause
+ * suxec to follow the chain itself.
+ *
+ * A registration can only be used by the owner of its symlink, so each
+ * registration is verified on behalf of that owner. The registrations
+ * of each owner are verified by a child process that has adopted the
+ * credentials of the owner, so that the chain is followed with the
+ * same permissions as a launch. The owner can signal the child, so the
+ * child unmaps the index before adopting the credentials, and returns
+ * each chain to the privileged parent, which alone writes the index.
+ */
+
+#define INDEX_SETTLE_MS 100
+#define INDEX_INTERVAL 300
+
+#define WATCH_TOP      0x1u
+#define WATCH_LICENSEE 0x2u
+#define WATCH_TARGET   0x4u
+
+#define DIRECTORY_EVENTS ( \
+    IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+    IN_DELETE_SELF | IN_MOVE_SELF)
+
+#define TARGET_EVENTS (DIRECTORY_EVENTS | IN_CLOSE_WRITE)
+
+struct watch {
+    int mWd;
+    unsigned mKind;
+    char *mLicenseeDir;
+};
+
+struct result {
+    size_t mRegistration;
+    int mVerified;
+    int mIndexed;
+    size_t mTargetLen;
+    unsigned char mChain[SUXEC_CHAIN_SIZE];
+};
+
+struct registration {
+    char *mPath;
+    const char *mName;
+    int mLicenseeWd;
+    struct stat mStat;
+    char *mTarget;
+    const char *mTargetName;
+    int mTargetWd;
+    int mDirty;
+};
+
+static int sDebug;
+static volatile sig_atomic_t sStopped;
+
+static char **sDirs;
+static size_t sDirsLen;
+
+static int sInotifyFd = -1;
+
+static struct watch *sWatches;
+static size_t sWatchesLen;
+
+static struct registration *sRegistrations;
+static size_t sRegistrationsLen;
+
+/* -------------------------------------------------------------------------- */
+static void
+stop(int aSigNum)
+{
+    sStopped = 1;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+debug_(const char *aFmt, ...)
+{
+    va_list argp;
+
+    va_start(argp, aFmt);
+
+    fprintf(stderr, "%s: ", program_invocation_short_name);
+    vfprintf(stderr, aFmt, argp);
+    fputc('\n', stderr);
+
+    va_end(argp);
+}
+
+#define DEBUG(...) \
+    if (!sDebug) ; else do debug_(__VA_ARGS__); while (0)
+
+/* -------------------------------------------------------------------------- */
+static void
+debug_license_(void *aArg, const char *aFmt, va_list aArgp)
+{
+    fprintf(stderr, "%s: ", program_invocation_short_name);
+    vfprintf(stderr, aFmt, aArgp);
+    fputc('\n', stderr);
+}
+
+/* -------------------------------------------------------------------------- */
+static struct watch *
+find_watch_(int aWd)
+{
+    for (size_t wx = 0; wx < sWatchesLen; ++wx) {
+        if (aWd == sWatches[wx].mWd)
+            return &sWatches[wx];
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+add_watch_(const char *aPath, unsigned aKind)
+{
+    /* A directory watched for more than one reason shares a single
+     * watch descriptor, so accumulate the events of interest.
+     */
+
+    int wd = inotify_add_watch(sInotifyFd, aPath,
+        IN_MASK_ADD | IN_ONLYDIR | IN_DONT_FOLLOW |
+        (WATCH_TARGET == aKind ? TARGET_EVENTS : DIRECTORY_EVENTS));
+    if (-1 == wd) {
+        DEBUG("Unable to watch %s - %s", aPath, strerror(errno));
+        return -1;
+    }
+
+    struct watch *watch = find_watch_(wd);
+    if (!watch) {
+        watch = realloc(sWatches, (sWatchesLen + 1) * sizeof(*sWatches));
+        if (!watch)
+            err(1, "Unable to allocate watch");
+        sWatches = watch;
+
+        watch = &sWatches[sWatchesLen++];
+        *watch = (struct watch) { .mWd = wd };
+    }
+
+    watch->mKind |= aKind;
+
+    if (WATCH_LICENSEE == aKind && !watch->mLicenseeDir) {
+        watch->mLicenseeDir = strdup(aPath);
+        if (!watch->mLicenseeDir)
+            err(1, "Unable to allocate watch");
+    }
+
+    return wd;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+add_registration_(const char *aDir, const char *aName, int aLicenseeWd)
+{
+    char *path;
+    if (-1 == asprintf(&path, "%s/%s", aDir, aName))
+        err(1, "Unable to allocate registration");
+
+    struct stat registrationStat;
+    if (lstat(path, &registrationStat) ||
+            !S_ISLNK(registrationStat.st_mode)) {
+        free(path);
+        return;
+    }
+
+    struct registration *registration = realloc(
+        sRegistrations, (sRegistrationsLen + 1) * sizeof(*registration));
+    if (!registration)
+        err(1, "Unable to allocate registration");
+    sRegistrations = registration;
+
+    sRegistrations[sRegistrationsLen++] = (struct registration) {
+        .mPath = path,
+        .mName = path + strlen(aDir) + 1,
+        .mLicenseeWd = aLicenseeWd,
+        .mStat = registrationStat,
+        .mTargetWd = -1,
+        .mDirty = 1,
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+remove_registration_(size_t aIndex)
+{
+    free(sRegistrations[aIndex].mPath);
+    free(sRegistrations[aIndex].mTarget);
+
+    sRegistrations[aIndex] = sRegistrations[--sRegistrationsLen];
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+scan_licensee_(const char *aLicenseeDir, int aLicenseeWd)
+{
+    DIR *dir = opendir(aLicenseeDir);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+            add_registration_(aLicenseeDir, entry->d_name, aLicenseeWd);
+    }
+
+    closedir(dir);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+scan_(void)
+{
+    /* Discard every watch and registration, and find them again,
+     * retaining the index since unchanged chains remain valid.
+     */
+
+    while (sRegistrationsLen)
+        remove_registration_(sRegistrationsLen - 1);
+
+    while (sWatchesLen)
+        free(sWatches[--sWatchesLen].mLicenseeDir);
+
+    if (-1 != sInotifyFd)
+        close(sInotifyFd);
+
+    sInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (-1 == sInotifyFd)
+        err(1, "Unable to create inotify instance");
+
+    for (size_t dx = 0; dx < sDirsLen; ++dx) {
+        if (-1 == add_watch_(sDirs[dx], WATCH_TOP))
+            continue;
+
+        DIR *dir = opendir(sDirs[dx]);
+        if (!dir)
+            continue;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            char *licenseeDir;
+            if (-1 == asprintf(
+                    &licenseeDir, "%s/%s", sDirs[dx], entry->d_name))
+                err(1, "Unable to allocate licensee directory");
+
+            struct stat licenseeStat;
+            if (!lstat(licenseeDir, &licenseeStat) &&
+                    S_ISDIR(licenseeStat.st_mode)) {
+                int wd = add_watch_(licenseeDir, WATCH_LICENSEE);
+                if (-1 != wd)
+                    scan_licensee_(licenseeDir, wd);
+            }
+
+            free(licenseeDir);
+        }
+
+        closedir(dir);
+    }
+
+    DEBUG("Found %zu registrations", sRegistrationsLen);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+collect_chain_(void *aArg, const struct stat *aRegistration, const void *aChain)
+{
+    struct result *result = aArg;
+
+    result->mIndexed = 1;
+    memcpy(result->mChain, aChain, SUXEC_CHAIN_SIZE);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+verify_as_(uid_t aOwner, int aResultsFd)
+{
+    /* Adopt the credentials of the owner before following any chain,
+     * and report the chain and target of each registration, or an
+     * empty path if the registration is refused.
+     */
+
+    if (munmap(sIndex, sizeof(*sIndex)))
+        return 1;
+    sIndex = 0;
+
+    struct passwd *passwd = getpwuid(aOwner);
+    if (!passwd)
+        return 1;
+
+    if (!geteuid()) {
+        if (initgroups(passwd->pw_name, passwd->pw_gid) ||
+                setgid(passwd->pw_gid) ||
+                setuid(aOwner))
+            return 1;
+    }
+
+    FILE *results = fdopen(aResultsFd, "w");
+    if (!results)
+        return 1;
+
+    struct result result;
+
+    struct suxec_context context = {
+        .mDebug = sDebug ? debug_license_ : 0,
+        .mStoreChain = collect_chain_,
+        .mArg = &result,
+    };
+
+    int rc = 0;
+
+    for (size_t rx = 0; rx < sRegistrationsLen; ++rx) {
+        struct registration *registration = &sRegistrations[rx];
+
+        if (!registration->mDirty || aOwner != registration->mStat.st_uid)
+            continue;
+
+        result = (struct result) { .mRegistration = rx };
+
+        struct suxec_license license_, *license =
+            suxec_create_license(&license_, &context);
+
+        result.mVerified = !suxec_verify(
+            license, aOwner, passwd->pw_gid, registration->mPath);
+
+        DEBUG("%s %s %s",
+            result.mVerified ? "Indexed" : "Refused",
+            registration->mPath,
+            result.mVerified ?
+                license->mPath : sFailureName[license->mFailure]);
+
+        const char *target = result.mVerified ? license->mPath : "";
+
+        result.mTargetLen = strlen(target);
+
+        if (1 != fwrite(&result, sizeof(result), 1, results) ||
+                result.mTargetLen != fwrite(
+                    target, 1, result.mTargetLen, results))
+            rc = 1;
+
+        license = suxec_close_license(license);
+    }
+
+    return fclose(results) || rc ? 1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+watch_target_(struct registration *self, const char *aTarget)
+{
+    free(self->mTarget);
+    self->mTarget = 0;
+    self->mTargetName = 0;
+    self->mTargetWd = -1;
+
+    const char *name = strrchr(aTarget, '/');
+    if (!*aTarget || !name)
+        return;
+
+    self->mTarget = strdup(aTarget);
+    if (!self->mTarget)
+        err(1, "Unable to allocate target");
+    self->mTargetName = self->mTarget + (name - aTarget) + 1;
+
+    char *targetDir = strndup(aTarget, name == aTarget ? 1 : name - aTarget);
+    if (!targetDir)
+        err(1, "Unable to allocate target");
+
+    self->mTargetWd = add_watch_(targetDir, WATCH_TARGET);
+
+    free(targetDir);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+verify_owner_(uid_t aOwner)
+{
+    int resultsFds[2];
+    if (pipe2(resultsFds, O_CLOEXEC))
+        err(1, "Unable to create pipe");
+
+    pid_t pid = fork();
+    if (-1 == pid)
+        err(1, "Unable to fork");
+
+    if (!pid) {
+        close(resultsFds[0]);
+        _exit(verify_as_(aOwner, resultsFds[1]));
+    }
+
+    close(resultsFds[1]);
+
+    FILE *results = fdopen(resultsFds[0], "r");
+    if (!results)
+        err(1, "Unable to read results");
+
+    /* Only the parent writes the index, keyed by the registration
+     * that it found, so that the chain is only used if it names the
+     * same registration.
+     */
+
+    struct result result;
+    char target[PATH_MAX];
+
+    while (1 == fread(&result, sizeof(result), 1, results)) {
+        if (result.mRegistration >= sRegistrationsLen ||
+                result.mTargetLen >= sizeof(target) ||
+                result.mTargetLen != fread(
+                    target, 1, result.mTargetLen, results))
+            break;
+
+        target[result.mTargetLen] = 0;
+
+        struct registration *registration =
+            &sRegistrations[result.mRegistration];
+
+        if (result.mVerified && result.mIndexed)
+            store_chain(0, &registration->mStat, result.mChain);
+        else
+            erase_chain(&registration->mStat);
+
+        watch_target_(registration, target);
+    }
+
+    fclose(results);
+
+    int status;
+    if (-1 == waitpid(pid, &status, 0))
+        err(1, "Unable to wait for pid %d", pid);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+        warnx("Unable to verify registrations of uid %u", aOwner);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+verify_(void)
+{
+    /* Remove the chains of registrations that have disappeared, and
+     * verify the remainder on behalf of each owner in turn.
+     */
+
+    for (size_t rx = sRegistrationsLen; rx--; ) {
+        struct registration *registration = &sRegistrations[rx];
+
+        if (!registration->mDirty)
+            continue;
+
+        struct stat registrationStat;
+        if (lstat(registration->mPath, &registrationStat) ||
+                !S_ISLNK(registrationStat.st_mode)) {
+            DEBUG("Removed %s", registration->mPath);
+            erase_chain(&registration->mStat);
+            remove_registration_(rx);
+            continue;
+        }
+
+        if (registrationStat.st_ino != registration->mStat.st_ino ||
+                registrationStat.st_dev != registration->mStat.st_dev)
+            erase_chain(&registration->mStat);
+
+        registration->mStat = registrationStat;
+    }
+
+    uid_t euid = geteuid();
+
+    for (size_t rx = 0; rx < sRegistrationsLen; ++rx) {
+        uid_t owner = sRegistrations[rx].mStat.st_uid;
+
+        if (!sRegistrations[rx].mDirty)
+            continue;
+
+        /* Without privilege, only the registrations of the effective
+         * user can be verified on behalf of their owner.
+         */
+
+        if (!euid || euid == owner)
+            verify_owner_(owner);
+
+        for (size_t ox = rx; ox < sRegistrationsLen; ++ox) {
+            if (owner == sRegistrations[ox].mStat.st_uid)
+                sRegistrations[ox].mDirty = 0;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+mark_(const struct watch *aWatch, const char *aName)
+{
+    /* Mark each registration affected by an event in a licensee or
+     * target directory, where an event without a name applies to
+     * the whole directory, and add each new registration.
+     */
+
+    int found = 0;
+
+    for (size_t rx = 0; rx < sRegistrationsLen; ++rx) {
+        struct registration *registration = &sRegistrations[rx];
+
+        if (aWatch->mWd == registration->mLicenseeWd &&
+                (!aName || !strcmp(aName, registration->mName))) {
+            registration->mDirty = 1;
+            found = 1;
+        }
+
+        if (aWatch->mWd == registration->mTargetWd &&
+                (!aName || !strcmp(aName, registration->mTargetName)))
+            registration->mDirty = 1;
+    }
+
+    if (!found && aName && aWatch->mLicenseeDir)
+        add_registration_(aWatch->mLicenseeDir, aName, aWatch->mWd);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+read_events_(void)
+{
+    /* Return non-zero if every registration must be found again. */
+
+    int rescan = 0;
+
+    char buf[4096]
+        __attribute__((__aligned__(__alignof__(struct inotify_event))));
+
+    while (1) {
+        ssize_t len = read(sInotifyFd, buf, sizeof(buf));
+        if (-1 == len) {
+            if (EINTR == errno)
+                continue;
+            if (EAGAIN == errno)
+                break;
+            err(1, "Unable to read events");
+        }
+
+        for (ssize_t ex = 0; ex < len; ) {
+            const struct inotify_event *event = (const void *) &buf[ex];
+
+            ex += sizeof(*event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                rescan = 1;
+                continue;
+            }
+
+            const struct watch *watch = find_watch_(event->wd);
+            if (!watch)
+                continue;
+
+            /* Licensee directories are only found by a scan, so a change
+             * to a registration directory, or to the identity of a
+             * licensee directory, requires another scan.
+             */
+
+            if ((watch->mKind & WATCH_TOP) ||
+                    ((watch->mKind & WATCH_LICENSEE) &&
+                        (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)))) {
+                rescan = 1;
+                continue;
+            }
+
+            mark_(watch, event->len ? event->name : 0);
+        }
+    }
+
+    return rescan;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [-1d] [-i seconds] directory ...\n",
+        program_invocation_short_name);
+    exit(1);
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+parse_interval(const char *aArg)
+{
+    /* The interval is waited in milliseconds by poll(2), which must
+     * not overflow.
+     */
+
+    char *end;
+
+    errno = 0;
+    unsigned long interval = strtoul(aArg, &end, 10);
+    if (errno || end == aArg || *end || '-' == *aArg ||
+            !interval || interval > INT_MAX / 1000)
+        usage();
+
+    return interval;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    int once = 0;
+    unsigned interval = INDEX_INTERVAL;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+1di:"))) {
+        switch (opt) {
+        default:
+            usage();
+
+        case '1':
+            once = 1;
+            break;
+
+        case 'd':
+            sDebug = 1;
+            break;
+
+        case 'i':
+            interval = parse_interval(optarg);
+            break;
+        }
+    }
+
+    if (optind == argc)
+        usage();
+
+    /* The chains are keyed by the registration symlinks, so any path
+     * to each directory suffices, but watch each directory only once.
+     */
+
+    sDirsLen = argc - optind;
+    sDirs = calloc(sDirsLen, sizeof(*sDirs));
+    if (!sDirs)
+        err(1, "Unable to allocate directories");
+
+    for (size_t dx = 0; dx < sDirsLen; ++dx) {
+        sDirs[dx] = realpath(argv[optind + dx], 0);
+        if (!sDirs[dx])
+            err(1, "Unable to find %s", argv[optind + dx]);
+    }
+
+    sIndex = map_index_(MAPPED_WRITE | MAPPED_CREATE);
+    if (!sIndex)
+        err(1, "Unable to open %s", SUXEC_INDEX_PATH);
+
+    struct sigaction stopAction = { .sa_handler = stop };
+    if (sigaction(SIGINT, &stopAction, 0) ||
+            sigaction(SIGTERM, &stopAction, 0))
+        err(1, "Unable to configure signal handlers");
+
+    scan_();
+    verify_();
+
+    while (!once && !sStopped) {
+        struct pollfd pollFd = { .fd = sInotifyFd, .events = POLLIN };
+
+        int ready = poll(&pollFd, 1, interval * 1000);
+        if (-1 == ready) {
+            if (EINTR == errno)
+                continue;
+            err(1, "Unable to wait for events");
+        }
+
+        int rescan = !ready;
+
+        /* Changes usually arrive in bursts, so wait for the file
+         * system to settle before verifying the registrations.
+         */
+
+        while (ready) {
+            rescan |= read_events_();
+
+            ready = poll(&pollFd, 1, INDEX_SETTLE_MS);
+            if (-1 == ready && EINTR != errno)
+                err(1, "Unable to wait for events");
+            if (-1 == ready)
+                break;
+        }
+
+        if (rescan)
+            scan_();
+
+        verify_();
+    }
+
+    size_t indexed = 0;
+    for (size_t rx = 0; rx < sRegistrationsLen; ++rx)
+        indexed += !!sRegistrations[rx].mTarget;
+
+    fprintf(stderr, "%s: %zu of %zu registrations indexed\n",
+        program_invocation_short_name, indexed, sRegistrationsLen);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,249 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "failure.h"
+#include "trace_ring.h"
+
+/* -------------------------------------------------------------------------- */
+/* Decode the event trace
+ *
+ * Take a consistent copy of the events in the ring, and print them
+ * as one timeline per launch. A launch begins with a start event, and
+ * comprises the subsequent events from the same process.
+ */
+
+struct launch_event {
+    unsigned mLaunch;
+    struct trace_event mEvent;
+};
+
+#define LAUNCH_PIDS (2 * TRACE_EVENTS)
+
+static struct {
+    uint32_t mPid;
+    unsigned mLaunch;
+} sLaunchPid[LAUNCH_PIDS];
+
+static unsigned sLaunches;
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+find_launch(const struct trace_event *aEvent)
+{
+    unsigned px = aEvent->mPid % LAUNCH_PIDS;
+
+    while (sLaunchPid[px].mPid && sLaunchPid[px].mPid != aEvent->mPid)
+        px = (px + 1) % LAUNCH_PIDS;
+
+    /* Events that precede the start event of a process, perhaps
+     * because the start event was overwritten, form a launch of
+     * their own.
+     */
+
+    if (!sLaunchPid[px].mPid || TRACE_START == aEvent->mKind) {
+        sLaunchPid[px].mPid = aEvent->mPid;
+        sLaunchPid[px].mLaunch = ++sLaunches;
+    }
+
+    return sLaunchPid[px].mLaunch;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+rank_launch_event(const void *aLhs, const void *aRhs)
+{
+    const struct launch_event *lhs = aLhs;
+    const struct launch_event *rhs = aRhs;
+
+    if (lhs->mLaunch != rhs->mLaunch)
+        return lhs->mLaunch < rhs->mLaunch ? -1 : 1;
+
+    return lhs->mEvent.mSeq < rhs->mEvent.mSeq ? -1 :
+           lhs->mEvent.mSeq > rhs->mEvent.mSeq;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+print_event(const struct trace_event *aEvent, uint64_t aStart)
+{
+    uint64_t offset = aEvent->mTime - aStart;
+
+    printf("  +%" PRIu64 ".%06" PRIu64 " %-12s",
+        offset / 1000000000, offset % 1000000000 / 1000,
+        sTraceKindName[aEvent->mKind]);
+
+    switch (aEvent->mKind) {
+    default:
+        printf(" uid=%" PRIu32 " gid=%" PRIu32 " dev=%u:%u ino=%" PRIu64,
+            aEvent->mUid, aEvent->mGid,
+            major(aEvent->mDev), minor(aEvent->mDev), aEvent->mIno);
+        break;
+
+    case TRACE_START:
+        printf(" uid=%" PRIu32 " gid=%" PRIu32, aEvent->mUid, aEvent->mGid);
+        break;
+
+    case TRACE_EXEC:
+        printf(" uid=%" PRIu32 " gid=%" PRIu32 " hops=%" PRIu32,
+            aEvent->mUid, aEvent->mGid, aEvent->mHops);
+        break;
+
+    case TRACE_FAILURE:
+        printf(" reason=%s errno=%" PRId32,
+            FAILURES > aEvent->mReason ?
+                sFailureName[aEvent->mReason] : "unknown",
+            aEvent->mErrno);
+        if (aEvent->mErrno)
+            printf(" (%s)", strerror(aEvent->mErrno));
+        break;
+    }
+
+    printf("\n");
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [-p pid] [file]\n", program_invocation_short_name);
+    exit(1);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    uint32_t pid = 0;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+p:"))) {
+        switch (opt) {
+        default:
+            usage();
+
+        case 'p':
+            pid = strtoul(optarg, 0, 10);
+            if (!pid)
+                usage();
+            break;
+        }
+    }
+
+    if (optind + 1 < argc)
+        usage();
+
+    const char *path = optind < argc ? argv[optind] : SUXEC_TRACE_PATH;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+        err(1, "Unable to open %s", path);
+
+    struct stat traceStat;
+    if (fstat(fd, &traceStat))
+        err(1, "Unable to stat %s", path);
+
+    if (sizeof(struct trace) > (size_t) traceStat.st_size)
+        errx(1, "No events in %s", path);
+
+    const struct trace *trace = mmap(
+        0, sizeof(*trace), PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == trace)
+        err(1, "Unable to map %s", path);
+
+    if (TRACE_MAGIC != trace->mHeader.mMagic ||
+            TRACE_VERSION != trace->mHeader.mVersion ||
+            TRACE_EVENTS != trace->mHeader.mEvents)
+        errx(1, "Unrecognised trace format in %s", path);
+
+    /* Copy the most recent events in order, skipping any that are
+     * being written concurrently.
+     */
+
+    static struct launch_event events[TRACE_EVENTS];
+    size_t numEvents = 0;
+
+    uint64_t head = trace_head(trace);
+    uint64_t tail = TRACE_EVENTS < head ? head - TRACE_EVENTS : 0;
+
+    for (uint64_t ticket = tail; ticket < head; ++ticket) {
+        struct launch_event *launchEvent = &events[numEvents];
+
+        if (read_trace_event(trace, ticket, &launchEvent->mEvent))
+            continue;
+
+        launchEvent->mLaunch = find_launch(&launchEvent->mEvent);
+
+        if (!pid || pid == launchEvent->mEvent.mPid)
+            ++numEvents;
+    }
+
+    qsort(events, numEvents, sizeof(*events), rank_launch_event);
+
+    uint64_t start = 0;
+
+    for (size_t ex = 0; ex < numEvents; ++ex) {
+        const struct trace_event *event = &events[ex].mEvent;
+
+        if (!ex || events[ex-1].mLaunch != events[ex].mLaunch) {
+            start = event->mTime;
+
+            struct tm tm;
+            time_t secs = start / 1000000000;
+            char stamp[sizeof("YYYY-MM-DDTHH:MM:SS")];
+
+            if (!gmtime_r(&secs, &tm) ||
+                    !strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm))
+                strcpy(stamp, "?");
+
+            printf("%s.%09" PRIu64 "Z pid %" PRIu32 "\n",
+                stamp, start % 1000000000, event->mPid);
+        }
+
+        print_event(event, start);
+    }
+
+    return fflush(stdout) ? 1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
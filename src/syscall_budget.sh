@@ -0,0 +1,171 @@
+#!/usr/bin/env bash
+# -*- sh-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et:
+
+# Check the system calls made by suxec against a budget.
+#
+# Each scenario in the test directory is run under syscount, which
+# counts the system calls from the start of main until the target
+# program would be executed. The count of each system call must not
+# exceed the budget in syscall_budget.txt, which allows a base number
+# of calls and a number of calls for each symlink hop.
+#
+# Only suxec-static is checked because the files-only user database
+# makes the count independent of the configuration of the host.
+#
+# usage: syscall_budget.sh [update]
+#
+# Use update to rewrite the budget from the current counts.
+
+[ -z "${0##/*}" ] || exec "$PWD/$0" "$@"
+
+set -eu -o pipefail
+
+SCENARIOS="01 02 03 04 08"
+BUDGET="${0%/*}/syscall_budget.txt"
+SUXEC="${0%/*}/suxec-static"
+SYSCOUNT="${0%/*}/syscount"
+
+# The first system call in main opens the statistics file, and
+# marks the end of the startup of the runtime.
+
+MARKER=/run/suxec/stats
+
+say()
+{
+    printf '%s\n' "$*"
+}
+
+skip()
+{
+    say "SKIP $*" >&2
+    exit 77
+}
+
+hops()
+{
+    local LINK="$1"
+    local HOPS=0
+
+    while [ -L "$LINK" ] ; do
+        local TARGET
+        TARGET=$(readlink "$LINK")
+        [ -n "${TARGET##/*}" ] || LINK=
+        LINK="${LINK%/*}/$TARGET"
+        HOPS=$((HOPS + 1))
+    done
+
+    say "$HOPS"
+}
+
+count()
+{
+    local SCENARIO="$1"
+    local LINK="${0%/*}/test/$SCENARIO/run"
+    local HOPS
+    HOPS=$(hops "$LINK")
+
+    "$SYSCOUNT" -m "$MARKER" "$SUXEC" "$LINK" 2>/dev/null |
+    while read -r SYSCALL COUNT ; do
+        say "$SCENARIO $HOPS $SYSCALL $COUNT"
+    done
+}
+
+counts()
+{
+    local SCENARIO
+    for SCENARIO in $SCENARIOS ; do
+        count "$SCENARIO"
+    done
+}
+
+update()
+{
+    # Allow for each hop the largest increase seen between the most
+    # expensive scenarios at each hop count, and then the largest
+    # remainder as the base.
+
+    {
+        say "# System calls made by suxec-static from the start of main"
+        say "# until the target program is executed, allowing base calls"
+        say "# and hop calls for each symlink followed."
+        say "#"
+        say "# Regenerate using: syscall_budget.sh update"
+        say "#"
+        printf '# %-20s %5s %5s\n' syscall base hop
+        counts | awk '
+            {
+                keys[$3] = 1
+                levels[$2] = 1
+                if (calls[$3, $2] < $4)
+                    calls[$3, $2] = $4
+            }
+            END {
+                for (key in keys) {
+                    hop = 0
+                    for (i in levels) {
+                        for (j in levels) {
+                            dh = j - i
+                            dc = calls[key, j] - calls[key, i]
+                            if (dh > 0 && dc > hop * dh)
+                                hop = int((dc + dh - 1) / dh)
+                        }
+                    }
+                    base = 0
+                    for (i in levels) {
+                        rem = calls[key, i] - hop * i
+                        if (rem > base)
+                            base = rem
+                    }
+                    printf "  %-20s %5d %5d\n", key, base, hop
+                }
+            }' | sort
+    } > "$BUDGET"
+}
+
+check()
+{
+    counts | awk -v budget="$BUDGET" '
+        BEGIN {
+            while ((getline line < budget) > 0) {
+                if (line ~ /^#/)
+                    continue
+                split(line, field)
+                base[field[1]] = field[2]
+                hop[field[1]] = field[3]
+            }
+        }
+        !($3 in base) {
+            printf "test/%s: %s %d added\n", $1, $3, $4
+            failed = 1
+            next
+        }
+        {
+            allowed = base[$3] + hop[$3] * $2
+            if ($4 <= allowed)
+                next
+            printf "test/%s: %s %d exceeds %d = %d + %d * %d hops\n", \
+                $1, $3, $4, allowed, base[$3], hop[$3], $2
+            failed = 1
+        }
+        END {
+            exit failed
+        }'
+}
+
+main()
+{
+    [ -x "$SUXEC" ] || skip "Unable to find suxec-static"
+    [ ! -e "${MARKER%/*}" ] || skip "Counts depend on ${MARKER%/*}"
+
+    "$SYSCOUNT" true >/dev/null 2>&1 || skip "Unable to trace"
+
+    chmod og-rw "${0%/*}/test"
+
+    case "${1-check}" in
+    check)  check ;;
+    update) update ;;
+    *)      say "usage: ${0##*/} [check | update]" >&2 ; exit 1 ;;
+    esac
+}
+
+main "$@"
@@ -0,0 +1,264 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "syscall_names.h"
+
+/* -------------------------------------------------------------------------- */
+/* Count system calls made by a program
+ *
+ * Run the program under ptrace(2), and count each system call from
+ * the marker until the program executes another program or exits.
+ * The marker is the first open(2) or openat(2) of the named path,
+ * which allows the startup of the runtime to be excluded. The program
+ * is killed rather than allowed to execute its successor.
+ *
+ * The counts are printed as lines of name and count, ordered by name.
+ */
+
+#define SYSCALLS (sizeof(sSyscallName) / sizeof(sSyscallName[0]))
+
+static unsigned sCount[SYSCALLS];
+static unsigned sOther;
+
+/* -------------------------------------------------------------------------- */
+static int
+match_path(pid_t aPid, unsigned long long aAddr, const char *aPath)
+{
+    char path[PATH_MAX];
+
+    struct iovec local = { .iov_base = path, .iov_len = sizeof(path) };
+    struct iovec remote = { .iov_base = (void *) aAddr, .iov_len = 1 };
+
+    /* Read one page at a time to avoid reading past the end of
+     * the mapping containing the path.
+     */
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+
+    size_t pathLen = 0;
+    while (pathLen < sizeof(path)) {
+        remote.iov_base = (char *) aAddr + pathLen;
+        remote.iov_len = pageSize - (aAddr + pathLen) % pageSize;
+        if (remote.iov_len > sizeof(path) - pathLen)
+            remote.iov_len = sizeof(path) - pathLen;
+
+        local.iov_base = path + pathLen;
+        local.iov_len = remote.iov_len;
+
+        ssize_t readLen = process_vm_readv(aPid, &local, 1, &remote, 1, 0);
+        if (0 >= readLen)
+            return 0;
+
+        if (memchr(path + pathLen, 0, readLen))
+            return !strcmp(path, aPath);
+
+        pathLen += readLen;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+is_marker(
+    pid_t aPid, const struct __ptrace_syscall_info *aInfo, const char *aMarker)
+{
+    if (!aMarker)
+        return 1;
+
+    switch (aInfo->entry.nr) {
+    default:
+        return 0;
+
+#ifdef SYS_open
+    case SYS_open:
+        return match_path(aPid, aInfo->entry.args[0], aMarker);
+#endif
+
+    case SYS_openat:
+        return match_path(aPid, aInfo->entry.args[1], aMarker);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+is_exec(unsigned long long aNr)
+{
+    return SYS_execve == aNr || SYS_execveat == aNr;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+count(unsigned long long aNr)
+{
+    if (SYSCALLS > aNr && sSyscallName[aNr])
+        ++sCount[aNr];
+    else
+        ++sOther;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+trace(pid_t aPid, const char *aMarker)
+{
+    int status;
+
+    if (aPid != waitpid(aPid, &status, 0) || !WIFSTOPPED(status))
+        errx(1, "Unable to start traced program");
+
+    if (ptrace(PTRACE_SETOPTIONS, aPid, 0,
+            PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL))
+        err(1, "Unable to configure trace");
+
+    /* The first execve(2) starts the traced program, and the next
+     * one ends the count.
+     */
+
+    unsigned numExecs = 0;
+    int counting = 0;
+    int signal = 0;
+
+    while (1) {
+        if (ptrace(PTRACE_SYSCALL, aPid, 0, signal))
+            err(1, "Unable to resume traced program");
+        signal = 0;
+
+        if (aPid != waitpid(aPid, &status, 0))
+            err(1, "Unable to wait for traced program");
+
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+            break;
+
+        if ((SIGTRAP | 0x80) != WSTOPSIG(status)) {
+            if (SIGTRAP != WSTOPSIG(status))
+                signal = WSTOPSIG(status);
+            continue;
+        }
+
+        struct __ptrace_syscall_info info;
+        if (0 >= ptrace(
+                PTRACE_GET_SYSCALL_INFO, aPid, sizeof(info), &info))
+            err(1, "Unable to query system call");
+
+        if (PTRACE_SYSCALL_INFO_ENTRY != info.op)
+            continue;
+
+        if (is_exec(info.entry.nr) && 1 < ++numExecs)
+            break;
+
+        if (!counting && 1 == numExecs)
+            counting = is_marker(aPid, &info, aMarker);
+
+        if (counting)
+            count(info.entry.nr);
+    }
+
+    kill(aPid, SIGKILL);
+    waitpid(aPid, &status, 0);
+
+    if (!counting)
+        errx(1, "Unable to find marker %s", aMarker ? aMarker : "");
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+rank_name(const void *aLhs, const void *aRhs)
+{
+    return strcmp(
+        sSyscallName[*(const unsigned *) aLhs],
+        sSyscallName[*(const unsigned *) aRhs]);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    const char *marker = 0;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "+m:"))) {
+        switch (opt) {
+        default:
+            errx(1, "usage: %s [-m path] cmd ...", argv[0]);
+
+        case 'm':
+            marker = optarg;
+            break;
+        }
+    }
+
+    if (optind >= argc)
+        errx(1, "usage: %s [-m path] cmd ...", argv[0]);
+
+    pid_t pid = fork();
+    if (-1 == pid)
+        err(1, "Unable to fork");
+
+    if (!pid) {
+        if (ptrace(PTRACE_TRACEME, 0, 0, 0) || raise(SIGSTOP))
+            err(1, "Unable to trace");
+        execvp(argv[optind], &argv[optind]);
+        err(1, "Unable to execute %s", argv[optind]);
+    }
+
+    trace(pid, marker);
+
+    unsigned numbers[SYSCALLS];
+    unsigned numNumbers = 0;
+
+    for (unsigned nr = 0; nr < SYSCALLS; ++nr) {
+        if (sCount[nr])
+            numbers[numNumbers++] = nr;
+    }
+
+    qsort(numbers, numNumbers, sizeof(*numbers), rank_name);
+
+    for (unsigned nx = 0; nx < numNumbers; ++nx)
+        printf("%s %u\n", sSyscallName[numbers[nx]], sCount[numbers[nx]]);
+    if (sOther)
+        printf("other %u\n", sOther);
+
+    return fflush(stdout) ? 1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -20,6 +20,11 @@ suxec()
     valgrind "$@"
 }
 
+cleanup()
+{
+    [ -z "${CLEANUP++}" ] || rm -rf "$CLEANUP"
+}
+
 expect()
 {
     test "$@" || {
@@ -149,6 +154,280 @@ test_08()
     expect x"$(groups)" = x"$RESULT"
 }
 
+test_09()
+{
+    local ONE TWO
+
+    ONE=$(suxec "${0%/*}/test/01/run" 2>&1 >/dev/null)
+    ONE=$(say "$ONE" | grep 'Path allocations')
+    say "$ONE" >&2
+    expect -n "$ONE"
+
+    TWO=$(suxec "${0%/*}/test/02/run" 2>&1 >/dev/null)
+    TWO=$(say "$TWO" | grep 'Path allocations')
+    say "$TWO" >&2
+    expect -n "$TWO"
+
+    expect x"$ONE" = x"$TWO"
+}
+
+test_10()
+{
+    local RESULT
+    RESULT=$(
+        export LD_PRELOAD="${0%/*}/.libs/slow_backend.so"
+        export SLOW_NSS=1000:1000 SLOW_FS=100:100 SLOW_TRACE=1
+        suxec "${0%/*}/test/02/run" 2>&1 >/dev/null)
+    RESULT=$(say "$RESULT" | grep '^slow ')
+    say "$RESULT" >&2
+
+    expect "$(say "$RESULT" | grep -c '^slow getpwuid_r ')" -ge 2
+    expect "$(say "$RESULT" | grep -c '^slow getgrouplist ')" -ge 1
+    expect "$(say "$RESULT" | grep -c '^slow openat ')" -ge 2
+    expect "$(say "$RESULT" | grep -c '^slow statx ')" -ge 1
+    expect "$(say "$RESULT" | grep -c '^slow readlinkat ')" -ge 3
+}
+
+test_11()
+{
+    local RESULT
+    RESULT=$(suxec --timing-fd 3 "${0%/*}/test/02/run" 3>&1 >/dev/null)
+    say "$RESULT" >&2
+    expect -n "$RESULT"
+
+    expect x"$(say "$RESULT" | wc -l)" = x1
+    expect -z "${RESULT##\{\"pid\":[1-9]*\}}"
+    expect -z "${RESULT##*,\"hops\":3,\"hop_ns\":\[[0-9]*,[0-9]*,[0-9]*\],*}"
+
+    local PHASE
+    for PHASE in parse grouplist requestor symlink licensor parent \
+                 resolve environment impersonate exec ; do
+        expect -z "${RESULT##*,\"${PHASE}_ns\":[1-9]*}"
+    done
+}
+
+test_12()
+{
+    local NOTES
+    NOTES=$(readelf -n "${0%/*}/suxec" | grep -A1 'Provider: suxec')
+    say "$NOTES" >&2
+
+    # Probes are only compiled when sys/sdt.h is available.
+
+    if ! grep -q '^#define HAVE_SYS_SDT_H 1' "${0%/*}/../config.h" ; then
+        expect -z "$NOTES"
+        return 0
+    fi
+
+    local PROBE
+    for PROBE in license license__resolved user user__error grouplist \
+                 follow follow__error impersonate exec die ; do
+        expect -n "$(say "$NOTES" | grep -x "    Name: $PROBE")"
+    done
+}
+
+test_13()
+{
+    # Statistics are reported only if the shared file is readable.
+
+    local RESULT RC=0
+    RESULT=$(suxec --stats) || RC=$?
+
+    if [ ! -r /run/suxec/stats ] ; then
+        expect $RC = 127
+        expect -z "$RESULT"
+        return 0
+    fi
+
+    expect $RC = 0
+    expect -z "${RESULT##*suxec_launches_total [0-9]*}"
+}
+
+test_14()
+{
+    # Audit each registration without executing any of them.
+
+    local RESULT
+    RESULT=$(suxec --audit "${0%/*}/test" | tr '\0' '\n')
+    say "$RESULT" >&2
+
+    expect x"$(say "$RESULT" | grep -cx 'allow none 01/run')" = x1
+    expect x"$(say "$RESULT" | grep -cx 'allow none 02/run')" = x1
+    expect x"$(say "$RESULT" | grep -cx 'deny target_mode 02/bounce')" = x1
+    expect x"$(say "$RESULT" | grep -cx 'deny target_owner 04/run')" = x1
+}
+
+test_15()
+{
+    # A dry run reports the verdict without running the program.
+
+    local RESULT RC=0
+    RESULT=$(suxec --check "${0%/*}/test/02/run" | tr '\0' '\n')
+    say "$RESULT" >&2
+
+    expect x"$(say "$RESULT" | wc -l)" = x1
+    expect -z "${RESULT##allow none $USER [0-9]*:[0-9]* [1-9]* */test/bin/printenv}"
+
+    RESULT=$(
+        set -o pipefail
+        suxec --check "${0%/*}/test/04/run" | tr '\0' '\n') || RC=$?
+    say "$RESULT" >&2
+
+    expect $RC = 127
+    expect -z "${RESULT##deny target_owner $USER [0-9]*:[0-9]* [1-9]* /usr/bin/env}"
+}
+
+test_16()
+{
+    # A session launches the program for each command, and is refused
+    # once the registration changes.
+
+    CLEANUP=$(mktemp -d)
+    mkdir "$CLEANUP/licensee"
+
+    local TARGET
+    TARGET="$(cd "${0%/*}/test/bin" && pwd -P)/printenv"
+    ln -s "$TARGET" "$CLEANUP/licensee/run"
+
+    local REPLY PID RC=0
+    coproc SESSION {
+        suxec --session SESSION=0 "$CLEANUP/licensee/run" 2>"$CLEANUP/log"
+    }
+
+    local SETTINGS
+    for SETTINGS in 'SESSION=1\0' '' ; do
+        printf "$SETTINGS"'\0' >&"${SESSION[1]}"
+
+        read -r -d '' REPLY <&"${SESSION[0]}"
+        say "$REPLY" >&2
+        expect -z "${REPLY##pid [1-9]*}"
+        PID=${REPLY#pid }
+
+        read -r -d '' REPLY <&"${SESSION[0]}"
+        say "$REPLY" >&2
+        expect x"$REPLY" = x"exit $PID 0"
+    done
+
+    expect x"$(grep -c '^SESSION=' "$CLEANUP/log")" = x2
+    expect -n "$(grep -x 'SESSION=1' "$CLEANUP/log")"
+    expect -n "$(grep -x 'SESSION=0' "$CLEANUP/log")"
+
+    ln -sf "$TARGET" "$CLEANUP/licensee/run"
+    printf '\0' >&"${SESSION[1]}"
+
+    read -r -d '' REPLY <&"${SESSION[0]}"
+    say "$REPLY" >&2
+    expect x"$REPLY" = x"deny changed"
+
+    wait "$SESSION_PID" || RC=$?
+    expect $RC = 127
+
+    # The session ends when there are no more commands.
+
+    local RESULT
+    RESULT=$(printf '\0' | suxec --session "${0%/*}/test/01/run" 2>/dev/null |
+        tr '\0' '\n')
+    say "$RESULT" >&2
+
+    expect x"$(say "$RESULT" | wc -l)" = x2
+    expect -z "${RESULT##pid [1-9]*}"
+    expect -z "${RESULT##*exit [1-9]* 0}"
+}
+
+test_17()
+{
+    # A pipeline runs each stage as its licensor, and reports the
+    # exit status of each stage.
+
+    CLEANUP=$(mktemp -d)
+    mkdir "$CLEANUP/licensee" "$CLEANUP/bin"
+
+    printf '#!/bin/sh\nexec wc -l\n' > "$CLEANUP/bin/count"
+    printf '#!/bin/sh\ncat >/dev/null\nexit 3\n' > "$CLEANUP/bin/fail"
+    chmod 755 "$CLEANUP/bin/count" "$CLEANUP/bin/fail"
+
+    ln -s "$(cd "${0%/*}/test/bin" && pwd -P)/printenv" \
+        "$CLEANUP/licensee/printenv"
+    ln -s ../bin/count "$CLEANUP/licensee/count"
+    ln -s ../bin/fail "$CLEANUP/licensee/fail"
+
+    local RESULT STATUS RC=0
+    RESULT=$(
+        suxec --status-fd 3 --pipeline PIPELINE=1 \
+            "$CLEANUP/licensee/printenv" "$CLEANUP/licensee/count" \
+            3>"$CLEANUP/status")
+    STATUS=$(tr '\0' '\n' < "$CLEANUP/status")
+    say "$RESULT" >&2
+    say "$STATUS" >&2
+
+    expect x"$RESULT" = x5
+    expect x"$(say "$STATUS" | grep -c '^exit [1-9][0-9]* 0$')" = x2
+
+    suxec --pipeline "$CLEANUP/licensee/printenv" \
+        "$CLEANUP/licensee/fail" "$CLEANUP/licensee/count" || RC=$?
+    expect $RC = 3
+
+    RC=0
+    suxec --pipeline "$CLEANUP/licensee/printenv" \
+        "${0%/*}/test/04/run" || RC=$?
+    expect $RC = 127
+}
+
+test_18()
+{
+    # Registrations on a network file system can be followed using
+    # cached attributes, with only the objects that the rules depend
+    # upon fetched from the file server. The interposed statx(2)
+    # stands in for the file server.
+
+    local RESULT LAZY
+    RESULT=$(
+        export LD_PRELOAD="${0%/*}/.libs/slow_backend.so"
+        export SLOW_FS=0 SLOW_TRACE=1
+        suxec --timing-fd 3 "${0%/*}/test/02/run" 3>&1 2>&1 >/dev/null)
+    LAZY=$(
+        export LD_PRELOAD="${0%/*}/.libs/slow_backend.so"
+        export SLOW_FS=0 SLOW_TRACE=1
+        suxec --nfs --timing-fd 3 "${0%/*}/test/02/run" 3>&1 2>&1 >/dev/null)
+    say "$RESULT" >&2
+    say "$LAZY" >&2
+
+    expect -z "${RESULT##*\"round_trips\":8,*}"
+    expect "$(say "$RESULT" | grep -c '^slow statx ')" = 8
+    expect -z "${LAZY##*\"round_trips\":4,*}"
+    expect "$(say "$LAZY" | grep -c '^slow statx ')" = 4
+    expect -n "$(say "$LAZY" | grep 'Confirmed 4 pins')"
+}
+
+test_19()
+{
+    # The target is read ahead during a launch, but not during a
+    # dry run, and the warmer relies on the statistics to rank the
+    # registrations.
+
+    local RESULT RC=0
+    RESULT=$(suxec "${0%/*}/test/02/run" 2>&1 >/dev/null)
+    say "$RESULT" >&2
+    expect -n "$(say "$RESULT" | grep 'Read ahead .*/bin/printenv started')"
+
+    RESULT=$(suxec --check "${0%/*}/test/02/run" 2>&1 >/dev/null)
+    say "$RESULT" >&2
+    expect -z "$(say "$RESULT" | grep 'Read ahead')"
+
+    RESULT=$(
+        set -o pipefail
+        suxec --warm "${0%/*}/test" | tr '\0' '\n') || RC=$?
+    say "$RESULT" >&2
+
+    if [ ! -r /run/suxec/stats ] ; then
+        expect $RC = 127
+        expect -z "$RESULT"
+        return 0
+    fi
+
+    expect $RC = 0
+}
+
 run()
 {
     local OUTPUT
@@ -179,6 +458,17 @@ run_tests()
     run test_06
     run test_07
     run test_08
+    run test_09
+    run test_10
+    run test_11
+    run test_12
+    run test_13
+    run test_14
+    run test_15
+    run test_16
+    run test_17
+    run test_18
+    run test_19
 }
 
 main()
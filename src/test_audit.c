@@ -0,0 +1,268 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* -------------------------------------------------------------------------- */
+static char sAuditDir[] = "/tmp/test_audit.XXXXXX";
+static char sAuditPath[sizeof(sAuditDir) + sizeof("/audit")];
+
+#define SUXEC_AUDIT_PATH sAuditPath
+
+#include "audit.c.h"
+
+/* -------------------------------------------------------------------------- */
+static struct stat sRegistration = { .st_dev = 0x801, .st_ino = 42 };
+static struct stat sTarget = { .st_dev = 0x802, .st_ino = 43 };
+
+static char sLongPath[2 * AUDIT_RECORD_MAX];
+
+static struct {
+    const char *mSymLink;
+    const char *mPath;
+    unsigned mHops;
+} sAuditPlan[] = {
+    { "reg/alice/run", "/opt/bin/run", 1 },
+    { "", "/", 0 },
+    { "reg/alice/a b\nc", "/opt/bin/a b\nc", 2 },
+    { sLongPath, "/opt/bin/long", 3 },
+    { "reg/alice/long", sLongPath, 4 },
+    { sLongPath, sLongPath, 5 },
+};
+
+/* -------------------------------------------------------------------------- */
+static void
+create_audit(mode_t aMode)
+{
+    int fd = open(sAuditPath, O_WRONLY | O_CREAT | O_TRUNC, aMode);
+    assert(-1 != fd);
+    assert(!fchmod(fd, aMode));
+    assert(!close(fd));
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+record(unsigned aIndex)
+{
+    return record_audit(
+        &sRegistration, &sTarget, 1001, 101, 1000, 100,
+        sAuditPlan[aIndex].mHops,
+        sAuditPlan[aIndex].mSymLink, sAuditPlan[aIndex].mPath);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+check_record(const struct audit_record *aRecord, unsigned aIndex)
+{
+    assert(aRecord);
+    assert(AUDIT_RECORD_MAX >= aRecord->mLength);
+    assert(!(aRecord->mLength % AUDIT_ALIGN));
+    assert(getpid() == aRecord->mPid);
+    assert(aRecord->mTime);
+    assert(1001 == aRecord->mRequestorUid && 101 == aRecord->mRequestorGid);
+    assert(1000 == aRecord->mLicensorUid && 100 == aRecord->mLicensorGid);
+    assert(0x801 == aRecord->mRegistrationDev);
+    assert(42 == aRecord->mRegistrationIno);
+    assert(0x802 == aRecord->mTargetDev && 43 == aRecord->mTargetIno);
+    assert(sAuditPlan[aIndex].mHops == aRecord->mHops);
+
+    /* Long paths are truncated, but always retain a prefix. */
+
+    const char *symLink = aRecord->mPaths;
+    const char *path = audit_record_path(aRecord);
+
+    assert(!strncmp(sAuditPlan[aIndex].mSymLink, symLink, strlen(symLink)));
+    assert(!strncmp(sAuditPlan[aIndex].mPath, path, strlen(path)));
+
+    if (sLongPath != sAuditPlan[aIndex].mSymLink)
+        assert(!strcmp(sAuditPlan[aIndex].mSymLink, symLink));
+    if (sLongPath != sAuditPlan[aIndex].mPath)
+        assert(!strcmp(sAuditPlan[aIndex].mPath, path));
+    else
+        assert(AUDIT_RECORD_MAX / 4 < strlen(path));
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    memset(sLongPath, 'x', sizeof(sLongPath) - 1);
+
+    assert(mkdtemp(sAuditDir));
+    snprintf(sAuditPath, sizeof(sAuditPath), "%s/audit", sAuditDir);
+
+    /* Auditing is disabled unless the log exists, and the original
+     * errno is preserved.
+     */
+
+    errno = EBADF;
+    open_audit();
+    assert(-1 == sAuditFd);
+    assert(EBADF == errno);
+    assert(!record(0));
+
+    /* Refuse a log that other users could have modified. */
+
+    create_audit(0622);
+    open_audit();
+    assert(-1 == sAuditFd);
+
+    /* Append records to a spool, and recover them even when
+     * separated by the fragment of a short write.
+     */
+
+    create_audit(0600);
+    open_audit();
+    assert(-1 != sAuditFd);
+    assert(FD_CLOEXEC & fcntl(sAuditFd, F_GETFD));
+    assert(O_NONBLOCK & fcntl(sAuditFd, F_GETFL));
+
+    unsigned numPlan = sizeof(sAuditPlan)/sizeof(sAuditPlan[0]);
+
+    for (unsigned ix = 0; ix < numPlan; ++ix) {
+        fprintf(stderr, "[%u] spool\n", ix);
+        errno = EBADF;
+        assert(!record(ix));
+        assert(EBADF == errno);
+        if (!ix)
+            assert(24 == write(sAuditFd, "fragment of a short write", 24));
+    }
+
+    static char spool[AUDIT_RECORD_MAX * 8];
+    int fd = open(sAuditPath, O_RDONLY);
+    assert(-1 != fd);
+    ssize_t spoolLen = read(fd, spool, sizeof(spool));
+    assert(0 < spoolLen);
+    assert(!close(fd));
+
+    union audit_buffer audit;
+
+    size_t offset = 0;
+    for (unsigned ix = 0; ix < numPlan; ++ix)
+        check_record(
+            scan_audit_record(spool, spoolLen, &offset, &audit), ix);
+    assert(!scan_audit_record(spool, spoolLen, &offset, &audit));
+
+    /* A truncated record at the end of the spool is ignored. */
+
+    offset = 0;
+    unsigned numRecords = 0;
+    while (scan_audit_record(spool, spoolLen - 8, &offset, &audit))
+        ++numRecords;
+    assert(numPlan - 1 == numRecords);
+
+    /* Follow a spool that has been replaced by the collector, and
+     * leave the spool alone while it remains in place.
+     */
+
+    char collectedPath[sizeof(sAuditPath) + sizeof(".old")];
+    snprintf(collectedPath, sizeof(collectedPath), "%s.old", sAuditPath);
+
+    int auditFd = sAuditFd;
+    follow_audit();
+    assert(auditFd == sAuditFd);
+
+    assert(!rename(sAuditPath, collectedPath));
+    create_audit(0600);
+
+    errno = EBADF;
+    follow_audit();
+    assert(EBADF == errno);
+    assert(-1 != sAuditFd);
+    assert(!record(0));
+
+    struct stat collectedStat;
+    assert(!stat(collectedPath, &collectedStat));
+    assert(spoolLen == collectedStat.st_size);
+
+    fd = open(sAuditPath, O_RDONLY);
+    assert(-1 != fd);
+    spoolLen = read(fd, spool, sizeof(spool));
+    assert(0 < spoolLen);
+    assert(!close(fd));
+
+    offset = 0;
+    check_record(scan_audit_record(spool, spoolLen, &offset, &audit), 0);
+    assert(!scan_audit_record(spool, spoolLen, &offset, &audit));
+
+    /* Stop auditing when the spool is removed. */
+
+    assert(!unlink(sAuditPath));
+    follow_audit();
+    assert(-1 == sAuditFd);
+    assert(!record(0));
+
+    assert(!unlink(collectedPath));
+
+    /* Send records as datagrams, and report drops rather than
+     * waiting when the receiver falls behind.
+     */
+
+    struct sockaddr_un sockAddr = { .sun_family = AF_UNIX };
+    strcpy(sockAddr.sun_path, sAuditPath);
+
+    int sockFd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    assert(-1 != sockFd);
+    assert(!bind(sockFd, (struct sockaddr *) &sockAddr, sizeof(sockAddr)));
+    assert(!chmod(sAuditPath, 0600));
+
+    open_audit();
+    assert(-1 != sAuditFd);
+
+    for (unsigned ix = 0; ix < numPlan; ++ix) {
+        fprintf(stderr, "[%u] socket\n", ix);
+        assert(!record(ix));
+
+        static char datagram[AUDIT_RECORD_MAX];
+        ssize_t datagramLen = recv(sockFd, datagram, sizeof(datagram), 0);
+        assert(0 < datagramLen);
+
+        offset = 0;
+        check_record(
+            scan_audit_record(datagram, datagramLen, &offset, &audit), ix);
+        assert(datagramLen == offset);
+    }
+
+    unsigned numSent = 0;
+    while (!record(0))
+        assert(++numSent < 1000000);
+    assert(-1 == send(sAuditFd, "", 1, 0) && EAGAIN == errno);
+
+    assert(!close(sAuditFd));
+    assert(!close(sockFd));
+
+    unlink(sAuditPath);
+    rmdir(sAuditDir);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
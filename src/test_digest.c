@@ -0,0 +1,229 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test_mapped.h"
+
+#include <signal.h>
+
+#include <sys/wait.h>
+
+#define SUXEC_DIGEST_PATH sMappedPath
+
+#include "digest.c.h"
+
+#define CHILDREN 4
+#define CHILD_STORES 20000
+#define TARGETS 1000
+
+/* -------------------------------------------------------------------------- */
+static struct stat
+target(unsigned aIno, unsigned aCtime)
+{
+    return (struct stat) {
+        .st_dev = 8,
+        .st_ino = aIno,
+        .st_size = aIno * 3,
+        .st_mtim = { .tv_sec = aIno },
+        .st_ctim = { .tv_sec = aCtime, .tv_nsec = aIno },
+    };
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+fill(unsigned char *aDigest, unsigned aIno, unsigned aCtime)
+{
+    for (unsigned dx = 0; dx < SUXEC_DIGEST_SIZE; ++dx)
+        aDigest[dx] = aIno * 31 + aCtime * 7 + dx;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+check(unsigned aIno, unsigned aCtime)
+{
+    struct stat stat = target(aIno, aCtime);
+
+    unsigned char digest[SUXEC_DIGEST_SIZE];
+    unsigned char expected[SUXEC_DIGEST_SIZE];
+
+    if (fetch_digest(0, &stat, digest))
+        return -1;
+
+    fill(expected, aIno, aCtime);
+    assert(!memcmp(digest, expected, sizeof(digest)));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+store(unsigned aIno, unsigned aCtime)
+{
+    struct stat stat = target(aIno, aCtime);
+
+    unsigned char digest[SUXEC_DIGEST_SIZE];
+
+    fill(digest, aIno, aCtime);
+    store_digest(0, &stat, digest);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    create_mapped_dir("digests");
+
+    /* Without a directory for the cache, digests are neither stored
+     * nor found, and the original errno is preserved.
+     */
+
+    errno = EBADF;
+    open_digests();
+    assert(!sDigests);
+    assert(EBADF == errno);
+    store(1, 1);
+    assert(check(1, 1));
+
+    /* Refuse a file that other users could have modified. */
+
+    create_unsafe_mapped("digests");
+    open_digests();
+    assert(!sDigests);
+
+    assert(!unlink(sMappedPath));
+    open_digests();
+    assert(sDigests);
+    assert(DIGEST_MAGIC == sDigests->mHeader.mMagic);
+    assert(DIGEST_VERSION == sDigests->mHeader.mVersion);
+
+    /* A digest is only found for an identical target, and a new
+     * digest for a target replaces the previous one.
+     */
+
+    assert(check(1, 1));
+    store(1, 1);
+    assert(!check(1, 1));
+    assert(check(1, 2));
+    assert(check(2, 1));
+
+    store(1, 2);
+    assert(!check(1, 2));
+    assert(check(1, 1));
+
+    for (unsigned tx = 0; tx < TARGETS; ++tx)
+        store(100 + tx, 5);
+    for (unsigned tx = 0; tx < TARGETS; ++tx)
+        assert(!check(100 + tx, 5));
+
+    /* A writer killed part way through an entry leaves it busy.
+     * Other writers leave the entry alone while the writer exists,
+     * and only take it over once the writer no longer exists. View
+     * the cache as a single entry so that every target uses it.
+     */
+
+    struct mapped_table table = digest_table_();
+    table.mEntriesLen = 1;
+    table.mProbes = 1;
+
+    struct stat stuckStat = target(7, 9);
+    struct digest_key stuckKey = key_digest_(&stuckStat);
+
+    uint64_t stuckDigest[DIGEST_WORDS] = { 7, 9 };
+    uint64_t digest[DIGEST_WORDS];
+
+    int readyPipe[2];
+    assert(!pipe(readyPipe));
+
+    pid_t writer = fork();
+    assert(-1 != writer);
+    if (!writer) {
+        uint64_t *entry = &sDigests->mEntries[0].mSeq;
+        uint32_t seq = __atomic_load_n(entry, __ATOMIC_RELAXED);
+
+        __atomic_store_n(entry,
+            (uint64_t) getpid() << 32 | (uint32_t) (seq | 1),
+            __ATOMIC_RELAXED);
+        __atomic_store_n(&entry[1], 0, __ATOMIC_RELAXED);
+
+        assert(1 == write(readyPipe[1], "", 1));
+        while (1)
+            pause();
+    }
+
+    char ready;
+    assert(1 == read(readyPipe[0], &ready, 1));
+    assert(!close(readyPipe[0]));
+    assert(!close(readyPipe[1]));
+
+    store_mapped_entry(&table, (const uint64_t *) &stuckKey, stuckDigest);
+    assert(fetch_mapped_entry(&table, (const uint64_t *) &stuckKey, digest));
+
+    int writerStatus;
+    assert(!kill(writer, SIGKILL));
+    assert(writer == waitpid(writer, &writerStatus, 0));
+    assert(WIFSIGNALED(writerStatus) && SIGKILL == WTERMSIG(writerStatus));
+
+    store_mapped_entry(&table, (const uint64_t *) &stuckKey, stuckDigest);
+    assert(!fetch_mapped_entry(&table, (const uint64_t *) &stuckKey, digest));
+    assert(!memcmp(digest, stuckDigest, sizeof(digest)));
+    assert(!(sDigests->mEntries[0].mSeq & 1));
+
+    /* Concurrent writers from separate processes must not leave
+     * a torn entry visible to readers.
+     */
+
+    for (unsigned cx = 0; cx < CHILDREN; ++cx) {
+        pid_t pid = fork();
+        assert(-1 != pid);
+        if (!pid) {
+            open_digests();
+            if (!sDigests)
+                _exit(1);
+            for (unsigned sx = 0; sx < CHILD_STORES; ++sx) {
+                store(100 + sx % TARGETS, 6 + (sx + cx) % 3);
+                check(100 + (sx * 7) % TARGETS, 6 + sx % 3);
+            }
+            _exit(0);
+        }
+    }
+
+    for (unsigned rx = 0; rx < CHILD_STORES; ++rx)
+        check(100 + rx % TARGETS, 6 + rx % 3);
+
+    for (unsigned cx = 0; cx < CHILDREN; ++cx) {
+        int status;
+        assert(-1 != wait(&status));
+        assert(WIFEXITED(status) && !WEXITSTATUS(status));
+    }
+
+    remove_mapped_dir();
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
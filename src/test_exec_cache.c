@@ -0,0 +1,259 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/wait.h>
+
+/* -------------------------------------------------------------------------- */
+static char sCacheDir[] = "/tmp/test_exec_cache.XXXXXX";
+static char sCachePath[sizeof(sCacheDir) + sizeof("/cache")];
+
+#define SUXEC_EXEC_CACHE_PATH sCachePath
+
+#include "exec_cache.c.h"
+
+/* -------------------------------------------------------------------------- */
+static char *
+test_path(const char *aName)
+{
+    static char path[sizeof(sCacheDir) + 64];
+
+    snprintf(path, sizeof(path), "%s/%s", sCacheDir, aName);
+
+    return path;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_program(const char *aName, const char *aOriginal)
+{
+    int srcFd = open(aOriginal, O_RDONLY | O_CLOEXEC);
+    assert(-1 != srcFd);
+
+    struct stat srcStat;
+    assert(!fstat(srcFd, &srcStat));
+
+    int fd = open(test_path(aName), O_WRONLY | O_CREAT | O_EXCL, 0755);
+    assert(-1 != fd);
+    assert(!copy_exec_cache_(fd, srcFd, srcStat.st_size));
+    assert(!close(fd));
+    assert(!close(srcFd));
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+fetch(const char *aName, struct stat *aStat)
+{
+    struct stat programStat;
+    assert(!stat(test_path(aName), &programStat));
+
+    if (aStat)
+        *aStat = programStat;
+
+    return fetch_exec_cache(
+        test_path(aName), &programStat, getuid(), getgid());
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+count_entries(void)
+{
+    DIR *dir = opendir(sCachePath);
+    assert(dir);
+
+    unsigned entries = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+        entries += '.' != *entry->d_name;
+
+    assert(!closedir(dir));
+
+    return entries;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    assert(mkdtemp(sCacheDir));
+    snprintf(sCachePath, sizeof(sCachePath), "%s/cache", sCacheDir);
+
+    create_program("true", "/bin/true");
+    create_program("copy", "/bin/true");
+    create_program("other", "/bin/false");
+
+    int fd = open(test_path("script"), O_WRONLY | O_CREAT | O_EXCL, 0755);
+    assert(-1 != fd);
+    assert(10 == write(fd, "#!/bin/sh\n", 10));
+    assert(!close(fd));
+
+    /* Without the directory, nothing is cached, and the original
+     * errno is preserved.
+     */
+
+    errno = EBADF;
+    open_exec_cache();
+    assert(-1 == sExecCacheFd);
+    assert(EBADF == errno);
+    assert(-1 == fetch("true", 0));
+    assert(EBADF == errno);
+
+    /* Refuse a directory that other users could search. */
+
+    assert(!mkdir(sCachePath, 0755));
+    assert(!chmod(sCachePath, 0755));
+    open_exec_cache();
+    assert(-1 == sExecCacheFd);
+
+    assert(!chmod(sCachePath, 0700));
+    open_exec_cache();
+    assert(-1 != sExecCacheFd);
+
+    /* The first launch makes a copy, and later launches reuse it. */
+
+    struct stat programStat;
+
+    int copyFd = fetch("true", &programStat);
+    assert(-1 != copyFd);
+    assert(2 == count_entries());
+
+    struct stat copyStat;
+    assert(!fstat(copyFd, &copyStat));
+    assert(EXEC_CACHE_MODE == (copyStat.st_mode & 07777));
+    assert(programStat.st_size == copyStat.st_size);
+    assert(2 == copyStat.st_nlink);
+
+    int againFd = fetch("true", 0);
+    assert(-1 != againFd);
+    assert(2 == count_entries());
+
+    struct stat againStat;
+    assert(!fstat(againFd, &againStat));
+    assert(copyStat.st_ino == againStat.st_ino);
+    assert(!close(againFd));
+
+    /* Identical programs share a copy, but each different program
+     * has its own copy.
+     */
+
+    int sharedFd = fetch("copy", 0);
+    assert(-1 != sharedFd);
+    assert(3 == count_entries());
+
+    struct stat sharedStat;
+    assert(!fstat(sharedFd, &sharedStat));
+    assert(copyStat.st_ino == sharedStat.st_ino);
+    assert(3 == sharedStat.st_nlink);
+    assert(!close(sharedFd));
+
+    int otherFd = fetch("other", 0);
+    assert(-1 != otherFd);
+    assert(5 == count_entries());
+    assert(!close(otherFd));
+
+    /* Neither scripts nor programs that changed after verification
+     * are copied.
+     */
+
+    assert(-1 == fetch("script", 0));
+
+    programStat.st_ctim.tv_nsec ^= 1;
+    assert(-1 == fetch_exec_cache(
+        test_path("true"), &programStat, getuid(), getgid()));
+    assert(5 == count_entries());
+
+    /* Programs are only copied if the licensor can reach them, even
+     * though the cache is filled by the privileged user.
+     */
+
+    assert(!mkdir(test_path("hidden"), 0755));
+    create_program("hidden/true", "/bin/true");
+
+    struct stat hiddenStat;
+    assert(!stat(test_path("hidden/true"), &hiddenStat));
+    assert(!chmod(test_path("hidden"), 0));
+
+    assert(-1 == fetch_exec_cache(
+        test_path("hidden/true"), &hiddenStat,
+        geteuid() ? getuid() : 65534, geteuid() ? getgid() : 65534));
+    assert(5 == count_entries());
+
+    assert(!chmod(test_path("hidden"), 0755));
+
+    /* The copy can be executed in place of the original. */
+
+    pid_t pid = fork();
+    assert(-1 != pid);
+    if (!pid) {
+        char *args[] = { "true", 0 };
+        char *env[] = { 0 };
+        execveat(copyFd, "", args, env, AT_EMPTY_PATH);
+        _exit(127);
+    }
+
+    int status;
+    assert(pid == waitpid(pid, &status, 0));
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+
+    assert(!close(copyFd));
+
+    /* Remove the cache. */
+
+    DIR *dir = opendir(sCachePath);
+    assert(dir);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if ('.' != *entry->d_name)
+            assert(!unlinkat(dirfd(dir), entry->d_name, 0));
+    }
+
+    assert(!closedir(dir));
+
+    const char *names[] = {
+        "true", "copy", "other", "script", "hidden/true",
+    };
+    for (unsigned nx = 0; nx < sizeof(names) / sizeof(*names); ++nx)
+        assert(!unlink(test_path(names[nx])));
+
+    assert(!rmdir(test_path("hidden")));
+
+    assert(!close(sExecCacheFd));
+    assert(!rmdir(sCachePath));
+    assert(!rmdir(sCacheDir));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,255 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "test_mapped.h"
+
+#include <string.h>
+
+#include <sys/mman.h>
+
+#define SUXEC_INDEX_PATH sMappedPath
+
+#include "index_fetch.c.h"
+#include "index_store.c.h"
+
+/* -------------------------------------------------------------------------- */
+static char *
+reg_path(const char *aName)
+{
+    static char path[sizeof(sMappedDir) + 64];
+
+    snprintf(path, sizeof(path), "%s/%s", sMappedDir, aName);
+
+    return path;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct stat
+registration(const char *aName)
+{
+    struct stat regStat;
+    assert(!lstat(reg_path(aName), &regStat));
+
+    return regStat;
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+entries(const struct stat *aRegistration)
+{
+    /* Count the entries holding a chain for the registration,
+     * whatever the change time of the registration.
+     */
+
+    unsigned numEntries = 0;
+
+    for (unsigned ex = 0; ex < INDEX_ENTRIES; ++ex) {
+        const struct index_entry *entry = &sIndex->mEntries[ex];
+
+        if (aRegistration->st_dev == entry->mKey.mDev &&
+                aRegistration->st_ino == entry->mKey.mIno)
+            ++numEntries;
+    }
+
+    return numEntries;
+}
+
+/* -------------------------------------------------------------------------- */
+static const struct suxec_context sIndexContext = {
+    .mFetchChain = fetch_chain,
+    .mStoreChain = store_chain,
+};
+
+static unsigned
+verify_indexed(const char *aName)
+{
+    /* Return the number of round trips, which shows whether the
+     * chain was confirmed from the index or followed again.
+     */
+
+    struct suxec_license license;
+
+    suxec_create_license(&license, &sIndexContext);
+    assert(!suxec_verify(&license, getuid(), getgid(), reg_path(aName)));
+    assert(!strcmp(reg_path("bin/run"), license.mPath));
+
+    unsigned roundTrips = license.mRoundTrips;
+
+    suxec_close_license(&license);
+
+    return roundTrips;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    unsigned char chain[SUXEC_CHAIN_SIZE] = { 0 };
+
+    create_mapped_dir("index");
+
+    /* Without a directory for the index, chains are neither stored
+     * nor found, and the original errno is preserved.
+     */
+
+    errno = EBADF;
+    open_index();
+    assert(!sIndex);
+    assert(EBADF == errno);
+
+    struct stat missing = { .st_dev = 8, .st_ino = 1 };
+    store_chain(0, &missing, chain);
+    assert(fetch_chain(0, &missing, chain));
+
+    /* Refuse a file that other users could have modified, and
+     * only create the file when writing the index.
+     */
+
+    create_unsafe_mapped("index");
+    open_index();
+    assert(!sIndex);
+
+    assert(!unlink(sMappedPath));
+    open_index();
+    assert(!sIndex);
+
+    struct index *index = map_index_(MAPPED_WRITE | MAPPED_CREATE);
+    assert(index);
+    assert(INDEX_MAGIC == index->mHeader.mMagic);
+    assert(INDEX_VERSION == index->mHeader.mVersion);
+
+    open_index();
+    assert(sIndex && index != sIndex);
+    assert(!munmap(sIndex, sizeof(*sIndex)));
+
+    sIndex = index;
+
+    /* Create a registration directory that satisfies the rules for
+     * the current user, who is both the licensor and the licensee.
+     */
+
+    assert(!mkdir(reg_path("reg"), 0711));
+    assert(!mkdir(reg_path("reg/licensee"), 0755));
+    assert(!mkdir(reg_path("bin"), 0755));
+
+    int fd = open(reg_path("bin/run"), O_WRONLY | O_CREAT | O_EXCL, 0755);
+    assert(-1 != fd);
+    assert(!close(fd));
+
+    assert(!symlink("../../bin/run", reg_path("reg/licensee/run")));
+    assert(!symlink("../licensee/run", reg_path("reg/licensee/hop")));
+
+    /* A verified chain is published, and is then confirmed rather
+     * than followed.
+     */
+
+    struct stat run = registration("reg/licensee/run");
+
+    assert(fetch_chain(0, &run, chain));
+    assert(7 == verify_indexed("reg/licensee/run"));
+    assert(!fetch_chain(0, &run, chain));
+    assert(1 == entries(&run));
+
+    assert(4 == verify_indexed("reg/licensee/run"));
+
+    /* A change to an object in the chain leaves the registration,
+     * and so the key, unchanged. The stale chain is still found,
+     * but is refused by the pin of the changed object, so the chain
+     * is followed again, and replaces the stale chain.
+     */
+
+    assert(!chmod(reg_path("bin/run"), 0750));
+    assert(!fetch_chain(0, &run, chain));
+    assert(10 == verify_indexed("reg/licensee/run"));
+    assert(1 == entries(&run));
+    assert(4 == verify_indexed("reg/licensee/run"));
+
+    assert(!chmod(reg_path("bin/run"), 0755));
+    assert(10 == verify_indexed("reg/licensee/run"));
+    assert(4 == verify_indexed("reg/licensee/run"));
+
+    /* A change to the registration itself is a different key, and
+     * the new chain replaces the entry of the previous one.
+     */
+
+    struct stat changed;
+    do {
+        assert(!lchown(reg_path("reg/licensee/run"), -1, getgid()));
+        changed = registration("reg/licensee/run");
+    } while (!memcmp(&changed.st_ctim, &run.st_ctim, sizeof(run.st_ctim)));
+
+    assert(fetch_chain(0, &changed, chain));
+    assert(7 == verify_indexed("reg/licensee/run"));
+    assert(fetch_chain(0, &run, chain));
+    assert(!fetch_chain(0, &changed, chain));
+    assert(1 == entries(&changed));
+
+    /* Each registration holds its own chain, even when it leads
+     * to the same target.
+     */
+
+    struct stat hop = registration("reg/licensee/hop");
+
+    verify_indexed("reg/licensee/hop");
+    assert(!fetch_chain(0, &hop, chain));
+    assert(!fetch_chain(0, &changed, chain));
+    assert(1 == entries(&hop) && 1 == entries(&changed));
+
+    /* Erasing a registration removes its chain whatever the change
+     * time, so that the chain is followed again, and leaves the
+     * chains of other registrations.
+     */
+
+    erase_chain(&run);
+    assert(fetch_chain(0, &changed, chain));
+    assert(!entries(&changed));
+    assert(!fetch_chain(0, &hop, chain));
+
+    assert(7 == verify_indexed("reg/licensee/run"));
+    assert(4 == verify_indexed("reg/licensee/run"));
+
+    /* Remove the registration directory. */
+
+    const char *names[] = {
+        "reg/licensee/hop", "reg/licensee/run", "bin/run",
+    };
+
+    for (unsigned nx = 0; nx < sizeof(names) / sizeof(*names); ++nx)
+        assert(!unlink(reg_path(names[nx])));
+
+    assert(!rmdir(reg_path("reg/licensee")));
+    assert(!rmdir(reg_path("reg")));
+    assert(!rmdir(reg_path("bin")));
+
+    remove_mapped_dir();
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,647 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+
+#include "libsuxec.h"
+
+/* -------------------------------------------------------------------------- */
+static char sRegDir[] = "/tmp/test_libsuxec.XXXXXX";
+
+#define VERIFIERS 4
+
+/* -------------------------------------------------------------------------- */
+static char *
+reg_path(const char *aName)
+{
+    static __thread char path[sizeof(sRegDir) + 64];
+
+    snprintf(path, sizeof(path), "%s/%s", sRegDir, aName);
+
+    return path;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_file(const char *aName, mode_t aMode, const char *aContent)
+{
+    int fd = open(reg_path(aName), O_WRONLY | O_CREAT | O_EXCL, aMode);
+    assert(-1 != fd);
+    assert(strlen(aContent) == write(fd, aContent, strlen(aContent)));
+    assert(!fchmod(fd, aMode));
+    assert(!close(fd));
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_link(const char *aTarget, const char *aName)
+{
+    assert(!symlink(aTarget, reg_path(aName)));
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned sEvents[SUXEC_EVENT_ENVIRONMENT + 1];
+
+static void
+count_event(void *aArg, enum suxec_event aEvent, const struct stat *aStat)
+{
+    __atomic_fetch_add(&sEvents[aEvent], 1, __ATOMIC_RELAXED);
+}
+
+static const struct suxec_context sContext = { .mEvent = count_event };
+
+/* -------------------------------------------------------------------------- */
+static unsigned sBatchRoundTrips;
+
+static void
+count_batch_round_trips(void *aArg, const char *aFmt, va_list aArgp)
+{
+    if (!strcmp(aFmt, "Attribute round trips %u"))
+        sBatchRoundTrips = va_arg(aArgp, unsigned);
+}
+
+static const struct suxec_context sLazyBatchContext = {
+    .mDebug = count_batch_round_trips,
+    .mFlags = SUXEC_DONT_SYNC,
+};
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+verify_as(uid_t aUid, const char *aPath)
+{
+    struct suxec_license license;
+
+    suxec_create_license(&license, &sContext);
+
+    int rc = suxec_verify(&license, aUid, getgid(), aPath);
+
+    enum failure failure = license.mFailure;
+
+    assert(rc ? FAILURE_NONE != failure : FAILURE_NONE == failure);
+    assert(rc || license.mPath);
+
+    suxec_close_license(&license);
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    unsigned mFetches;
+    unsigned mStores;
+    int mValid;
+    struct stat mStat;
+    unsigned char mDigest[SUXEC_DIGEST_SIZE];
+} sDigestCache;
+
+static int
+fetch_digest(void *aArg, const struct stat *aStat, unsigned char *aDigest)
+{
+    ++sDigestCache.mFetches;
+
+    if (!sDigestCache.mValid ||
+            aStat->st_ino != sDigestCache.mStat.st_ino ||
+            aStat->st_ctim.tv_sec != sDigestCache.mStat.st_ctim.tv_sec ||
+            aStat->st_ctim.tv_nsec != sDigestCache.mStat.st_ctim.tv_nsec)
+        return -1;
+
+    memcpy(aDigest, sDigestCache.mDigest, SUXEC_DIGEST_SIZE);
+    return 0;
+}
+
+static void
+store_digest(void *aArg, const struct stat *aStat, const unsigned char *aDigest)
+{
+    ++sDigestCache.mStores;
+
+    sDigestCache.mValid = 1;
+    sDigestCache.mStat = *aStat;
+    memcpy(sDigestCache.mDigest, aDigest, SUXEC_DIGEST_SIZE);
+}
+
+static const struct suxec_context sDigestContext = {
+    .mFetchDigest = fetch_digest,
+    .mStoreDigest = store_digest,
+};
+
+/* -------------------------------------------------------------------------- */
+static int
+pin_digest(const char *aName, const char *aValue)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "user.suxec.digest.%s", aName);
+
+    if (!aValue)
+        return removexattr(reg_path("reg/licensee"), name);
+
+    return setxattr(
+        reg_path("reg/licensee"), name, aValue, strlen(aValue), 0);
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+verify_digest(const char *aName)
+{
+    struct suxec_license license;
+
+    suxec_create_license(&license, &sDigestContext);
+    suxec_verify(&license, getuid(), getgid(), reg_path(aName));
+
+    enum failure failure = license.mFailure;
+
+    suxec_close_license(&license);
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    unsigned mFetches;
+    unsigned mStores;
+    int mValid;
+    struct stat mStat;
+    unsigned char mChain[SUXEC_CHAIN_SIZE];
+} sChainIndex;
+
+static int
+fetch_chain(void *aArg, const struct stat *aRegistration, void *aChain)
+{
+    ++sChainIndex.mFetches;
+
+    if (!sChainIndex.mValid ||
+            aRegistration->st_ino != sChainIndex.mStat.st_ino ||
+            aRegistration->st_ctim.tv_sec != sChainIndex.mStat.st_ctim.tv_sec ||
+            aRegistration->st_ctim.tv_nsec != sChainIndex.mStat.st_ctim.tv_nsec)
+        return -1;
+
+    memcpy(aChain, sChainIndex.mChain, SUXEC_CHAIN_SIZE);
+    return 0;
+}
+
+static void
+store_chain(void *aArg, const struct stat *aRegistration, const void *aChain)
+{
+    ++sChainIndex.mStores;
+
+    sChainIndex.mValid = 1;
+    sChainIndex.mStat = *aRegistration;
+    memcpy(sChainIndex.mChain, aChain, SUXEC_CHAIN_SIZE);
+}
+
+static const struct suxec_context sChainContext = {
+    .mFetchChain = fetch_chain,
+    .mStoreChain = store_chain,
+};
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+verify_indexed(const char *aName, unsigned *aRoundTrips)
+{
+    struct suxec_license license;
+
+    suxec_create_license(&license, &sChainContext);
+    suxec_verify(&license, getuid(), getgid(), reg_path(aName));
+
+    enum failure failure = license.mFailure;
+
+    assert(failure || !strcmp(reg_path("bin/run"), license.mPath));
+    assert(failure || 1 == license.mHops);
+
+    if (aRoundTrips)
+        *aRoundTrips = license.mRoundTrips;
+
+    suxec_close_license(&license);
+
+    return failure;
+}
+
+/* -------------------------------------------------------------------------- */
+static enum failure
+verify(const char *aName)
+{
+    return verify_as(getuid(), reg_path(aName));
+}
+
+/* -------------------------------------------------------------------------- */
+static void *
+verify_concurrently(void *aArg)
+{
+    for (unsigned ix = 0; ix < 100; ++ix) {
+        assert(FAILURE_NONE == verify("reg/licensee/run"));
+        assert(FAILURE_TARGET_MODE == verify("reg/licensee/data"));
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+check_review(
+    void *aArg,
+    const char *aLicensee, const char *aName, enum failure aVerdict)
+{
+    unsigned *reviewed = aArg;
+
+    assert(!strcmp("licensee", aLicensee) || !strcmp(".hidden", aLicensee));
+
+    if (!strcmp(".hidden", aLicensee))
+        assert(FAILURE_HIDDEN_DIRECTORY == aVerdict);
+    else if (!strcmp("run", aName))
+        assert(FAILURE_NONE == aVerdict);
+    else if (!strcmp("data", aName))
+        assert(FAILURE_TARGET_MODE == aVerdict);
+    else if (!strcmp("missing", aName))
+        assert(FAILURE_FOLLOW == aVerdict);
+    else
+        assert(!"Unexpected registration");
+
+    ++*reviewed;
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    assert(mkdtemp(sRegDir));
+
+    /* Create a registration directory that satisfies the rules for
+     * the current user, who is both the licensor and the licensee.
+     */
+
+    assert(!mkdir(reg_path("reg"), 0711));
+    assert(!mkdir(reg_path("reg/licensee"), 0755));
+    assert(!mkdir(reg_path("reg/.hidden"), 0755));
+    assert(!mkdir(reg_path("bin"), 0755));
+
+    create_file("bin/run", 0755, "#!/bin/sh\nexit 7\n");
+    create_file("bin/data", 0644, "");
+
+    create_link("../../bin/run", "reg/licensee/run");
+    create_link("../../bin/data", "reg/licensee/data");
+    create_link("../../bin/missing", "reg/licensee/missing");
+    create_link("../../bin/run", "reg/.hidden/run");
+
+    /* Each refusal is returned with its reason, and the caller
+     * is informed of each phase of the verification.
+     */
+
+    struct suxec_license license;
+
+    suxec_create_license(&license, &sContext);
+    assert(FAILURE_NONE == license.mFailure);
+    assert(!license.mPath);
+
+    assert(!suxec_verify(
+        &license, getuid(), getgid(), reg_path("reg/licensee/run")));
+    assert(FAILURE_NONE == license.mFailure);
+    assert(getuid() == license.mRequestor.mUid);
+    assert(getuid() == license.mLicensor.mUid);
+    assert(license.mLicensor.mName);
+    assert(1 == license.mHops);
+    assert(6 == license.mRoundTrips);
+    assert(!strcmp(reg_path("bin/run"), license.mPath));
+    assert(S_ISREG(license.mPathStat.st_mode));
+    assert(S_ISLNK(license.mRegistrationStat.st_mode));
+    assert(1 == sEvents[SUXEC_EVENT_HOP]);
+    assert(1 == sEvents[SUXEC_EVENT_RESOLVE]);
+
+    assert(-1 == suxec_verify(
+        &license, getuid(), getgid(), reg_path("reg/licensee/run")));
+    assert(EINVAL == errno);
+
+    suxec_close_license(&license);
+
+    /* Cached attributes are used while following the registration,
+     * and only the objects that the rules depend upon are fetched
+     * from the file server.
+     */
+
+    static const struct suxec_context lazyContext = {
+        .mFlags = SUXEC_DONT_SYNC,
+    };
+
+    suxec_create_license(&license, &lazyContext);
+    assert(!suxec_verify(
+        &license, getuid(), getgid(), reg_path("reg/licensee/run")));
+    assert(4 == license.mRoundTrips);
+    suxec_close_license(&license);
+
+    assert(FAILURE_TARGET_MODE == verify("reg/licensee/data"));
+    assert(FAILURE_FOLLOW == verify("reg/licensee/missing"));
+    assert(FAILURE_SYMLINK == verify("reg/licensee/absent"));
+    assert(FAILURE_HIDDEN_DIRECTORY == verify("reg/.hidden/run"));
+
+    assert(!chmod(reg_path("reg"), 0715));
+    assert(FAILURE_PARENT_OTHER_MODE == verify("reg/licensee/run"));
+    assert(!chmod(reg_path("reg"), 0711));
+
+    /* Licenses are independent, so can be verified on many threads
+     * at the same time.
+     */
+
+    pthread_t verifiers[VERIFIERS];
+
+    for (unsigned tx = 0; tx < VERIFIERS; ++tx)
+        assert(!pthread_create(&verifiers[tx], 0, verify_concurrently, 0));
+
+    for (unsigned tx = 0; tx < VERIFIERS; ++tx)
+        assert(!pthread_join(verifiers[tx], 0));
+
+    /* Settings override the defaults, and replace earlier settings
+     * of the same name.
+     */
+
+    suxec_create_license(&license, &sContext);
+
+    char *env[] = { "PATH=/opt/bin", "TERM=dumb", "TERM=vt100", "=x" };
+
+    assert(-1 == suxec_environment(&license, env, 2));
+
+    assert(!suxec_verify(
+        &license, getuid(), getgid(), reg_path("reg/licensee/run")));
+
+    assert(!suxec_environment(&license, env, 3));
+
+    unsigned envLen = 0;
+    for (char **envp = license.mEnv; *envp; ++envp) {
+        assert(strcmp("PATH=/usr/bin:/bin", *envp));
+        assert(strcmp("TERM=dumb", *envp));
+        ++envLen;
+    }
+    assert(5 == envLen);
+    assert(!strcmp("PATH=/opt/bin", license.mEnv[0]));
+    assert(!strcmp("TERM=vt100", license.mEnv[1]));
+    assert(!strcmp("SHELL=/bin/sh", license.mEnv[4]));
+
+    /* The program runs in a child process so that the credentials
+     * of the caller are not changed.
+     */
+
+    pid_t pid = suxec_spawn(&license);
+    assert(-1 != pid);
+
+    int status;
+    assert(pid == waitpid(pid, &status, 0));
+    assert(WIFEXITED(status) && 7 == WEXITSTATUS(status));
+
+    suxec_close_license(&license);
+
+    suxec_create_license(&license, &sContext);
+
+    assert(-1 == suxec_environment(&license, env, 4));
+    assert(!suxec_verify(
+        &license, getuid(), getgid(), reg_path("reg/licensee/run")));
+    assert(-1 == suxec_environment(&license, env, 4));
+    assert(FAILURE_ENVIRONMENT == license.mFailure);
+
+    suxec_close_license(&license);
+
+    /* A verified license can be revalidated until any part of the
+     * chain changes, but adding a registration changes nothing.
+     */
+
+    suxec_create_license(&license, &sContext);
+
+    assert(-1 == suxec_revalidate(&license));
+    assert(!suxec_verify(
+        &license, getuid(), getgid(), reg_path("reg/licensee/run")));
+    assert(!suxec_revalidate(&license));
+
+    create_link("../../bin/run", "reg/licensee/added");
+    assert(!suxec_revalidate(&license));
+    assert(!unlink(reg_path("reg/licensee/added")));
+
+    assert(!chmod(reg_path("bin/run"), 0750));
+    assert(-1 == suxec_revalidate(&license));
+    assert(FAILURE_CHANGED == license.mFailure);
+    assert(-1 == suxec_impersonate(&license));
+    assert(!chmod(reg_path("bin/run"), 0755));
+
+    suxec_close_license(&license);
+
+    /* A verified chain is offered to the index, and is confirmed
+     * using the attributes of each object in the chain rather than
+     * being followed again.
+     */
+
+    unsigned roundTrips;
+
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", &roundTrips));
+    assert(1 == sChainIndex.mFetches && 1 == sChainIndex.mStores);
+    assert(7 == roundTrips);
+
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", &roundTrips));
+    assert(2 == sChainIndex.mFetches && 1 == sChainIndex.mStores);
+    assert(4 == roundTrips);
+
+    /* A changed chain is followed again, after confirming the
+     * objects up to the one that changed, and the index is refreshed.
+     */
+
+    assert(!chmod(reg_path("bin/run"), 0750));
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", &roundTrips));
+    assert(2 == sChainIndex.mStores && 10 == roundTrips);
+    assert(!chmod(reg_path("bin/run"), 0755));
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", &roundTrips));
+    assert(3 == sChainIndex.mStores && 10 == roundTrips);
+
+    /* Only a well formed chain is used. */
+
+    sChainIndex.mChain[0] ^= 1;
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", &roundTrips));
+    assert(4 == sChainIndex.mStores && 7 == roundTrips);
+
+    /* The rules are still applied to changed registrations. */
+
+    assert(!chmod(reg_path("bin/run"), 0644));
+    assert(FAILURE_TARGET_MODE == verify_indexed("reg/licensee/run", 0));
+    assert(!chmod(reg_path("bin/run"), 0755));
+
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", 0));
+    assert(FAILURE_NONE == verify_indexed("reg/licensee/run", &roundTrips));
+    assert(4 == roundTrips);
+
+    /* Review every registration without executing any of them. */
+
+    unsigned reviewed = 0;
+    assert(!suxec_review(&sContext, reg_path("reg"), check_review, &reviewed));
+    assert(4 == reviewed);
+
+    assert(-1 == suxec_review(
+        &sContext, reg_path("absent"), check_review, &reviewed));
+
+    /* A batch reaches the same verdicts as verifying each registration
+     * in turn, whatever the order of the registrations.
+     */
+
+    const char *batchNames[] = {
+        "reg/licensee/run", "reg/.hidden/run", "reg/licensee/data",
+        "reg/licensee/absent", "reg/licensee/missing", "reg/licensee/run",
+        "bin/run", "reg/licensee/data", 0, "reg/licensee/run",
+    };
+
+    size_t batchLen = sizeof(batchNames) / sizeof(*batchNames);
+
+    char *batchSymlinks[batchLen];
+    uid_t batchUids[batchLen];
+    enum failure batchVerdicts[batchLen];
+
+    for (size_t bx = 0; bx < batchLen; ++bx) {
+        batchSymlinks[bx] = strdup(
+            batchNames[bx] ? reg_path(batchNames[bx]) : "");
+        assert(batchSymlinks[bx]);
+        batchUids[bx] = bx == batchLen - 1 ? (uid_t) -2 : getuid();
+    }
+
+    assert(!suxec_verify_batch(
+        &sContext, batchLen, batchUids,
+        (const char * const *) batchSymlinks, batchVerdicts));
+
+    /* Cached attributes are also used by a batch, and confirmed with
+     * the file server once the rules are satisfied.
+     */
+
+    enum failure lazyVerdicts[batchLen];
+
+    assert(!suxec_verify_batch(
+        &sLazyBatchContext, batchLen, batchUids,
+        (const char * const *) batchSymlinks, lazyVerdicts));
+
+    for (size_t bx = 0; bx < batchLen; ++bx) {
+        assert(batchVerdicts[bx] ==
+            verify_as(batchUids[bx], batchSymlinks[bx]));
+        assert(batchVerdicts[bx] == lazyVerdicts[bx]);
+        free(batchSymlinks[bx]);
+    }
+
+    const char *lazySymlink = reg_path("reg/licensee/run");
+    uid_t lazyUid = getuid();
+
+    assert(!suxec_verify_batch(
+        &sLazyBatchContext, 1, &lazyUid, &lazySymlink, lazyVerdicts));
+    assert(FAILURE_NONE == lazyVerdicts[0]);
+    assert(4 == sBatchRoundTrips);
+
+    assert(FAILURE_NONE == batchVerdicts[0]);
+    assert(FAILURE_HIDDEN_DIRECTORY == batchVerdicts[1]);
+    assert(FAILURE_SYMLINK == batchVerdicts[3]);
+    assert(FAILURE_SYMLINK == batchVerdicts[8]);
+    assert(FAILURE_REQUESTOR == batchVerdicts[9]);
+
+    assert(!suxec_verify_batch(&sContext, 0, 0, 0, 0));
+
+    /* A licensor can pin the digest of a target. The digest is
+     * only computed when it is not already known to the caller.
+     */
+
+    if (pin_digest("run", "sha256:"
+            "4d8fe24768718d56bd8c282eb86ad8c8"
+            "411b2d3d4f8cc99d84fc37f55f7d3780")) {
+        assert(ENOTSUP == errno);
+        fprintf(stderr, "Skipping digest pins\n");
+    } else {
+        assert(FAILURE_NONE == verify_digest("reg/licensee/run"));
+        assert(1 == sDigestCache.mFetches && 1 == sDigestCache.mStores);
+
+        assert(FAILURE_NONE == verify_digest("reg/licensee/run"));
+        assert(2 == sDigestCache.mFetches && 1 == sDigestCache.mStores);
+
+        enum failure digestVerdict;
+        const char *digestSymlink = reg_path("reg/licensee/run");
+        uid_t digestUid = getuid();
+
+        assert(!suxec_verify_batch(
+            &sDigestContext, 1, &digestUid, &digestSymlink, &digestVerdict));
+        assert(FAILURE_NONE == digestVerdict);
+        assert(1 == sDigestCache.mStores);
+
+        assert(!pin_digest("run", "sha256:"
+            "4d8fe24768718d56bd8c282eb86ad8c8"
+            "411b2d3d4f8cc99d84fc37f55f7d3781"));
+        assert(FAILURE_DIGEST == verify_digest("reg/licensee/run"));
+        assert(FAILURE_DIGEST == verify_indexed("reg/licensee/run", 0));
+        assert(!suxec_verify_batch(
+            &sDigestContext, 1, &digestUid, &digestSymlink, &digestVerdict));
+        assert(FAILURE_DIGEST == digestVerdict);
+
+        /* Without the cache, the target is measured again. */
+
+        sDigestCache.mValid = 0;
+        assert(FAILURE_DIGEST == verify("reg/licensee/run"));
+
+        assert(!pin_digest("run", "sha256:4d8fe247"));
+        assert(FAILURE_DIGEST == verify("reg/licensee/run"));
+        assert(!pin_digest("run", "md5:"
+            "4d8fe24768718d56bd8c282eb86ad8c8"
+            "411b2d3d4f8cc99d84fc37f55f7d3780"));
+        assert(FAILURE_DIGEST == verify("reg/licensee/run"));
+
+        /* Pins only apply to the registration that they name. */
+
+        assert(!pin_digest("data", "sha256:"
+            "4d8fe24768718d56bd8c282eb86ad8c8"
+            "411b2d3d4f8cc99d84fc37f55f7d3780"));
+        assert(FAILURE_TARGET_MODE == verify("reg/licensee/data"));
+        assert(!pin_digest("data", 0));
+
+        assert(!pin_digest("run", 0));
+        assert(FAILURE_NONE == verify("reg/licensee/run"));
+    }
+
+    /* Remove the registration directory. */
+
+    const char *names[] = {
+        "reg/.hidden/run", "reg/licensee/missing", "reg/licensee/data",
+        "reg/licensee/run", "bin/data", "bin/run",
+    };
+
+    for (unsigned nx = 0; nx < sizeof(names) / sizeof(*names); ++nx)
+        assert(!unlink(reg_path(names[nx])));
+
+    assert(!rmdir(reg_path("reg/.hidden")));
+    assert(!rmdir(reg_path("reg/licensee")));
+    assert(!rmdir(reg_path("reg")));
+    assert(!rmdir(reg_path("bin")));
+    assert(!rmdir(sRegDir));
+
+    return 0;
+}
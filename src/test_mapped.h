@@ -0,0 +1,85 @@
+#ifndef SUXEC_TEST_MAPPED_H
+#define SUXEC_TEST_MAPPED_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/* -------------------------------------------------------------------------- */
+/* Shared mapped table test helpers
+ *
+ * Each table is first named in a directory that does not exist, so
+ * that the test can check that the table is silently disabled, and
+ * then in a private temporary directory. The test should include
+ * this file first, and name sMappedPath as the path of the table.
+ */
+
+static char sMappedDir[] = "/tmp/test_mapped.XXXXXX";
+static char sMappedPath[sizeof(sMappedDir) + 64];
+
+static inline void
+create_mapped_dir(const char *aName)
+{
+    assert(mkdtemp(sMappedDir));
+    snprintf(sMappedPath, sizeof(sMappedPath), "%s/none/%s", sMappedDir, aName);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+create_unsafe_mapped(const char *aName)
+{
+    /* Create a file in the private directory that other users could
+     * have modified, and leave it to be removed once it is refused.
+     */
+
+    snprintf(sMappedPath, sizeof(sMappedPath), "%s/%s", sMappedDir, aName);
+
+    int fd = open(sMappedPath, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    assert(-1 != fd);
+    assert(!fchmod(fd, 0666));
+    assert(!close(fd));
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void
+remove_mapped_dir(void)
+{
+    unlink(sMappedPath);
+    assert(!rmdir(sMappedDir));
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_TEST_MAPPED_H */
@@ -0,0 +1,173 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+
+/* -------------------------------------------------------------------------- */
+static char sPasswdPath[] = "/tmp/test_nss_files_passwd.XXXXXX";
+static char sGroupPath[] = "/tmp/test_nss_files_group.XXXXXX";
+
+#define NSS_FILES_PASSWD sPasswdPath
+#define NSS_FILES_GROUP sGroupPath
+
+#include "nss_files.c.h"
+
+/* -------------------------------------------------------------------------- */
+static const char sPasswd[] =
+    "# comment\n"
+    "+nis::::::\n"
+    "root:x:0:0:root:/root:/bin/bash\n"
+    "broken:x:1:1\n"
+    "alice:x:1000:1000:Alice:/home/alice:/bin/sh\n"
+    "bob:x:1001:100::/home/bob:\n"
+    "carmen:x:1002:1002:Carmen:/home/carmen:/bin/sh";
+
+static const char sGroup[] =
+    "root:x:0:\n"
+    "users:x:100:alice,carmen\n"
+    "alice:x:1000:\n"
+    "wheel:x:10:bob,alice\n"
+    "audio:x:29:alicex,xalice\n"
+    "video:x:44:carmen,alice";
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    uid_t mUid;
+    const char *mName;
+    gid_t mGid;
+    const char *mDir;
+    const char *mShell;
+} sPasswdPlan[] = {
+    { 0,    "root",   0,    "/root",        "/bin/bash" },
+    { 1,    0 },
+    { 1000, "alice",  1000, "/home/alice",  "/bin/sh" },
+    { 1001, "bob",    100,  "/home/bob",    "" },
+    { 1002, "carmen", 1002, "/home/carmen", "/bin/sh" },
+    { 1003, 0 },
+};
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    const char *mName;
+    gid_t mGid;
+    int mLen;
+    gid_t mList[4];
+} sGroupPlan[] = {
+    { "root",   0,    1, { 0 } },
+    { "alice",  1000, 4, { 1000, 100, 10, 44 } },
+    { "alice",  100,  3, { 100, 10, 44 } },
+    { "bob",    100,  2, { 100, 10 } },
+    { "nobody", 65534, 1, { 65534 } },
+};
+
+/* -------------------------------------------------------------------------- */
+static void
+write_file(char *aPath, const char *aContent)
+{
+    int fd = mkstemp(aPath);
+    assert(-1 != fd);
+    assert(strlen(aContent) == write(fd, aContent, strlen(aContent)));
+    assert(!close(fd));
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    write_file(sPasswdPath, sPasswd);
+    write_file(sGroupPath, sGroup);
+
+    char *passwdBuf = 0;
+
+    for (unsigned ix = 0;
+            ix < sizeof(sPasswdPlan)/sizeof(sPasswdPlan[0]); ++ix) {
+
+        fprintf(stderr,
+            "[%u] %d (%s)\n",
+            ix, sPasswdPlan[ix].mUid, sPasswdPlan[ix].mName);
+
+        struct passwd passwd;
+        struct passwd *pw = nss_files_getpwuid_r(
+            sPasswdPlan[ix].mUid, &passwd, &passwdBuf);
+
+        if (!sPasswdPlan[ix].mName) {
+            assert(!pw);
+        } else {
+            assert(&passwd == pw);
+            assert(sPasswdPlan[ix].mUid == pw->pw_uid);
+            assert(sPasswdPlan[ix].mGid == pw->pw_gid);
+            assert(!strcmp(sPasswdPlan[ix].mName, pw->pw_name));
+            assert(!strcmp(sPasswdPlan[ix].mDir, pw->pw_dir));
+            assert(!strcmp(sPasswdPlan[ix].mShell, pw->pw_shell));
+        }
+    }
+
+    for (unsigned ix = 0;
+            ix < sizeof(sGroupPlan)/sizeof(sGroupPlan[0]); ++ix) {
+
+        fprintf(stderr,
+            "[%u] %s %d\n",
+            ix, sGroupPlan[ix].mName, sGroupPlan[ix].mGid);
+
+        /* Start with a buffer that is too small to verify that
+         * the required size is reported.
+         */
+
+        gid_t groupList[4];
+        int groupLen = 1;
+
+        int rc = nss_files_getgrouplist(
+            sGroupPlan[ix].mName, sGroupPlan[ix].mGid, groupList, &groupLen);
+
+        assert(sGroupPlan[ix].mLen == groupLen);
+
+        if (1 < sGroupPlan[ix].mLen) {
+            assert(-1 == rc);
+
+            rc = nss_files_getgrouplist(
+                sGroupPlan[ix].mName, sGroupPlan[ix].mGid,
+                groupList, &groupLen);
+        }
+
+        assert(sGroupPlan[ix].mLen == rc);
+        assert(sGroupPlan[ix].mLen == groupLen);
+        assert(!memcmp(
+            sGroupPlan[ix].mList, groupList, groupLen * sizeof(*groupList)));
+    }
+
+    free(passwdBuf);
+
+    unlink(sPasswdPath);
+    unlink(sGroupPath);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -49,9 +49,9 @@ static struct {
 int
 main(int argc, char **argv)
 {
-    for (unsigned ix = 0; ix < sizeof(sTestPlan)/sizeof(sTestPlan[0]); ++ix) {
+    struct pathbuf path_, *path = create_pathbuf(&path_);
 
-        char *path = 0;
+    for (unsigned ix = 0; ix < sizeof(sTestPlan)/sizeof(sTestPlan[0]); ++ix) {
 
         fprintf(stderr,
             "[%u] %d (%s)> <= (%s) + (%s)\n",
@@ -59,15 +59,26 @@ main(int argc, char **argv)
             sTestPlan[ix].mResult, sTestPlan[ix].mPath,
             sTestPlan[ix].mLhs, sTestPlan[ix].mRhs);
 
-        int rc = splice_path(&path, sTestPlan[ix].mLhs, sTestPlan[ix].mRhs);
+        int rc = splice_path(
+            path,
+            pathview_cstr(sTestPlan[ix].mLhs),
+            pathview_cstr(sTestPlan[ix].mRhs));
         if (rc) {
             assert(sTestPlan[ix].mResult);
         } else {
-            assert(!strcmp(sTestPlan[ix].mPath, path));
+            assert(!strcmp(sTestPlan[ix].mPath, path->mBuf));
+            assert(strlen(path->mBuf) == path->mLen);
         }
-
-        free(path);
     }
+
+    /* The buffer is reused for each splice, so only the first
+     * splice should allocate.
+     */
+
+    assert(1 == sPathBufAllocs);
+
+    path = close_pathbuf(path);
+
     return 0;
 }
 
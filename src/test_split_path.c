@@ -93,21 +93,21 @@ main(int argc, char **argv)
             sTestPlan[ix].mResult, sTestPlan[ix].mPath,
             sTestPlan[ix].mLhs, sTestPlan[ix].mRhs);
 
-        char *lhs = 0;
-        char *rhs = 0;
+        struct pathview lhs;
+        struct pathview rhs;
 
-        int rc = split_path(sTestPlan[ix].mPath, &lhs, &rhs);
+        int rc = split_path(pathview_cstr(sTestPlan[ix].mPath), &lhs, &rhs);
         if (rc) {
             assert(sTestPlan[ix].mResult);
         } else {
-            fprintf(stderr, "(%s) (%s)\n", lhs, rhs);
+            fprintf(stderr, "(%.*s) (%.*s)\n",
+                (int) lhs.mLen, lhs.mPtr, (int) rhs.mLen, rhs.mPtr);
 
-            assert(!strcmp(sTestPlan[ix].mLhs, lhs));
-            assert(!strcmp(sTestPlan[ix].mRhs, rhs));
+            assert(strlen(sTestPlan[ix].mLhs) == lhs.mLen);
+            assert(strlen(sTestPlan[ix].mRhs) == rhs.mLen);
+            assert(!memcmp(sTestPlan[ix].mLhs, lhs.mPtr, lhs.mLen));
+            assert(!memcmp(sTestPlan[ix].mRhs, rhs.mPtr, rhs.mLen));
         }
-
-        free(lhs);
-        free(rhs);
     }
     return 0;
 }
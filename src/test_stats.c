@@ -0,0 +1,225 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/wait.h>
+
+/* -------------------------------------------------------------------------- */
+static char sStatsDir[] = "/tmp/test_stats.XXXXXX";
+static char sStatsPath[sizeof(sStatsDir) + sizeof("/none/stats")];
+
+#define SUXEC_STATS_PATH sStatsPath
+
+#include "stats.c.h"
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    dev_t mDev;
+    ino_t mIno;
+    uid_t mLicensor;
+    uid_t mLicensee;
+    uint64_t mLatency;
+} sLaunchPlan[] = {
+    { 1, 100, 1000, 2000, 1500 },
+    { 1, 100, 1000, 2000, 3000 },
+    { 1, 101, 1000, 2001, 1 << 20 },
+    { 2, 100, 1001, 2000, 0 },
+};
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    enum failure mFailure;
+    unsigned mCount;
+} sFailurePlan[] = {
+    { FAILURE_USAGE,         1 },
+    { FAILURE_SYMLINK_OWNER, 3 },
+    { FAILURE_OTHER,         2 },
+};
+
+#define CHILDREN 4
+#define CHILD_LAUNCHES 1000
+
+/* -------------------------------------------------------------------------- */
+static void
+launch(unsigned aIndex)
+{
+    struct stat registration = {
+        .st_dev = sLaunchPlan[aIndex].mDev,
+        .st_ino = sLaunchPlan[aIndex].mIno,
+    };
+
+    record_stats_launch(
+        &registration,
+        sLaunchPlan[aIndex].mLicensor,
+        sLaunchPlan[aIndex].mLicensee,
+        sLaunchPlan[aIndex].mLatency);
+}
+
+/* -------------------------------------------------------------------------- */
+static const struct stats_registration *
+find_registration(dev_t aDev, ino_t aIno)
+{
+    for (unsigned rx = 0; rx < STATS_REGISTRATIONS; ++rx) {
+        const struct stats_registration *slot = &sStats->mRegistrations[rx];
+        if (slot->mLaunches && aDev == slot->mDev && aIno == slot->mIno)
+            return slot;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    assert(mkdtemp(sStatsDir));
+    snprintf(sStatsPath, sizeof(sStatsPath), "%s/none/stats", sStatsDir);
+
+    /* Without a directory for the statistics file, recording is
+     * silently disabled and the original errno is preserved.
+     */
+
+    errno = 0;
+    assert(print_stats(stderr));
+    errno = EBADF;
+    open_stats();
+    assert(!sStats);
+    assert(EBADF == errno);
+    launch(0);
+    record_stats_failure(FAILURE_OTHER);
+
+    snprintf(sStatsPath, sizeof(sStatsPath), "%s/stats", sStatsDir);
+
+    /* Refuse a file that other users could have modified. */
+
+    int fd = open(sStatsPath, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    assert(-1 != fd);
+    assert(!fchmod(fd, 0666));
+    assert(!close(fd));
+    open_stats();
+    assert(!sStats);
+
+    assert(!unlink(sStatsPath));
+    open_stats();
+    assert(sStats);
+    assert(STATS_MAGIC == sStats->mHeader.mMagic);
+    assert(STATS_VERSION == sStats->mHeader.mVersion);
+
+    for (unsigned ix = 0;
+            ix < sizeof(sLaunchPlan)/sizeof(sLaunchPlan[0]); ++ix) {
+        fprintf(stderr, "[%u] launch\n", ix);
+        launch(ix);
+    }
+
+    for (unsigned ix = 0;
+            ix < sizeof(sFailurePlan)/sizeof(sFailurePlan[0]); ++ix) {
+        fprintf(stderr, "[%u] failure\n", ix);
+        for (unsigned cx = 0; cx < sFailurePlan[ix].mCount; ++cx) {
+            record_stats_failure(sFailurePlan[ix].mFailure);
+        }
+    }
+
+    assert(4 == sStats->mLaunches.mValue);
+    assert(1500 + 3000 + (1 << 20) == sStats->mLatencySum.mValue);
+    assert(1 == sStats->mLatency[0].mValue);
+    assert(1 == sStats->mLatency[11].mValue);
+    assert(1 == sStats->mLatency[12].mValue);
+    assert(1 == sStats->mLatency[21].mValue);
+
+    for (unsigned ix = 0;
+            ix < sizeof(sFailurePlan)/sizeof(sFailurePlan[0]); ++ix)
+        assert(sFailurePlan[ix].mCount ==
+            sStats->mFailures[sFailurePlan[ix].mFailure].mValue);
+    assert(!sStats->mFailures[FAILURE_TARGET].mValue);
+
+    record_stats_audit_drop();
+    assert(1 == sStats->mAuditDrops.mValue);
+
+    const struct stats_registration *slot = find_registration(1, 100);
+    assert(slot && 2 == slot->mLaunches);
+    assert(1000 == slot->mLicensor && 2000 == slot->mLicensee);
+    slot = find_registration(1, 101);
+    assert(slot && 1 == slot->mLaunches && 2001 == slot->mLicensee);
+    slot = find_registration(2, 100);
+    assert(slot && 1 == slot->mLaunches && 1001 == slot->mLicensor);
+
+    struct stat launched = { .st_dev = 1, .st_ino = 100 };
+    assert(2 == count_stats_launches(sStats, &launched));
+    launched.st_ino = 102;
+    assert(!count_stats_launches(sStats, &launched));
+
+    /* Concurrent launches from separate processes sharing the file
+     * must not lose updates.
+     */
+
+    for (unsigned cx = 0; cx < CHILDREN; ++cx) {
+        pid_t pid = fork();
+        assert(-1 != pid);
+        if (!pid) {
+            open_stats();
+            if (!sStats)
+                _exit(1);
+            for (unsigned lx = 0; lx < CHILD_LAUNCHES; ++lx)
+                launch(lx % 2);
+            _exit(0);
+        }
+    }
+
+    for (unsigned cx = 0; cx < CHILDREN; ++cx) {
+        int status;
+        assert(-1 != wait(&status));
+        assert(WIFEXITED(status) && !WEXITSTATUS(status));
+    }
+
+    assert(4 + CHILDREN * CHILD_LAUNCHES == sStats->mLaunches.mValue);
+    slot = find_registration(1, 100);
+    assert(slot && 2 + CHILDREN * CHILD_LAUNCHES == slot->mLaunches);
+
+    /* Registrations that cannot be placed within the probe limit
+     * are counted as overflow.
+     */
+
+    for (unsigned ix = 0; ix < 2 * STATS_REGISTRATIONS; ++ix) {
+        struct stat registration = { .st_dev = 3, .st_ino = ix };
+        record_stats_launch(&registration, 0, 0, 1);
+    }
+    assert(sStats->mOverflow.mValue);
+
+    assert(!print_stats(stderr));
+
+    unlink(sStatsPath);
+    rmdir(sStatsDir);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,254 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/sysmacros.h>
+#include <sys/wait.h>
+
+/* -------------------------------------------------------------------------- */
+static char sTraceDir[] = "/tmp/test_trace.XXXXXX";
+static char sTracePath[sizeof(sTraceDir) + sizeof("/trace")];
+
+#define SUXEC_TRACE_PATH sTracePath
+
+#include "trace.c.h"
+
+#define CHILDREN 4
+#define CHILD_EVENTS (2 * TRACE_EVENTS)
+
+/* -------------------------------------------------------------------------- */
+static void
+create_trace(mode_t aMode)
+{
+    int fd = open(sTracePath, O_WRONLY | O_CREAT | O_TRUNC, aMode);
+    assert(-1 != fd);
+    assert(!fchmod(fd, aMode));
+    assert(!close(fd));
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+check_events(unsigned aMinimum)
+{
+    /* Every event that can be read must be internally consistent
+     * even while other processes are writing.
+     */
+
+    uint64_t head = trace_head(sTrace.mTrace);
+    uint64_t tail = TRACE_EVENTS < head ? head - TRACE_EVENTS : 0;
+
+    unsigned numEvents = 0;
+    for (uint64_t ticket = tail; ticket < head; ++ticket) {
+        struct trace_event event;
+
+        if (read_trace_event(sTrace.mTrace, ticket, &event))
+            continue;
+
+        assert(ticket + 1 == event.mSeq);
+        assert(TRACE_REGISTRATION == event.mKind);
+        assert(event.mUid == event.mGid);
+        assert(event.mIno == event.mUid * 1000003ULL);
+        ++numEvents;
+    }
+
+    assert(aMinimum <= numEvents);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    assert(mkdtemp(sTraceDir));
+    snprintf(sTracePath, sizeof(sTracePath), "%s/trace", sTraceDir);
+
+    /* Tracing is disabled unless the file exists, and the original
+     * errno is preserved.
+     */
+
+    errno = EBADF;
+    open_trace();
+    assert(!sTrace.mTrace);
+    assert(EBADF == errno);
+    assert(-1 == access(sTracePath, F_OK));
+    record_trace_failure(FAILURE_OTHER, 0);
+
+    /* Refuse a file that other users could have modified. */
+
+    create_trace(0666);
+    open_trace();
+    assert(!sTrace.mTrace);
+
+    create_trace(0644);
+    open_trace();
+    assert(sTrace.mTrace);
+    assert(getpid() == sTrace.mPid);
+    assert(TRACE_MAGIC == sTrace.mTrace->mHeader.mMagic);
+    assert(TRACE_EVENTS == sTrace.mTrace->mHeader.mEvents);
+
+    struct stat registration = {
+        .st_uid = 1000, .st_gid = 100, .st_dev = makedev(8, 1), .st_ino = 42,
+    };
+
+    record_trace_identity(TRACE_START, 1001, 101, 0);
+    record_trace_stat(TRACE_REGISTRATION, &registration);
+    record_trace_identity(TRACE_EXEC, 1000, 100, 3);
+    record_trace_failure(FAILURE_SYMLINK_OWNER, ENOENT);
+
+    assert(4 == trace_head(sTrace.mTrace));
+
+    struct trace_event event;
+
+    assert(!read_trace_event(sTrace.mTrace, 0, &event));
+    assert(TRACE_START == event.mKind);
+    assert(1001 == event.mUid && 101 == event.mGid);
+    assert(getpid() == event.mPid);
+    assert(event.mTime);
+
+    uint64_t startTime = event.mTime;
+
+    assert(!read_trace_event(sTrace.mTrace, 1, &event));
+    assert(TRACE_REGISTRATION == event.mKind);
+    assert(1000 == event.mUid && 100 == event.mGid);
+    assert(makedev(8, 1) == event.mDev && 42 == event.mIno);
+    assert(startTime <= event.mTime);
+
+    assert(!read_trace_event(sTrace.mTrace, 2, &event));
+    assert(TRACE_EXEC == event.mKind && 3 == event.mHops);
+
+    assert(!read_trace_event(sTrace.mTrace, 3, &event));
+    assert(TRACE_FAILURE == event.mKind);
+    assert(FAILURE_SYMLINK_OWNER == event.mReason);
+    assert(ENOENT == event.mErrno);
+
+    assert(read_trace_event(sTrace.mTrace, 4, &event));
+
+    /* Once the ring wraps, the oldest events are no longer
+     * available.
+     */
+
+    for (unsigned ex = 0; ex < TRACE_EVENTS; ++ex) {
+        registration.st_uid = registration.st_gid = ex;
+        registration.st_ino = ex * 1000003ULL;
+        record_trace_stat(TRACE_REGISTRATION, &registration);
+    }
+
+    assert(read_trace_event(sTrace.mTrace, 3, &event));
+    assert(!read_trace_event(sTrace.mTrace, 4, &event));
+    check_events(TRACE_EVENTS);
+
+    /* A writer that finds its slot busy, or holding a newer event,
+     * drops its event rather than tear the event in the slot.
+     */
+
+    uint64_t ticket = trace_head(sTrace.mTrace);
+    struct trace_event *busy = &sTrace.mTrace->mRing[ticket % TRACE_EVENTS];
+    struct trace_event *newer =
+        &sTrace.mTrace->mRing[(ticket + 1) % TRACE_EVENTS];
+
+    uint64_t busySeq = busy->mSeq;
+    busy->mSeq = TRACE_BUSY;
+    record_trace_identity(TRACE_EXEC, 7, 7, 0);
+    assert(TRACE_BUSY == busy->mSeq);
+    assert(read_trace_event(sTrace.mTrace, ticket, &event));
+
+    uint64_t newerSeq = newer->mSeq;
+    newer->mSeq = ticket + 2 + TRACE_EVENTS;
+    record_trace_identity(TRACE_EXEC, 7, 7, 0);
+    assert(ticket + 2 + TRACE_EVENTS == newer->mSeq);
+    assert(read_trace_event(sTrace.mTrace, ticket + 1, &event));
+
+    /* A slot left holding an older event is reclaimed by the next
+     * writer.
+     */
+
+    busy->mSeq = busySeq;
+    newer->mSeq = newerSeq;
+    for (unsigned ex = 0; ex < TRACE_EVENTS; ++ex) {
+        registration.st_uid = registration.st_gid = ex;
+        registration.st_ino = ex * 1000003ULL;
+        record_trace_stat(TRACE_REGISTRATION, &registration);
+    }
+    check_events(TRACE_EVENTS);
+
+    /* Concurrent writers must not corrupt each other, and readers
+     * must only see complete events.
+     */
+
+    for (unsigned cx = 0; cx < CHILDREN; ++cx) {
+        pid_t pid = fork();
+        assert(-1 != pid);
+        if (!pid) {
+            open_trace();
+            if (!sTrace.mTrace)
+                _exit(1);
+            for (unsigned ex = 0; ex < CHILD_EVENTS; ++ex) {
+                unsigned id = (cx + 1) * CHILD_EVENTS + ex;
+                registration.st_uid = registration.st_gid = id;
+                registration.st_ino = id * 1000003ULL;
+                record_trace_stat(TRACE_REGISTRATION, &registration);
+            }
+            _exit(0);
+        }
+    }
+
+    for (unsigned rx = 0; rx < 100; ++rx)
+        check_events(0);
+
+    for (unsigned cx = 0; cx < CHILDREN; ++cx) {
+        int status;
+        assert(-1 != wait(&status));
+        assert(WIFEXITED(status) && !WEXITSTATUS(status));
+    }
+
+    assert(6 + 2 * TRACE_EVENTS + CHILDREN * CHILD_EVENTS ==
+        trace_head(sTrace.mTrace));
+
+    /* Every event that survived is complete, and once the writers
+     * are quiescent, every slot can be claimed again.
+     */
+
+    check_events(0);
+
+    for (unsigned ex = 0; ex < TRACE_EVENTS; ++ex) {
+        registration.st_uid = registration.st_gid = ex;
+        registration.st_ino = ex * 1000003ULL;
+        record_trace_stat(TRACE_REGISTRATION, &registration);
+    }
+    check_events(TRACE_EVENTS);
+
+    unlink(sTracePath);
+    rmdir(sTraceDir);
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
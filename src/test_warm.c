@@ -0,0 +1,205 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* -------------------------------------------------------------------------- */
+static char sWarmDir[] = "/tmp/test_warm.XXXXXX";
+
+#include "warm.c.h"
+
+/* -------------------------------------------------------------------------- */
+static struct {
+    const char *mName;
+    size_t mSize;
+    uint64_t mLaunches;
+} sTargetPlan[] = {
+    { "hot",   256 * 1024, 10 },
+    { "fifo",  0,           7 },
+    { "warm",  1,           5 },
+    { "cold",  4096,        1 },
+    { "never", 4096,        0 },
+};
+
+#define TARGETS (sizeof(sTargetPlan) / sizeof(sTargetPlan[0]))
+
+/* -------------------------------------------------------------------------- */
+static char *
+test_path(const char *aPrefix, const char *aName)
+{
+    static char path[2][sizeof(sWarmDir) + 64];
+    static unsigned px;
+
+    char *buf = path[px++ % 2];
+    snprintf(buf, sizeof(path[0]), "%s/%s%s", sWarmDir, aPrefix, aName);
+
+    return buf;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+create_targets(void)
+{
+    static char buf[4096];
+    memset(buf, 'x', sizeof(buf));
+
+    for (unsigned tx = 0; tx < TARGETS; ++tx) {
+        const char *name = sTargetPlan[tx].mName;
+        const char *path = test_path("", name);
+
+        if (!strcmp("fifo", name)) {
+            assert(!mkfifo(path, 0644));
+        } else {
+            int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0755);
+            assert(-1 != fd);
+            for (size_t size = sTargetPlan[tx].mSize; size; ) {
+                size_t len = size < sizeof(buf) ? size : sizeof(buf);
+                assert(len == write(fd, buf, len));
+                size -= len;
+            }
+            assert(!close(fd));
+        }
+
+        assert(!symlink(path, test_path("reg-", name)));
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static const struct warm_target *
+find_target(const struct warm *aWarm, const char *aName)
+{
+    const char *path = test_path("reg-", aName);
+
+    for (size_t tx = 0; tx < aWarm->mLen; ++tx) {
+        if (!strcmp(path, aWarm->mTargets[tx].mPath))
+            return &aWarm->mTargets[tx];
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+add_targets(struct warm *aWarm)
+{
+    create_warm(aWarm);
+
+    for (unsigned tx = 0; tx < TARGETS; ++tx)
+        assert(!add_warm_target(
+            aWarm,
+            test_path("reg-", sTargetPlan[tx].mName),
+            sTargetPlan[tx].mLaunches));
+
+    /* Registrations that were never launched are ignored. */
+
+    assert(TARGETS - 1 == aWarm->mLen);
+    assert(!find_target(aWarm, "never"));
+}
+
+/* -------------------------------------------------------------------------- */
+int
+main(int argc, char **argv)
+{
+    assert(mkdtemp(sWarmDir));
+
+    create_targets();
+
+    /* Only the highest ranked programs are read ahead, and a
+     * registration that does not resolve to a regular file is
+     * skipped without being opened.
+     */
+
+    struct warm warm;
+    add_targets(&warm);
+
+    assert(2 == load_warm(&warm, 3, 0));
+
+    assert(10 == warm.mTargets[0].mLaunches);
+    assert(7 == warm.mTargets[1].mLaunches);
+    assert(5 == warm.mTargets[2].mLaunches);
+    assert(1 == warm.mTargets[3].mLaunches);
+
+    assert(find_target(&warm, "hot")->mWarm);
+    assert(!find_target(&warm, "fifo")->mWarm);
+    assert(find_target(&warm, "warm")->mWarm);
+    assert(!find_target(&warm, "cold")->mWarm);
+
+    for (size_t tx = 0; tx < warm.mLen; ++tx)
+        assert(!warm.mTargets[tx].mMap);
+
+    close_warm(&warm);
+
+    /* Locked programs are mapped and resident. */
+
+    add_targets(&warm);
+
+    assert(2 == load_warm(&warm, 3, 1));
+
+    const struct warm_target *hot = find_target(&warm, "hot");
+    assert(hot->mMap && sTargetPlan[0].mSize == hot->mMapLen);
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (hot->mMapLen + pageSize - 1) / pageSize;
+
+    unsigned char *resident = malloc(pages);
+    assert(resident);
+    assert(!mincore(hot->mMap, hot->mMapLen, resident));
+    for (size_t px = 0; px < pages; ++px)
+        assert(resident[px] & 1);
+    free(resident);
+
+    assert(find_target(&warm, "warm")->mMap);
+    assert(!find_target(&warm, "fifo")->mMap);
+    assert(!find_target(&warm, "cold")->mMap);
+
+    close_warm(&warm);
+
+    /* A registration that has since been removed is skipped. */
+
+    add_targets(&warm);
+
+    assert(!unlink(test_path("", "hot")));
+    assert(1 == load_warm(&warm, 3, 0));
+    assert(!find_target(&warm, "hot")->mWarm);
+
+    close_warm(&warm);
+
+    for (unsigned tx = 0; tx < TARGETS; ++tx) {
+        unlink(test_path("", sTargetPlan[tx].mName));
+        assert(!unlink(test_path("reg-", sTargetPlan[tx].mName)));
+    }
+
+    assert(!rmdir(sWarmDir));
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
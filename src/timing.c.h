@@ -0,0 +1,223 @@
+#ifndef SUXEC_TIMING_H
+#define SUXEC_TIMING_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* -------------------------------------------------------------------------- */
+/* Phase timing
+ *
+ * Record CLOCK_MONOTONIC timestamps at phase boundaries so that
+ * collectors can build a latency breakdown of each launch. The
+ * record is written to the descriptor named by --timing-fd as one
+ * line of compact JSON, using a single write(2) no larger than
+ * PIPE_BUF so that records from concurrent launches sharing a pipe
+ * are not interleaved:
+ *
+ *  {"pid":N,"start_ns":T,"parse_ns":D,...,"hop_ns":[D,...],"exec_ns":D}
+ *
+ * The start is an absolute CLOCK_MONOTONIC time, and each
+ * subsequent phase is the offset in nanoseconds from the start.
+ */
+
+enum timing_phase {
+    TIMING_PARSE,
+    TIMING_GROUPLIST,
+    TIMING_REQUESTOR,
+    TIMING_SYMLINK,
+    TIMING_LICENSOR,
+    TIMING_PARENT,
+    TIMING_RESOLVE,
+    TIMING_ENVIRONMENT,
+    TIMING_IMPERSONATE,
+    TIMING_EXEC,
+    TIMING_PHASES
+};
+
+static const char *sTimingPhaseName[TIMING_PHASES] = {
+    [TIMING_PARSE]       = "parse",
+    [TIMING_GROUPLIST]   = "grouplist",
+    [TIMING_REQUESTOR]   = "requestor",
+    [TIMING_SYMLINK]     = "symlink",
+    [TIMING_LICENSOR]    = "licensor",
+    [TIMING_PARENT]      = "parent",
+    [TIMING_RESOLVE]     = "resolve",
+    [TIMING_ENVIRONMENT] = "environment",
+    [TIMING_IMPERSONATE] = "impersonate",
+    [TIMING_EXEC]        = "exec",
+};
+
+#define TIMING_HOPS_MAX 64
+
+struct timing {
+    int mFd;
+    unsigned long long mStart;
+    unsigned long long mPhase[TIMING_PHASES];
+    unsigned long long mHop[TIMING_HOPS_MAX];
+    unsigned mHops;
+    unsigned mRoundTrips;
+};
+
+static struct timing sTiming = { .mFd = -1 };
+
+/* -------------------------------------------------------------------------- */
+static unsigned long long
+timing_now_(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        return 0;
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+start_timing(void)
+{
+    sTiming.mStart = timing_now_();
+}
+
+/* -------------------------------------------------------------------------- */
+static unsigned long long
+elapsed_timing(void)
+{
+    return timing_now_() - sTiming.mStart;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+mark_timing(enum timing_phase aPhase)
+{
+    if (-1 != sTiming.mFd)
+        sTiming.mPhase[aPhase] = timing_now_() - sTiming.mStart;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+mark_timing_hop(void)
+{
+    if (-1 != sTiming.mFd) {
+        if (TIMING_HOPS_MAX > sTiming.mHops)
+            sTiming.mHop[sTiming.mHops] = timing_now_() - sTiming.mStart;
+        ++sTiming.mHops;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+count_timing_round_trips(unsigned aRoundTrips)
+{
+    sTiming.mRoundTrips += aRoundTrips;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+write_timing(void)
+{
+    int rc = -1;
+
+    if (-1 == sTiming.mFd) {
+        rc = 0;
+        goto Finally;
+    }
+
+    char buf[PIPE_BUF];
+    size_t len = 0;
+
+    /* Format the entire record before writing anything, and
+     * abandon the record rather than emit a partial line.
+     */
+
+#define TIMING_APPEND(...) \
+    do { \
+        int len_ = snprintf(buf + len, sizeof(buf) - len, __VA_ARGS__); \
+        if (0 > len_ || sizeof(buf) - len <= (size_t) len_) { \
+            errno = ENOSPC; \
+            goto Finally; \
+        } \
+        len += len_; \
+    } while (0)
+
+    TIMING_APPEND("{\"pid\":%d,\"start_ns\":%llu",
+        (int) getpid(), sTiming.mStart);
+
+    for (unsigned px = 0; px < TIMING_EXEC; ++px) {
+        TIMING_APPEND(",\"%s_ns\":%llu",
+            sTimingPhaseName[px], sTiming.mPhase[px]);
+
+        if (TIMING_PARENT == px) {
+            unsigned hops = sTiming.mHops;
+            if (TIMING_HOPS_MAX < hops)
+                hops = TIMING_HOPS_MAX;
+
+            TIMING_APPEND(",\"hops\":%u,\"hop_ns\":[", sTiming.mHops);
+            for (unsigned hx = 0; hx < hops; ++hx)
+                TIMING_APPEND("%s%llu", hx ? "," : "", sTiming.mHop[hx]);
+            TIMING_APPEND("]");
+        }
+
+        if (TIMING_RESOLVE == px)
+            TIMING_APPEND(",\"round_trips\":%u", sTiming.mRoundTrips);
+    }
+
+    TIMING_APPEND(",\"%s_ns\":%llu}\n",
+        sTimingPhaseName[TIMING_EXEC], sTiming.mPhase[TIMING_EXEC]);
+
+#undef TIMING_APPEND
+
+    ssize_t wrlen;
+    do
+        wrlen = write(sTiming.mFd, buf, len);
+    while (-1 == wrlen && EINTR == errno);
+
+    if (-1 == wrlen)
+        goto Finally;
+
+    if (len != (size_t) wrlen) {
+        errno = EIO;
+        goto Finally;
+    }
+
+    rc = 0;
+
+Finally:
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_TIMING_H */
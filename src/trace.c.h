@@ -0,0 +1,192 @@
+#ifndef SUXEC_TRACE_H
+#define SUXEC_TRACE_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "failure.h"
+#include "mapped.c.h"
+#include "trace_ring.h"
+
+/* -------------------------------------------------------------------------- */
+/* Event trace writer
+ *
+ * Tracing is enabled by creating an empty file owned by the privileged
+ * user at SUXEC_TRACE_PATH, and the file is extended to hold the ring
+ * when first used. Each event costs a clock read and a handful of
+ * stores to the shared mapping, and no system calls.
+ */
+
+struct trace_writer {
+    struct trace *mTrace;
+    uint32_t mPid;
+};
+
+static struct trace_writer sTrace;
+
+/* -------------------------------------------------------------------------- */
+static struct trace *
+map_trace_(void)
+{
+    /* The file must already exist, and the creator of the header
+     * also records the size of the ring.
+     */
+
+    struct trace *trace = map_file(SUXEC_TRACE_PATH, sizeof(*trace),
+        MAPPED_WRITE, 0, TRACE_MAGIC, TRACE_VERSION);
+    if (!trace)
+        return 0;
+
+    uint32_t events = 0;
+    __atomic_compare_exchange_n(
+        &trace->mHeader.mEvents, &events, TRACE_EVENTS,
+        0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    if (TRACE_EVENTS != __atomic_load_n(
+            &trace->mHeader.mEvents, __ATOMIC_RELAXED)) {
+        munmap(trace, sizeof(*trace));
+        errno = EINVAL;
+        return 0;
+    }
+
+    return trace;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+open_trace(void)
+{
+    int savedErrno = errno;
+    sTrace.mTrace = map_trace_();
+    if (sTrace.mTrace)
+        sTrace.mPid = getpid();
+    errno = savedErrno;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_trace_(const struct trace_event *aEvent)
+{
+    struct trace *trace = sTrace.mTrace;
+
+    if (!trace)
+        return;
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts))
+        ts.tv_sec = ts.tv_nsec = 0;
+
+    uint64_t ticket =
+        __atomic_fetch_add(&trace->mHead.mValue, 1, __ATOMIC_RELAXED);
+
+    struct trace_event *slot = &trace->mRing[ticket % TRACE_EVENTS];
+
+    /* Mark the slot busy before overwriting it so that readers do not
+     * mistake a partial update for the previous event. Only a slot
+     * holding an older event can be claimed, which is usually the
+     * event from the previous lap, but can be older still if a writer
+     * on that lap dropped its event. A writer that dies while filling
+     * its slot leaves the slot busy, losing only that slot.
+     */
+
+    uint64_t seq = __atomic_load_n(&slot->mSeq, __ATOMIC_RELAXED);
+    do {
+        if (TRACE_BUSY == seq || ticket + 1 <= seq)
+            return;
+    } while (!__atomic_compare_exchange_n(
+        &slot->mSeq, &seq, TRACE_BUSY,
+        0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(
+        &slot->mTime, ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+        __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mDev, aEvent->mDev, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mIno, aEvent->mIno, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mPid, sTrace.mPid, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mUid, aEvent->mUid, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mGid, aEvent->mGid, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mErrno, aEvent->mErrno, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mKind, aEvent->mKind, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mReason, aEvent->mReason, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->mHops, aEvent->mHops, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->mSeq, ticket + 1, __ATOMIC_RELEASE);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_trace_identity(
+    enum trace_kind aKind, uid_t aUid, gid_t aGid, unsigned aHops)
+{
+    record_trace_(&(struct trace_event) {
+        .mKind = aKind,
+        .mUid = aUid,
+        .mGid = aGid,
+        .mHops = aHops,
+    });
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_trace_stat(enum trace_kind aKind, const struct stat *aStat)
+{
+    record_trace_(&(struct trace_event) {
+        .mKind = aKind,
+        .mUid = aStat->st_uid,
+        .mGid = aStat->st_gid,
+        .mDev = aStat->st_dev,
+        .mIno = aStat->st_ino,
+    });
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+record_trace_failure(enum failure aFailure, int aErrno)
+{
+    record_trace_(&(struct trace_event) {
+        .mKind = TRACE_FAILURE,
+        .mReason = aFailure,
+        .mErrno = aErrno,
+    });
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_TRACE_H */
@@ -0,0 +1,151 @@
+#ifndef SUXEC_TRACE_RING_H
+#define SUXEC_TRACE_RING_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+/* Binary event trace
+ *
+ * The trace is a ring of fixed size events in a file shared by all
+ * invocations on the host. Writers claim a ticket by incrementing
+ * the head of the ring, mark the slot selected by the ticket as busy,
+ * fill it, and then publish the slot by storing the ticket in its
+ * sequence number. A writer drops its event rather than wait if the
+ * slot is busy, or already holds a newer event, so that a writer
+ * lapped by another never overwrites the newer event. Readers
+ * validate each slot against its ticket both before and after copying
+ * it, and discard slots that are incomplete or overwritten.
+ */
+
+#ifndef SUXEC_TRACE_PATH
+#define SUXEC_TRACE_PATH "/run/suxec/trace"
+#endif
+
+#define TRACE_MAGIC 0x73757874u
+#define TRACE_VERSION 1u
+#define TRACE_CACHELINE 64
+#define TRACE_EVENTS 4096
+#define TRACE_BUSY UINT64_MAX
+
+enum trace_kind {
+    TRACE_START,
+    TRACE_DIRECTORY,
+    TRACE_PARENT,
+    TRACE_REGISTRATION,
+    TRACE_TARGET,
+    TRACE_EXEC,
+    TRACE_FAILURE,
+    TRACE_KINDS
+};
+
+static const char * const sTraceKindName[TRACE_KINDS] = {
+    [TRACE_START]        = "start",
+    [TRACE_DIRECTORY]    = "directory",
+    [TRACE_PARENT]       = "parent",
+    [TRACE_REGISTRATION] = "registration",
+    [TRACE_TARGET]       = "target",
+    [TRACE_EXEC]         = "exec",
+    [TRACE_FAILURE]      = "failure",
+};
+
+struct trace_event {
+    uint64_t mSeq;
+    uint64_t mTime;
+    uint64_t mDev;
+    uint64_t mIno;
+    uint32_t mPid;
+    uint32_t mUid;
+    uint32_t mGid;
+    int32_t mErrno;
+    uint16_t mKind;
+    uint16_t mReason;
+    uint32_t mHops;
+} __attribute__((__aligned__(TRACE_CACHELINE)));
+
+struct trace {
+    struct {
+        uint32_t mMagic;
+        uint32_t mVersion;
+        uint32_t mEvents;
+    } __attribute__((__aligned__(TRACE_CACHELINE))) mHeader;
+
+    struct {
+        uint64_t mValue;
+    } __attribute__((__aligned__(TRACE_CACHELINE))) mHead;
+
+    struct trace_event mRing[TRACE_EVENTS];
+};
+
+/* -------------------------------------------------------------------------- */
+static inline uint64_t
+trace_head(const struct trace *aTrace)
+{
+    return __atomic_load_n(&aTrace->mHead.mValue, __ATOMIC_ACQUIRE);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int
+read_trace_event(
+    const struct trace *aTrace, uint64_t aTicket, struct trace_event *aEvent)
+{
+    const struct trace_event *slot = &aTrace->mRing[aTicket % TRACE_EVENTS];
+
+    if (aTicket + 1 != __atomic_load_n(&slot->mSeq, __ATOMIC_ACQUIRE))
+        return -1;
+
+    aEvent->mTime = __atomic_load_n(&slot->mTime, __ATOMIC_RELAXED);
+    aEvent->mDev = __atomic_load_n(&slot->mDev, __ATOMIC_RELAXED);
+    aEvent->mIno = __atomic_load_n(&slot->mIno, __ATOMIC_RELAXED);
+    aEvent->mPid = __atomic_load_n(&slot->mPid, __ATOMIC_RELAXED);
+    aEvent->mUid = __atomic_load_n(&slot->mUid, __ATOMIC_RELAXED);
+    aEvent->mGid = __atomic_load_n(&slot->mGid, __ATOMIC_RELAXED);
+    aEvent->mErrno = __atomic_load_n(&slot->mErrno, __ATOMIC_RELAXED);
+    aEvent->mKind = __atomic_load_n(&slot->mKind, __ATOMIC_RELAXED);
+    aEvent->mReason = __atomic_load_n(&slot->mReason, __ATOMIC_RELAXED);
+    aEvent->mHops = __atomic_load_n(&slot->mHops, __ATOMIC_RELAXED);
+
+    /* The slot might have been reclaimed by a writer while the
+     * content was being copied.
+     */
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (aTicket + 1 != __atomic_load_n(&slot->mSeq, __ATOMIC_RELAXED))
+        return -1;
+
+    aEvent->mSeq = aTicket + 1;
+
+    return TRACE_KINDS > aEvent->mKind ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_TRACE_RING_H */
@@ -0,0 +1,307 @@
+#!/usr/bin/env bash
+# -*- sh-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et:
+
+# Run suxec across real identity switches without host privileges.
+#
+# The script re-executes itself in a new user and mount namespace.
+# The invoking user is mapped to root, and the subordinate ids listed
+# in /etc/subuid and /etc/subgid are mapped from 1 upwards. Inside the
+# namespace, private passwd and group files define a licensor and a
+# licensee with distinct supplementary groups, and setuid copies of
+# suxec are installed on a private tmpfs.
+#
+# usage: userns.sh [test]
+#        userns.sh bench [bench_launch options]
+#
+# The script exits with status 77 to skip when the namespace cannot
+# be created, so that it can run as part of make check.
+
+[ -z "${0##/*}" ] || exec "$PWD/$0" "$@"
+
+set -eu
+
+LICENSOR=1001
+LICENSEE=1002
+STRANGER=1003
+GROUP_TOOLS=1101
+GROUP_DATA=1102
+GROUP_SHARED=1103
+USERNS_IDS=2000
+
+say()
+{
+    printf '%s\n' "$*"
+}
+
+skip()
+{
+    say "SKIP $*" >&2
+    exit 77
+}
+
+expect()
+{
+    test "$@" || {
+        say "Failed at line ${BASH_LINENO[0]}: $*" >&2
+        exit 1
+    }
+}
+
+subid()
+{
+    awk -F: -v name="$(id -un)" -v uid="$(id -u)" '
+        ($1 == name || $1 == uid) && $3 >= '"$USERNS_IDS"' {
+            print $2
+            exit
+        }' "$1" 2>/dev/null
+}
+
+enter()
+{
+    local SUBUID SUBGID
+
+    local CMD
+    for CMD in unshare newuidmap newgidmap setpriv ; do
+        command -v "$CMD" >/dev/null || skip "Unable to find $CMD"
+    done
+
+    SUBUID=$(subid /etc/subuid)
+    SUBGID=$(subid /etc/subgid)
+
+    [ -n "$SUBUID" ] || skip "No subordinate uid range for $(id -un)"
+    [ -n "$SUBGID" ] || skip "No subordinate gid range for $(id -un)"
+
+    unshare --user --mount --map-root-user true 2>/dev/null ||
+        skip "Unable to create user namespace"
+
+    exec unshare \
+        --user --mount --map-root-user \
+        --map-users="$SUBUID,1,$USERNS_IDS" \
+        --map-groups="$SUBGID,1,$USERNS_IDS" \
+        --setgroups=allow \
+        -- env USERNS_INSIDE=1 "$0" "$@"
+}
+
+prepare()
+{
+    WORKDIR=$(mktemp -d)
+    trap 'umount -l "$WORKDIR" && rmdir "$WORKDIR"' EXIT
+    mount -t tmpfs -o mode=0755 tmpfs "$WORKDIR"
+
+    mkdir -m 0755 "$WORKDIR/etc" "$WORKDIR/bin" "$WORKDIR/home"
+
+    cat > "$WORKDIR/etc/passwd" <<EOF
+root:x:0:0:root:/root:/bin/sh
+licensor:x:$LICENSOR:$LICENSOR::$WORKDIR/home/licensor:/bin/sh
+licensee:x:$LICENSEE:$LICENSEE::$WORKDIR/home/licensee:/bin/sh
+stranger:x:$STRANGER:$STRANGER::$WORKDIR/home/stranger:/bin/sh
+EOF
+
+    cat > "$WORKDIR/etc/group" <<EOF
+root:x:0:
+licensor:x:$LICENSOR:
+licensee:x:$LICENSEE:
+stranger:x:$STRANGER:
+tools:x:$GROUP_TOOLS:licensor
+data:x:$GROUP_DATA:licensor
+shared:x:$GROUP_SHARED:licensor,licensee
+EOF
+
+    cat > "$WORKDIR/etc/nsswitch.conf" <<EOF
+passwd: files
+group: files
+EOF
+
+    local FILE
+    for FILE in passwd group nsswitch.conf ; do
+        [ ! -e "/etc/$FILE" ] ||
+            mount --bind "$WORKDIR/etc/$FILE" "/etc/$FILE"
+    done
+
+    # Install setuid copies of suxec owned by the namespace root. The
+    # build directory typically resides on a filesystem that cannot
+    # honour setuid from within the namespace.
+
+    SUXEC=()
+    local PROGRAM
+    for PROGRAM in suxec suxec-static ; do
+        [ -x "${0%/*}/$PROGRAM" ] || continue
+        cp "${0%/*}/$PROGRAM" "$WORKDIR/bin/$PROGRAM"
+        chmod 4755 "$WORKDIR/bin/$PROGRAM"
+        SUXEC+=("$WORKDIR/bin/$PROGRAM")
+    done
+    expect ${#SUXEC[@]} -ne 0
+
+    # Create a registration in which the licensee owns the symlink,
+    # and the licensor owns the directories and the target.
+
+    mkdir -m 0711 "$WORKDIR/reg"
+    mkdir -m 0755 "$WORKDIR/reg/licensee" "$WORKDIR/libexec"
+
+    cat > "$WORKDIR/libexec/id" <<'EOF'
+#!/bin/sh
+printf 'uid=%s euid=%s gid=%s egid=%s\n' \
+    "$(id -ru)" "$(id -u)" "$(id -rg)" "$(id -g)"
+printf 'groups=%s\n' "$(id -G | tr ' ' '\n' | sort -n | tr '\n' ' ')"
+printf 'LOGNAME=%s HOME=%s\n' "$LOGNAME" "$HOME"
+EOF
+    chmod 0755 "$WORKDIR/libexec/id"
+
+    ln -s "$WORKDIR/libexec/id" "$WORKDIR/reg/licensee/id"
+    ln -s "$WORKDIR/libexec/id" "$WORKDIR/reg/licensee/foreign"
+
+    chown "$LICENSOR:$LICENSOR" \
+        "$WORKDIR/reg" "$WORKDIR/reg/licensee" \
+        "$WORKDIR/libexec" "$WORKDIR/libexec/id"
+    chown -h "$LICENSEE:$LICENSEE" "$WORKDIR/reg/licensee/id"
+    chown -h "$LICENSOR:$LICENSOR" "$WORKDIR/reg/licensee/foreign"
+}
+
+prepare_exec_cache()
+{
+    # Enable the executable cache on a private tmpfs, and offer ELF
+    # targets that the licensor can execute in place, that reside on
+    # a noexec file system, and that reside in a directory that only
+    # the licensee can search.
+
+    mount -t tmpfs -o mode=0755 tmpfs /var/cache
+    mkdir -m 0700 /var/cache/suxec
+
+    mkdir -m 0755 "$WORKDIR/noexec"
+    mount -t tmpfs -o mode=0755,noexec tmpfs "$WORKDIR/noexec"
+    mkdir -m 0710 "$WORKDIR/private"
+
+    local DIR
+    for DIR in libexec noexec private ; do
+        cp /bin/true "$WORKDIR/$DIR/true"
+        chmod 0755 "$WORKDIR/$DIR/true"
+        chown "$LICENSOR:$LICENSOR" "$WORKDIR/$DIR/true"
+        ln -s "$WORKDIR/$DIR/true" "$WORKDIR/reg/licensee/$DIR"
+        chown -h "$LICENSEE:$LICENSEE" "$WORKDIR/reg/licensee/$DIR"
+    done
+
+    chown "$LICENSEE:$LICENSEE" "$WORKDIR/private"
+}
+
+as()
+{
+    local NAME="$1" ; shift
+    setpriv --reuid="$NAME" --regid="$NAME" --init-groups -- "$@"
+}
+
+test_identity()
+{
+    local RESULT
+    RESULT=$(as licensee "$1" "$WORKDIR/reg/licensee/id")
+    say "$RESULT" >&2
+
+    expect -z "${RESULT##*uid=$LICENSOR euid=$LICENSOR *}"
+    expect -z "${RESULT##*gid=$LICENSOR egid=$LICENSOR*}"
+    expect -z "${RESULT##*LOGNAME=licensor HOME=$WORKDIR/home/licensor*}"
+}
+
+test_groups()
+{
+    local RESULT
+    RESULT=$(as licensee "$1" "$WORKDIR/reg/licensee/id")
+    say "$RESULT" >&2
+
+    local EXPECTED="$LICENSOR $GROUP_TOOLS $GROUP_DATA $GROUP_SHARED "
+    expect -z "${RESULT##*groups=$EXPECTED*}"
+}
+
+test_foreign()
+{
+    # The registration symlink must be owned by the requestor.
+
+    local RC=0
+    as licensee "$1" "$WORKDIR/reg/licensee/foreign" || RC=$?
+    expect $RC = 127
+}
+
+test_stranger()
+{
+    # Other users cannot use the registration of the licensee.
+
+    local RC=0
+    as stranger "$1" "$WORKDIR/reg/licensee/id" || RC=$?
+    expect $RC = 127
+}
+
+test_exec_cache()
+{
+    # A program that the licensor can execute is copied to the cache.
+
+    as licensee "$1" "$WORKDIR/reg/licensee/libexec"
+    expect -n "$(ls -A /var/cache/suxec)"
+}
+
+test_noexec()
+{
+    # Neither a program on a noexec file system, nor a program that
+    # the licensor cannot reach, is executed from the cache. Instead
+    # the original is executed in place, which fails after impersonation.
+
+    local RC
+
+    RC=0
+    as licensee "$1" "$WORKDIR/reg/licensee/noexec" || RC=$?
+    expect $RC = 255
+
+    RC=0
+    as licensee "$1" "$WORKDIR/reg/licensee/private" || RC=$?
+    expect $RC = 255
+}
+
+run()
+{
+    local OUTPUT
+    OUTPUT=$(
+        exec 2>&1 >/dev/null
+        set -x
+        "$@"
+    ) || {
+        say "$OUTPUT"
+        say "FAILED $*"
+        false
+    }
+    [ -z "${OPT_VERBOSE++}" ] ||
+        say "$OUTPUT"
+    say "OK     -$- $*"
+}
+
+run_tests()
+{
+    local PROGRAM
+    for PROGRAM in "${SUXEC[@]}" ; do
+        run test_identity "$PROGRAM"
+        run test_groups "$PROGRAM"
+        run test_foreign "$PROGRAM"
+        run test_stranger "$PROGRAM"
+        run test_exec_cache "$PROGRAM"
+        run test_noexec "$PROGRAM"
+    done
+}
+
+run_bench()
+{
+    [ -x "${0%/*}/bench_launch" ] || skip "Unable to find bench_launch"
+
+    TMPDIR="$WORKDIR" "${0%/*}/bench_launch" \
+        -L licensor -R licensee "$@" "${SUXEC[@]}"
+}
+
+main()
+{
+    [ -n "${USERNS_INSIDE++}" ] || enter "$@"
+
+    prepare
+
+    case "${1-test}" in
+    test)  prepare_exec_cache ; run_tests ;;
+    bench) shift ; run_bench "$@" ;;
+    *)     say "usage: ${0##*/} [test | bench [options]]" >&2 ; exit 1 ;;
+    esac
+}
+
+main "$@"
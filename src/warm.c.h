@@ -0,0 +1,247 @@
+#ifndef SUXEC_WARM_H
+#define SUXEC_WARM_H
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2022, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "finally.h"
+
+/* -------------------------------------------------------------------------- */
+/* Page cache warmer
+ *
+ * Keep the programs of the most launched registrations in the page
+ * cache, so that a launch does not wait for page faults after the
+ * program would otherwise have been evicted. Registrations are ranked
+ * by launch count, and the program of each of the highest ranked is
+ * read ahead, and optionally mapped and locked so that it remains
+ * resident while the warmer runs.
+ *
+ * Each program is found by following the registration symlink, and
+ * is only opened for reading if it is a regular file, so that a
+ * registration cannot be used to open a device or a fifo.
+ */
+
+#define WARM_INTERVAL 60
+
+struct warm_target {
+    uint64_t mLaunches;
+    char *mPath;
+    int mWarm;
+    void *mMap;
+    size_t mMapLen;
+};
+
+struct warm {
+    struct warm_target *mTargets;
+    size_t mLen;
+    size_t mMaxLen;
+};
+
+/* -------------------------------------------------------------------------- */
+static struct warm *
+create_warm(struct warm *self)
+{
+    *self = (struct warm) { .mTargets = 0 };
+
+    return self;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct warm *
+close_warm(struct warm *self)
+{
+    if (self) {
+        for (size_t tx = 0; tx < self->mLen; ++tx) {
+            struct warm_target *target = &self->mTargets[tx];
+
+            if (target->mMap)
+                munmap(target->mMap, target->mMapLen);
+            free(target->mPath);
+        }
+
+        free(self->mTargets);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+add_warm_target(struct warm *self, const char *aPath, uint64_t aLaunches)
+{
+    /* Registrations that were never launched are not worth
+     * keeping in memory.
+     */
+
+    if (!aLaunches)
+        return 0;
+
+    if (self->mLen == self->mMaxLen) {
+        size_t maxLen = self->mMaxLen ? 2 * self->mMaxLen : 64;
+
+        struct warm_target *targets = realloc(
+            self->mTargets, maxLen * sizeof(*targets));
+        if (!targets)
+            return -1;
+
+        self->mTargets = targets;
+        self->mMaxLen = maxLen;
+    }
+
+    char *path = strdup(aPath);
+    if (!path)
+        return -1;
+
+    self->mTargets[self->mLen++] = (struct warm_target) {
+        .mLaunches = aLaunches,
+        .mPath = path,
+    };
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+rank_warm_target_(const void *aLhs, const void *aRhs)
+{
+    const struct warm_target *lhs = aLhs;
+    const struct warm_target *rhs = aRhs;
+
+    if (lhs->mLaunches != rhs->mLaunches)
+        return lhs->mLaunches > rhs->mLaunches ? -1 : 1;
+
+    return strcmp(lhs->mPath, rhs->mPath);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+open_warm_target_(const char *aPath, struct stat *aStat)
+{
+    int rc = -1;
+
+    int pathFd = -1;
+    int fd = -1;
+
+    pathFd = open(aPath, O_PATH | O_CLOEXEC);
+    if (-1 == pathFd)
+        goto Finally;
+
+    if (fstat(pathFd, aStat))
+        goto Finally;
+
+    if (!S_ISREG(aStat->st_mode)) {
+        errno = EINVAL;
+        goto Finally;
+    }
+
+    /* Reopen the file that was examined, rather than the path,
+     * which might since have been changed.
+     */
+
+    char procPath[sizeof("/proc/self/fd/") + sizeof(int) * 3];
+    snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", pathFd);
+
+    fd = open(procPath, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd)
+        goto Finally;
+
+    rc = 0;
+
+Finally:
+
+    FINALLY({
+        if (-1 != pathFd)
+            close(pathFd);
+    });
+
+    return rc ? -1 : fd;
+}
+
+/* -------------------------------------------------------------------------- */
+static size_t
+load_warm(struct warm *self, size_t aTop, int aLock)
+{
+    /* Read ahead the programs of the highest ranked registrations,
+     * and return the number that were read ahead. A registration
+     * can be removed at any time, so programs that cannot be opened
+     * are skipped.
+     */
+
+    qsort(self->mTargets, self->mLen, sizeof(*self->mTargets),
+        rank_warm_target_);
+
+    size_t warmed = 0;
+
+    for (size_t tx = 0; tx < self->mLen && tx < aTop; ++tx) {
+        struct warm_target *target = &self->mTargets[tx];
+
+        struct stat targetStat;
+        int fd = open_warm_target_(target->mPath, &targetStat);
+        if (-1 == fd)
+            continue;
+
+        if (!posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED)) {
+            target->mWarm = 1;
+            ++warmed;
+        }
+
+        if (aLock && targetStat.st_size) {
+            void *map = mmap(
+                0, targetStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (MAP_FAILED != map) {
+                if (!mlock(map, targetStat.st_size)) {
+                    target->mMap = map;
+                    target->mMapLen = targetStat.st_size;
+                } else {
+                    munmap(map, targetStat.st_size);
+                }
+            }
+        }
+
+        close(fd);
+    }
+
+    return warmed;
+}
+
+/* -------------------------------------------------------------------------- */
+
+#endif /* SUXEC_WARM_H */